@@ -24,6 +24,8 @@ typedef struct svsignore_ svsignore_t;
 struct kline_ {
   char *user;
   char *host;
+  match_pattern_t *user_pat;
+  match_pattern_t *host_pat;
   char *reason;
   char *setby;
 
@@ -31,11 +33,14 @@ struct kline_ {
   long duration;
   time_t settime;
   time_t expires;
+
+  deadline_t expiry;
 };
 
 /* xline list struct */
 struct xline_ {
   char *realname;
+  match_pattern_t *realname_pat;
   char *reason;
   char *setby;
 
@@ -43,11 +48,14 @@ struct xline_ {
   long duration;
   time_t settime;
   time_t expires;
+
+  deadline_t expiry;
 };
 
 /* qline list struct */
 struct qline_ {
   char *mask;
+  match_pattern_t *mask_pat;
   char *reason;
   char *setby;
 
@@ -55,13 +63,29 @@ struct qline_ {
   long duration;
   time_t settime;
   time_t expires;
+
+  deadline_t expiry;
 };
 
+/* position of an object in the expiry index, see expire_check() */
+typedef struct {
+  void *owner;
+  time_t due;		/* earliest time the owner can expire */
+  unsigned int slot;	/* 1-based index in the heap, 0 if not queued */
+} expiry_node_t;
+
+/* position of an object in one of the account search indexes */
+typedef struct {
+  mowgli_node_t node;
+  mowgli_list_t *bucket;	/* list the node is on, NULL if not indexed */
+} index_node_t;
+
 /* services ignore struct */
 struct svsignore_ {
   svsignore_t *svsignore;
 
   char *mask;
+  match_pattern_t *mask_pat;
   time_t settime;
   char *setby;
   char *reason;
@@ -96,6 +120,14 @@ struct myuser_
   language_t *language;
 
   mowgli_list_t cert_fingerprints;
+
+  mowgli_list_t authcookies; /* authcookie_t's issued for this account */
+
+  expiry_node_t expiry;
+
+  index_node_t email_idx;
+  index_node_t registered_idx;
+  index_node_t lastlogin_idx;
 };
 
 /* Keep this synchronized with mu_flags in libathemecore/flags.c */
@@ -135,6 +167,10 @@ struct mynick_
   time_t lastseen;
 
   mowgli_node_t node; /* for myuser_t.nicks */
+
+  expiry_node_t expiry;
+
+  index_node_t prefix_idx;
 };
 
 /* record about a name that used to exist */
@@ -171,6 +207,8 @@ struct mychan_
   char *mlock_key;
 
   unsigned int flags;
+
+  expiry_node_t expiry;
 };
 
 /* Keep this synchronized with mc_flags in libathemecore/flags.c */
@@ -205,6 +243,7 @@ struct chanacs_
 	myentity_t *entity;
 	mychan_t *mychan;
 	char     *host;
+	match_pattern_t *host_pat;
 	unsigned int  level;
 	time_t    tmodified;
 
@@ -296,6 +335,11 @@ typedef struct {
 	int approved;
 } hook_channel_acl_req_t;
 
+typedef struct {
+	myuser_t *mu;		/* recipient */
+	mymemo_t *memo;
+} hook_memo_sent_t;
+
 typedef struct {
 	mychan_t *mc;
 	myuser_t *mu;
@@ -397,7 +441,7 @@ E void kline_delete(kline_t *k);
 E kline_t *kline_find(const char *user, const char *host);
 E kline_t *kline_find_num(unsigned long number);
 E kline_t *kline_find_user(user_t *u);
-E void kline_expire(void *arg);
+E void kline_set_settime(kline_t *k, time_t settime);
 
 E mowgli_list_t xlnlist;
 
@@ -406,7 +450,7 @@ E void xline_delete(const char *realname);
 E xline_t *xline_find(const char *realname);
 E xline_t *xline_find_num(unsigned int number);
 E xline_t *xline_find_user(user_t *u);
-E void xline_expire(void *arg);
+E void xline_set_settime(xline_t *x, time_t settime);
 
 E mowgli_list_t qlnlist;
 
@@ -417,12 +461,35 @@ E qline_t *qline_find_match(const char *mask);
 E qline_t *qline_find_num(unsigned int number);
 E qline_t *qline_find_user(user_t *u);
 E qline_t *qline_find_channel(channel_t *c);
-E void qline_expire(void *arg);
+E void qline_set_settime(qline_t *q, time_t settime);
+
+/* accountindex.c */
+#define ACCOUNT_INDEX_PREFIXLEN 3
+
+typedef enum {
+	ACCOUNT_INDEX_REGISTERED,
+	ACCOUNT_INDEX_LASTLOGIN,
+} account_index_time_t;
+
+E void account_index_enable(void);
+E void account_index_disable(void);
+E bool account_index_enabled(void);
+E void account_index_add_myuser(myuser_t *mu);
+E void account_index_delete_myuser(myuser_t *mu);
+E void account_index_add_mynick(mynick_t *mn);
+E void account_index_delete_mynick(mynick_t *mn);
+E void account_index_touch(myuser_t *mu);
+E mowgli_list_t *account_index_email(stringref email_canonical);
+E mowgli_list_t *account_index_nick_prefix(const char *prefix);
+E unsigned int account_index_count_before(account_index_time_t which, time_t when);
+E void account_index_foreach_before(account_index_time_t which, time_t when, void (*cb)(myuser_t *mu, void *privdata), void *privdata);
 
 /* account.c */
 E mowgli_patricia_t *nicklist;
 E mowgli_patricia_t *oldnameslist;
 E mowgli_patricia_t *mclist;
+E hashdict_t *nicklist_hash;
+E hashdict_t *mclist_hash;
 
 E void init_accounts(void);
 
@@ -432,6 +499,8 @@ E void myuser_delete(myuser_t *mu);
 //inline myuser_t *myuser_find(const char *name);
 E void myuser_rename(myuser_t *mu, const char *name);
 E void myuser_set_email(myuser_t *mu, const char *newemail);
+E void myuser_set_registered(myuser_t *mu, time_t ts);
+E void myuser_set_lastlogin(myuser_t *mu, time_t ts);
 E myuser_t *myuser_find_ext(const char *name);
 E void myuser_notice(const char *from, myuser_t *target, const char *fmt, ...) PRINTFLIKE(3, 4);
 
@@ -456,6 +525,7 @@ E mycertfp_t *mycertfp_find(const char *certfp);
 E mychan_t *mychan_add(char *name);
 //inline mychan_t *mychan_find(const char *name);
 E bool mychan_isused(mychan_t *mc);
+E void mychan_touch(mychan_t *mc);
 E unsigned int mychan_num_founders(mychan_t *mc);
 E const char *mychan_founder_names(mychan_t *mc);
 E myuser_t *mychan_pick_candidate(mychan_t *mc, unsigned int minlevel);
@@ -19,6 +19,9 @@
 #include "i18n.h"
 #include "common.h"
 #include "object.h"
+#include "deadline.h"
+#include "ratelimit.h"
+#include "hashdict.h"
 #include "connection.h"
 #include "res.h"
 #include "hook.h"
@@ -47,7 +50,9 @@
 #include "servtree.h"
 #include "services.h"
 #include "users.h"
+#include "p10numeric.h"
 #include "sourceinfo.h"
+#include "scan.h"
 #include "taint.h"
 #include "database_backend.h"
 #include "entity.h"
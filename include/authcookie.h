@@ -15,7 +15,9 @@ struct authcookie_ {
 	char *ticket;
 	myuser_t *myuser;
 	time_t expire;
-	mowgli_node_t node;
+	mowgli_node_t node;	/* in authcookie_list */
+	mowgli_node_t unode;	/* in myuser->authcookies */
+	deadline_t deadline;
 };
 
 E void authcookie_init(void);
@@ -24,7 +26,6 @@ E authcookie_t *authcookie_find(char *ticket, myuser_t *myuser);
 E void authcookie_destroy(authcookie_t *ac);
 E void authcookie_destroy_all(myuser_t *mu);
 E bool authcookie_validate(char *ticket, myuser_t *myuser);
-E void authcookie_expire(void *arg);
 
 #endif
 
@@ -36,6 +36,10 @@ struct channel_
   unsigned int flags;
 
   mychan_t *mychan;
+
+  struct modestackdata *modestack; /* pending mode changes, see cmode.c */
+
+  unsigned int msgsubs; /* CHANMSG_*, see channel_message_update() */
 };
 
 /* struct for channel memberships */
@@ -52,6 +56,7 @@ struct chanban_
 {
   channel_t *chan;
   char *mask;
+  match_pattern_t *mask_pat;
   int type; /* 'b', 'e', 'I', etc -- jilles */
   mowgli_node_t node; /* for channel_t.bans */
   unsigned int flags;
@@ -71,6 +76,10 @@ struct chanban_
 /* channel_t.flags */
 #define CHAN_LOG        0x00000001 /* logs sent to here */
 
+/* channel_t.msgsubs */
+#define CHANMSG_HOOK    0x00000001 /* channel_message hook */
+#define CHANMSG_SERVICE 0x00000002 /* handlers of services on the channel */
+
 /* chanuser_t.modes */
 #define CSTATUS_OP      0x00000001
 #define CSTATUS_VOICE   0x00000002
@@ -164,6 +173,7 @@ E void modestack_flush_now(void);
 
 /* channels.c */
 E mowgli_patricia_t *chanlist;
+E hashdict_t *chanlist_hash;
 
 E void init_channels(void);
 
@@ -175,6 +185,9 @@ E chanuser_t *chanuser_add(channel_t *chan, const char *user);
 E void chanuser_delete(channel_t *chan, user_t *user);
 E chanuser_t *chanuser_find(channel_t *chan, user_t *user);
 
+E void channel_message_update(mychan_t *mc);
+E void channel_message_update_all(void);
+
 E chanban_t *chanban_add(channel_t *chan, const char *mask, int type);
 E void chanban_delete(chanban_t *c);
 E chanban_t *chanban_find(channel_t *chan, const char *mask, int type);
@@ -34,6 +34,7 @@ E void command_help_short(sourceinfo_t *si, mowgli_patricia_t *commandtree, cons
 E bool (*command_authorize)(service_t *svs, sourceinfo_t *si, command_t *c, const char *userlevel);
 
 /* help.c */
+E void help_init(void);
 E void help_display(sourceinfo_t *si, service_t *service, const char *command, mowgli_patricia_t *list);
 E void help_display_as_subcmd(sourceinfo_t *si, service_t *service, const char *subcmd_of, const char *command, mowgli_patricia_t *list);
 
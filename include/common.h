@@ -101,6 +101,8 @@ typedef struct channel_ channel_t;
 typedef struct chanuser_ chanuser_t;
 typedef struct chanban_ chanban_t;
 
+typedef struct match_pattern_ match_pattern_t;
+
 typedef struct operclass_ operclass_t;
 typedef struct soper_ soper_t;
 typedef struct myuser_ myuser_t;
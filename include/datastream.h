@@ -10,10 +10,12 @@
 #define ATHEME_DATASTREAM_H
 
 E void sendq_add(connection_t *cptr, char *buf, size_t len);
+E void sendq_add_file(connection_t *cptr, int fd, off_t offset, size_t len);
 E void sendq_add_eof(connection_t *cptr);
 E void sendq_flush(connection_t *cptr);
 E bool sendq_nonempty(connection_t *cptr);
 E void sendq_set_limit(connection_t *cptr, size_t len);
+E int sendq_length(connection_t *cptr);
 
 E int recvq_length(connection_t *cptr);
 E void recvq_put(connection_t *cptr);
@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2026 Zohlai Development Group
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Per-object deadlines.
+ *
+ */
+
+#ifndef DEADLINE_H
+#define DEADLINE_H
+
+typedef struct deadline_ deadline_t;
+typedef void (*deadline_func_t)(void *arg);
+
+/* Embed one of these in the object that needs a timeout, initialize it
+ * with deadline_init() and (re)schedule it with deadline_set(). The
+ * callback runs once, after the deadline has been removed from the
+ * scheduler; it may set it again or free the object holding it.
+ */
+struct deadline_ {
+	const char *name;
+	deadline_func_t func;
+	void *arg;
+
+	time_t when;
+	unsigned int slot;	/* 1-based index in the heap, 0 if not pending */
+};
+
+E void deadline_init(deadline_t *dl, const char *name, deadline_func_t func, void *arg);
+E void deadline_set(deadline_t *dl, time_t when);
+E void deadline_cancel(deadline_t *dl);
+E unsigned int deadline_count(void);
+
+static inline bool deadline_pending(const deadline_t *dl)
+{
+	return dl->slot != 0;
+}
+
+#endif
+
+/* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
+ * vim:ts=8
+ * vim:sw=8
+ * vim:noexpandtab
+ */
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2026 Zohlai Development Group
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Open addressing hash dictionaries.
+ *
+ */
+
+#ifndef HASHDICT_H
+#define HASHDICT_H
+
+typedef unsigned int (*hashdict_hash_fn_t)(const char *key);
+typedef int (*hashdict_compare_fn_t)(const char *a, const char *b);
+
+/* Keys are not copied; they must stay valid until the entry is deleted.
+ * The hash of the folded key is kept next to it, so probing only looks
+ * at key strings whose hash is equal and growing never rehashes.
+ */
+typedef struct {
+	unsigned int hash;
+	const char *key;
+	void *data;		/* NULL for an empty slot */
+} hashdict_slot_t;
+
+typedef struct {
+	hashdict_hash_fn_t hash;
+	hashdict_compare_fn_t compare;
+	unsigned int mask;	/* number of slots - 1 */
+	unsigned int count;
+	hashdict_slot_t *slots;
+} hashdict_t;
+
+E hashdict_t *hashdict_create(hashdict_hash_fn_t hash, hashdict_compare_fn_t compare);
+E void hashdict_destroy(hashdict_t *hd);
+E bool hashdict_add(hashdict_t *hd, const char *key, void *data);
+E void *hashdict_retrieve(const hashdict_t *hd, const char *key);
+E void *hashdict_delete(hashdict_t *hd, const char *key);
+
+/* hashes agreeing with irccasecmp(), strcasecmp() and strcmp() */
+E unsigned int hashdict_hash_irccase(const char *key);
+E unsigned int hashdict_hash_strcase(const char *key);
+E unsigned int hashdict_hash_exact(const char *key);
+
+static inline unsigned int hashdict_size(const hashdict_t *hd)
+{
+	return hd->count;
+}
+
+#endif
+
+/* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
+ * vim:ts=8
+ * vim:sw=8
+ * vim:noexpandtab
+ */
@@ -9,8 +9,13 @@
 #ifndef HTTPD_H
 #define HTTPD_H
 
+/* seconds a connection may stay silent before it is dropped */
+#define HTTPD_IDLE_TIMEOUT 300
+
 typedef struct path_handler_ path_handler_t;
 
+/* registered in httpd_path_handlers, keyed by path; a path ending
+ * in a slash also handles everything below it */
 struct path_handler_
 {
 	const char *path;
@@ -29,8 +34,25 @@ struct httpddata
 	bool correct_content_type;
 	bool expect_100_continue;
 	bool sent_reply;
+	bool http_1_1;		/* request line said HTTP/1.1 */
+	char if_none_match[64];
+	char if_modified_since[40];
+	deadline_t idle;
+	/* set by a path handler that keeps the connection open to
+	 * stream a response; called when the connection goes away */
+	void (*stream_close)(connection_t *cptr);
+	void *stream_data;
 };
 
+/* the Connection header a reply needs; an HTTP/1.0 client that asked
+ * for keep-alive waits for the close unless the reply confirms it */
+static inline const char *httpd_connection_header(const struct httpddata *hd)
+{
+	if (hd->connection_close)
+		return "Connection: close\r\n";
+	return hd->http_1_1 ? "" : "Connection: keep-alive\r\n";
+}
+
 #endif
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs ts=8 sw=8 noexpandtab
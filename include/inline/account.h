@@ -41,7 +41,7 @@ static inline myuser_t *myuser_find_uid(const char *uid)
  */
 static inline mynick_t *mynick_find(const char *name)
 {
-	return name ? mowgli_patricia_retrieve(nicklist, name) : NULL;
+	return name ? hashdict_retrieve(nicklist_hash, name) : NULL;
 }
 
 static inline myuser_t *myuser_find_by_nick(const char *name)
@@ -84,7 +84,7 @@ static inline myuser_name_t *myuser_name_find(const char *name)
 
 static inline mychan_t *mychan_find(const char *name)
 {
-	return name ? mowgli_patricia_retrieve(mclist, name) : NULL;
+	return name ? hashdict_retrieve(mclist_hash, name) : NULL;
 }
 
 static inline mychan_t *mychan_from(channel_t *chan)
@@ -18,7 +18,7 @@
  */
 static inline channel_t *channel_find(const char *name)
 {
-	return name ? mowgli_patricia_retrieve(chanlist, name) : NULL;
+	return name ? hashdict_retrieve(chanlist_hash, name) : NULL;
 }
 
 /*
@@ -53,6 +53,11 @@ E void strcasecanon(char *);
 E void noopcanon(char *);
 
 E int match(const char *, const char *);
+E bool match_has_wildcards(const char *mask);
+
+E match_pattern_t *match_pattern_create(const char *mask);
+E void match_pattern_destroy(match_pattern_t *pat);
+E int match_compiled(const match_pattern_t *pat, const char *name);
 E char *collapse(char *);
 
 /* regex_create() flags */
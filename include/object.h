@@ -16,12 +16,26 @@ struct metadata_ {
 
 typedef struct metadata_ metadata_t;
 
+/* entries are kept in a sorted array up to this many, then in a dictionary */
+#define METADATA_INLINE_MAX	8
+
+typedef struct {
+	unsigned int count, size;
+	metadata_t **vec;		/* while dict is NULL */
+	mowgli_patricia_t *dict;
+} metadata_table_t;
+
+typedef struct {
+	unsigned int pos;
+	mowgli_patricia_iteration_state_t state;
+} metadata_iteration_state_t;
+
 typedef void (*destructor_t)(void *);
 
 typedef struct {
 	int refcount;
 	destructor_t destructor;
-	mowgli_patricia_t *metadata;
+	metadata_table_t *metadata;
 	mowgli_patricia_t *privatedata;
 #ifdef OBJECT_DEBUG
 	mowgli_node_t dnode;
@@ -40,6 +54,14 @@ E metadata_t *metadata_add(void *target, const char *name, const char *value);
 E void metadata_delete(void *target, const char *name);
 E metadata_t *metadata_find(void *target, const char *name);
 E void metadata_delete_all(void *target);
+E unsigned int metadata_count(void *target);
+E size_t metadata_size(void *target);
+
+E void metadata_foreach_start(void *target, metadata_iteration_state_t *state);
+E metadata_t *metadata_foreach_cur(void *target, metadata_iteration_state_t *state);
+E void metadata_foreach_next(void *target, metadata_iteration_state_t *state);
+
+#define METADATA_FOREACH(md, state, target) for (metadata_foreach_start(target, state); (md = metadata_foreach_cur(target, state)); metadata_foreach_next(target, state))
 
 E void *privatedata_get(void *target, const char *key);
 E void privatedata_set(void *target, const char *key, void *data);
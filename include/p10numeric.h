@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2026 Zohlai Development Group
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Direct lookup of P10 numerics.
+ *
+ */
+
+#ifndef P10NUMERIC_H
+#define P10NUMERIC_H
+
+#define P10_SERVER_MAX	4096		/* two base64 characters */
+#define P10_CLIENT_MAX	262144		/* three base64 characters */
+
+E int p10_decode(const char *s, size_t len);
+
+E void p10_server_add(server_t *s);
+E void p10_server_delete(server_t *s);
+E server_t *p10_server_find(const char *numeric);
+
+E void p10_user_add(user_t *u);
+E void p10_user_delete(user_t *u);
+E user_t *p10_user_find(const char *numeric);
+
+#endif
+
+/* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
+ * vim:ts=8
+ * vim:sw=8
+ * vim:noexpandtab
+ */
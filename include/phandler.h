@@ -99,6 +99,10 @@ E void (*wallops_sts)(const char *text);
  * modes is a convenience argument giving the simple modes with parameters
  * do not rely upon chanuser_find(c,u) */
 E void (*join_sts)(channel_t *c, user_t *u, bool isnew, char *modes);
+/* join a channel with several clients on the services server at once,
+ * as join_sts() would for each of them; the lines may not exceed the
+ * ircd's limits, so split them where needed */
+E void (*join_batch_sts)(channel_t *c, user_t **users, unsigned int count, bool isnew, char *modes);
 /* lower the TS of a channel, joining it with the given client on the
  * services server (opped), replacing the current simple modes with the
  * ones stored in the channel_t and clearing all other statuses
@@ -254,6 +258,7 @@ E void generic_invite_sts(user_t *source, user_t *target, channel_t *channel);
 E void generic_quit_sts(user_t *u, const char *reason);
 E void generic_wallops_sts(const char *text);
 E void generic_join_sts(channel_t *c, user_t *u, bool isnew, char *modes);
+E void generic_join_batch_sts(channel_t *c, user_t **users, unsigned int count, bool isnew, char *modes);
 E void generic_chan_lowerts(channel_t *c, user_t *u);
 E void generic_kick(user_t *source, channel_t *c, user_t *u, const char *reason);
 E void generic_msg(const char *from, const char *target, const char *fmt, ...);
@@ -61,6 +61,7 @@ E bool should_reg_umode(user_t *);
 E void services_init(void);
 E void reintroduce_user(user_t *u);
 E void handle_nickchange(user_t *u);
+E void burstlogin_init(void);
 E void handle_burstlogin(user_t *u, const char *login, time_t ts);
 E void handle_setlogin(sourceinfo_t *si, user_t *u, const char *login, time_t ts);
 E void handle_certfp(sourceinfo_t *si, user_t *u, const char *certfp);
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2026 Zohlai Development Group
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Rate limiters.
+ *
+ */
+
+#ifndef RATELIMIT_H
+#define RATELIMIT_H
+
+/* one event, in the units ratelimit_t levels are kept in */
+#define RATELIMIT_UNIT	256
+
+/* A leaky bucket: events pour their cost in, and it drains by limit
+ * events per period. Embed one in the object being limited, zeroed.
+ */
+typedef struct {
+	unsigned int level;	/* times RATELIMIT_UNIT */
+	time_t last;		/* when it was last drained */
+} ratelimit_t;
+
+E void ratelimit_drain(ratelimit_t *rl, unsigned int limit, unsigned int period);
+E bool ratelimit_check(ratelimit_t *rl, unsigned int limit, unsigned int period);
+E void ratelimit_reset(ratelimit_t *rl);
+
+static inline void ratelimit_add(ratelimit_t *rl, unsigned int cost)
+{
+	rl->level = rl->level + cost < rl->level ? UINT_MAX : rl->level + cost;
+}
+
+/* The last few events, in a ring that is allocated once. An event keeps
+ * who caused it as a pointer that is only ever compared by address, so
+ * the caller must hold it (a strshare reference, say) until the event
+ * is pushed out of the window. What the event was is only kept as a
+ * fingerprint.
+ */
+typedef struct {
+	time_t time;
+	const void *source;
+	unsigned int text;
+} ratelimit_event_t;
+
+typedef struct {
+	unsigned int size;
+	unsigned int count;
+	unsigned int next;	/* slot the next event goes to */
+	ratelimit_event_t *ring;
+} ratelimit_window_t;
+
+E unsigned int ratelimit_fingerprint(const char *s);
+
+E void ratelimit_window_init(ratelimit_window_t *w, unsigned int size);
+E void ratelimit_window_free(ratelimit_window_t *w);
+E const void *ratelimit_window_add(ratelimit_window_t *w, const void *source, unsigned int text);
+
+/* the i-th event in the window, oldest first */
+static inline const ratelimit_event_t *ratelimit_window_nth(const ratelimit_window_t *w, unsigned int i)
+{
+	return &w->ring[(w->next + w->size - w->count + i) % w->size];
+}
+
+static inline const ratelimit_event_t *ratelimit_window_oldest(const ratelimit_window_t *w)
+{
+	return w->count != 0 ? ratelimit_window_nth(w, 0) : NULL;
+}
+
+static inline const ratelimit_event_t *ratelimit_window_newest(const ratelimit_window_t *w)
+{
+	return w->count != 0 ? ratelimit_window_nth(w, w->count - 1) : NULL;
+}
+
+#endif
+
+/* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
+ * vim:ts=8
+ * vim:sw=8
+ * vim:noexpandtab
+ */
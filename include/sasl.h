@@ -29,6 +29,8 @@ struct sasl_session_ {
 
   char *host;
   char *ip;
+
+  deadline_t deadline;
 };
 
 struct sasl_message_ {
@@ -62,9 +64,10 @@ typedef struct {
 #define ASASL_MORE 1 /* everything looks good so far, but we're not done yet */
 #define ASASL_DONE 2 /* client successfully authenticated */
 
-#define ASASL_MARKED_FOR_DELETION   1 /* see delete_stale() in saslserv/main.c */
 #define ASASL_NEED_LOG              2 /* user auth success needs to be logged still */
 
+#define SASL_SESSION_TIMEOUT        60 /* seconds without progress before a session is dropped */
+
 #endif
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2026 Zohlai Development Group
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Time-sliced dictionary scans.
+ *
+ */
+
+#ifndef SCAN_H
+#define SCAN_H
+
+typedef struct scan_ scan_t;
+
+/* Called once per element; return false to end the scan early. */
+typedef bool (*scan_func_t)(scan_t *scan, void *data);
+
+/* Called exactly once when the scan ends. If cancelled is true the
+ * requester is going away and no output may be sent to scan->si.
+ */
+typedef void (*scan_done_func_t)(scan_t *scan, bool cancelled);
+
+/* A scan walks a patricia in slices of a few milliseconds, yielding to
+ * the event loop between slices. Deletions from the tree while a scan
+ * is suspended must be announced with scan_forget() beforehand.
+ */
+struct scan_ {
+	mowgli_node_t node;
+
+	mowgli_patricia_t *tree;
+	mowgli_patricia_iteration_state_t state;
+	bool started;
+
+	sourceinfo_t *si;
+	scan_func_t func;
+	scan_done_func_t done;
+	void *privdata;
+
+	unsigned int visited;
+};
+
+E void scan_init(void);
+E bool scan_start(sourceinfo_t *si, mowgli_patricia_t *tree, scan_func_t func, scan_done_func_t done, void *privdata);
+E void scan_forget(mowgli_patricia_t *tree, void *data);
+E void scan_cancel_all(scan_func_t func);
+E unsigned int scan_count(void);
+
+#endif
+
+/* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
+ * vim:ts=8
+ * vim:sw=8
+ * vim:noexpandtab
+ */
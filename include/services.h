@@ -108,6 +108,7 @@ E void (*try_kick)(user_t *source, channel_t *chan, user_t *target, const char *
 E void kill_user(user_t *source, user_t *victim, const char *fmt, ...) PRINTFLIKE(3, 4);
 E void introduce_enforcer(const char *nick);
 E void join(const char *chan, const char *nick);
+E void join_batched(const char *chan, const char *nick);
 E void joinall(const char *name);
 E void part(const char *chan, const char *nick);
 E void partall(const char *name);
@@ -11,7 +11,16 @@
 #define ATHEME_TOOLS_H
 
 /* email stuff */
+E void email_init(void);
 E int sendemail(user_t *u, myuser_t *mu, const char *type, const char *email, const char *param);
+E unsigned int email_queue_length(void);
+
+typedef struct {
+	const char *type;
+	const char *account;
+	const char *email;
+	bool delivered;		/* the MTA accepted it */
+} hook_email_status_t;
 
 /* email types (meaning of param argument) */
 #define EMAIL_REGISTER	"register"	/* register an account/nick (verification code) */
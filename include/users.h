@@ -28,8 +28,7 @@ struct user_
 	myuser_t *myuser;
 
 	unsigned int offenses;
-	unsigned int msgs; /* times FLOOD_MSGS_FACTOR */
-	time_t lastmsg;
+	ratelimit_t flood; /* see floodcheck() */
 
 	unsigned int flags;
 
@@ -40,7 +39,7 @@ struct user_
 	char *certfp; /* client certificate fingerprint */
 };
 
-#define FLOOD_MSGS_FACTOR 256
+#define FLOOD_MSGS_FACTOR RATELIMIT_UNIT
 
 #define UF_AWAY        0x00000002
 #define UF_INVIS       0x00000004
@@ -80,6 +79,8 @@ E bool is_service(user_t *user);
 /* users.c */
 E mowgli_patricia_t *userlist;
 E mowgli_patricia_t *uidlist;
+E hashdict_t *userlist_hash;
+E hashdict_t *uidlist_hash;
 
 E void init_users(void);
 
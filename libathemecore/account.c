@@ -32,6 +32,10 @@ mowgli_patricia_t *oldnameslist;
 mowgli_patricia_t *mclist;
 mowgli_patricia_t *certfplist;
 
+/* lookups by name; the tries stay for ordered walks and scans */
+hashdict_t *nicklist_hash;
+hashdict_t *mclist_hash;
+
 mowgli_heap_t *myuser_heap;   /* HEAP_USER */
 mowgli_heap_t *mynick_heap;   /* HEAP_USER */
 mowgli_heap_t *mycertfp_heap; /* HEAP_USER */
@@ -39,6 +43,38 @@ mowgli_heap_t *myuser_name_heap;	/* HEAP_USER / 2 */
 mowgli_heap_t *mychan_heap;	/* HEAP_CHANNEL */
 mowgli_heap_t *chanacs_heap;	/* HEAP_CHANACS */
 
+/* Expiry candidates are kept in one binary min-heap per object type,
+ * ordered by the earliest time each object could possibly expire.
+ * The keys are allowed to be early (e.g. lastlogin moved forward after
+ * the object was queued); expire_check() recomputes the exact time when
+ * an object reaches the top and requeues it if it is not due yet. They
+ * must never be late, so anything that moves an expiry time backwards
+ * has to requeue the object.
+ */
+typedef struct {
+	expiry_node_t **nodes;
+	unsigned int count;
+	unsigned int size;
+} expiry_index_t;
+
+static expiry_index_t myuser_expiry;
+static expiry_index_t mynick_expiry;
+static expiry_index_t mychan_expiry;
+
+/* the index is built on the first expire_check() after the database
+ * has been loaded, and rebuilt whenever the expiry periods change */
+static bool expiry_index_ready = false;
+static unsigned int expiry_nick_period;
+static unsigned int expiry_chan_period;
+
+/* objects which are due but may not be expired right now (held,
+ * logged in, vetoed by a hook) are looked at again after this long */
+#define EXPIRY_RECHECK	3600
+
+static void expiry_index_set(expiry_index_t *idx, expiry_node_t *node, time_t due);
+static void expiry_index_remove(expiry_index_t *idx, expiry_node_t *node);
+static time_t mychan_expiry_due(mychan_t *mc);
+
 /*
  * init_accounts()
  *
@@ -73,6 +109,8 @@ void init_accounts(void)
 	oldnameslist = mowgli_patricia_create(irccasecanon);
 	mclist = mowgli_patricia_create(irccasecanon);
 	certfplist = mowgli_patricia_create(strcasecanon);
+	nicklist_hash = hashdict_create(hashdict_hash_irccase, irccasecmp);
+	mclist_hash = hashdict_create(hashdict_hash_irccase, irccasecmp);
 }
 
 /*
@@ -169,6 +207,14 @@ myuser_t *myuser_add_id(const char *id, const char *name, const char *pass, cons
 
 	myuser_name_restore(entity(mu)->name, mu);
 
+	/* lastlogin and the flags are usually filled in by the caller,
+	 * so have the next expiry pass work out the real expiry time */
+	mu->expiry.owner = mu;
+	if (expiry_index_ready)
+		expiry_index_set(&myuser_expiry, &mu->expiry, CURRTIME);
+
+	account_index_add_myuser(mu);
+
 	cnt.myuser++;
 
 	return mu;
@@ -322,6 +368,9 @@ void myuser_delete(myuser_t *mu)
 	if (nicks[0] != '\0')
 		slog(LG_REGISTER, _("DELETE: \2%s\2 from \2%s\2"), nicks, entity(mu)->name);
 
+	expiry_index_remove(&myuser_expiry, &mu->expiry);
+	account_index_delete_myuser(mu);
+
 	/* entity(mu)->name is the index for this dtree */
 	myentity_del(entity(mu));
 
@@ -414,11 +463,47 @@ void myuser_set_email(myuser_t *mu, const char *newemail)
 	return_if_fail(mu != NULL);
 	return_if_fail(newemail != NULL);
 
+	account_index_delete_myuser(mu);
+
 	strshare_unref(mu->email);
 	strshare_unref(mu->email_canonical);
 
 	mu->email = strshare_get(newemail);
 	mu->email_canonical = canonicalize_email(newemail);
+
+	account_index_add_myuser(mu);
+}
+
+/*
+ * myuser_set_registered(myuser_t *mu, time_t ts)
+ * myuser_set_lastlogin(myuser_t *mu, time_t ts)
+ *
+ * Changes the registration or last login time of an account.
+ *
+ * Inputs:
+ *      - account to change
+ *      - new time
+ *
+ * Outputs:
+ *      - nothing
+ *
+ * Side Effects:
+ *      - the account search indexes are updated
+ */
+void myuser_set_registered(myuser_t *mu, time_t ts)
+{
+	return_if_fail(mu != NULL);
+
+	mu->registered = ts;
+	account_index_touch(mu);
+}
+
+void myuser_set_lastlogin(myuser_t *mu, time_t ts)
+{
+	return_if_fail(mu != NULL);
+
+	mu->lastlogin = ts;
+	account_index_touch(mu);
 }
 
 /*
@@ -693,10 +778,16 @@ mynick_t *mynick_add(myuser_t *mu, const char *name)
 	mn->registered = CURRTIME;
 
 	mowgli_patricia_add(nicklist, mn->nick, mn);
+	hashdict_add(nicklist_hash, mn->nick, mn);
 	mowgli_node_add(mn, &mn->node, &mu->nicks);
+	account_index_add_mynick(mn);
 
 	myuser_name_restore(mn->nick, mu);
 
+	mn->expiry.owner = mn;
+	if (expiry_index_ready)
+		expiry_index_set(&mynick_expiry, &mn->expiry, CURRTIME);
+
 	cnt.mynick++;
 
 	return mn;
@@ -725,6 +816,11 @@ void mynick_delete(mynick_t *mn)
 
 	myuser_name_remember(mn->nick, mn->owner);
 
+	expiry_index_remove(&mynick_expiry, &mn->expiry);
+
+	account_index_delete_mynick(mn);
+	scan_forget(nicklist, mn);
+	hashdict_delete(nicklist_hash, mn->nick);
 	mowgli_patricia_delete(nicklist, mn->nick);
 	mowgli_node_delete(&mn->node, &mn->owner->nicks);
 
@@ -866,7 +962,7 @@ void myuser_name_restore(const char *name, myuser_t *mu)
 {
 	myuser_name_t *mun;
 	metadata_t *md, *md2;
-	mowgli_patricia_iteration_state_t state;
+	metadata_iteration_state_t state;
 	char *copy;
 
 	mun = myuser_name_find(name);
@@ -891,7 +987,7 @@ void myuser_name_restore(const char *name, myuser_t *mu)
 
 	if (object(mun)->metadata)
 	{
-		MOWGLI_PATRICIA_FOREACH(md, &state, object(mun)->metadata)
+		METADATA_FOREACH(md, &state, mun)
 		{
 			/* prefer current metadata to saved */
 			if (!metadata_find(mu, md->name))
@@ -972,14 +1068,23 @@ static void mychan_delete(mychan_t *mc)
 		slog(LG_DEBUG, "mychan_delete(): %s", mc->name);
 
 	if (mc->chan != NULL)
+	{
 		mc->chan->mychan = NULL;
 
+		/* all of them go by the registration */
+		mc->chan->msgsubs = 0;
+	}
+
 	/* remove the chanacs shiz */
 	MOWGLI_ITER_FOREACH_SAFE(n, tn, mc->chanacs.head)
 		object_unref(n->data);
 
 	metadata_delete_all(mc);
 
+	expiry_index_remove(&mychan_expiry, &mc->expiry);
+
+	scan_forget(mclist, mc);
+	hashdict_delete(mclist_hash, mc->name);
 	mowgli_patricia_delete(mclist, mc->name);
 
 	strshare_unref(mc->name);
@@ -1010,6 +1115,11 @@ mychan_t *mychan_add(char *name)
 		mc->chan->mychan = mc;
 
 	mowgli_patricia_add(mclist, mc->name, mc);
+	hashdict_add(mclist_hash, mc->name, mc);
+
+	mc->expiry.owner = mc;
+	if (expiry_index_ready)
+		expiry_index_set(&mychan_expiry, &mc->expiry, CURRTIME);
 
 	cnt.mychan++;
 
@@ -1040,6 +1150,31 @@ bool mychan_isused(mychan_t *mc)
 	return false;
 }
 
+/*
+ * mychan_touch(mychan_t *mc)
+ *
+ * Marks a channel as used right now.
+ *
+ * Inputs:
+ *      - channel that was used
+ *
+ * Outputs:
+ *      - nothing
+ *
+ * Side Effects:
+ *      - the channel's last used time is updated and it is requeued
+ *        in the expiry index.
+ */
+void mychan_touch(mychan_t *mc)
+{
+	return_if_fail(mc != NULL);
+
+	mc->used = CURRTIME;
+
+	if (expiry_index_ready)
+		expiry_index_set(&mychan_expiry, &mc->expiry, mychan_expiry_due(mc));
+}
+
 unsigned int mychan_num_founders(mychan_t *mc)
 {
 	mowgli_node_t *n;
@@ -1366,6 +1501,7 @@ static void chanacs_delete(chanacs_t *ca)
 
 	if (ca->host != NULL)
 		free(ca->host);
+	match_pattern_destroy(ca->host_pat);
 
 	mowgli_heap_free(chanacs_heap, ca);
 
@@ -1410,6 +1546,7 @@ chanacs_t *chanacs_add(mychan_t *mychan, myentity_t *mt, unsigned int level, tim
 	ca->mychan = mychan;
 	ca->entity = isdynamic(mt) ? object_ref(mt) : mt;
 	ca->host = NULL;
+	ca->host_pat = NULL;
 	ca->level = level & ca_all;
 	ca->tmodified = ts;
 
@@ -1464,6 +1601,7 @@ chanacs_t *chanacs_add_host(mychan_t *mychan, const char *host, unsigned int lev
 	ca->mychan = mychan;
 	ca->entity = NULL;
 	ca->host = sstrdup(host);
+	ca->host_pat = match_pattern_create(host);
 	ca->level = level & ca_all;
 	ca->tmodified = ts;
 
@@ -1578,10 +1716,10 @@ chanacs_t *chanacs_find_host(mychan_t *mychan, const char *host, unsigned int le
 
 		if (level != 0x0)
 		{
-			if ((ca->entity == NULL) && (!match(ca->host, host)) && ((ca->level & level) == level))
+			if ((ca->entity == NULL) && (!match_compiled(ca->host_pat, host)) && ((ca->level & level) == level))
 				return ca;
 		}
-		else if ((ca->entity == NULL) && (!match(ca->host, host)))
+		else if ((ca->entity == NULL) && (!match_compiled(ca->host_pat, host)))
 			return ca;
 	}
 
@@ -1600,7 +1738,7 @@ unsigned int chanacs_host_flags(mychan_t *mychan, const char *host)
 	{
 		ca = (chanacs_t *)n->data;
 
-		if (ca->entity == NULL && !match(ca->host, host))
+		if (ca->entity == NULL && !match_compiled(ca->host_pat, host))
 			result |= ca->level;
 	}
 
@@ -1964,13 +2102,224 @@ bool chanacs_change_simple(mychan_t *mychan, myentity_t *mt, const char *hostmas
 	return chanacs_change(mychan, mt, hostmask, &a, &r, ca_all, setter);
 }
 
-static int expire_myuser_cb(myentity_t *mt, void *unused)
+/*************************
+ * E X P I R Y   I N D E X *
+ *************************/
+
+static void expiry_index_place(expiry_index_t *idx, expiry_node_t *node, unsigned int i)
+{
+	idx->nodes[i] = node;
+	node->slot = i + 1;
+}
+
+static void expiry_index_sift_up(expiry_index_t *idx, unsigned int i)
+{
+	expiry_node_t *node = idx->nodes[i];
+	unsigned int parent;
+
+	while (i > 0)
+	{
+		parent = (i - 1) / 2;
+		if (idx->nodes[parent]->due <= node->due)
+			break;
+
+		expiry_index_place(idx, idx->nodes[parent], i);
+		i = parent;
+	}
+
+	expiry_index_place(idx, node, i);
+}
+
+static void expiry_index_sift_down(expiry_index_t *idx, unsigned int i)
+{
+	expiry_node_t *node = idx->nodes[i];
+	unsigned int child;
+
+	for (;;)
+	{
+		child = 2 * i + 1;
+		if (child >= idx->count)
+			break;
+		if (child + 1 < idx->count && idx->nodes[child + 1]->due < idx->nodes[child]->due)
+			child++;
+		if (node->due <= idx->nodes[child]->due)
+			break;
+
+		expiry_index_place(idx, idx->nodes[child], i);
+		i = child;
+	}
+
+	expiry_index_place(idx, node, i);
+}
+
+/* queues or requeues an object to be looked at no earlier than due;
+ * a due time of 0 means the object can never expire */
+static void expiry_index_set(expiry_index_t *idx, expiry_node_t *node, time_t due)
+{
+	time_t olddue;
+
+	if (due == 0)
+	{
+		expiry_index_remove(idx, node);
+		return;
+	}
+
+	if (node->slot == 0)
+	{
+		if (idx->count == idx->size)
+		{
+			idx->size = idx->size != 0 ? idx->size * 2 : 1024;
+			idx->nodes = srealloc(idx->nodes, idx->size * sizeof(expiry_node_t *));
+		}
+
+		node->due = due;
+		idx->nodes[idx->count] = node;
+		expiry_index_sift_up(idx, idx->count++);
+		return;
+	}
+
+	olddue = node->due;
+	node->due = due;
+
+	if (due < olddue)
+		expiry_index_sift_up(idx, node->slot - 1);
+	else
+		expiry_index_sift_down(idx, node->slot - 1);
+}
+
+static void expiry_index_remove(expiry_index_t *idx, expiry_node_t *node)
+{
+	expiry_node_t *last;
+	unsigned int i;
+
+	if (node->slot == 0)
+		return;
+
+	i = node->slot - 1;
+	node->slot = 0;
+
+	last = idx->nodes[--idx->count];
+	if (last == node)
+		return;
+
+	idx->nodes[i] = last;
+	if (i > 0 && idx->nodes[(i - 1) / 2]->due > last->due)
+		expiry_index_sift_up(idx, i);
+	else
+		expiry_index_sift_down(idx, i);
+}
+
+/* returns the first object in the index if it is due, else NULL */
+static void *expiry_index_next(expiry_index_t *idx)
+{
+	if (idx->count == 0 || idx->nodes[0]->due > CURRTIME)
+		return NULL;
+
+	return idx->nodes[0]->owner;
+}
+
+/* requeues an object which is due but was kept for now */
+static void expiry_index_defer(expiry_index_t *idx, expiry_node_t *node, time_t due)
+{
+	if (due != 0 && due <= CURRTIME)
+		due = CURRTIME + EXPIRY_RECHECK;
+
+	expiry_index_set(idx, node, due);
+}
+
+static time_t myuser_expiry_due(myuser_t *mu)
+{
+	time_t due = 0;
+
+	if (nicksvs.expiry > 0)
+		due = mu->lastlogin + nicksvs.expiry;
+
+	if (mu->flags & MU_WAITAUTH && (due == 0 || mu->registered + 86400 < due))
+		due = mu->registered + 86400;
+
+	return due;
+}
+
+static time_t mynick_expiry_due(mynick_t *mn)
+{
+	if (nicksvs.expiry == 0)
+		return 0;
+
+	return mn->lastseen + nicksvs.expiry;
+}
+
+static time_t mychan_expiry_due(mychan_t *mc)
+{
+	/* channels are also looked at daily to keep their last used
+	 * time up to date while they are in use */
+	time_t due = mc->used + 86400 - 3660;
+
+	if (chansvs.expiry > 0 && mc->used + chansvs.expiry < due)
+		due = mc->used + chansvs.expiry;
+
+	return due;
+}
+
+static int expiry_index_add_myuser_cb(myentity_t *mt, void *unused)
 {
-	hook_expiry_req_t req;
 	myuser_t *mu = user(mt);
 
 	return_val_if_fail(isuser(mt), 0);
 
+	mu->expiry.owner = mu;
+	mu->expiry.slot = 0;
+	expiry_index_set(&myuser_expiry, &mu->expiry, myuser_expiry_due(mu));
+
+	return 0;
+}
+
+static void expiry_index_rebuild(void)
+{
+	mynick_t *mn;
+	mychan_t *mc;
+	mowgli_patricia_iteration_state_t state;
+
+	slog(LG_DEBUG, "expiry_index_rebuild(): indexing %u accounts, %u nicks, %u channels",
+			cnt.myuser, cnt.mynick, cnt.mychan);
+
+	myuser_expiry.count = 0;
+	mynick_expiry.count = 0;
+	mychan_expiry.count = 0;
+
+	myentity_foreach_t(ENT_USER, expiry_index_add_myuser_cb, NULL);
+
+	MOWGLI_PATRICIA_FOREACH(mn, &state, nicklist)
+	{
+		mn->expiry.owner = mn;
+		mn->expiry.slot = 0;
+		expiry_index_set(&mynick_expiry, &mn->expiry, mynick_expiry_due(mn));
+	}
+
+	MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
+	{
+		mc->expiry.owner = mc;
+		mc->expiry.slot = 0;
+		expiry_index_set(&mychan_expiry, &mc->expiry, mychan_expiry_due(mc));
+	}
+
+	expiry_nick_period = nicksvs.expiry;
+	expiry_chan_period = chansvs.expiry;
+	expiry_index_ready = true;
+}
+
+static void expire_myuser(myuser_t *mu)
+{
+	hook_expiry_req_t req;
+	time_t due;
+
+	/* the key may be stale, e.g. they identified since it was set */
+	due = myuser_expiry_due(mu);
+	if (due == 0 || due > CURRTIME)
+	{
+		expiry_index_set(&myuser_expiry, &mu->expiry, due);
+		return;
+	}
+
 	req.data.mu = mu;
 	req.do_expire = 1;
 	hook_call_user_check_expire(&req);
@@ -1982,131 +2331,175 @@ static int expire_myuser_cb(myentity_t *mt, void *unused)
 	 */
 	if (MOWGLI_LIST_LENGTH(&mu->logins) > 0)
 	{
-		mu->lastlogin = CURRTIME;
-		return 0;
+		myuser_set_lastlogin(mu, CURRTIME);
+		expiry_index_defer(&myuser_expiry, &mu->expiry, myuser_expiry_due(mu));
+		return;
 	}
 
-	if (!req.do_expire)
-		return 0;
-
-	if (MU_HOLD & mu->flags)
-		return 0;
-
-	if ((nicksvs.expiry > 0 && mu->lastlogin < CURRTIME && (unsigned int)(CURRTIME - mu->lastlogin) >= nicksvs.expiry) ||
-			(mu->flags & MU_WAITAUTH && CURRTIME - mu->registered >= 86400))
+	/* Don't expire accounts with privs on them in atheme.conf,
+	 * (now zohlai.conf - mt) otherwise someone can reregister
+	 * them and take the privs -- jilles */
+	if (!req.do_expire || MU_HOLD & mu->flags || is_conf_soper(mu))
 	{
-		/* Don't expire accounts with privs on them in atheme.conf,
-		 * (now zohlai.conf - mt) otherwise someone can reregister
-		 * them and take the privs -- jilles */
-		if (is_conf_soper(mu))
-			return 0;
-
-		slog(LG_REGISTER, _("EXPIRE: \2%s\2 from \2%s\2 "), entity(mu)->name, mu->email);
-		slog(LG_VERBOSE, "expire_check(): expiring account %s (unused %ds, email %s, nicks %zu, chanacs %zu)",
-				entity(mu)->name, (int)(CURRTIME - mu->lastlogin),
-				mu->email, MOWGLI_LIST_LENGTH(&mu->nicks),
-				MOWGLI_LIST_LENGTH(&entity(mu)->chanacs));
-		object_dispose(mu);
+		expiry_index_defer(&myuser_expiry, &mu->expiry, due);
+		return;
 	}
 
-	return 0;
+	expiry_index_remove(&myuser_expiry, &mu->expiry);
+
+	slog(LG_REGISTER, _("EXPIRE: \2%s\2 from \2%s\2 "), entity(mu)->name, mu->email);
+	slog(LG_VERBOSE, "expire_check(): expiring account %s (unused %ds, email %s, nicks %zu, chanacs %zu)",
+			entity(mu)->name, (int)(CURRTIME - mu->lastlogin),
+			mu->email, MOWGLI_LIST_LENGTH(&mu->nicks),
+			MOWGLI_LIST_LENGTH(&entity(mu)->chanacs));
+	object_dispose(mu);
 }
 
-void expire_check(void *arg)
+static void expire_mynick(mynick_t *mn)
 {
-	mynick_t *mn;
-	mychan_t *mc;
-	user_t *u;
-	mowgli_patricia_iteration_state_t state;
 	hook_expiry_req_t req;
+	user_t *u;
+	time_t due;
 
-	/* Let them know about this and the likely subsequent db_save()
-	 * right away -- jilles */
-	if (curr_uplink != NULL && curr_uplink->conn != NULL)
-		sendq_flush(curr_uplink->conn);
+	due = mynick_expiry_due(mn);
+	if (due == 0 || due > CURRTIME)
+	{
+		expiry_index_set(&mynick_expiry, &mn->expiry, due);
+		return;
+	}
 
-	myentity_foreach_t(ENT_USER, expire_myuser_cb, NULL);
+	req.do_expire = 1;
+	req.data.mn = mn;
 
-	MOWGLI_PATRICIA_FOREACH(mn, &state, nicklist)
+	hook_call_nick_check_expire(&req);
+
+	if (!req.do_expire || MU_HOLD & mn->owner->flags)
 	{
-		req.do_expire = 1;
-		req.data.mn = mn;
+		expiry_index_defer(&mynick_expiry, &mn->expiry, due);
+		return;
+	}
 
-		hook_call_nick_check_expire(&req);
+	/* do not drop main nick like this; it goes with the account */
+	if (!irccasecmp(mn->nick, entity(mn->owner)->name))
+	{
+		expiry_index_set(&mynick_expiry, &mn->expiry, CURRTIME + nicksvs.expiry);
+		return;
+	}
 
-		if (!req.do_expire)
-			continue;
+	u = user_find_named(mn->nick);
+	if (u != NULL && u->myuser == mn->owner)
+	{
+		/* still logged in, bleh */
+		mn->lastseen = CURRTIME;
+		myuser_set_lastlogin(mn->owner, CURRTIME);
+		expiry_index_set(&mynick_expiry, &mn->expiry, mynick_expiry_due(mn));
+		return;
+	}
 
-		if (nicksvs.expiry > 0 && mn->lastseen < CURRTIME &&
-				(unsigned int)(CURRTIME - mn->lastseen) >= nicksvs.expiry)
-		{
-			if (MU_HOLD & mn->owner->flags)
-				continue;
+	expiry_index_remove(&mynick_expiry, &mn->expiry);
 
-			/* do not drop main nick like this */
-			if (!irccasecmp(mn->nick, entity(mn->owner)->name))
-				continue;
+	slog(LG_REGISTER, _("EXPIRE: \2%s\2 from \2%s\2"), mn->nick, entity(mn->owner)->name);
+	slog(LG_VERBOSE, "expire_check(): expiring nick %s (unused %lds, account %s)",
+			mn->nick, (long)(CURRTIME - mn->lastseen),
+			entity(mn->owner)->name);
+	object_unref(mn);
+}
 
-			u = user_find_named(mn->nick);
-			if (u != NULL && u->myuser == mn->owner)
-			{
-				/* still logged in, bleh */
-				mn->lastseen = CURRTIME;
-				mn->owner->lastlogin = CURRTIME;
-				continue;
-			}
+static void expire_mychan(mychan_t *mc)
+{
+	hook_expiry_req_t req;
+	time_t due;
 
-			slog(LG_REGISTER, _("EXPIRE: \2%s\2 from \2%s\2"), mn->nick, entity(mn->owner)->name);
-			slog(LG_VERBOSE, "expire_check(): expiring nick %s (unused %lds, account %s)",
-					mn->nick, (long)(CURRTIME - mn->lastseen),
-					entity(mn->owner)->name);
-			object_unref(mn);
-		}
+	due = mychan_expiry_due(mc);
+	if (due > CURRTIME)
+	{
+		expiry_index_set(&mychan_expiry, &mc->expiry, due);
+		return;
 	}
 
-	MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
-	{
-		req.do_expire = 1;
-		req.data.mc = mc;
+	req.do_expire = 1;
+	req.data.mc = mc;
 
-		hook_call_channel_check_expire(&req);
+	hook_call_channel_check_expire(&req);
 
-		if (!req.do_expire)
-			continue;
+	if (!req.do_expire)
+	{
+		expiry_index_defer(&mychan_expiry, &mc->expiry, due);
+		return;
+	}
 
-		if ((CURRTIME - mc->used) >= 86400 - 3660)
+	if ((CURRTIME - mc->used) >= 86400 - 3660)
+	{
+		/* keep last used time accurate to
+		 * within a day, making sure an active
+		 * channel will never get "Last used"
+		 * in /cs info -- jilles */
+		if (mychan_isused(mc))
 		{
-			/* keep last used time accurate to
-			 * within a day, making sure an active
-			 * channel will never get "Last used"
-			 * in /cs info -- jilles */
-			if (mychan_isused(mc))
-			{
-				mc->used = CURRTIME;
-				slog(LG_DEBUG, "expire_check(): updating last used time on %s because it appears to be still in use", mc->name);
-				continue;
-			}
+			slog(LG_DEBUG, "expire_check(): updating last used time on %s because it appears to be still in use", mc->name);
+			mychan_touch(mc);
+			return;
 		}
+	}
 
-		if (chansvs.expiry > 0 && mc->used < CURRTIME &&
-				(unsigned int)(CURRTIME - mc->used) >= chansvs.expiry)
+	if (chansvs.expiry > 0 && mc->used < CURRTIME &&
+			(unsigned int)(CURRTIME - mc->used) >= chansvs.expiry)
+	{
+		if (MC_HOLD & mc->flags)
 		{
-			if (MC_HOLD & mc->flags)
-				continue;
+			expiry_index_defer(&mychan_expiry, &mc->expiry, due);
+			return;
+		}
 
-			slog(LG_REGISTER, _("EXPIRE: \2%s\2 from \2%s\2"), mc->name, mychan_founder_names(mc));
-			slog(LG_VERBOSE, "expire_check(): expiring channel %s (unused %lds, founder %s, chanacs %zu)",
-					mc->name, (long)(CURRTIME - mc->used),
-					mychan_founder_names(mc),
-					MOWGLI_LIST_LENGTH(&mc->chanacs));
+		expiry_index_remove(&mychan_expiry, &mc->expiry);
 
-			hook_call_channel_drop(mc);
-			if (mc->chan != NULL && !(mc->chan->flags & CHAN_LOG))
-				part(mc->name, chansvs.nick);
+		slog(LG_REGISTER, _("EXPIRE: \2%s\2 from \2%s\2"), mc->name, mychan_founder_names(mc));
+		slog(LG_VERBOSE, "expire_check(): expiring channel %s (unused %lds, founder %s, chanacs %zu)",
+				mc->name, (long)(CURRTIME - mc->used),
+				mychan_founder_names(mc),
+				MOWGLI_LIST_LENGTH(&mc->chanacs));
 
-			object_unref(mc);
-		}
+		hook_call_channel_drop(mc);
+		if (mc->chan != NULL && !(mc->chan->flags & CHAN_LOG))
+			part(mc->name, chansvs.nick);
+
+		object_unref(mc);
+		return;
 	}
+
+	/* Unused but not expired yet; nothing changes until it expires
+	 * or someone uses it again, which calls mychan_touch(). */
+	if (chansvs.expiry > 0)
+		expiry_index_defer(&mychan_expiry, &mc->expiry, mc->used + chansvs.expiry);
+	else
+		expiry_index_remove(&mychan_expiry, &mc->expiry);
+}
+
+void expire_check(void *arg)
+{
+	myuser_t *mu;
+	mynick_t *mn;
+	mychan_t *mc;
+
+	/* Let them know about this and the likely subsequent db_save()
+	 * right away -- jilles */
+	if (curr_uplink != NULL && curr_uplink->conn != NULL)
+		sendq_flush(curr_uplink->conn);
+
+	if (!expiry_index_ready || expiry_nick_period != nicksvs.expiry ||
+			expiry_chan_period != chansvs.expiry)
+		expiry_index_rebuild();
+
+	/* Each step either drops the object or requeues it in the
+	 * future, so these loops only visit objects that are due. */
+	while ((mu = expiry_index_next(&myuser_expiry)) != NULL)
+		expire_myuser(mu);
+
+	while ((mn = expiry_index_next(&mynick_expiry)) != NULL)
+		expire_mynick(mn);
+
+	while ((mc = expiry_index_next(&mychan_expiry)) != NULL)
+		expire_mychan(mc);
 }
 
 static int check_myuser_cb(myentity_t *mt, void *unused)
@@ -2124,9 +2517,9 @@ static int check_myuser_cb(myentity_t *mt, void *unused)
 		{
 			mn = n->data;
 			if (mn->registered < mu->registered)
-				mu->registered = mn->registered;
+				myuser_set_registered(mu, mn->registered);
 			if (mn->lastseen > mu->lastlogin)
-				mu->lastlogin = mn->lastseen;
+				myuser_set_lastlogin(mu, mn->lastseen);
 			if (!irccasecmp(entity(mu)->name, mn->nick))
 				mn1 = mn;
 		}
@@ -0,0 +1,395 @@
+/*
+ * atheme-services: A collection of minimalist IRC services
+ * accountindex.c: Secondary indexes for account searches.
+ *
+ * Copyright (c) 2026 Zohlai Development Group
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "atheme.h"
+
+/* The indexes only exist while some module has asked for them, so
+ * networks that never search accounts do not pay for their upkeep.
+ *
+ * Accounts are kept in lists per canonical email address and per day of
+ * registration and last login; nicks are kept in lists per first
+ * ACCOUNT_INDEX_PREFIXLEN characters. All of these only narrow a search
+ * down: callers must still check their criteria against each candidate.
+ * That also keeps the time indexes correct when something updates
+ * lastlogin behind our back, as it only ever moves forward.
+ */
+#define DAY (24 * 60 * 60)
+
+typedef struct {
+	mowgli_list_t **days;
+	time_t first;		/* day number of days[0] */
+	unsigned int count;
+} time_index_t;
+
+static unsigned int index_refcnt = 0;
+
+static mowgli_patricia_t *email_index;
+static mowgli_patricia_t *prefix_index;
+static time_index_t registered_index;
+static time_index_t lastlogin_index;
+
+static void index_node_add(void *data, index_node_t *in, mowgli_list_t *bucket)
+{
+	in->bucket = bucket;
+	mowgli_node_add(data, &in->node, bucket);
+}
+
+static void index_node_delete(index_node_t *in)
+{
+	if (in->bucket == NULL)
+		return;
+
+	mowgli_node_delete(&in->node, in->bucket);
+	in->bucket = NULL;
+}
+
+/*
+ * the time indexes
+ */
+
+static time_t time_index_day(time_t ts)
+{
+	return ts > 0 ? ts / DAY : 0;
+}
+
+static mowgli_list_t *time_index_bucket(time_index_t *idx, time_t ts)
+{
+	time_t day = time_index_day(ts);
+	unsigned int grow;
+
+	if (idx->count == 0)
+	{
+		idx->days = scalloc(1, sizeof(mowgli_list_t *));
+		idx->first = day;
+		idx->count = 1;
+	}
+	else if (day < idx->first)
+	{
+		grow = idx->first - day;
+		idx->days = srealloc(idx->days, (idx->count + grow) * sizeof(mowgli_list_t *));
+		memmove(idx->days + grow, idx->days, idx->count * sizeof(mowgli_list_t *));
+		memset(idx->days, 0, grow * sizeof(mowgli_list_t *));
+		idx->first = day;
+		idx->count += grow;
+	}
+	else if (day >= idx->first + idx->count)
+	{
+		grow = day - (idx->first + idx->count) + 1;
+		idx->days = srealloc(idx->days, (idx->count + grow) * sizeof(mowgli_list_t *));
+		memset(idx->days + idx->count, 0, grow * sizeof(mowgli_list_t *));
+		idx->count += grow;
+	}
+
+	if (idx->days[day - idx->first] == NULL)
+		idx->days[day - idx->first] = mowgli_list_create();
+
+	return idx->days[day - idx->first];
+}
+
+static void time_index_set(time_index_t *idx, myuser_t *mu, index_node_t *in, time_t ts)
+{
+	mowgli_list_t *bucket = time_index_bucket(idx, ts);
+
+	if (in->bucket == bucket)
+		return;
+
+	index_node_delete(in);
+	index_node_add(mu, in, bucket);
+}
+
+static void time_index_clear(time_index_t *idx)
+{
+	unsigned int i;
+
+	for (i = 0; i < idx->count; i++)
+	{
+		/* the nodes are embedded in the accounts */
+		if (idx->days[i] != NULL)
+			mowgli_list_free(idx->days[i]);
+	}
+
+	free(idx->days);
+	idx->days = NULL;
+	idx->first = 0;
+	idx->count = 0;
+}
+
+static time_index_t *time_index_get(account_index_time_t which)
+{
+	return which == ACCOUNT_INDEX_REGISTERED ? &registered_index : &lastlogin_index;
+}
+
+/* number of days up to and including the one holding when */
+static unsigned int time_index_span(time_index_t *idx, time_t when)
+{
+	time_t day = time_index_day(when);
+
+	if (idx->count == 0 || day < idx->first)
+		return 0;
+	if (day >= idx->first + idx->count)
+		return idx->count;
+
+	return day - idx->first + 1;
+}
+
+/*
+ * the keyed indexes
+ */
+
+static void keyed_index_add(mowgli_patricia_t *tree, const char *key, void *data, index_node_t *in)
+{
+	mowgli_list_t *bucket;
+
+	if ((bucket = mowgli_patricia_retrieve(tree, key)) == NULL)
+	{
+		bucket = mowgli_list_create();
+		mowgli_patricia_add(tree, key, bucket);
+	}
+
+	index_node_add(data, in, bucket);
+}
+
+static void keyed_index_delete(mowgli_patricia_t *tree, const char *key, index_node_t *in)
+{
+	mowgli_list_t *bucket = in->bucket;
+
+	if (bucket == NULL)
+		return;
+
+	index_node_delete(in);
+
+	if (MOWGLI_LIST_LENGTH(bucket) == 0 && mowgli_patricia_retrieve(tree, key) == bucket)
+	{
+		mowgli_patricia_delete(tree, key);
+		mowgli_list_free(bucket);
+	}
+}
+
+static void keyed_index_free_bucket(const char *key, void *data, void *privdata)
+{
+	mowgli_list_free(data);
+}
+
+static void nick_prefix(char *buf, const char *nick)
+{
+	mowgli_strlcpy(buf, nick, ACCOUNT_INDEX_PREFIXLEN + 1);
+}
+
+/*
+ * maintenance, called from account.c
+ */
+
+void account_index_add_myuser(myuser_t *mu)
+{
+	if (index_refcnt == 0)
+		return;
+
+	if (mu->email_canonical != NULL)
+		keyed_index_add(email_index, mu->email_canonical, mu, &mu->email_idx);
+
+	time_index_set(&registered_index, mu, &mu->registered_idx, mu->registered);
+	time_index_set(&lastlogin_index, mu, &mu->lastlogin_idx, mu->lastlogin);
+}
+
+void account_index_delete_myuser(myuser_t *mu)
+{
+	if (index_refcnt == 0)
+		return;
+
+	keyed_index_delete(email_index, mu->email_canonical, &mu->email_idx);
+	index_node_delete(&mu->registered_idx);
+	index_node_delete(&mu->lastlogin_idx);
+}
+
+void account_index_add_mynick(mynick_t *mn)
+{
+	char prefix[ACCOUNT_INDEX_PREFIXLEN + 1];
+
+	if (index_refcnt == 0)
+		return;
+
+	nick_prefix(prefix, mn->nick);
+	keyed_index_add(prefix_index, prefix, mn, &mn->prefix_idx);
+}
+
+void account_index_delete_mynick(mynick_t *mn)
+{
+	char prefix[ACCOUNT_INDEX_PREFIXLEN + 1];
+
+	if (index_refcnt == 0)
+		return;
+
+	nick_prefix(prefix, mn->nick);
+	keyed_index_delete(prefix_index, prefix, &mn->prefix_idx);
+}
+
+/* registered or lastlogin changed */
+void account_index_touch(myuser_t *mu)
+{
+	if (index_refcnt == 0)
+		return;
+
+	time_index_set(&registered_index, mu, &mu->registered_idx, mu->registered);
+	time_index_set(&lastlogin_index, mu, &mu->lastlogin_idx, mu->lastlogin);
+}
+
+/*
+ * account_index_enable()
+ *
+ * Inputs:
+ *       none
+ *
+ * Outputs:
+ *       none
+ *
+ * Side Effects:
+ *       - the first caller builds the indexes from the current accounts,
+ *         after which they are kept up to date until the last caller
+ *         calls account_index_disable()
+ */
+void account_index_enable(void)
+{
+	myentity_iteration_state_t mestate;
+	mowgli_patricia_iteration_state_t state;
+	myentity_t *mt;
+	mynick_t *mn;
+
+	if (index_refcnt++ > 0)
+		return;
+
+	email_index = mowgli_patricia_create(noopcanon);
+	prefix_index = mowgli_patricia_create(irccasecanon);
+
+	MYENTITY_FOREACH_T(mt, &mestate, ENT_USER)
+		account_index_add_myuser(user(mt));
+
+	MOWGLI_PATRICIA_FOREACH(mn, &state, nicklist)
+		account_index_add_mynick(mn);
+
+	slog(LG_DEBUG, "account_index_enable(): indexed %u emails, %u nick prefixes",
+			mowgli_patricia_size(email_index), mowgli_patricia_size(prefix_index));
+}
+
+void account_index_disable(void)
+{
+	myentity_iteration_state_t mestate;
+	mowgli_patricia_iteration_state_t state;
+	myentity_t *mt;
+	mynick_t *mn;
+
+	return_if_fail(index_refcnt > 0);
+
+	if (--index_refcnt > 0)
+		return;
+
+	MYENTITY_FOREACH_T(mt, &mestate, ENT_USER)
+	{
+		user(mt)->email_idx.bucket = NULL;
+		user(mt)->registered_idx.bucket = NULL;
+		user(mt)->lastlogin_idx.bucket = NULL;
+	}
+
+	MOWGLI_PATRICIA_FOREACH(mn, &state, nicklist)
+		mn->prefix_idx.bucket = NULL;
+
+	mowgli_patricia_destroy(email_index, keyed_index_free_bucket, NULL);
+	mowgli_patricia_destroy(prefix_index, keyed_index_free_bucket, NULL);
+	time_index_clear(&registered_index);
+	time_index_clear(&lastlogin_index);
+}
+
+bool account_index_enabled(void)
+{
+	return index_refcnt > 0;
+}
+
+/*
+ * queries
+ */
+
+/* accounts with the given canonical email, or NULL */
+mowgli_list_t *account_index_email(stringref email_canonical)
+{
+	return_val_if_fail(index_refcnt > 0, NULL);
+
+	if (email_canonical == NULL)
+		return NULL;
+
+	return mowgli_patricia_retrieve(email_index, email_canonical);
+}
+
+/* nicks starting with the first ACCOUNT_INDEX_PREFIXLEN characters of
+ * prefix, or NULL; prefix must be at least that long unless it is a
+ * whole nick */
+mowgli_list_t *account_index_nick_prefix(const char *prefix)
+{
+	char buf[ACCOUNT_INDEX_PREFIXLEN + 1];
+
+	return_val_if_fail(index_refcnt > 0, NULL);
+
+	nick_prefix(buf, prefix);
+	return mowgli_patricia_retrieve(prefix_index, buf);
+}
+
+/* upper bound on the number of accounts whose time is before when */
+unsigned int account_index_count_before(account_index_time_t which, time_t when)
+{
+	time_index_t *idx = time_index_get(which);
+	unsigned int i, span, count = 0;
+
+	return_val_if_fail(index_refcnt > 0, 0);
+
+	span = time_index_span(idx, when);
+	for (i = 0; i < span; i++)
+		if (idx->days[i] != NULL)
+			count += MOWGLI_LIST_LENGTH(idx->days[i]);
+
+	return count;
+}
+
+/* calls cb for every account whose time may be before when; the
+ * callback must not modify accounts */
+void account_index_foreach_before(account_index_time_t which, time_t when, void (*cb)(myuser_t *mu, void *privdata), void *privdata)
+{
+	time_index_t *idx = time_index_get(which);
+	mowgli_node_t *n;
+	unsigned int i, span;
+
+	return_if_fail(index_refcnt > 0);
+
+	span = time_index_span(idx, when);
+	for (i = 0; i < span; i++)
+	{
+		if (idx->days[i] == NULL)
+			continue;
+
+		MOWGLI_ITER_FOREACH(n, idx->days[i]->head)
+			cb(n->data, privdata);
+	}
+}
+
+/* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
+ * vim:ts=8
+ * vim:sw=8
+ * vim:noexpandtab
+ */
@@ -246,6 +246,10 @@ void zohlai_setup(void)
 
 	authcookie_init();
 	common_ctcp_init();
+	email_init();
+	help_init();
+	scan_init();
+	burstlogin_init();
 }
 
 int zohlai_main(int argc, char *argv[])
@@ -421,14 +425,6 @@ int zohlai_main(int argc, char *argv[])
 	/* check expires every hour */
 	mowgli_timer_add(base_eventloop, "expire_check", expire_check, NULL, 3600);
 
-	/* check k/x/q line expires every minute */
-	mowgli_timer_add(base_eventloop, "kline_expire", kline_expire, NULL, 60);
-	mowgli_timer_add(base_eventloop, "xline_expire", xline_expire, NULL, 60);
-	mowgli_timer_add(base_eventloop, "qline_expire", qline_expire, NULL, 60);
-
-	/* check authcookie expires every ten minutes */
-	mowgli_timer_add(base_eventloop, "authcookie_expire", authcookie_expire, NULL, 600);
-
 	me.connected = false;
 	uplink_connect();
 
@@ -26,12 +26,16 @@
 
 mowgli_list_t authcookie_list;
 mowgli_heap_t *authcookie_heap;
+static mowgli_patricia_t *authcookie_tree;
+
+static void authcookie_expire(void *arg);
 
 void authcookie_init(void)
 {
 	authcookie_heap = sharedheap_get(sizeof(authcookie_t));
+	authcookie_tree = mowgli_patricia_create(noopcanon);
 
-	if (!authcookie_heap)
+	if (!authcookie_heap || !authcookie_tree)
 	{
 		slog(LG_ERROR, "authcookie_init(): cannot initialize block allocator.");
 		exit(EXIT_FAILURE);
@@ -54,11 +58,23 @@ authcookie_t *authcookie_create(myuser_t *mu)
 {
 	authcookie_t *au = mowgli_heap_alloc(authcookie_heap);
 
+	/* tickets are random, but the index needs them unique */
 	au->ticket = random_string(20);
+	while (mowgli_patricia_retrieve(authcookie_tree, au->ticket) != NULL)
+	{
+		free(au->ticket);
+		au->ticket = random_string(20);
+	}
+
 	au->myuser = mu;
 	au->expire = CURRTIME + 3600;
 
+	mowgli_patricia_add(authcookie_tree, au->ticket, au);
 	mowgli_node_add(au, &au->node, &authcookie_list);
+	mowgli_node_add(au, &au->unode, &mu->authcookies);
+
+	deadline_init(&au->deadline, "authcookie_expire", authcookie_expire, au);
+	deadline_set(&au->deadline, au->expire);
 
 	return au;
 }
@@ -77,45 +93,20 @@ authcookie_t *authcookie_create(myuser_t *mu)
  */
 authcookie_t *authcookie_find(char *ticket, myuser_t *myuser)
 {
-	mowgli_node_t *n;
 	authcookie_t *ac;
 
 	/* at least one must be specified */
 	return_val_if_fail(ticket != NULL || myuser != NULL, NULL);
 
-	if (!myuser)		/* must have ticket */
-	{
-		MOWGLI_ITER_FOREACH(n, authcookie_list.head)
-		{
-			ac = n->data;
+	if (!ticket)		/* must have myuser */
+		return myuser->authcookies.head != NULL ? myuser->authcookies.head->data : NULL;
 
-			if (!strcmp(ac->ticket, ticket))
-				return ac;
-		}
-	}
-	else if (!ticket)	/* must have myuser */
-	{
-		MOWGLI_ITER_FOREACH(n, authcookie_list.head)
-		{
-			ac = n->data;
+	ac = mowgli_patricia_retrieve(authcookie_tree, ticket);
 
-			if (ac->myuser == myuser)
-				return ac;
-		}
-	}
-	else			/* must have both */
-	{
-		MOWGLI_ITER_FOREACH(n, authcookie_list.head)
-		{
-			ac = n->data;
-
-			if (ac->myuser == myuser
-				&& !strcmp(ac->ticket, ticket))
-				return ac;
-		}
-	}
+	if (ac != NULL && myuser != NULL && ac->myuser != myuser)
+		return NULL;
 
-	return NULL;
+	return ac;
 }
 
 /*
@@ -134,7 +125,10 @@ void authcookie_destroy(authcookie_t * ac)
 {
 	return_if_fail(ac != NULL);
 
+	deadline_cancel(&ac->deadline);
+	mowgli_patricia_delete(authcookie_tree, ac->ticket);
 	mowgli_node_delete(&ac->node, &authcookie_list);
+	mowgli_node_delete(&ac->unode, &ac->myuser->authcookies);
 	free(ac->ticket);
 	mowgli_heap_free(authcookie_heap, ac);
 }
@@ -154,42 +148,26 @@ void authcookie_destroy(authcookie_t * ac)
 void authcookie_destroy_all(myuser_t *mu)
 {
 	mowgli_node_t *n, *tn;
-	authcookie_t *ac;
-
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, authcookie_list.head)
-	{
-		ac = n->data;
 
-		if (ac->myuser == mu)
-			authcookie_destroy(ac);
-	}
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, mu->authcookies.head)
+		authcookie_destroy(n->data);
 }
 
 /*
  * authcookie_expire()
  *
  * Inputs:
- *       unused arg because this is an event function
+ *       the authcookie whose deadline passed
  *
  * Outputs:
  *       none
  *
  * Side Effects:
- *       expired authcookies are destroyed
+ *       the authcookie is destroyed
  */
-void authcookie_expire(void *arg)
+static void authcookie_expire(void *arg)
 {
-	authcookie_t *ac;
-	mowgli_node_t *n, *tn;
-
-	(void)arg;
-        MOWGLI_ITER_FOREACH_SAFE(n, tn, authcookie_list.head)
-	{
-		ac = n->data;
-
-		if (ac->expire <= CURRTIME)
-			authcookie_destroy(ac);
-	}
+	authcookie_destroy(arg);
 }
 
 /*
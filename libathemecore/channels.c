@@ -24,6 +24,7 @@
 #include "atheme.h"
 
 mowgli_patricia_t *chanlist;
+hashdict_t *chanlist_hash;
 
 mowgli_heap_t *chan_heap;
 mowgli_heap_t *chanuser_heap;
@@ -56,6 +57,7 @@ void init_channels(void)
 	}
 
 	chanlist = mowgli_patricia_create(irccasecanon);
+	chanlist_hash = hashdict_create(hashdict_hash_irccase, irccasecmp);
 }
 
 /*
@@ -116,10 +118,14 @@ channel_t *channel_add(const char *name, time_t ts, server_t *creator)
 	c->bans.tail = NULL;
 	c->bans.count = 0;
 
+	mowgli_patricia_add(chanlist, c->name, c);
+	hashdict_add(chanlist_hash, c->name, c);
+
 	if ((mc = mychan_find(c->name)))
+	{
 		mc->chan = c;
-
-	mowgli_patricia_add(chanlist, c->name, c);
+		channel_message_update(mc);
+	}
 
 	cnt.chan++;
 
@@ -178,6 +184,8 @@ void channel_delete(channel_t *c)
 
 	hook_call_channel_delete(c);
 
+	scan_forget(chanlist, c);
+	hashdict_delete(chanlist_hash, c->name);
 	mowgli_patricia_delete(chanlist, c->name);
 
 	if ((mc = mychan_find(c->name)))
@@ -200,6 +208,50 @@ void channel_delete(channel_t *c)
 	cnt.chan--;
 }
 
+/*
+ * channel_message_update(mychan_t *mc)
+ *
+ * Recomputes who wants to see messages to a registered channel.
+ *
+ * Inputs:
+ *     - registered channel whose settings may have changed
+ *
+ * Outputs:
+ *     - nothing
+ *
+ * Side Effects:
+ *     - if the channel exists, its msgsubs are cleared and the
+ *       channel_message_subscribe hook sets them again; channels
+ *       without any are skipped by handle_channel_message()
+ */
+void channel_message_update(mychan_t *mc)
+{
+	return_if_fail(mc != NULL);
+
+	if (mc->chan == NULL)
+		return;
+
+	mc->chan->msgsubs = 0;
+	hook_call_channel_message_subscribe(mc);
+}
+
+/*
+ * channel_message_update_all()
+ *
+ * As channel_message_update() for every registered channel; for modules
+ * that subscribe or unsubscribe, or change global settings.
+ */
+void channel_message_update_all(void)
+{
+	mychan_t *mc;
+	mowgli_patricia_iteration_state_t state;
+
+	MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
+	{
+		channel_message_update(mc);
+	}
+}
+
 /*
  * chanban_add(channel_t *chan, const char *mask, int type)
  *
@@ -245,6 +297,7 @@ chanban_t *chanban_add(channel_t *chan, const char *mask, int type)
 
 	c->chan = chan;
 	c->mask = sstrdup(mask);
+	c->mask_pat = match_pattern_create(mask);
 	c->type = type;
 
 	mowgli_node_add(c, &c->node, &chan->bans);
@@ -272,6 +325,7 @@ void chanban_delete(chanban_t * c)
 
 	mowgli_node_delete(&c->node, &c->chan->bans);
 
+	match_pattern_destroy(c->mask_pat);
 	free(c->mask);
 	mowgli_heap_free(chanban_heap, c);
 }
@@ -389,22 +389,30 @@ void channel_mode_va(user_t *source, channel_t *chan, int parc, char *parv0, ...
 	channel_mode(source, chan, parc, parv);
 }
 
-static struct modestackdata {
+/* Pending mode changes are kept per channel, hanging off channel_t, and
+ * all of them are sent at the end of the event loop iteration. A channel
+ * only stacks changes from one source at a time; if another source comes
+ * along, what is pending is sent first so the ircd sees the changes in
+ * the order they were made.
+ */
+struct modestackdata {
+	mowgli_node_t node;
 	char source[HOSTLEN]; /* name */
 	channel_t *channel;
 	unsigned int modes_on;
 	unsigned int modes_off;
 	unsigned int limit;
-	char extmodes[256][512];
-	bool limitused, extmodesused[256];
+	char **extmodes; /* ignore_mode_list_size entries */
+	bool limitused, *extmodesused;
 	char pmodes[2*MAXMODES+2];
 	char params[512]; /* includes leading space */
 	int totalparamslen; /* includes leading space */
 	int totallen;
 	int paramcount;
+};
 
-	mowgli_eventloop_timer_t *event;
-} modestackdata;
+static mowgli_list_t modestack_pending;
+static mowgli_eventloop_timer_t *modestack_event = NULL;
 
 static void modestack_calclen(struct modestackdata *md);
 
@@ -461,7 +469,11 @@ static void modestack_clear(struct modestackdata *md)
 	md->modes_off = 0;
 	md->limitused = 0;
 	for (i = 0; i < ignore_mode_list_size; i++)
-		md->extmodesused[i] = 0, *md->extmodes[i] = '\0';
+	{
+		md->extmodesused[i] = 0;
+		free(md->extmodes[i]);
+		md->extmodes[i] = NULL;
+	}
 	md->pmodes[0] = '\0';
 	md->params[0] = '\0';
 	md->totallen = 0;
@@ -565,20 +577,69 @@ static void modestack_flush(struct modestackdata *md)
 	modestack_clear(md);
 }
 
+/* sends whatever is pending and forgets the channel's stack */
+static void modestack_release(struct modestackdata *md, bool send)
+{
+	if (send)
+		modestack_flush(md);
+	else
+		modestack_clear(md);
+
+	mowgli_node_delete(&md->node, &modestack_pending);
+	md->channel->modestack = NULL;
+
+	free(md->extmodes);
+	free(md->extmodesused);
+	free(md);
+}
+
+static void modestack_release_all(bool send)
+{
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, modestack_pending.head)
+		modestack_release(n->data, send);
+}
+
+static void modestack_flush_callback(void *arg)
+{
+	modestack_event = NULL;
+	modestack_release_all(true);
+}
+
 static struct modestackdata *modestack_init(const char *source, channel_t *channel)
 {
+	struct modestackdata *md;
+
 	return_val_if_fail(source != NULL, NULL);
 	return_val_if_fail(channel != NULL, NULL);
 
-	if (irccasecmp(source, modestackdata.source) || channel != modestackdata.channel)
+	if ((md = channel->modestack) == NULL)
 	{
-		/*slog(LG_DEBUG, "modestack_init(): new source/channel, flushing");*/
-		modestack_flush(&modestackdata);
+		md = smalloc(sizeof(struct modestackdata));
+		memset(md, 0, sizeof(struct modestackdata));
+		md->channel = channel;
+		if (ignore_mode_list_size != 0)
+		{
+			md->extmodes = scalloc(sizeof(char *), ignore_mode_list_size);
+			md->extmodesused = scalloc(sizeof(bool), ignore_mode_list_size);
+		}
+
+		channel->modestack = md;
+		mowgli_node_add(md, &md->node, &modestack_pending);
+	}
+	else if (irccasecmp(source, md->source))
+	{
+		/*slog(LG_DEBUG, "modestack_init(): new source, flushing");*/
+		modestack_flush(md);
 	}
 
-	mowgli_strlcpy(modestackdata.source, source, sizeof modestackdata.source);
-	modestackdata.channel = channel;
-	return &modestackdata;
+	mowgli_strlcpy(md->source, source, sizeof md->source);
+
+	if (modestack_event == NULL)
+		modestack_event = mowgli_timer_add_once(base_eventloop, "flush_cmode_callback", modestack_flush_callback, NULL, 0);
+
+	return md;
 }
 
 static void modestack_add_simple(struct modestackdata *md, int dir, int flags)
@@ -616,17 +677,19 @@ static void modestack_add_ext(struct modestackdata *md, int dir, int i, const ch
 	modestack_calclen(md);
 	if (md->paramcount >= MAXMODES)
 		modestack_flush(md);
+	free(md->extmodes[i]);
+	md->extmodes[i] = NULL;
 	if (dir == MTYPE_ADD)
 	{
 		if (md->totallen + 1 + strlen(value) > 512)
 			modestack_flush(md);
-		mowgli_strlcpy(md->extmodes[i], value, sizeof md->extmodes[i]);
+		md->extmodes[i] = sstrdup(value);
 	}
 	else if (dir == MTYPE_DEL)
-		md->extmodes[i][0] = '\0';
+		md->extmodes[i] = sstrdup("");
 	else
 		slog(LG_ERROR, "modestack_add_ext(): invalid direction");
-	md->extmodesused[i] = 1;
+	md->extmodesused[i] = md->extmodes[i] != NULL;
 }
 
 static void modestack_add_param(struct modestackdata *md, int dir, char type, const char *value)
@@ -673,47 +736,46 @@ static void modestack_add_param(struct modestackdata *md, int dir, char type, co
 	mowgli_strlcat(md->params, value, sizeof md->params);
 }
 
-static void modestack_flush_callback(void *arg)
-{
-	modestack_flush((struct modestackdata *)arg);
-	((struct modestackdata *)arg)->event = 0;
-}
-
 /* flush pending modes for a certain channel */
 void modestack_flush_channel(channel_t *channel)
 {
-	if (channel == NULL || channel == modestackdata.channel)
-		modestack_flush(&modestackdata);
+	if (channel == NULL)
+		modestack_release_all(true);
+	else if (channel->modestack != NULL)
+		modestack_release(channel->modestack, true);
 }
 
 /* forget pending modes for a certain channel */
 void modestack_forget_channel(channel_t *channel)
 {
-	if (channel == NULL || channel == modestackdata.channel)
-		modestack_clear(&modestackdata);
+	if (channel == NULL)
+		modestack_release_all(false);
+	else if (channel->modestack != NULL)
+		modestack_release(channel->modestack, false);
 }
 
 /* handle a channel that is going to be destroyed */
 void modestack_finalize_channel(channel_t *channel)
 {
+	struct modestackdata *md;
 	user_t *u;
 
-	if (channel == modestackdata.channel)
+	if ((md = channel->modestack) == NULL)
+		return;
+
+	if (md->modes_off & ircd->perm_mode)
 	{
-		if (modestackdata.modes_off & ircd->perm_mode)
-		{
-			/* A mode change is not a good way to destroy a channel */
-			slog(LG_DEBUG, "modestack_finalize_channel(): flushing modes for %s to clear perm mode", channel->name);
-			u = user_find_named(modestackdata.source);
-			if (u != NULL)
-				join_sts(channel, u, false, channel_modes(channel, true));
-			modestack_flush(&modestackdata);
-			if (u != NULL)
-				part_sts(channel, u);
-		}
-		else
-			modestack_clear(&modestackdata);
+		/* A mode change is not a good way to destroy a channel */
+		slog(LG_DEBUG, "modestack_finalize_channel(): flushing modes for %s to clear perm mode", channel->name);
+		u = user_find_named(md->source);
+		if (u != NULL)
+			join_sts(channel, u, false, channel_modes(channel, true));
+		modestack_flush(md);
+		if (u != NULL)
+			part_sts(channel, u);
 	}
+
+	modestack_release(md, false);
 }
 
 /* stack simple modes without parameters */
@@ -725,8 +787,6 @@ void modestack_mode_simple_real(const char *source, channel_t *channel, int dir,
 		return;
 	md = modestack_init(source, channel);
 	modestack_add_simple(md, dir, flags);
-	if (!md->event)
-		md->event = mowgli_timer_add_once(base_eventloop, "flush_cmode_callback", modestack_flush_callback, md, 0);
 }
 void (*modestack_mode_simple)(const char *source, channel_t *channel, int dir, int flags) = modestack_mode_simple_real;
 
@@ -737,8 +797,6 @@ void modestack_mode_limit_real(const char *source, channel_t *channel, int dir,
 
 	md = modestack_init(source, channel);
 	modestack_add_limit(md, dir, limit);
-	if (!md->event)
-		md->event = mowgli_timer_add_once(base_eventloop, "flush_cmode_callback", modestack_flush_callback, md, 0);
 }
 void (*modestack_mode_limit)(const char *source, channel_t *channel, int dir, unsigned int limit) = modestack_mode_limit_real;
 
@@ -755,8 +813,6 @@ void modestack_mode_ext_real(const char *source, channel_t *channel, int dir, un
 		return;
 	}
 	modestack_add_ext(md, dir, i, value);
-	if (!md->event)
-		md->event = mowgli_timer_add_once(base_eventloop, "flush_cmode_callback", modestack_flush_callback, md, 0);
 }
 void (*modestack_mode_ext)(const char *source, channel_t *channel, int dir, unsigned int i, const char *value) = modestack_mode_ext_real;
 
@@ -767,15 +823,13 @@ void modestack_mode_param_real(const char *source, channel_t *channel, int dir,
 
 	md = modestack_init(source, channel);
 	modestack_add_param(md, dir, type, value);
-	if (!md->event)
-		md->event = mowgli_timer_add_once(base_eventloop, "flush_cmode_callback", modestack_flush_callback, md, 0);
 }
 void (*modestack_mode_param)(const char *source, channel_t *channel, int dir, char type, const char *value) = modestack_mode_param_real;
 
 /* go ahead and flush now */
 void modestack_flush_now(void)
 {
-	modestack_flush(&modestackdata);
+	modestack_release_all(true);
 }
 
 /* Clear all simple modes (+imnpstkl etc) on a channel */
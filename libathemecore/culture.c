@@ -75,12 +75,16 @@ const char *translation_get(const char *str)
 {
 	translation_t *t;
 
+	/* most networks have no translations configured at all */
+	if (mowgli_patricia_size(itranslation_tree) == 0 && mowgli_patricia_size(translation_tree) == 0)
+		return str;
+
 	/* See if an internal substitution is present. */
 	if ((t = mowgli_patricia_retrieve(itranslation_tree, str)) != NULL)
 		str = t->replacement;
 
 	if ((t = mowgli_patricia_retrieve(translation_tree, str)) != NULL)
-		return t->replacement;
+		str = t->replacement;
 
 	return str;
 }
@@ -24,6 +24,11 @@
 #include "atheme.h"
 #include "datastream.h"
 
+#if defined(HAVE_SENDFILE) && defined(__linux__)
+# include <sys/sendfile.h>
+# define USE_SENDFILE
+#endif
+
 #define SENDQSIZE (4096 - 40)
 
 #ifdef MOWGLI_OS_WIN
@@ -37,9 +42,33 @@ struct sendq {
 	mowgli_node_t node;
 	int firstused; /* offset of first used byte */
 	int firstfree; /* 1 + offset of last used byte */
+	/* file segment queued by sendq_add_file(), buf is not allocated */
+	int fd;
+	off_t offset;
+	size_t remain;
 	char buf[SENDQSIZE];
 };
 
+static struct sendq *sendq_create(mowgli_list_t *list)
+{
+	struct sendq *sq;
+
+	sq = smalloc(sizeof(struct sendq));
+	sq->firstused = sq->firstfree = 0;
+	sq->fd = -1;
+	mowgli_node_add(sq, &sq->node, list);
+
+	return sq;
+}
+
+static void sendq_destroy(struct sendq *sq, mowgli_list_t *list)
+{
+	if (sq->fd != -1)
+		close(sq->fd);
+	mowgli_node_delete(&sq->node, list);
+	free(sq);
+}
+
 void sendq_add(connection_t * cptr, char *buf, size_t len)
 {
 	mowgli_node_t *n;
@@ -71,7 +100,7 @@ void sendq_add(connection_t * cptr, char *buf, size_t len)
 		connection_setselect_write(cptr, sendq_flush);
 
 	n = cptr->sendq.tail;
-	if (n != NULL)
+	if (n != NULL && ((struct sendq *)n->data)->fd == -1)
 	{
 		sq = n->data;
 		l = SENDQSIZE - sq->firstfree;
@@ -85,9 +114,7 @@ void sendq_add(connection_t * cptr, char *buf, size_t len)
 
 	while (len > 0)
 	{
-		sq = smalloc(sizeof(struct sendq));
-		sq->firstused = sq->firstfree = 0;
-		mowgli_node_add(sq, &sq->node, &cptr->sendq);
+		sq = sendq_create(&cptr->sendq);
 		l = SENDQSIZE - sq->firstfree;
 		if (l > len)
 			l = len;
@@ -98,6 +125,71 @@ void sendq_add(connection_t * cptr, char *buf, size_t len)
 	}
 }
 
+/*
+ * Queues len bytes of the file fd starting at offset. The data is not
+ * copied; it is read when the connection becomes writable, with
+ * sendfile() where available. fd is duplicated, so the caller may
+ * close or keep its own descriptor.
+ */
+void sendq_add_file(connection_t *cptr, int fd, off_t offset, size_t len)
+{
+	struct sendq *sq;
+	int newfd;
+
+	return_if_fail(cptr != NULL);
+
+	if (cptr->flags & (CF_DEAD | CF_SEND_EOF))
+	{
+		slog(LG_DEBUG, "sendq_add_file(): attempted to send to fd %d which is already dead", cptr->fd);
+		return;
+	}
+
+	if (len == 0)
+		return;
+
+	if ((newfd = dup(fd)) == -1)
+	{
+		slog(LG_DEBUG, "sendq_add_file(): dup() failed on connection %s[%d]: %s",
+				cptr->name, cptr->fd, strerror(errno));
+		cptr->flags |= CF_DEAD;
+		return;
+	}
+
+	if (!sendq_nonempty(cptr))
+		connection_setselect_write(cptr, sendq_flush);
+
+	sq = smalloc(offsetof(struct sendq, buf));
+	sq->firstused = sq->firstfree = 0;
+	sq->fd = newfd;
+	sq->offset = offset;
+	sq->remain = len;
+	mowgli_node_add(sq, &sq->node, &cptr->sendq);
+}
+
+static int sendq_flush_file(connection_t *cptr, struct sendq *sq)
+{
+	int l;
+#ifdef USE_SENDFILE
+	l = sendfile(cptr->fd, sq->fd, &sq->offset, sq->remain);
+#else
+	char buf[SENDQSIZE];
+
+	l = pread(sq->fd, buf, sq->remain < sizeof buf ? sq->remain : sizeof buf, sq->offset);
+	if (l > 0 && (l = send(cptr->fd, buf, l, 0)) > 0)
+		sq->offset += l;
+#endif
+	if (l == 0)
+	{
+		/* the file shrank under us, the length we promised is wrong */
+		slog(LG_DEBUG, "sendq_flush(): short file on connection %s[%d]", cptr->name, cptr->fd);
+		cptr->flags |= CF_DEAD;
+		return -1;
+	}
+	if (l > 0)
+		sq->remain -= l;
+	return l;
+}
+
 void sendq_add_eof(connection_t * cptr)
 {
 	return_if_fail(cptr != NULL);
@@ -124,8 +216,37 @@ void sendq_flush(connection_t * cptr)
         {
                 sq = (struct sendq *)n->data;
 
+		if (sq->fd != -1)
+		{
+			if (sendq_flush_file(cptr, sq) == -1)
+			{
+				int err = ioerrno();
+
+				if (!(cptr->flags & CF_DEAD) && !mowgli_eventloop_ignore_errno(err))
+				{
+					slog(LG_DEBUG, "sendq_flush(): file write error %d (%s) on connection %s[%d]",
+							err, strerror(err),
+							cptr->name, cptr->fd);
+					cptr->flags |= CF_DEAD;
+				}
+
+				return;
+			}
+			if (sq->remain != 0)
+				return;
+			sendq_destroy(sq, &cptr->sendq);
+			continue;
+		}
+
                 if (sq->firstused == sq->firstfree)
-                        break;
+		{
+			/* the emptied buffer kept at the head may have
+			 * a file segment queued behind it */
+			if (n->next == NULL)
+				break;
+			sendq_destroy(sq, &cptr->sendq);
+			continue;
+		}
 
                 if ((l = send(cptr->fd, sq->buf + sq->firstused, sq->firstfree - sq->firstused, 0)) == -1)
                 {
@@ -180,11 +301,13 @@ bool sendq_nonempty(connection_t *cptr)
 		return false;
 	if (cptr->flags & CF_SEND_EOF)
 		return true;
-	n = cptr->sendq.head;
-	if (n == NULL)
-		return false;
-	sq = n->data;
-	return sq->firstfree > sq->firstused;
+	MOWGLI_ITER_FOREACH(n, cptr->sendq.head)
+	{
+		sq = n->data;
+		if (sq->fd != -1 || sq->firstfree > sq->firstused)
+			return true;
+	}
+	return false;
 }
 
 void sendq_set_limit(connection_t *cptr, size_t len)
@@ -192,6 +315,20 @@ void sendq_set_limit(connection_t *cptr, size_t len)
 	cptr->sendq_limit = len;
 }
 
+int sendq_length(connection_t *cptr)
+{
+	int l = 0;
+	mowgli_node_t *n;
+	struct sendq *sq;
+
+	MOWGLI_ITER_FOREACH(n, cptr->sendq.head)
+	{
+		sq = n->data;
+		l += sq->fd != -1 ? (int)sq->remain : sq->firstfree - sq->firstused;
+	}
+	return l;
+}
+
 int recvq_length(connection_t *cptr)
 {
 	int l = 0;
@@ -238,9 +375,7 @@ void recvq_put(connection_t *cptr)
 	}
 	if (sq == NULL)
 	{
-		sq = smalloc(sizeof(struct sendq));
-		sq->firstused = sq->firstfree = 0;
-		mowgli_node_add(sq, &sq->node, &cptr->recvq);
+		sq = sendq_create(&cptr->recvq);
 		l = SENDQSIZE;
 	}
 	errno = 0;
@@ -377,16 +512,14 @@ void sendqrecvq_free(connection_t *cptr)
 	{
 		sq = nptr->data;
 
-		mowgli_node_delete(&sq->node, &cptr->recvq);
-		free(sq);
+		sendq_destroy(sq, &cptr->recvq);
 	}
 
 	MOWGLI_ITER_FOREACH_SAFE(nptr, nptr2, cptr->sendq.head)
 	{
 		sq = nptr->data;
 
-		mowgli_node_delete(&sq->node, &cptr->sendq);
-		free(sq);
+		sendq_destroy(sq, &cptr->sendq);
 	}
 }
 
@@ -0,0 +1,265 @@
+/*
+ * atheme-services: A collection of minimalist IRC services
+ * deadline.c: Per-object deadlines.
+ *
+ * Copyright (c) 2026 Zohlai Development Group
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "atheme.h"
+
+/* All pending deadlines live in one binary min-heap ordered by expiry
+ * time. A single one-shot eventloop timer is kept armed for the head of
+ * the heap, so nothing is scanned periodically and each deadline costs
+ * O(log n) to set or cancel.
+ */
+static deadline_t **deadline_heap = NULL;
+static unsigned int deadline_heap_count = 0;
+static unsigned int deadline_heap_size = 0;
+
+static mowgli_eventloop_timer_t *deadline_timer = NULL;
+static time_t deadline_timer_when;
+static bool deadline_running = false;
+
+static void deadline_run(void *arg);
+
+static void deadline_place(deadline_t *dl, unsigned int i)
+{
+	deadline_heap[i] = dl;
+	dl->slot = i + 1;
+}
+
+static void deadline_sift_up(unsigned int i)
+{
+	deadline_t *dl = deadline_heap[i];
+	unsigned int parent;
+
+	while (i > 0)
+	{
+		parent = (i - 1) / 2;
+		if (deadline_heap[parent]->when <= dl->when)
+			break;
+
+		deadline_place(deadline_heap[parent], i);
+		i = parent;
+	}
+
+	deadline_place(dl, i);
+}
+
+static void deadline_sift_down(unsigned int i)
+{
+	deadline_t *dl = deadline_heap[i];
+	unsigned int child;
+
+	for (;;)
+	{
+		child = 2 * i + 1;
+		if (child >= deadline_heap_count)
+			break;
+		if (child + 1 < deadline_heap_count && deadline_heap[child + 1]->when < deadline_heap[child]->when)
+			child++;
+		if (dl->when <= deadline_heap[child]->when)
+			break;
+
+		deadline_place(deadline_heap[child], i);
+		i = child;
+	}
+
+	deadline_place(dl, i);
+}
+
+static void deadline_remove(deadline_t *dl)
+{
+	deadline_t *last;
+	unsigned int i;
+
+	i = dl->slot - 1;
+	dl->slot = 0;
+
+	last = deadline_heap[--deadline_heap_count];
+	if (last == dl)
+		return;
+
+	deadline_heap[i] = last;
+	if (i > 0 && deadline_heap[(i - 1) / 2]->when > last->when)
+		deadline_sift_up(i);
+	else
+		deadline_sift_down(i);
+}
+
+/* makes sure the timer fires no later than the earliest deadline; if it
+ * fires early because that deadline went away, it just rearms itself */
+static void deadline_arm(void)
+{
+	time_t when;
+
+	if (deadline_running || deadline_heap_count == 0)
+		return;
+
+	when = deadline_heap[0]->when;
+	if (deadline_timer != NULL)
+	{
+		if (deadline_timer_when <= when)
+			return;
+
+		mowgli_timer_destroy(base_eventloop, deadline_timer);
+	}
+
+	deadline_timer_when = when;
+	deadline_timer = mowgli_timer_add_once(base_eventloop, "deadline_run", deadline_run, NULL,
+			when > CURRTIME ? when - CURRTIME : 0);
+}
+
+static void deadline_run(void *arg)
+{
+	deadline_t *dl;
+
+	/* one-shot timers are freed by the eventloop after they ran */
+	deadline_timer = NULL;
+	deadline_running = true;
+
+	while (deadline_heap_count > 0 && deadline_heap[0]->when <= CURRTIME)
+	{
+		dl = deadline_heap[0];
+		deadline_remove(dl);
+
+		dl->func(dl->arg);
+	}
+
+	deadline_running = false;
+	deadline_arm();
+}
+
+/*
+ * deadline_init(deadline_t *dl, const char *name, deadline_func_t func,
+ * void *arg)
+ *
+ * Prepares a deadline for use.
+ *
+ * Inputs:
+ *      - deadline to initialize
+ *      - name for debugging
+ *      - function to call when the deadline passes
+ *      - argument to pass to that function
+ *
+ * Outputs:
+ *      - none
+ *
+ * Side Effects:
+ *      - none, the deadline is not scheduled yet
+ */
+void deadline_init(deadline_t *dl, const char *name, deadline_func_t func, void *arg)
+{
+	return_if_fail(dl != NULL);
+	return_if_fail(func != NULL);
+
+	dl->name = name;
+	dl->func = func;
+	dl->arg = arg;
+	dl->when = 0;
+	dl->slot = 0;
+}
+
+/*
+ * deadline_set(deadline_t *dl, time_t when)
+ *
+ * Schedules or reschedules a deadline.
+ *
+ * Inputs:
+ *      - deadline to schedule
+ *      - time at which its function should be called
+ *
+ * Outputs:
+ *      - none
+ *
+ * Side Effects:
+ *      - the deadline is (re)scheduled; times in the past fire on the
+ *        next eventloop iteration, or a second later when set from a
+ *        deadline function so it cannot keep the scheduler busy
+ */
+void deadline_set(deadline_t *dl, time_t when)
+{
+	time_t oldwhen;
+
+	return_if_fail(dl != NULL);
+	return_if_fail(dl->func != NULL);
+
+	if (deadline_running && when <= CURRTIME)
+		when = CURRTIME + 1;
+
+	if (dl->slot == 0)
+	{
+		if (deadline_heap_count == deadline_heap_size)
+		{
+			deadline_heap_size = deadline_heap_size != 0 ? deadline_heap_size * 2 : 256;
+			deadline_heap = srealloc(deadline_heap, deadline_heap_size * sizeof(deadline_t *));
+		}
+
+		dl->when = when;
+		deadline_heap[deadline_heap_count] = dl;
+		deadline_sift_up(deadline_heap_count++);
+	}
+	else
+	{
+		oldwhen = dl->when;
+		dl->when = when;
+
+		if (when < oldwhen)
+			deadline_sift_up(dl->slot - 1);
+		else
+			deadline_sift_down(dl->slot - 1);
+	}
+
+	deadline_arm();
+}
+
+/*
+ * deadline_cancel(deadline_t *dl)
+ *
+ * Unschedules a deadline.
+ *
+ * Inputs:
+ *      - deadline to cancel
+ *
+ * Outputs:
+ *      - none
+ *
+ * Side Effects:
+ *      - the deadline will not fire; this is a no-op if it is not pending
+ */
+void deadline_cancel(deadline_t *dl)
+{
+	return_if_fail(dl != NULL);
+
+	if (dl->slot == 0)
+		return;
+
+	deadline_remove(dl);
+}
+
+unsigned int deadline_count(void)
+{
+	return deadline_heap_count;
+}
+
+/* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
+ * vim:ts=8
+ * vim:sw=8
+ * vim:noexpandtab
+ */
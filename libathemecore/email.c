@@ -0,0 +1,538 @@
+/*
+ * atheme-services: A collection of minimalist IRC services
+ * email.c: Email templates and the delivery queue.
+ *
+ * Copyright (c) 2005-2007 Atheme Project (http://www.atheme.org)
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Emails are rendered from cached templates and queued. A single
+ * helper process, forked once, takes them over a socketpair and runs
+ * the MTA for each; the services process itself never forks per email.
+ *
+ * Main process to helper:   "<id> <length>\n" then <length> bytes:
+ *                           MTA path, newline, envelope sender, newline,
+ *                           the message.
+ * Helper to main process:   "<id> <MTA exit status>\n"
+ */
+
+#include "atheme.h"
+#include "datastream.h"
+
+#ifndef MOWGLI_OS_WIN
+
+#define EMAIL_QUEUE_MAX		1000	/* messages waiting for the helper */
+#define EMAIL_INFLIGHT_MAX	16	/* messages given to the helper at once */
+#define EMAIL_HELPER_RESTART	10	/* seconds to wait after the helper died */
+
+typedef struct {
+	mowgli_list_t lines;
+} email_template_t;
+
+typedef struct {
+	mowgli_node_t node;
+	unsigned int id;
+	unsigned int attempts;
+	char *type;
+	char *account;
+	char *email;
+	mowgli_string_t *data;	/* frame body */
+} email_message_t;
+
+static mowgli_patricia_t *email_templates;
+static mowgli_list_t email_queue;
+static mowgli_list_t email_inflight;
+static connection_t *email_helper;
+static unsigned int email_next_id;
+static deadline_t email_restart;
+
+static void email_queue_run(void);
+
+static void email_template_free(const char *key, void *data, void *privdata)
+{
+	email_template_t *t = data;
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, t->lines.head)
+	{
+		free(n->data);
+		mowgli_node_delete(n, &t->lines);
+		mowgli_node_free(n);
+	}
+	free(t);
+}
+
+static email_template_t *email_template_find(const char *type)
+{
+	email_template_t *t;
+	char pathbuf[BUFSIZE], buf[BUFSIZE];
+	FILE *in;
+
+	if ((t = mowgli_patricia_retrieve(email_templates, type)) != NULL)
+		return t;
+
+	snprintf(pathbuf, sizeof pathbuf, "%s/%s", SHAREDIR "/email", type);
+	if ((in = fopen(pathbuf, "r")) == NULL)
+		return NULL;
+
+	t = scalloc(sizeof(email_template_t), 1);
+	while (fgets(buf, BUFSIZE, in))
+	{
+		strip(buf);
+		mowgli_node_add(sstrdup(buf), mowgli_node_create(), &t->lines);
+	}
+	fclose(in);
+
+	mowgli_patricia_add(email_templates, type, t);
+
+	return t;
+}
+
+/* templates may have been edited; reread them on next use */
+static void email_config_ready(void *unused)
+{
+	mowgli_patricia_destroy(email_templates, email_template_free, NULL);
+	email_templates = mowgli_patricia_create(noopcanon);
+}
+
+static void email_message_free(email_message_t *msg)
+{
+	free(msg->type);
+	free(msg->account);
+	free(msg->email);
+	mowgli_string_destroy(msg->data);
+	free(msg);
+}
+
+static void email_message_done(email_message_t *msg, bool delivered)
+{
+	hook_email_status_t hdata;
+
+	if (!delivered)
+		slog(LG_INFO, "email_message_done(): email for %s failed", msg->email);
+
+	hdata.type = msg->type;
+	hdata.account = msg->account;
+	hdata.email = msg->email;
+	hdata.delivered = delivered;
+	hook_call_email_status(&hdata);
+
+	email_message_free(msg);
+}
+
+/* runs in the helper: pipe one message into the MTA and wait for it */
+static int email_helper_deliver(const char *mta, const char *from, const char *text, size_t len)
+{
+	int pipfds[2];
+	pid_t pid;
+	ssize_t l;
+	int status;
+
+	if (pipe(pipfds) < 0)
+		return 255;
+
+	switch (pid = fork())
+	{
+		case -1:
+			close(pipfds[0]);
+			close(pipfds[1]);
+			return 255;
+		case 0:
+			close(pipfds[1]);
+			dup2(pipfds[0], 0);
+			execl(mta, mta, "-t", "-f", from, NULL);
+			_exit(255);
+	}
+
+	close(pipfds[0]);
+	while (len > 0 && (l = write(pipfds[1], text, len)) > 0)
+	{
+		text += l;
+		len -= l;
+	}
+	close(pipfds[1]);
+
+	if (waitpid(pid, &status, 0) == -1)
+		return 255;
+
+	return WIFEXITED(status) ? WEXITSTATUS(status) : 255;
+}
+
+/* the helper's main loop; it exits when services closes its end */
+static void email_helper_run(int fd)
+{
+	FILE *in;
+	char buf[BUFSIZE];
+	char *data, *from, *text;
+	unsigned int id;
+	unsigned long len;
+	int status;
+
+	signal(SIGCHLD, SIG_DFL);
+	signal(SIGPIPE, SIG_IGN);
+
+	if ((in = fdopen(fd, "r")) == NULL)
+		return;
+
+	while (fgets(buf, sizeof buf, in) != NULL)
+	{
+		if (sscanf(buf, "%u %lu", &id, &len) != 2)
+			break;
+
+		data = smalloc(len + 1);
+		if (fread(data, 1, len, in) != len)
+		{
+			free(data);
+			break;
+		}
+		data[len] = '\0';
+
+		status = 255;
+		if ((from = strchr(data, '\n')) != NULL && (text = strchr(from + 1, '\n')) != NULL)
+		{
+			*from++ = '\0';
+			*text++ = '\0';
+			status = email_helper_deliver(data, from, text, data + len - text);
+		}
+		free(data);
+
+		snprintf(buf, sizeof buf, "%u %d\n", id, status);
+		if (write(fd, buf, strlen(buf)) < 0)
+			break;
+	}
+}
+
+static void email_helper_recvq(connection_t *cptr)
+{
+	char buf[BUFSIZE];
+	int count, status;
+	unsigned int id;
+	mowgli_node_t *n;
+	email_message_t *msg;
+
+	count = recvq_getline(cptr, buf, sizeof buf - 1);
+	if (count <= 0)
+		return;
+	buf[count] = '\0';
+
+	if (sscanf(buf, "%u %d", &id, &status) != 2)
+		return;
+
+	/* the helper works in order, so this is almost always the head */
+	MOWGLI_ITER_FOREACH(n, email_inflight.head)
+	{
+		msg = n->data;
+		if (msg->id != id)
+			continue;
+
+		mowgli_node_delete(&msg->node, &email_inflight);
+		email_message_done(msg, status == 0);
+		break;
+	}
+
+	email_queue_run();
+}
+
+static void email_helper_closed(connection_t *cptr)
+{
+	email_message_t *msg;
+
+	slog(LG_ERROR, "email_helper_closed(): lost the email helper, %u emails outstanding",
+			(unsigned int)MOWGLI_LIST_LENGTH(&email_inflight));
+	email_helper = NULL;
+
+	/* put unanswered messages back for the next helper, but only once;
+	 * better a duplicate email than a lost verification code */
+	while (email_inflight.tail != NULL)
+	{
+		msg = email_inflight.tail->data;
+		mowgli_node_delete(&msg->node, &email_inflight);
+		if (msg->attempts > 1)
+			email_message_done(msg, false);
+		else
+			mowgli_node_add_head(msg, &msg->node, &email_queue);
+	}
+
+	if (MOWGLI_LIST_LENGTH(&email_queue) != 0)
+		deadline_set(&email_restart, CURRTIME + EMAIL_HELPER_RESTART);
+}
+
+static void email_helper_waited(pid_t pid, int status, void *data)
+{
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		slog(LG_INFO, "email_helper_waited(): email helper %d exited abnormally", (int)pid);
+}
+
+static bool email_helper_start(void)
+{
+	int sv[2];
+	pid_t pid;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+	{
+		slog(LG_ERROR, "email_helper_start(): socketpair: %s", strerror(errno));
+		return false;
+	}
+
+	switch (pid = fork())
+	{
+		case -1:
+			slog(LG_ERROR, "email_helper_start(): fork: %s", strerror(errno));
+			close(sv[0]);
+			close(sv[1]);
+			return false;
+		case 0:
+			connection_close_all_fds();
+			close(sv[0]);
+			email_helper_run(sv[1]);
+			_exit(0);
+	}
+
+	close(sv[1]);
+	childproc_add(pid, "email helper", email_helper_waited, NULL);
+
+	email_helper = connection_add("email helper", sv[0], 0, recvq_put, NULL);
+	email_helper->recvq_handler = email_helper_recvq;
+	email_helper->close_handler = email_helper_closed;
+
+	slog(LG_DEBUG, "email_helper_start(): started email helper %d", (int)pid);
+
+	return true;
+}
+
+static void email_restart_cb(void *unused)
+{
+	email_queue_run();
+}
+
+/* hand queued messages to the helper, starting it if necessary */
+static void email_queue_run(void)
+{
+	email_message_t *msg;
+	char buf[64];
+
+	if (MOWGLI_LIST_LENGTH(&email_queue) == 0)
+		return;
+
+	if (email_helper == NULL)
+	{
+		if (deadline_pending(&email_restart))
+			return;
+		if (!email_helper_start())
+		{
+			deadline_set(&email_restart, CURRTIME + EMAIL_HELPER_RESTART);
+			return;
+		}
+	}
+
+	while (MOWGLI_LIST_LENGTH(&email_inflight) < EMAIL_INFLIGHT_MAX && email_queue.head != NULL)
+	{
+		msg = email_queue.head->data;
+		mowgli_node_delete(&msg->node, &email_queue);
+		mowgli_node_add(msg, &msg->node, &email_inflight);
+		msg->attempts++;
+
+		snprintf(buf, sizeof buf, "%u %lu\n", msg->id, (unsigned long)msg->data->pos);
+		sendq_add(email_helper, buf, strlen(buf));
+		sendq_add(email_helper, msg->data->str, msg->data->pos);
+	}
+}
+
+void email_init(void)
+{
+	email_templates = mowgli_patricia_create(noopcanon);
+	deadline_init(&email_restart, "email_restart", email_restart_cb, NULL);
+
+	hook_add_event("config_ready");
+	hook_add_config_ready(email_config_ready);
+	hook_add_event("email_status");
+}
+
+unsigned int email_queue_length(void)
+{
+	return MOWGLI_LIST_LENGTH(&email_queue) + MOWGLI_LIST_LENGTH(&email_inflight);
+}
+
+#else
+
+void email_init(void)
+{
+}
+
+unsigned int email_queue_length(void)
+{
+	return 0;
+}
+
+#endif
+
+/* send the specified type of email.
+ *
+ * u is whoever caused this to be called, the corresponding service
+ *   in case of xmlrpc
+ * type is EMAIL_*, see include/tools.h
+ * mu is the recipient user
+ * param depends on type, also see include/tools.h
+ *
+ * The email is queued; whether it was delivered is reported later
+ * through the email_status hook.
+ */
+int sendemail(user_t *u, myuser_t *mu, const char *type, const char *email, const char *param)
+{
+#ifndef MOWGLI_OS_WIN
+	char *date = NULL;
+	char timebuf[BUFSIZE], to[BUFSIZE], from[BUFSIZE], buf[BUFSIZE], sourceinfo[BUFSIZE];
+	const char *nicksvs, *chansvs, *memosvs, *opersvs;
+	email_template_t *t;
+	email_message_t *msg;
+	mowgli_node_t *n;
+	time_t t0;
+	struct tm tm;
+	static time_t period_start = 0, lastwallops = 0;
+	static unsigned int emailcount = 0;
+	service_t *svs;
+
+	if (u == NULL || mu == NULL)
+		return 0;
+
+	if (me.mta == NULL)
+	{
+		if (strcmp(type, EMAIL_MEMO) && !is_internal_client(u))
+		{
+			svs = service_find("operserv");
+			notice(svs ? svs->nick : me.name, u->nick, "Sending email is administratively disabled.");
+		}
+		return 0;
+	}
+
+	if (!validemail(email))
+	{
+		if (strcmp(type, EMAIL_MEMO) && !is_internal_client(u))
+		{
+			svs = service_find("operserv");
+			notice(svs ? svs->nick : me.name, u->nick, "The email address is considered invalid.");
+		}
+		return 0;
+	}
+
+	if ((unsigned int)(CURRTIME - period_start) > me.emailtime)
+	{
+		emailcount = 0;
+		period_start = CURRTIME;
+	}
+	emailcount++;
+	if (emailcount > me.emaillimit || MOWGLI_LIST_LENGTH(&email_queue) >= EMAIL_QUEUE_MAX)
+	{
+		if (CURRTIME - lastwallops > 60)
+		{
+			wallops(_("Rejecting email for %s[%s@%s] due to too high load (type '%s' to %s <%s>)"),
+					u->nick, u->user, u->vhost,
+					type, entity(mu)->name, email);
+			slog(LG_ERROR, "sendemail(): rejecting email for %s[%s@%s] (%s) due to too high load (type '%s' to %s <%s>)",
+					u->nick, u->user, u->vhost,
+					u->ip ? u->ip : u->host,
+					type, entity(mu)->name, email);
+			lastwallops = CURRTIME;
+		}
+		return 0;
+	}
+
+	if ((t = email_template_find(type)) == NULL)
+	{
+		slog(LG_ERROR, "sendemail(): rejecting email for %s[%s@%s] (%s), due to unknown type '%s'",
+			       u->nick, u->user, u->vhost, email, type);
+		return 0;
+	}
+
+	slog(LG_INFO, "sendemail(): email for %s[%s@%s] (%s) type %s to %s <%s>",
+			u->nick, u->user, u->vhost, u->ip ? u->ip : u->host,
+			type, entity(mu)->name, email);
+
+	/* set up the email headers */
+	time(&t0);
+	tm = *localtime(&t0);
+	strftime(timebuf, sizeof timebuf, "%a, %d %b %Y %H:%M:%S %z", &tm);
+
+	date = timebuf;
+
+	snprintf(from, sizeof from, "\"%s\" <%s>",
+			me.netname, me.register_email);
+	snprintf(to, sizeof to, "\"%s\" <%s>", entity(mu)->name, email);
+	/* \ is special here; escape it */
+	replace(to, sizeof to, "\\", "\\\\");
+	snprintf(sourceinfo, sizeof sourceinfo, "%s[%s@%s]", u->nick, u->user, u->vhost);
+
+	nicksvs = (svs = service_find("nickserv")) != NULL ? svs->me->nick : NULL;
+	chansvs = (svs = service_find("chanserv")) != NULL ? svs->me->nick : NULL;
+	memosvs = (svs = service_find("memoserv")) != NULL ? svs->me->nick : NULL;
+	opersvs = (svs = service_find("operserv")) != NULL ? svs->me->nick : NULL;
+
+	msg = scalloc(sizeof(email_message_t), 1);
+	msg->id = ++email_next_id;
+	msg->type = sstrdup(type);
+	msg->account = sstrdup(entity(mu)->name);
+	msg->email = sstrdup(email);
+	msg->data = mowgli_string_create();
+
+	mowgli_string_append(msg->data, me.mta, strlen(me.mta));
+	mowgli_string_append_char(msg->data, '\n');
+	mowgli_string_append(msg->data, me.register_email, strlen(me.register_email));
+	mowgli_string_append_char(msg->data, '\n');
+
+	MOWGLI_ITER_FOREACH(n, t->lines.head)
+	{
+		mowgli_strlcpy(buf, n->data, sizeof buf);
+
+		replace(buf, sizeof buf, "&from&", from);
+		replace(buf, sizeof buf, "&to&", to);
+		replace(buf, sizeof buf, "&replyto&", me.adminemail);
+		replace(buf, sizeof buf, "&date&", date);
+		replace(buf, sizeof buf, "&accountname&", entity(mu)->name);
+		replace(buf, sizeof buf, "&entityname&", u->myuser ? entity(u->myuser)->name : u->nick);
+		replace(buf, sizeof buf, "&netname&", me.netname);
+		replace(buf, sizeof buf, "&param&", param);
+		replace(buf, sizeof buf, "&sourceinfo&", sourceinfo);
+		if (nicksvs != NULL)
+			replace(buf, sizeof buf, "&nicksvs&", nicksvs);
+		if (chansvs != NULL)
+			replace(buf, sizeof buf, "&chansvs&", chansvs);
+		if (memosvs != NULL)
+			replace(buf, sizeof buf, "&memosvs&", memosvs);
+		if (opersvs != NULL)
+			replace(buf, sizeof buf, "&opersvs&", opersvs);
+
+		mowgli_string_append(msg->data, buf, strlen(buf));
+		mowgli_string_append_char(msg->data, '\n');
+	}
+
+	mowgli_node_add(msg, &msg->node, &email_queue);
+	email_queue_run();
+
+	return 1;
+#else
+# warning implement me :(
+	return 0;
+#endif
+}
+
+/* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
+ * vim:ts=8
+ * vim:sw=8
+ * vim:noexpandtab
+ */
@@ -0,0 +1,267 @@
+/*
+ * atheme-services: A collection of minimalist IRC services
+ * hashdict.c: Open addressing hash dictionaries.
+ *
+ * Copyright (c) 2026 Zohlai Development Group
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "atheme.h"
+
+/* Linear probing over one flat slot array. The table is kept at most
+ * three quarters full and deletion shifts later entries back into the
+ * hole, so there are no tombstones and a probe ends at the first empty
+ * slot. These dictionaries are for lookups only; anything that needs
+ * to walk the entries in order keeps using a patricia tree.
+ */
+#define HASHDICT_MINSIZE	16
+
+static inline unsigned int hashdict_finish(unsigned int hash)
+{
+	/* the low bits pick the slot, and FNV leaves them the weakest */
+	hash ^= hash >> 15;
+	hash *= 0x2c1b3c6dU;
+	hash ^= hash >> 12;
+
+	return hash;
+}
+
+unsigned int hashdict_hash_irccase(const char *key)
+{
+	const unsigned char *p = (const unsigned char *)key;
+	unsigned int hash = 2166136261U;
+
+	if (match_mapping == MATCH_ASCII)
+		return hashdict_hash_strcase(key);
+
+	while (*p != '\0')
+	{
+		hash ^= ToUpperTab[*p++];
+		hash *= 16777619U;
+	}
+
+	return hashdict_finish(hash);
+}
+
+unsigned int hashdict_hash_strcase(const char *key)
+{
+	const unsigned char *p = (const unsigned char *)key;
+	unsigned int hash = 2166136261U;
+
+	while (*p != '\0')
+	{
+		hash ^= (unsigned char)toupper(*p++);
+		hash *= 16777619U;
+	}
+
+	return hashdict_finish(hash);
+}
+
+unsigned int hashdict_hash_exact(const char *key)
+{
+	const unsigned char *p = (const unsigned char *)key;
+	unsigned int hash = 2166136261U;
+
+	while (*p != '\0')
+	{
+		hash ^= *p++;
+		hash *= 16777619U;
+	}
+
+	return hashdict_finish(hash);
+}
+
+static void hashdict_place(hashdict_slot_t *slots, unsigned int mask, const hashdict_slot_t *slot)
+{
+	unsigned int i;
+
+	for (i = slot->hash & mask; slots[i].data != NULL; i = (i + 1) & mask)
+		;
+
+	slots[i] = *slot;
+}
+
+static void hashdict_resize(hashdict_t *hd, unsigned int size)
+{
+	hashdict_slot_t *old = hd->slots;
+	unsigned int i, oldsize = hd->mask + 1;
+
+	hd->slots = scalloc(size, sizeof(hashdict_slot_t));
+	hd->mask = size - 1;
+
+	for (i = 0; i < oldsize; i++)
+		if (old[i].data != NULL)
+			hashdict_place(hd->slots, hd->mask, &old[i]);
+
+	free(old);
+}
+
+static hashdict_slot_t *hashdict_find(const hashdict_t *hd, const char *key, unsigned int hash)
+{
+	unsigned int i;
+
+	for (i = hash & hd->mask; hd->slots[i].data != NULL; i = (i + 1) & hd->mask)
+		if (hd->slots[i].hash == hash && !hd->compare(hd->slots[i].key, key))
+			return &hd->slots[i];
+
+	return NULL;
+}
+
+/*
+ * hashdict_create()
+ *
+ * Inputs:
+ *       a hash function, and a comparison function it agrees with
+ *
+ * Outputs:
+ *       an empty dictionary
+ *
+ * Side Effects:
+ *       none
+ */
+hashdict_t *hashdict_create(hashdict_hash_fn_t hash, hashdict_compare_fn_t compare)
+{
+	hashdict_t *hd;
+
+	return_val_if_fail(hash != NULL, NULL);
+	return_val_if_fail(compare != NULL, NULL);
+
+	hd = smalloc(sizeof(hashdict_t));
+	hd->hash = hash;
+	hd->compare = compare;
+	hd->count = 0;
+	hd->mask = HASHDICT_MINSIZE - 1;
+	hd->slots = scalloc(HASHDICT_MINSIZE, sizeof(hashdict_slot_t));
+
+	return hd;
+}
+
+void hashdict_destroy(hashdict_t *hd)
+{
+	return_if_fail(hd != NULL);
+
+	free(hd->slots);
+	free(hd);
+}
+
+/*
+ * hashdict_add()
+ *
+ * Inputs:
+ *       a dictionary, a key and the data stored under it
+ *
+ * Outputs:
+ *       false if the key was already present, true otherwise
+ *
+ * Side Effects:
+ *       - the dictionary doubles in size once it is three quarters full
+ */
+bool hashdict_add(hashdict_t *hd, const char *key, void *data)
+{
+	hashdict_slot_t slot;
+
+	return_val_if_fail(hd != NULL, false);
+	return_val_if_fail(key != NULL, false);
+	return_val_if_fail(data != NULL, false);
+
+	slot.hash = hd->hash(key);
+	slot.key = key;
+	slot.data = data;
+
+	if (hashdict_find(hd, key, slot.hash) != NULL)
+		return false;
+
+	if ((hd->count + 1) * 4 > (hd->mask + 1) * 3)
+		hashdict_resize(hd, (hd->mask + 1) * 2);
+
+	hashdict_place(hd->slots, hd->mask, &slot);
+	hd->count++;
+
+	return true;
+}
+
+void *hashdict_retrieve(const hashdict_t *hd, const char *key)
+{
+	hashdict_slot_t *slot;
+
+	return_val_if_fail(hd != NULL, NULL);
+	return_val_if_fail(key != NULL, NULL);
+
+	slot = hashdict_find(hd, key, hd->hash(key));
+
+	return slot != NULL ? slot->data : NULL;
+}
+
+/*
+ * hashdict_delete()
+ *
+ * Inputs:
+ *       a dictionary and a key
+ *
+ * Outputs:
+ *       the data that was stored under the key, or NULL
+ *
+ * Side Effects:
+ *       - the dictionary halves in size once it is an eighth full
+ */
+void *hashdict_delete(hashdict_t *hd, const char *key)
+{
+	hashdict_slot_t *slot;
+	unsigned int i, j, k;
+	void *data;
+
+	return_val_if_fail(hd != NULL, NULL);
+	return_val_if_fail(key != NULL, NULL);
+
+	slot = hashdict_find(hd, key, hd->hash(key));
+	if (slot == NULL)
+		return NULL;
+
+	data = slot->data;
+
+	/* pull back every later entry of the run that may sit in the hole,
+	 * that is whose home slot is not between the hole and itself */
+	for (i = j = slot - hd->slots;;)
+	{
+		j = (j + 1) & hd->mask;
+		if (hd->slots[j].data == NULL)
+			break;
+
+		k = hd->slots[j].hash & hd->mask;
+		if (i < j ? (k <= i || k > j) : (k <= i && k > j))
+		{
+			hd->slots[i] = hd->slots[j];
+			i = j;
+		}
+	}
+
+	hd->slots[i].key = NULL;
+	hd->slots[i].data = NULL;
+	hd->count--;
+
+	if (hd->mask + 1 > HASHDICT_MINSIZE && hd->count * 8 < hd->mask + 1)
+		hashdict_resize(hd, (hd->mask + 1) / 2);
+
+	return data;
+}
+
+/* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
+ * vim:ts=8
+ * vim:sw=8
+ * vim:noexpandtab
+ */
@@ -68,15 +68,55 @@ static command_t *help_cmd_find(sourceinfo_t *si, const char *subcmd_of, const c
 	return NULL;
 }
 
-static bool evaluate_condition(sourceinfo_t *si, const char *s)
+/* help files are parsed once and kept until the next rehash */
+typedef enum {
+	HELP_TEXT,
+	HELP_IF,
+	HELP_ELSE,
+	HELP_ENDIF
+} help_line_type_t;
+
+typedef enum {
+	COND_FALSE,
+	COND_HALFOPS,
+	COND_OWNER,
+	COND_PROTECT,
+	COND_ANYPRIVS,
+	COND_PRIV,
+	COND_MODULE,
+	COND_AUTH
+} help_cond_type_t;
+
+typedef struct {
+	help_line_type_t type;
+	help_cond_type_t cond;
+	bool negate;
+	bool has_nick;		/* text contains &nick& */
+	char *text;		/* text, or the argument of a condition */
+} help_line_t;
+
+typedef struct {
+	help_line_t *lines;	/* NULL if the file does not exist */
+	size_t count;
+} help_file_t;
+
+static mowgli_patricia_t *help_files;
+
+static void compile_condition(help_line_t *line, const char *s)
 {
 	char word[80];
 	char *p, *q;
 
-	while (*s == ' ' || *s == '\t')
+	line->negate = false;
+	for (;;)
+	{
+		while (*s == ' ' || *s == '\t')
+			s++;
+		if (*s != '!')
+			break;
+		line->negate = !line->negate;
 		s++;
-	if (*s == '!')
-		return !evaluate_condition(si, s + 1);
+	}
 	mowgli_strlcpy(word, s, sizeof word);
 	p = strchr(word, ' ');
 	if (p != NULL)
@@ -84,40 +124,154 @@ static bool evaluate_condition(sourceinfo_t *si, const char *s)
 		*p++ = '\0';
 		while (*p == ' ' || *p == '\t')
 			p++;
+		if ((q = strchr(p, ' ')) != NULL)
+			*q = '\0';
 	}
 	if (!strcmp(word, "halfops"))
-		return ircd->uses_halfops;
+		line->cond = COND_HALFOPS;
 	else if (!strcmp(word, "owner"))
-		return ircd->uses_owner;
+		line->cond = COND_OWNER;
 	else if (!strcmp(word, "protect"))
-		return ircd->uses_protect;
+		line->cond = COND_PROTECT;
 	else if (!strcmp(word, "anyprivs"))
-		return has_any_privs(si);
+		line->cond = COND_ANYPRIVS;
 	else if (!strcmp(word, "priv"))
+		line->cond = COND_PRIV;
+	else if (!strcmp(word, "module"))
+		line->cond = COND_MODULE;
+	else if (!strcmp(word, "auth"))
+		line->cond = COND_AUTH;
+	else
+		line->cond = COND_FALSE;
+	line->text = (line->cond == COND_PRIV || line->cond == COND_MODULE) && p != NULL ? sstrdup(p) : NULL;
+}
+
+static bool evaluate_condition(sourceinfo_t *si, const help_line_t *line)
+{
+	bool result;
+
+	switch (line->cond)
 	{
-		if (p != NULL && (q = strchr(p, ' ')) != NULL)
-			*q = '\0';
-		return has_priv(si, p);
+		case COND_HALFOPS:
+			result = ircd->uses_halfops;
+			break;
+		case COND_OWNER:
+			result = ircd->uses_owner;
+			break;
+		case COND_PROTECT:
+			result = ircd->uses_protect;
+			break;
+		case COND_ANYPRIVS:
+			result = has_any_privs(si);
+			break;
+		case COND_PRIV:
+			result = has_priv(si, line->text);
+			break;
+		case COND_MODULE:
+			result = line->text != NULL && module_find_published(line->text) != NULL;
+			break;
+		case COND_AUTH:
+			result = me.auth != AUTH_NONE;
+			break;
+		default:
+			result = false;
+			break;
 	}
-	else if (!strcmp(word, "module"))
+
+	return line->negate ? !result : result;
+}
+
+static help_file_t *help_file_load(const char *path)
+{
+	help_file_t *hf;
+	help_line_t *line;
+	FILE *in;
+	char buf[BUFSIZE];
+	size_t alloc = 0;
+
+	hf = scalloc(sizeof(help_file_t), 1);
+	if ((in = fopen(path, "r")) == NULL)
+		return hf;
+
+	hf->lines = smalloc(sizeof(help_line_t) * (alloc = 16));
+	while (fgets(buf, BUFSIZE, in))
 	{
-		if (p != NULL && (q = strchr(p, ' ')) != NULL)
-			*q = '\0';
-		return module_find_published(p) != NULL;
+		strip(buf);
+
+		if (hf->count == alloc)
+			hf->lines = srealloc(hf->lines, sizeof(help_line_t) * (alloc *= 2));
+		line = &hf->lines[hf->count++];
+		memset(line, 0, sizeof *line);
+
+		if (!strncmp(buf, "#if", 3))
+		{
+			line->type = HELP_IF;
+			compile_condition(line, buf + 3);
+		}
+		else if (!strncmp(buf, "#endif", 6))
+			line->type = HELP_ENDIF;
+		else if (!strncmp(buf, "#else", 5))
+			line->type = HELP_ELSE;
+		else
+		{
+			line->type = HELP_TEXT;
+			line->text = sstrdup(buf);
+			line->has_nick = strstr(buf, "&nick&") != NULL;
+		}
 	}
-	else if (!strcmp(word, "auth"))
-		return me.auth != AUTH_NONE;
-	else
-		return false;
+	fclose(in);
+
+	return hf;
+}
+
+static void help_file_free(const char *key, void *data, void *privdata)
+{
+	help_file_t *hf = data;
+	size_t i;
+
+	for (i = 0; i < hf->count; i++)
+		free(hf->lines[i].text);
+	free(hf->lines);
+	free(hf);
+}
+
+/* returns the parsed file, or NULL if it does not exist */
+static help_file_t *help_file_find(const char *path)
+{
+	help_file_t *hf;
+
+	if ((hf = mowgli_patricia_retrieve(help_files, path)) == NULL)
+	{
+		hf = help_file_load(path);
+		mowgli_patricia_add(help_files, path, hf);
+	}
+
+	return hf->lines != NULL ? hf : NULL;
+}
+
+static void help_config_ready(void *unused)
+{
+	mowgli_patricia_destroy(help_files, help_file_free, NULL);
+	help_files = mowgli_patricia_create(noopcanon);
+}
+
+void help_init(void)
+{
+	help_files = mowgli_patricia_create(noopcanon);
+
+	hook_add_event("config_ready");
+	hook_add_config_ready(help_config_ready);
 }
 
 void help_display_as_subcmd(sourceinfo_t *si, service_t *service, const char *subcmd_of, const char *command, mowgli_patricia_t *list)
 {
 	command_t *c;
-	FILE *help_file = NULL;
+	help_file_t *hf = NULL;
+	help_line_t *line;
 	char subname[BUFSIZE], buf[BUFSIZE];
 	const char *langname = NULL;
 	int ifnest, ifnest_false;
+	size_t i;
 
 
 	char *ccommand = sstrdup(command);
@@ -130,7 +284,7 @@ void help_display_as_subcmd(sourceinfo_t *si, service_t *service, const char *su
 		if (c->help.path)
 		{
 			if (*c->help.path == '/')
-				help_file = fopen(c->help.path, "r");
+				hf = help_file_find(c->help.path);
 			else
 			{
 				mowgli_strlcpy(subname, c->help.path, sizeof subname);
@@ -145,16 +299,16 @@ void help_display_as_subcmd(sourceinfo_t *si, service_t *service, const char *su
 				if (langname != NULL)
 				{
 					snprintf(buf, sizeof buf, "%s/%s/%s", SHAREDIR "/help", langname, subname);
-					help_file = fopen(buf, "r");
+					hf = help_file_find(buf);
 				}
-				if (help_file == NULL)
+				if (hf == NULL)
 				{
 					snprintf(buf, sizeof buf, "%s/%s", SHAREDIR "/help", subname);
-					help_file = fopen(buf, "r");
+					hf = help_file_find(buf);
 				}
 			}
 
-			if (!help_file)
+			if (hf == NULL)
 			{
 				command_fail(si, fault_nosuch_target, _("Could not get help file for \2%s\2."), command);
 				free(ccommand);
@@ -164,19 +318,18 @@ void help_display_as_subcmd(sourceinfo_t *si, service_t *service, const char *su
 			command_success_nodata(si, _("***** \2%s Help\2 *****"), service->nick);
 
 			ifnest = ifnest_false = 0;
-			while (fgets(buf, BUFSIZE, help_file))
+			for (i = 0; i < hf->count; i++)
 			{
-				strip(buf);
+				line = &hf->lines[i];
 
-				replace(buf, sizeof(buf), "&nick&", service->disp);
-				if (!strncmp(buf, "#if", 3))
+				if (line->type == HELP_IF)
 				{
-					if (ifnest_false > 0 || !evaluate_condition(si, buf + 3))
+					if (ifnest_false > 0 || !evaluate_condition(si, line))
 						ifnest_false++;
 					ifnest++;
 					continue;
 				}
-				else if (!strncmp(buf, "#endif", 6))
+				else if (line->type == HELP_ENDIF)
 				{
 					if (ifnest_false > 0)
 						ifnest_false--;
@@ -184,7 +337,7 @@ void help_display_as_subcmd(sourceinfo_t *si, service_t *service, const char *su
 						ifnest--;
 					continue;
 				}
-				else if (!strncmp(buf, "#else", 5))
+				else if (line->type == HELP_ELSE)
 				{
 					if (ifnest > 0 && ifnest_false <= 1)
 						ifnest_false ^= 1;
@@ -193,14 +346,18 @@ void help_display_as_subcmd(sourceinfo_t *si, service_t *service, const char *su
 				if (ifnest_false > 0)
 					continue;
 
-				if (buf[0])
+				if (line->has_nick)
+				{
+					mowgli_strlcpy(buf, line->text, sizeof buf);
+					replace(buf, sizeof(buf), "&nick&", service->disp);
 					command_success_nodata(si, "%s", buf);
+				}
+				else if (line->text[0])
+					command_success_nodata(si, "%s", line->text);
 				else
 					command_success_nodata(si, " ");
 			}
 
-			fclose(help_file);
-
 			command_success_nodata(si, _("***** \2End of Help\2 *****"));
 		}
 		else if (c->help.func)
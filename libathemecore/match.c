@@ -211,6 +211,301 @@ int match(const char *mask, const char *name)
 }
 
 
+/*
+ * Compiled masks.
+ *
+ * Most stored masks only use '*' and '?'. Those are split once into the
+ * literal runs between the stars, casefolded, so matching is a length
+ * check, the prefix and suffix compared in place, and a forward search
+ * for each run in between. The first literal of a run is looked for
+ * with memchr() where only one byte folds to it. Masks using escapes or
+ * the &, # and % classes are kept as they are and go through match().
+ */
+typedef struct {
+	size_t off;		/* into match_pattern_t.folded */
+	size_t len;
+	size_t lit;		/* first character that is not '?' */
+	int scan;		/* the only byte folding to that, or -1 */
+} match_segment_t;
+
+struct match_pattern_ {
+	char *mask;
+	char *folded;		/* mask casefolded, split at '*' */
+	int mapping;		/* match_mapping it was folded for */
+	bool simple;		/* only '*', '?' and literals */
+	bool star;
+	size_t minlen;
+	match_segment_t *segs;	/* with star: prefix, runs, suffix */
+	unsigned int nsegs;
+};
+
+static const unsigned char *match_fold_table(int mapping)
+{
+	static unsigned char asciitab[256];
+	static bool ascii_init = false;
+	int i;
+
+	if (mapping != MATCH_ASCII)
+		return ToLowerTab;
+
+	if (!ascii_init)
+	{
+		for (i = 0; i < 256; i++)
+			asciitab[i] = tolower(i);
+		ascii_init = true;
+	}
+
+	return asciitab;
+}
+
+static void match_segment_init(match_pattern_t *pat, match_segment_t *seg, size_t off, size_t len, const unsigned char *fold)
+{
+	const unsigned char *p = (const unsigned char *)pat->folded + off;
+	int i, found = 0;
+
+	seg->off = off;
+	seg->len = len;
+	seg->scan = -1;
+
+	for (seg->lit = 0; seg->lit < len && p[seg->lit] == '?'; seg->lit++)
+		;
+
+	if (seg->lit == len)
+		return;
+
+	for (i = 1; i < 256; i++)
+	{
+		if (fold[i] == p[seg->lit])
+		{
+			seg->scan = i;
+			found++;
+		}
+	}
+
+	if (found != 1)
+		seg->scan = -1;
+}
+
+/* what match() treats specially besides * and ? */
+#define MATCH_SPECIALS "\\&#%"
+
+/*
+ * match_has_wildcards()
+ *
+ * Inputs:
+ *       a mask as understood by match()
+ *
+ * Outputs:
+ *       false if the mask can only match a string equal to it, ignoring
+ *       case, true otherwise
+ *
+ * Side Effects:
+ *       none
+ */
+bool match_has_wildcards(const char *mask)
+{
+	return_val_if_fail(mask != NULL, false);
+
+	return strpbrk(mask, "*?" MATCH_SPECIALS) != NULL;
+}
+
+/*
+ * match_pattern_create()
+ *
+ * Inputs:
+ *       a mask as understood by match()
+ *
+ * Outputs:
+ *       a compiled mask, to be freed with match_pattern_destroy()
+ *
+ * Side Effects:
+ *       none
+ */
+match_pattern_t *match_pattern_create(const char *mask)
+{
+	match_pattern_t *pat;
+	const unsigned char *fold;
+	const char *m;
+	char *f;
+	size_t start, len;
+	unsigned int nsegs;
+
+	return_val_if_fail(mask != NULL, NULL);
+
+	pat = smalloc(sizeof(match_pattern_t));
+	memset(pat, 0, sizeof(match_pattern_t));
+
+	pat->mask = sstrdup(mask);
+	pat->mapping = match_mapping;
+	pat->simple = strpbrk(mask, MATCH_SPECIALS) == NULL;
+
+	if (!pat->simple)
+		return pat;
+
+	fold = match_fold_table(pat->mapping);
+	pat->folded = smalloc(strlen(mask) + 1);
+
+	nsegs = 1;
+	for (m = mask; *m != '\0'; m++)
+		if (*m == '*')
+			nsegs++;
+
+	pat->segs = smalloc(nsegs * sizeof(match_segment_t));
+
+	for (f = pat->folded, m = mask, start = 0;; m++)
+	{
+		if (*m != '*' && *m != '\0')
+		{
+			*f++ = *m == '?' ? '?' : fold[(unsigned char)*m];
+			continue;
+		}
+
+		len = (f - pat->folded) - start;
+
+		/* runs between stars that are empty are of no use; the
+		 * prefix and suffix keep their places even when empty */
+		if (len != 0 || pat->nsegs == 0 || *m == '\0')
+		{
+			match_segment_init(pat, &pat->segs[pat->nsegs++], start, len, fold);
+			pat->minlen += len;
+		}
+
+		if (*m == '\0')
+			break;
+
+		pat->star = true;
+		start = f - pat->folded;
+	}
+
+	*f = '\0';
+
+	return pat;
+}
+
+void match_pattern_destroy(match_pattern_t *pat)
+{
+	if (pat == NULL)
+		return;
+
+	free(pat->segs);
+	free(pat->folded);
+	free(pat->mask);
+	free(pat);
+}
+
+static inline bool match_segment_at(const match_pattern_t *pat, const match_segment_t *seg, const unsigned char *s, const unsigned char *fold)
+{
+	const unsigned char *p = (const unsigned char *)pat->folded + seg->off;
+	size_t i;
+
+	for (i = 0; i < seg->len; i++)
+		if (p[i] != '?' && p[i] != fold[s[i]])
+			return false;
+
+	return true;
+}
+
+/* the first place at or after s, and no later than last, the run matches */
+static const unsigned char *match_segment_find(const match_pattern_t *pat, const match_segment_t *seg, const unsigned char *s, const unsigned char *last, const unsigned char *fold)
+{
+	const unsigned char *p = (const unsigned char *)pat->folded + seg->off;
+	const unsigned char *c, *end;
+
+	if (seg->lit == seg->len)
+		return s <= last ? s : NULL;
+
+	end = last + seg->lit + 1;
+
+	while (s <= last)
+	{
+		c = s + seg->lit;
+
+		if (seg->scan != -1)
+			c = memchr(c, seg->scan, end - c);
+		else
+		{
+			while (c < end && fold[*c] != p[seg->lit])
+				c++;
+			if (c == end)
+				c = NULL;
+		}
+
+		if (c == NULL)
+			return NULL;
+
+		s = c - seg->lit;
+		if (match_segment_at(pat, seg, s, fold))
+			return s;
+		s++;
+	}
+
+	return NULL;
+}
+
+/*
+ * match_compiled()
+ *
+ * Inputs:
+ *       a compiled mask, and a string to match against it
+ *
+ * Outputs:
+ *       0 if the string matches, 1 otherwise, like match()
+ *
+ * Side Effects:
+ *       none
+ */
+int match_compiled(const match_pattern_t *pat, const char *name)
+{
+	const unsigned char *fold, *s, *end;
+	const match_segment_t *seg;
+	size_t len;
+	unsigned int i;
+
+	if (pat == NULL || name == NULL)
+		return 1;
+
+	/* the casemapping is only set once the protocol module is loaded */
+	if (!pat->simple || pat->mapping != match_mapping)
+		return match(pat->mask, name);
+
+	len = strlen(name);
+	if (len < pat->minlen)
+		return 1;
+
+	fold = match_fold_table(pat->mapping);
+	s = (const unsigned char *)name;
+
+	if (!pat->star)
+		return len == pat->minlen && match_segment_at(pat, &pat->segs[0], s, fold) ? 0 : 1;
+
+	if (!match_segment_at(pat, &pat->segs[0], s, fold))
+		return 1;
+
+	seg = &pat->segs[pat->nsegs - 1];
+	end = s + len - seg->len;
+	if (!match_segment_at(pat, seg, end, fold))
+		return 1;
+
+	s += pat->segs[0].len;
+
+	for (i = 1; i + 1 < pat->nsegs; i++)
+	{
+		seg = &pat->segs[i];
+
+		if ((size_t)(end - s) < seg->len)
+			return 1;
+
+		s = match_segment_find(pat, seg, s, end - seg->len, fold);
+		if (s == NULL)
+			return 1;
+
+		s += seg->len;
+	}
+
+	return 0;
+}
+
+
 /*
 ** collapse a pattern string into minimal components.
 ** This particular version is "in place", so that it changes the pattern
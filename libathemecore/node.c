@@ -119,6 +119,23 @@ void remove_illegals()
  * K L I N E *
  *************/
 
+static void kline_expire(void *arg)
+{
+	kline_t *k = arg;
+	char *reason;
+
+	/* TODO: determine validity of k->reason */
+	reason = k->reason ? k->reason : "(none)";
+
+	slog(LG_INFO, _("KLINE:EXPIRE: \2%s@%s\2 set \2%s\2 ago by \2%s\2 (reason: %s)"),
+		k->user, k->host, time_ago(k->settime), k->setby, reason);
+
+	verbose_wallops(_("AKILL expired on \2%s@%s\2, set by \2%s\2 (reason: %s)"),
+		k->user, k->host, k->setby, reason);
+
+	kline_delete(k);
+}
+
 kline_t *kline_add_with_id(const char *user, const char *host, const char *reason, long duration, const char *setby, unsigned long id)
 {
 	kline_t *k;
@@ -132,6 +149,8 @@ kline_t *kline_add_with_id(const char *user, const char *host, const char *reaso
 
 	k->user = sstrdup(user);
 	k->host = sstrdup(host);
+	k->user_pat = match_pattern_create(user);
+	k->host_pat = match_pattern_create(host);
 	k->reason = sstrdup(reason);
 	k->setby = sstrdup(setby);
 	k->duration = duration;
@@ -139,6 +158,10 @@ kline_t *kline_add_with_id(const char *user, const char *host, const char *reaso
 	k->expires = CURRTIME + duration;
 	k->number = id;
 
+	deadline_init(&k->expiry, "kline_expire", kline_expire, k);
+	if (duration != 0)
+		deadline_set(&k->expiry, k->expires);
+
 	cnt.kline++;
 
 
@@ -151,6 +174,18 @@ kline_t *kline_add_with_id(const char *user, const char *host, const char *reaso
 	return k;
 }
 
+/* backdates a kline loaded from the database; it expires accordingly */
+void kline_set_settime(kline_t *k, time_t settime)
+{
+	return_if_fail(k != NULL);
+
+	k->settime = settime;
+	k->expires = settime + k->duration;
+
+	if (k->duration != 0)
+		deadline_set(&k->expiry, k->expires);
+}
+
 kline_t *kline_add(const char *user, const char *host, const char *reason, long duration, const char *setby)
 {
 	return kline_add_with_id(user, host, reason, duration, setby, ++me.kline_id);
@@ -176,10 +211,14 @@ void kline_delete(kline_t *k)
 	if (me.connected && (k->duration == 0 || k->expires > CURRTIME))
 		unkline_sts("*", k->user, k->host);
 
+	deadline_cancel(&k->expiry);
+
 	n = mowgli_node_find(k, &klnlist);
 	mowgli_node_delete(n, &klnlist);
 	mowgli_node_free(n);
 
+	match_pattern_destroy(k->user_pat);
+	match_pattern_destroy(k->host_pat);
 	free(k->user);
 	free(k->host);
 	free(k->reason);
@@ -199,7 +238,7 @@ kline_t *kline_find(const char *user, const char *host)
 	{
 		k = (kline_t *)n->data;
 
-		if ((!match(k->user, user)) && (!match(k->host, host)))
+		if ((!match_compiled(k->user_pat, user)) && (!match_compiled(k->host_pat, host)))
 			return k;
 	}
 
@@ -233,45 +272,55 @@ kline_t *kline_find_user(user_t *u)
 
 		if (k->duration != 0 && k->expires <= CURRTIME)
 			continue;
-		if (!match(k->user, u->user) && (!match(k->host, u->host) || !match(k->host, u->ip) || !match_ips(k->host, u->ip)))
+		if (!match_compiled(k->user_pat, u->user) && (!match_compiled(k->host_pat, u->host) || !match_compiled(k->host_pat, u->ip) || !match_ips(k->host, u->ip)))
 			return k;
 	}
 
 	return NULL;
 }
 
-void kline_expire(void *arg)
+/*************
+ * X L I N E *
+ *************/
+
+static void xline_destroy(xline_t *x)
 {
-	kline_t *k;
-	char *reason;
-	mowgli_node_t *n, *tn;
+	mowgli_node_t *n;
 
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, klnlist.head)
-	{
-		k = (kline_t *)n->data;
+	slog(LG_DEBUG, "xline_delete(): %s -> %s", x->realname, x->reason);
 
-		if (k->duration == 0)
-			continue;
+	/* only unxline if ircd has not already removed this -- jilles */
+	if (me.connected && (x->duration == 0 || x->expires > CURRTIME))
+		unxline_sts("*", x->realname);
 
-		if (k->expires <= CURRTIME)
-		{
-			/* TODO: determine validity of k->reason */
-			reason = k->reason ? k->reason : "(none)";
+	deadline_cancel(&x->expiry);
+
+	n = mowgli_node_find(x, &xlnlist);
+	mowgli_node_delete(n, &xlnlist);
+	mowgli_node_free(n);
 
-			slog(LG_INFO, _("KLINE:EXPIRE: \2%s@%s\2 set \2%s\2 ago by \2%s\2 (reason: %s)"),
-				k->user, k->host, time_ago(k->settime), k->setby, reason);
+	match_pattern_destroy(x->realname_pat);
+	free(x->realname);
+	free(x->reason);
+	free(x->setby);
 
-			verbose_wallops(_("AKILL expired on \2%s@%s\2, set by \2%s\2 (reason: %s)"),
-				k->user, k->host, k->setby, reason);
+	mowgli_heap_free(xline_heap, x);
 
-			kline_delete(k);
-		}
-	}
+	cnt.xline--;
 }
 
-/*************
- * X L I N E *
- *************/
+static void xline_expire(void *arg)
+{
+	xline_t *x = arg;
+
+	slog(LG_INFO, _("XLINE:EXPIRE: \2%s\2 set \2%s\2 ago by \2%s\2"),
+		x->realname, time_ago(x->settime), x->setby);
+
+	verbose_wallops(_("XLINE expired on \2%s\2, set by \2%s\2"),
+		x->realname, x->setby);
+
+	xline_destroy(x);
+}
 
 xline_t *xline_add(const char *realname, const char *reason, long duration, const char *setby)
 {
@@ -286,6 +335,7 @@ xline_t *xline_add(const char *realname, const char *reason, long duration, cons
 	mowgli_node_add(x, n, &xlnlist);
 
 	x->realname = sstrdup(realname);
+	x->realname_pat = match_pattern_create(realname);
 	x->reason = sstrdup(reason);
 	x->setby = sstrdup(setby);
 	x->duration = duration;
@@ -293,6 +343,10 @@ xline_t *xline_add(const char *realname, const char *reason, long duration, cons
 	x->expires = CURRTIME + duration;
 	x->number = ++xcnt;
 
+	deadline_init(&x->expiry, "xline_expire", xline_expire, x);
+	if (duration != 0)
+		deadline_set(&x->expiry, x->expires);
+
 	cnt.xline++;
 
 	if (me.connected)
@@ -304,7 +358,6 @@ xline_t *xline_add(const char *realname, const char *reason, long duration, cons
 void xline_delete(const char *realname)
 {
 	xline_t *x = xline_find(realname);
-	mowgli_node_t *n;
 
 	if (!x)
 	{
@@ -312,23 +365,19 @@ void xline_delete(const char *realname)
 		return;
 	}
 
-	slog(LG_DEBUG, "xline_delete(): %s -> %s", x->realname, x->reason);
-
-	/* only unxline if ircd has not already removed this -- jilles */
-	if (me.connected && (x->duration == 0 || x->expires > CURRTIME))
-		unxline_sts("*", x->realname);
-
-	n = mowgli_node_find(x, &xlnlist);
-	mowgli_node_delete(n, &xlnlist);
-	mowgli_node_free(n);
+	xline_destroy(x);
+}
 
-	free(x->realname);
-	free(x->reason);
-	free(x->setby);
+/* backdates an xline loaded from the database; it expires accordingly */
+void xline_set_settime(xline_t *x, time_t settime)
+{
+	return_if_fail(x != NULL);
 
-	mowgli_heap_free(xline_heap, x);
+	x->settime = settime;
+	x->expires = settime + x->duration;
 
-	cnt.xline--;
+	if (x->duration != 0)
+		deadline_set(&x->expiry, x->expires);
 }
 
 xline_t *xline_find(const char *realname)
@@ -340,7 +389,7 @@ xline_t *xline_find(const char *realname)
 	{
 		x = (xline_t *)n->data;
 
-		if (!match(x->realname, realname))
+		if (!match_compiled(x->realname_pat, realname))
 			return x;
 	}
 
@@ -375,41 +424,55 @@ xline_t *xline_find_user(user_t *u)
 		if (x->duration != 0 && x->expires <= CURRTIME)
 			continue;
 
-		if (!match(x->realname, u->gecos))
+		if (!match_compiled(x->realname_pat, u->gecos))
 			return x;
 	}
 
 	return NULL;
 }
 
-void xline_expire(void *arg)
+/*************
+ * Q L I N E *
+ *************/
+
+static void qline_destroy(qline_t *q)
 {
-	xline_t *x;
-	mowgli_node_t *n, *tn;
+	mowgli_node_t *n;
 
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, xlnlist.head)
-	{
-		x = (xline_t *)n->data;
+	slog(LG_DEBUG, "qline_delete(): %s -> %s", q->mask, q->reason);
 
-		if (x->duration == 0)
-			continue;
+	/* only unqline if ircd has not already removed this -- jilles */
+	if (me.connected && (q->duration == 0 || q->expires > CURRTIME))
+		unqline_sts("*", q->mask);
 
-		if (x->expires <= CURRTIME)
-		{
-			slog(LG_INFO, _("XLINE:EXPIRE: \2%s\2 set \2%s\2 ago by \2%s\2"),
-				x->realname, time_ago(x->settime), x->setby);
+	deadline_cancel(&q->expiry);
 
-			verbose_wallops(_("XLINE expired on \2%s\2, set by \2%s\2"),
-				x->realname, x->setby);
+	n = mowgli_node_find(q, &qlnlist);
+	mowgli_node_delete(n, &qlnlist);
+	mowgli_node_free(n);
 
-			xline_delete(x->realname);
-		}
-	}
+	match_pattern_destroy(q->mask_pat);
+	free(q->mask);
+	free(q->reason);
+	free(q->setby);
+
+	mowgli_heap_free(qline_heap, q);
+
+	cnt.qline--;
 }
 
-/*************
- * Q L I N E *
- *************/
+static void qline_expire(void *arg)
+{
+	qline_t *q = arg;
+
+	slog(LG_INFO, _("QLINE:EXPIRE: \2%s\2 set \2%s\2 ago by \2%s\2"),
+		q->mask, time_ago(q->settime), q->setby);
+
+	verbose_wallops(_("QLINE expired on \2%s\2, set by \2%s\2"),
+		q->mask, q->setby);
+
+	qline_destroy(q);
+}
 
 qline_t *qline_add(const char *mask, const char *reason, long duration, const char *setby)
 {
@@ -423,6 +486,7 @@ qline_t *qline_add(const char *mask, const char *reason, long duration, const ch
 	mowgli_node_add(q, n, &qlnlist);
 
 	q->mask = sstrdup(mask);
+	q->mask_pat = match_pattern_create(mask);
 	q->reason = sstrdup(reason);
 	q->setby = sstrdup(setby);
 	q->duration = duration;
@@ -430,6 +494,10 @@ qline_t *qline_add(const char *mask, const char *reason, long duration, const ch
 	q->expires = CURRTIME + duration;
 	q->number = ++qcnt;
 
+	deadline_init(&q->expiry, "qline_expire", qline_expire, q);
+	if (duration != 0)
+		deadline_set(&q->expiry, q->expires);
+
 	cnt.qline++;
 
 	if (me.connected)
@@ -441,7 +509,6 @@ qline_t *qline_add(const char *mask, const char *reason, long duration, const ch
 void qline_delete(const char *mask)
 {
 	qline_t *q = qline_find(mask);
-	mowgli_node_t *n;
 
 	if (!q)
 	{
@@ -449,23 +516,19 @@ void qline_delete(const char *mask)
 		return;
 	}
 
-	slog(LG_DEBUG, "qline_delete(): %s -> %s", q->mask, q->reason);
-
-	/* only unqline if ircd has not already removed this -- jilles */
-	if (me.connected && (q->duration == 0 || q->expires > CURRTIME))
-		unqline_sts("*", q->mask);
+	qline_destroy(q);
+}
 
-	n = mowgli_node_find(q, &qlnlist);
-	mowgli_node_delete(n, &qlnlist);
-	mowgli_node_free(n);
+/* backdates a qline loaded from the database; it expires accordingly */
+void qline_set_settime(qline_t *q, time_t settime)
+{
+	return_if_fail(q != NULL);
 
-	free(q->mask);
-	free(q->reason);
-	free(q->setby);
+	q->settime = settime;
+	q->expires = settime + q->duration;
 
-	mowgli_heap_free(qline_heap, q);
-
-	cnt.qline--;
+	if (q->duration != 0)
+		deadline_set(&q->expiry, q->expires);
 }
 
 qline_t *qline_find(const char *mask)
@@ -495,7 +558,7 @@ qline_t *qline_find_match(const char *mask)
 
 		if (q->duration != 0 && q->expires <= CURRTIME)
 			continue;
-		if (!match(q->mask, mask))
+		if (!match_compiled(q->mask_pat, mask))
 			return q;
 	}
 
@@ -531,7 +594,7 @@ qline_t *qline_find_user(user_t *u)
 			continue;
 		if (q->mask[0] == '#' || q->mask[0] == '&')
 			continue;
-		if (!match(q->mask, u->nick))
+		if (!match_compiled(q->mask_pat, u->nick))
 			return q;
 	}
 
@@ -556,31 +619,6 @@ qline_t *qline_find_channel(channel_t *c)
 	return NULL;
 }
 
-void qline_expire(void *arg)
-{
-	qline_t *q;
-	mowgli_node_t *n, *tn;
-
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, qlnlist.head)
-	{
-		q = (qline_t *)n->data;
-
-		if (q->duration == 0)
-			continue;
-
-		if (q->expires <= CURRTIME)
-		{
-			slog(LG_INFO, _("QLINE:EXPIRE: \2%s\2 set \2%s\2 ago by \2%s\2"),
-				q->mask, time_ago(q->settime), q->setby);
-
-			verbose_wallops(_("QLINE expired on \2%s\2, set by \2%s\2"),
-				q->mask, q->setby);
-
-			qline_delete(q->mask);
-		}
-	}
-}
-
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
  * vim:ts=8
  * vim:sw=8
@@ -31,7 +31,7 @@ mowgli_heap_t *metadata_heap;	/* HEAP_CHANUSER */
 
 void init_metadata(void)
 {
-	metadata_heap = sharedheap_get(sizeof(metadata_t));
+	metadata_heap = sharedheap_get(sizeof(metadata_table_t));
 
 	if (metadata_heap == NULL)
 	{
@@ -180,7 +180,7 @@ void object_unref(void *obj)
 void object_dispose(void *object)
 {
 	object_t *obj;
-	mowgli_patricia_t *privatedata, *metadata;
+	mowgli_patricia_t *privatedata;
 
 	return_if_fail(object != NULL);
 	obj = object(object);
@@ -195,7 +195,6 @@ void object_dispose(void *object)
 	obj->refcount = -1;
 
 	privatedata = obj->privatedata;
-	metadata = obj->metadata;
 
 #ifdef OBJECT_DEBUG
 	mowgli_node_delete(&obj->dnode, &object_list);
@@ -211,33 +210,126 @@ void object_dispose(void *object)
 
 	if (privatedata != NULL)
 		mowgli_patricia_destroy(privatedata, NULL, NULL);
+}
+
+/*
+ * Metadata is kept in a metadata_table_t which is only allocated once the
+ * first entry is added. Up to METADATA_INLINE_MAX entries live in an array
+ * sorted by name, which is cheaper than a dictionary for the handful of
+ * keys most objects carry; past that the entries move to a dictionary.
+ * Each entry is a single allocation holding its value, and names are
+ * shared through strshare.
+ */
+
+static metadata_t *metadata_entry_create(const char *name, const char *value)
+{
+	metadata_t *md;
+	size_t len = strlen(value) + 1;
+
+	md = smalloc(sizeof(metadata_t) + len);
+	md->name = strshare_get(name);
+	md->value = (char *)(md + 1);
+	memcpy(md->value, value, len);
+
+	return md;
+}
+
+static void metadata_entry_destroy(metadata_t *md)
+{
+	strshare_unref(md->name);
+	free(md);
+}
+
+/* position of name in the array, or where it would be inserted */
+static unsigned int metadata_vec_find(metadata_table_t *mt, const char *name, bool *found)
+{
+	unsigned int i;
+	int cmp;
+
+	*found = false;
+
+	for (i = 0; i < mt->count; i++)
+	{
+		cmp = strcasecmp(mt->vec[i]->name, name);
+		if (cmp == 0)
+			*found = true;
+		if (cmp >= 0)
+			break;
+	}
+
+	return i;
+}
+
+static void metadata_promote(metadata_table_t *mt)
+{
+	unsigned int i;
+
+	mt->dict = mowgli_patricia_create(strcasecanon);
+
+	for (i = 0; i < mt->count; i++)
+		mowgli_patricia_add(mt->dict, mt->vec[i]->name, mt->vec[i]);
+
+	free(mt->vec);
+	mt->vec = NULL;
+	mt->size = 0;
+}
+
+static void metadata_table_free(object_t *obj)
+{
+	metadata_table_t *mt = obj->metadata;
 
-	if (metadata != NULL)
-		mowgli_patricia_destroy(metadata, NULL, NULL);
+	if (mt->dict != NULL)
+		mowgli_patricia_destroy(mt->dict, NULL, NULL);
+	free(mt->vec);
+
+	mowgli_heap_free(metadata_heap, mt);
+	obj->metadata = NULL;
 }
 
 metadata_t *metadata_add(void *target, const char *name, const char *value)
 {
 	object_t *obj;
+	metadata_table_t *mt;
 	metadata_t *md;
+	unsigned int pos;
+	bool found;
 
 	return_val_if_fail(name != NULL, NULL);
 	return_val_if_fail(value != NULL, NULL);
 
 	obj = object(target);
 
-	if (obj->metadata == NULL)
-		obj->metadata = mowgli_patricia_create(strcasecanon);
+	/* name and value may belong to the entry being replaced */
+	md = metadata_entry_create(name, value);
+	metadata_delete(target, md->name);
 
-	if (metadata_find(target, name))
-		metadata_delete(target, name);
+	if ((mt = obj->metadata) == NULL)
+	{
+		mt = obj->metadata = mowgli_heap_alloc(metadata_heap);
+		memset(mt, 0, sizeof(metadata_table_t));
+	}
 
-	md = mowgli_heap_alloc(metadata_heap);
+	if (mt->dict == NULL && mt->count == METADATA_INLINE_MAX)
+		metadata_promote(mt);
 
-	md->name = strshare_get(name);
-	md->value = sstrdup(value);
+	if (mt->dict != NULL)
+		mowgli_patricia_add(mt->dict, md->name, md);
+	else
+	{
+		if (mt->count == mt->size)
+		{
+			mt->size = mt->size ? mt->size * 2 : 2;
+			if (mt->size > METADATA_INLINE_MAX)
+				mt->size = METADATA_INLINE_MAX;
+			mt->vec = srealloc(mt->vec, mt->size * sizeof(metadata_t *));
+		}
+
+		pos = metadata_vec_find(mt, md->name, &found);
+		memmove(&mt->vec[pos + 1], &mt->vec[pos], (mt->count - pos) * sizeof(metadata_t *));
+		mt->vec[pos] = md;
+	}
 
-	mowgli_patricia_add(obj->metadata, md->name, md);
+	mt->count++;
 
 	return md;
 }
@@ -245,54 +337,153 @@ metadata_t *metadata_add(void *target, const char *name, const char *value)
 void metadata_delete(void *target, const char *name)
 {
 	object_t *obj;
-	metadata_t *md = metadata_find(target, name);
+	metadata_table_t *mt;
+	metadata_t *md;
+	unsigned int pos;
+	bool found;
 
-	if (!md)
-		return;
+	return_if_fail(target != NULL);
+	return_if_fail(name != NULL);
 
 	obj = object(target);
 
-	if (obj->metadata == NULL)
-		obj->metadata = mowgli_patricia_create(strcasecanon);
+	if ((mt = obj->metadata) == NULL)
+		return;
 
-	mowgli_patricia_delete(obj->metadata, name);
+	if (mt->dict != NULL)
+	{
+		if ((md = mowgli_patricia_delete(mt->dict, name)) == NULL)
+			return;
+	}
+	else
+	{
+		pos = metadata_vec_find(mt, name, &found);
+		if (!found)
+			return;
 
-	strshare_unref(md->name);
-	free(md->value);
+		md = mt->vec[pos];
+		memmove(&mt->vec[pos], &mt->vec[pos + 1], (mt->count - pos - 1) * sizeof(metadata_t *));
+	}
+
+	metadata_entry_destroy(md);
 
-	mowgli_heap_free(metadata_heap, md);
+	if (--mt->count == 0)
+		metadata_table_free(obj);
 }
 
 metadata_t *metadata_find(void *target, const char *name)
 {
-	object_t *obj;
+	metadata_table_t *mt;
+	unsigned int pos;
+	bool found;
 
 	return_val_if_fail(target != NULL, NULL);
 	return_val_if_fail(name != NULL, NULL);
 
-	obj = object(target);
+	if ((mt = object(target)->metadata) == NULL)
+		return NULL;
 
-	if (obj->metadata == NULL)
-		obj->metadata = mowgli_patricia_create(strcasecanon);
+	if (mt->dict != NULL)
+		return mowgli_patricia_retrieve(mt->dict, name);
 
-	return mowgli_patricia_retrieve(obj->metadata, name);
+	pos = metadata_vec_find(mt, name, &found);
+
+	return found ? mt->vec[pos] : NULL;
 }
 
 void metadata_delete_all(void *target)
 {
 	object_t *obj;
+	metadata_table_t *mt;
 	metadata_t *md;
 	mowgli_patricia_iteration_state_t state;
+	unsigned int i;
 
 	obj = object(target);
 
-	if (obj->metadata == NULL)
-		obj->metadata = mowgli_patricia_create(strcasecanon);
+	if ((mt = obj->metadata) == NULL)
+		return;
 
-	MOWGLI_PATRICIA_FOREACH(md, &state, obj->metadata)
+	if (mt->dict != NULL)
+	{
+		MOWGLI_PATRICIA_FOREACH(md, &state, mt->dict)
+			metadata_entry_destroy(md);
+	}
+	else
 	{
-		metadata_delete(obj, md->name);
+		for (i = 0; i < mt->count; i++)
+			metadata_entry_destroy(mt->vec[i]);
 	}
+
+	metadata_table_free(obj);
+}
+
+unsigned int metadata_count(void *target)
+{
+	metadata_table_t *mt = object(target)->metadata;
+
+	return mt != NULL ? mt->count : 0;
+}
+
+/* bytes held by an object's metadata; dictionary overhead is not counted */
+size_t metadata_size(void *target)
+{
+	metadata_table_t *mt = object(target)->metadata;
+	metadata_iteration_state_t state;
+	metadata_t *md;
+	size_t size;
+
+	if (mt == NULL)
+		return 0;
+
+	size = sizeof(metadata_table_t) + mt->size * sizeof(metadata_t *);
+
+	METADATA_FOREACH(md, &state, target)
+		size += sizeof(metadata_t) + strlen(md->value) + 1;
+
+	return size;
+}
+
+/*
+ * No particular order is guaranteed: small tables are walked in sorted
+ * order, large ones in whatever order their dictionary keeps. The
+ * metadata of the object being walked must not be changed until the
+ * walk is over.
+ */
+void metadata_foreach_start(void *target, metadata_iteration_state_t *state)
+{
+	metadata_table_t *mt = object(target)->metadata;
+
+	state->pos = 0;
+
+	if (mt != NULL && mt->dict != NULL)
+		mowgli_patricia_foreach_start(mt->dict, &state->state);
+}
+
+metadata_t *metadata_foreach_cur(void *target, metadata_iteration_state_t *state)
+{
+	metadata_table_t *mt = object(target)->metadata;
+
+	if (mt == NULL)
+		return NULL;
+
+	if (mt->dict != NULL)
+		return mowgli_patricia_foreach_cur(mt->dict, &state->state);
+
+	return state->pos < mt->count ? mt->vec[state->pos] : NULL;
+}
+
+void metadata_foreach_next(void *target, metadata_iteration_state_t *state)
+{
+	metadata_table_t *mt = object(target)->metadata;
+
+	if (mt == NULL)
+		return;
+
+	if (mt->dict != NULL)
+		mowgli_patricia_foreach_next(mt->dict, &state->state);
+	else
+		state->pos++;
 }
 
 void *privatedata_get(void *target, const char *key)
@@ -0,0 +1,214 @@
+/*
+ * atheme-services: A collection of minimalist IRC services
+ * p10numeric.c: Direct lookup of P10 numerics.
+ *
+ * Copyright (c) 2026 Zohlai Development Group
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "atheme.h"
+
+/* A P10 server numeric is two base64 characters and a client numeric is
+ * the server numeric followed by three more, so both decode to small
+ * integers. Servers are kept in a table indexed by their numeric, and
+ * each server has an array of its clients indexed by the client part;
+ * the array grows to the highest client numeric seen on that server,
+ * so at most P10_CLIENT_MAX entries.
+ */
+typedef struct {
+	server_t *server;
+	user_t **clients;
+	unsigned int size;
+} p10_server_slot_t;
+
+static p10_server_slot_t *p10_servers[P10_SERVER_MAX];
+
+static const signed char p10_base64[256] = {
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1,
+	-1,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+	15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 62, -1, 63, -1, -1,
+	-1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+	41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+/*
+ * p10_decode()
+ *
+ * Inputs:
+ *       a string and the number of base64 characters to decode from it
+ *
+ * Outputs:
+ *       the value, or -1 if one of the characters is not a P10 base64
+ *       digit (including the end of the string)
+ *
+ * Side Effects:
+ *       - none
+ */
+int p10_decode(const char *s, size_t len)
+{
+	int value = 0, digit;
+
+	while (len-- > 0)
+	{
+		if ((digit = p10_base64[(unsigned char)*s++]) < 0)
+			return -1;
+		value = value << 6 | digit;
+	}
+
+	return value;
+}
+
+static bool p10_active(void)
+{
+	return ircd != NULL && ircd->uses_p10;
+}
+
+static bool p10_split(const char *numeric, int *server, int *client)
+{
+	if ((*server = p10_decode(numeric, 2)) < 0)
+		return false;
+	if ((*client = p10_decode(numeric + 2, 3)) < 0)
+		return false;
+
+	return numeric[5] == '\0';
+}
+
+static p10_server_slot_t *p10_slot_get(int server)
+{
+	p10_server_slot_t *slot;
+
+	if ((slot = p10_servers[server]) == NULL)
+	{
+		slot = smalloc(sizeof(p10_server_slot_t));
+		memset(slot, 0, sizeof(p10_server_slot_t));
+		p10_servers[server] = slot;
+	}
+
+	return slot;
+}
+
+void p10_server_add(server_t *s)
+{
+	int server;
+
+	if (!p10_active() || s->sid == NULL)
+		return;
+
+	if ((server = p10_decode(s->sid, 2)) < 0 || s->sid[2] != '\0')
+		return;
+
+	p10_slot_get(server)->server = s;
+}
+
+void p10_server_delete(server_t *s)
+{
+	p10_server_slot_t *slot;
+	int server;
+
+	if (!p10_active() || s->sid == NULL)
+		return;
+
+	if ((server = p10_decode(s->sid, 2)) < 0 || s->sid[2] != '\0')
+		return;
+
+	/* the slot stays around: server_delete() has removed the server's
+	 * clients already, and the numeric will likely be reused */
+	if ((slot = p10_servers[server]) != NULL && slot->server == s)
+		slot->server = NULL;
+}
+
+server_t *p10_server_find(const char *numeric)
+{
+	int server;
+
+	if ((server = p10_decode(numeric, 2)) < 0 || numeric[2] != '\0')
+		return NULL;
+
+	return p10_servers[server] != NULL ? p10_servers[server]->server : NULL;
+}
+
+void p10_user_add(user_t *u)
+{
+	p10_server_slot_t *slot;
+	int server, client;
+	unsigned int size;
+
+	if (!p10_active() || u->uid == NULL || !p10_split(u->uid, &server, &client))
+		return;
+
+	slot = p10_slot_get(server);
+
+	if ((unsigned int)client >= slot->size)
+	{
+		size = slot->size ? slot->size : 64;
+		while (size <= (unsigned int)client)
+			size *= 2;
+
+		slot->clients = srealloc(slot->clients, size * sizeof(user_t *));
+		memset(slot->clients + slot->size, 0, (size - slot->size) * sizeof(user_t *));
+		slot->size = size;
+	}
+
+	slot->clients[client] = u;
+}
+
+void p10_user_delete(user_t *u)
+{
+	p10_server_slot_t *slot;
+	int server, client;
+
+	if (!p10_active() || u->uid == NULL || !p10_split(u->uid, &server, &client))
+		return;
+
+	if ((slot = p10_servers[server]) == NULL || (unsigned int)client >= slot->size)
+		return;
+
+	if (slot->clients[client] == u)
+		slot->clients[client] = NULL;
+}
+
+user_t *p10_user_find(const char *numeric)
+{
+	p10_server_slot_t *slot;
+	int server, client;
+
+	if (!p10_split(numeric, &server, &client))
+		return NULL;
+
+	if ((slot = p10_servers[server]) == NULL || (unsigned int)client >= slot->size)
+		return NULL;
+
+	return slot->clients[client];
+}
+
+/* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
+ * vim:ts=8
+ * vim:sw=8
+ * vim:noexpandtab
+ */
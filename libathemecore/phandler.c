@@ -28,6 +28,7 @@ unsigned int(*server_login) (void) = generic_server_login;
 void (*introduce_nick) (user_t *u) = generic_introduce_nick;
 void (*wallops_sts) (const char *text) = generic_wallops_sts;
 void (*join_sts) (channel_t *c, user_t *u, bool isnew, char *modes) = generic_join_sts;
+void (*join_batch_sts) (channel_t *c, user_t **users, unsigned int count, bool isnew, char *modes) = generic_join_batch_sts;
 void (*chan_lowerts) (channel_t *c, user_t *u) = generic_chan_lowerts;
 void (*kick) (user_t *source, channel_t *c, user_t *u, const char *reason) = generic_kick;
 void (*msg) (const char *from, const char *target, const char *fmt, ...) = generic_msg;
@@ -102,6 +103,15 @@ void generic_join_sts(channel_t *c, user_t *u, bool isnew, char *modes)
 	/* We can't do anything here. Bail. */
 }
 
+void generic_join_batch_sts(channel_t *c, user_t **users, unsigned int count, bool isnew, char *modes)
+{
+	unsigned int i;
+
+	/* only the first join creates the channel */
+	for (i = 0; i < count; i++)
+		join_sts(c, users[i], isnew && i == 0, modes);
+}
+
 void generic_chan_lowerts(channel_t *c, user_t *u)
 {
 	slog(LG_ERROR, "chan_lowerts() called but not supported!");
@@ -320,7 +330,7 @@ mowgli_node_t *generic_next_matching_ban(channel_t *c, user_t *u, int type, mowg
 		cb = n->data;
 
 		if (cb->type == type &&
-				(!match(cb->mask, hostbuf) || !match(cb->mask, cloakbuf) || !match(cb->mask, realbuf) || !match(cb->mask, ipbuf) || (ircd->flags & IRCD_CIDR_BANS && !match_cidr(cb->mask, ipbuf))))
+				(!match_compiled(cb->mask_pat, hostbuf) || !match_compiled(cb->mask_pat, cloakbuf) || !match_compiled(cb->mask_pat, realbuf) || !match_compiled(cb->mask_pat, ipbuf) || (ircd->flags & IRCD_CIDR_BANS && !match_cidr(cb->mask, ipbuf))))
 			return n;
 	}
 	return NULL;
@@ -345,7 +355,7 @@ mowgli_node_t *generic_next_matching_host_chanacs(mychan_t *mc, user_t *u, mowgl
 
 		if (ca->entity != NULL)
 		       continue;
-		if (!match(ca->host, hostbuf) || !match(ca->host, hostbuf2) || !match(ca->host, ipbuf) || (ircd->flags & IRCD_CIDR_BANS && !match_cidr(ca->host, ipbuf)))
+		if (!match_compiled(ca->host_pat, hostbuf) || !match_compiled(ca->host_pat, hostbuf2) || !match_compiled(ca->host_pat, ipbuf) || (ircd->flags & IRCD_CIDR_BANS && !match_cidr(ca->host, ipbuf)))
 			return n;
 	}
 	return NULL;
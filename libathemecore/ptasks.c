@@ -85,6 +85,65 @@ static void connection_stats_cb(const char *line, void *privdata)
 	numeric_sts(me.me, 249, ((user_t *)privdata), "F :%s", line);
 }
 
+typedef struct {
+	const char *name;
+	unsigned int objects, entries, hashed;
+	size_t bytes;
+} metadata_stats_t;
+
+static void metadata_stats_add(metadata_stats_t *st, void *obj)
+{
+	unsigned int count = metadata_count(obj);
+
+	if (count == 0)
+		return;
+
+	st->objects++;
+	st->entries += count;
+	st->bytes += metadata_size(obj);
+	if (object(obj)->metadata->dict != NULL)
+		st->hashed++;
+}
+
+static void metadata_stats(user_t *u)
+{
+	metadata_stats_t st[] = {
+		{ .name = "user" }, { .name = "myuser" }, { .name = "entity" },
+		{ .name = "mynick" }, { .name = "myuser_nam" }, { .name = "mychan" },
+		{ .name = "chanacs" },
+	};
+	mowgli_patricia_iteration_state_t state;
+	myentity_iteration_state_t mestate;
+	user_t *tu;
+	myentity_t *mt;
+	mynick_t *mn;
+	myuser_name_t *mun;
+	mychan_t *mc;
+	mowgli_node_t *n;
+	unsigned int i;
+
+	MOWGLI_PATRICIA_FOREACH(tu, &state, userlist)
+		metadata_stats_add(&st[0], tu);
+	MYENTITY_FOREACH(mt, &mestate)
+		metadata_stats_add(&st[mt->type == ENT_USER ? 1 : 2], mt);
+	MOWGLI_PATRICIA_FOREACH(mn, &state, nicklist)
+		metadata_stats_add(&st[3], mn);
+	MOWGLI_PATRICIA_FOREACH(mun, &state, oldnameslist)
+		metadata_stats_add(&st[4], mun);
+	MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
+	{
+		metadata_stats_add(&st[5], mc);
+
+		MOWGLI_ITER_FOREACH(n, mc->chanacs.head)
+			metadata_stats_add(&st[6], n->data);
+	}
+
+	numeric_sts(me.me, 249, u, "M :%-10s %7s %7s %7s %9s", "type", "objects", "entries", "hashed", "bytes");
+	for (i = 0; i < ARRAY_SIZE(st); i++)
+		numeric_sts(me.me, 249, u, "M :%-10s %7u %7u %7u %9zu", st[i].name,
+				st[i].objects, st[i].entries, st[i].hashed, st[i].bytes);
+}
+
 void handle_stats(user_t *u, char req)
 {
 	kline_t *k;
@@ -197,6 +256,14 @@ void handle_stats(user_t *u, char req)
 
 		  break;
 
+	  case 'M':
+	  case 'm':
+		  if (!has_priv_user(u, PRIV_SERVER_AUSPEX))
+			  break;
+
+		  metadata_stats(u);
+		  break;
+
 	  case 'o':
 	  case 'O':
 		  if (!has_priv_user(u, PRIV_VIEWPRIVS))
@@ -491,7 +558,15 @@ handle_channel_message(sourceinfo_t *si, char *target, bool is_notice, char *mes
 	if (cdata.c == NULL)
 		return;
 
-	hook_call_channel_message(&cdata);
+	/* ...or nobody wants to hear it */
+	if (cdata.c->msgsubs == 0)
+		return;
+
+	if (cdata.c->msgsubs & CHANMSG_HOOK)
+		hook_call_channel_message(&cdata);
+
+	if (!(cdata.c->msgsubs & CHANMSG_SERVICE) || cdata.c->numsvcmembers == 0)
+		return;
 
 	vec[0] = target;
 	vec[1] = message;
@@ -846,7 +921,6 @@ int floodcheck(user_t *u, user_t *t)
 {
 	const char *from;
 	static time_t last_ignore_notice = 0;
-	unsigned int reduction;
 
 	if (t == NULL)
 		from = me.name;
@@ -861,10 +935,10 @@ int floodcheck(user_t *u, user_t *t)
 	/* Check if we match a services ignore */
 	if (svsignore_find(u) && !has_priv_user(u, PRIV_ADMIN))
 	{
-		if (u->msgs == 0 && last_ignore_notice != CURRTIME)
+		if (u->flood.level == 0 && last_ignore_notice != CURRTIME)
 		{
 			/* tell them once per session, don't flood */
-			u->msgs = 1;
+			u->flood.level = 1;
 			last_ignore_notice = CURRTIME;
 			notice(from, u->nick, _("You are on services ignore. You may not use any service."));
 		}
@@ -876,41 +950,31 @@ int floodcheck(user_t *u, user_t *t)
 		/* check if they're being ignored */
 		if (u->offenses > 10)
 		{
-			if ((CURRTIME - u->lastmsg) > 30)
+			if ((CURRTIME - u->flood.last) > 30)
 			{
 				u->offenses -= 10;
-				u->lastmsg = CURRTIME;
-				u->msgs = 0;
+				ratelimit_reset(&u->flood);
 			}
 			else
 				return 1;
 		}
 
-		if (u->lastmsg != 0 && CURRTIME > u->lastmsg)
-		{
-			reduction = (CURRTIME - u->lastmsg) * (config_options.flood_msgs * FLOOD_MSGS_FACTOR / config_options.flood_time);
-			if (u->msgs > reduction)
-				u->msgs -= reduction;
-			else
-				u->msgs = 0;
-		}
-		u->lastmsg = CURRTIME;
-		u->msgs += FLOOD_MSGS_FACTOR;
+		ratelimit_drain(&u->flood, config_options.flood_msgs, config_options.flood_time);
+		ratelimit_add(&u->flood, FLOOD_MSGS_FACTOR);
 
-		if (u->msgs > config_options.flood_msgs * FLOOD_MSGS_FACTOR)
+		if (ratelimit_check(&u->flood, config_options.flood_msgs, config_options.flood_time))
 		{
 			/* they're flooding. */
 			/* perhaps allowed to? -- jilles */
 			if (has_priv_user(u, PRIV_FLOOD))
 			{
-				u->msgs = 0;
+				u->flood.level = 0;
 				return 0;
 			}
 			if (!u->offenses)
 			{
 				/* ignore them the first time */
-				u->lastmsg = CURRTIME;
-				u->msgs = 0;
+				ratelimit_reset(&u->flood);
 				u->offenses = 11;
 
 				notice(from, u->nick, _("You have triggered services flood protection."));
@@ -924,8 +988,7 @@ int floodcheck(user_t *u, user_t *t)
 			if (u->offenses == 1)
 			{
 				/* ignore them the second time */
-				u->lastmsg = CURRTIME;
-				u->msgs = 0;
+				ratelimit_reset(&u->flood);
 				u->offenses = 12;
 
 				notice(from, u->nick, _("You have triggered services flood protection."));
@@ -957,7 +1020,7 @@ int floodcheck(user_t *u, user_t *t)
 void command_add_flood(sourceinfo_t *si, unsigned int amount)
 {
 	if (si->su != NULL)
-		si->su->msgs += amount;
+		ratelimit_add(&si->su->flood, amount);
 }
 
 bool should_reg_umode(user_t *u)
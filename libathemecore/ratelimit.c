@@ -0,0 +1,165 @@
+/*
+ * atheme-services: A collection of minimalist IRC services
+ * ratelimit.c: Rate limiters.
+ *
+ * Copyright (c) 2026 Zohlai Development Group
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "atheme.h"
+
+/* Buckets are drained lazily, when they are next looked at, so an idle
+ * one costs nothing and needs no timer; it lives and dies with the
+ * object it is embedded in. Windows are fixed rings, so recording an
+ * event overwrites the oldest one instead of allocating.
+ */
+
+/*
+ * ratelimit_drain()
+ *
+ * Inputs:
+ *       a bucket, and the number of events per period it drains by
+ *
+ * Outputs:
+ *       none
+ *
+ * Side Effects:
+ *       - the level drops by the time passed since the last drain
+ */
+void ratelimit_drain(ratelimit_t *rl, unsigned int limit, unsigned int period)
+{
+	unsigned long long reduction;
+
+	return_if_fail(rl != NULL);
+
+	if (rl->last != 0 && CURRTIME > rl->last && period != 0)
+	{
+		/* multiply first, limit * RATELIMIT_UNIT is rarely a
+		 * multiple of period */
+		reduction = (unsigned long long)(CURRTIME - rl->last) * limit * RATELIMIT_UNIT / period;
+		if (rl->level > reduction)
+			rl->level -= reduction;
+		else
+			rl->level = 0;
+	}
+
+	rl->last = CURRTIME;
+}
+
+/*
+ * ratelimit_check()
+ *
+ * Inputs:
+ *       a bucket, and how many events per period it allows
+ *
+ * Outputs:
+ *       true if the bucket is over the limit
+ *
+ * Side Effects:
+ *       - the bucket is drained first
+ */
+bool ratelimit_check(ratelimit_t *rl, unsigned int limit, unsigned int period)
+{
+	ratelimit_drain(rl, limit, period);
+
+	return rl->level > limit * RATELIMIT_UNIT;
+}
+
+void ratelimit_reset(ratelimit_t *rl)
+{
+	return_if_fail(rl != NULL);
+
+	rl->level = 0;
+	rl->last = CURRTIME;
+}
+
+/* FNV-1a over the lowercased string, so matching is case insensitive as
+ * strcasecmp() is */
+unsigned int ratelimit_fingerprint(const char *s)
+{
+	unsigned int hash = 2166136261U;
+
+	return_val_if_fail(s != NULL, 0);
+
+	while (*s != '\0')
+	{
+		hash ^= (unsigned char)tolower((unsigned char)*s++);
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+void ratelimit_window_init(ratelimit_window_t *w, unsigned int size)
+{
+	return_if_fail(w != NULL);
+	return_if_fail(size != 0);
+
+	w->size = size;
+	w->count = 0;
+	w->next = 0;
+	w->ring = scalloc(size, sizeof(ratelimit_event_t));
+}
+
+void ratelimit_window_free(ratelimit_window_t *w)
+{
+	return_if_fail(w != NULL);
+
+	free(w->ring);
+	w->ring = NULL;
+	w->size = w->count = w->next = 0;
+}
+
+/*
+ * ratelimit_window_add()
+ *
+ * Inputs:
+ *       a window, the source of an event and a fingerprint of its text
+ *
+ * Outputs:
+ *       the source of the event pushed out to make room, or NULL
+ *
+ * Side Effects:
+ *       - the oldest event is dropped if the window is full
+ */
+const void *ratelimit_window_add(ratelimit_window_t *w, const void *source, unsigned int text)
+{
+	ratelimit_event_t *ev;
+	const void *dropped;
+
+	return_val_if_fail(w != NULL, NULL);
+	return_val_if_fail(w->ring != NULL, NULL);
+
+	ev = &w->ring[w->next];
+	dropped = w->count == w->size ? ev->source : NULL;
+	ev->time = CURRTIME;
+	ev->source = source;
+	ev->text = text;
+
+	w->next = (w->next + 1) % w->size;
+	if (w->count < w->size)
+		w->count++;
+
+	return dropped;
+}
+
+/* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
+ * vim:ts=8
+ * vim:sw=8
+ * vim:noexpandtab
+ */
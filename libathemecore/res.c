@@ -44,6 +44,12 @@ static void res_readreply(connection_t *cptr);
 #define RES_MAXADDRS   35	/* maximum addresses allowed */
 #define AR_TTL         600	/* TTL in seconds for dns cache entries */
 
+#define RES_IDHASH_SIZE     1024	/* buckets in the request id hash */
+#define RES_INITIAL_TIMEOUT 4000	/* ms, for a server without RTT samples */
+#define RES_MIN_TIMEOUT     1000	/* ms */
+#define RES_MAX_TIMEOUT     8000	/* ms */
+#define RES_MAX_BACKOFF     30		/* seconds */
+
 /* RFC 1104/1105 wasn't very helpful about what these fields
  * should be named, so for now, we'll just name them this way.
  * we probably should look at what named calls them or something.
@@ -57,6 +63,8 @@ static void res_readreply(connection_t *cptr);
 struct reslist
 {
 	mowgli_node_t node;
+	struct reslist *idnext;	/* next in id hash bucket */
+	bool hashed;
 	int id;
 	time_t ttl;
 	char type;
@@ -65,15 +73,30 @@ struct reslist
 	char sends;		/* number of sends (>1 means resent) */
 	time_t sentat;
 	time_t timeout;
-	unsigned int lastns;	/* index of last server sent to */
+	unsigned long long sentat_ms;
+	int lastns;		/* index of last server sent to, -1 if none */
+	deadline_t deadline;
 	sockaddr_any_t addr;
 	char *name;
 	dns_query_t *query;	/* query callback for this request */
 };
 
+/* per-nameserver state, RTTs in milliseconds */
+struct nsstats
+{
+	unsigned int srtt;		/* smoothed RTT, 0 if no samples yet */
+	unsigned int rttvar;
+	unsigned int timeouts;		/* consecutive timeouts */
+	unsigned int outstanding;
+	unsigned int sent;
+	unsigned int answered;
+	unsigned int timedout;
+};
+
 static connection_t *res_fd;
 static mowgli_list_t request_list = { NULL, NULL, 0 };
-static int ns_timeout_count[IRCD_MAXNS];
+static struct reslist *id_hash[RES_IDHASH_SIZE];
+static struct nsstats ns_stats[IRCD_MAXNS];
 
 static void rem_request(struct reslist *request);
 static struct reslist *make_request(dns_query_t *query);
@@ -81,20 +104,107 @@ static void do_query_name(dns_query_t *query, const char *name, struct reslist *
 static void do_query_number(dns_query_t *query, const sockaddr_any_t *,
 			    struct reslist *request);
 static void query_name(struct reslist *request);
-static int send_res_msg(const char *buf, int len, int count);
+static int send_res_msg(const char *buf, int len, int exclude);
 static void resend_query(struct reslist *request);
 static int check_question(struct reslist *request, RESHEADER * header, char *buf, char *eob);
 static int proc_answer(struct reslist *request, RESHEADER * header, char *, char *);
 static struct reslist *find_id(int id);
 static dns_reply_t *make_dnsreply(struct reslist *request);
 
+static unsigned long long res_mstime(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (unsigned long long)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+/*
+ * ns_rto - retransmission timeout for a nameserver, in seconds, from
+ * its smoothed RTT as in RFC 6298.
+ */
+static time_t ns_rto(int ns)
+{
+	unsigned int rto;
+
+	if (ns < 0 || ns_stats[ns].srtt == 0)
+		rto = RES_INITIAL_TIMEOUT;
+	else
+		rto = ns_stats[ns].srtt + 4 * ns_stats[ns].rttvar;
+
+	if (rto < RES_MIN_TIMEOUT)
+		rto = RES_MIN_TIMEOUT;
+	else if (rto > RES_MAX_TIMEOUT)
+		rto = RES_MAX_TIMEOUT;
+
+	return (rto + 999) / 1000;
+}
+
+static void ns_sample_rtt(int ns, unsigned int rtt)
+{
+	struct nsstats *st = &ns_stats[ns];
+	unsigned int delta;
+
+	/* 0 means "no samples", a sub-millisecond answer still counts */
+	if (rtt == 0)
+		rtt = 1;
+
+	if (st->srtt == 0)
+	{
+		st->srtt = rtt;
+		st->rttvar = rtt / 2;
+		return;
+	}
+
+	delta = st->srtt > rtt ? st->srtt - rtt : rtt - st->srtt;
+	st->rttvar = (3 * st->rttvar + delta) / 4;
+	st->srtt = (7 * st->srtt + rtt) / 8;
+	if (st->srtt == 0)
+		st->srtt = 1;
+}
+
+static void id_hash_add(struct reslist *request)
+{
+	struct reslist **bucket = &id_hash[request->id % RES_IDHASH_SIZE];
+
+	request->idnext = *bucket;
+	*bucket = request;
+	request->hashed = true;
+}
+
+static void id_hash_del(struct reslist *request)
+{
+	struct reslist **rp;
+
+	if (!request->hashed)
+		return;
+
+	for (rp = &id_hash[request->id % RES_IDHASH_SIZE]; *rp != NULL; rp = &(*rp)->idnext)
+	{
+		if (*rp == request)
+		{
+			*rp = request->idnext;
+			break;
+		}
+	}
+	request->hashed = false;
+}
+
+/* the request no longer waits for an answer from its last server */
+static void request_unsend(struct reslist *request)
+{
+	if (request->lastns >= 0 && request->lastns < irc_nscount && ns_stats[request->lastns].outstanding > 0)
+		ns_stats[request->lastns].outstanding--;
+	request->lastns = -1;
+}
+
 /*
  * int
  * res_ourserver(inp)
  *      looks up "inp" in irc_nsaddr_list[]
  * returns:
  *      0  : not found
- *      >0 : found
+ *      >0 : found, index of the server plus one
  * author:
  *      paul vixie, 29may94
  *      revised for ircd, cryogen(stu) may03
@@ -130,10 +240,7 @@ static int res_ourserver(const sockaddr_any_t *inp)
 						sizeof(struct in6_addr)) == 0) ||
 					      (memcmp(&v6->sin6_addr.s6_addr, &in6addr_any,
 						sizeof(struct in6_addr)) == 0))
-					  {
-						  ns_timeout_count[ns] = 0;
-						  return 1;
-					  }
+						  return ns + 1;
 			  break;
 #endif
 		  case AF_INET:
@@ -141,10 +248,7 @@ static int res_ourserver(const sockaddr_any_t *inp)
 				  if (v4->sin_port == v4in->sin_port)
 					  if ((v4->sin_addr.s_addr == INADDR_ANY)
 					      || (v4->sin_addr.s_addr == v4in->sin_addr.s_addr))
-					  {
-						  ns_timeout_count[ns] = 0;
-						  return 1;
-					  }
+						  return ns + 1;
 			  break;
 		  default:
 			  break;
@@ -155,69 +259,43 @@ static int res_ourserver(const sockaddr_any_t *inp)
 }
 
 /*
- * timeout_query_list - Remove queries from the list which have been
- * there too long without being resolved.
+ * timeout_request - a request got no answer in time; resend it to
+ * another server or give up.
  */
-static time_t timeout_query_list(time_t now)
+static void timeout_request(void *arg)
 {
-	mowgli_node_t *ptr;
-	mowgli_node_t *next_ptr;
-	struct reslist *request;
-	time_t next_time = 0;
-	time_t timeout = 0;
+	struct reslist *request = arg;
 
-	MOWGLI_ITER_FOREACH_SAFE(ptr, next_ptr, request_list.head)
+	if (request->lastns >= 0 && request->lastns < irc_nscount)
 	{
-		request = ptr->data;
-		timeout = request->sentat + request->timeout;
-
-		if (now >= timeout)
-		{
-			if (--request->retries <= 0)
-			{
-				(*request->query->callback) (request->query->ptr, NULL);
-				rem_request(request);
-				continue;
-			}
-			else
-			{
-				ns_timeout_count[request->lastns]++;
-				request->sentat = now;
-				request->timeout += request->timeout;
-				resend_query(request);
-			}
-		}
-
-		if ((next_time == 0) || timeout < next_time)
-		{
-			next_time = timeout;
-		}
+		ns_stats[request->lastns].timeouts++;
+		ns_stats[request->lastns].timedout++;
 	}
 
-	return (next_time > now) ? next_time : (now + AR_TTL);
-}
+	if (--request->retries <= 0)
+	{
+		(*request->query->callback) (request->query->ptr, NULL);
+		rem_request(request);
+		return;
+	}
 
-/*
- * timeout_resolver - check request list
- */
-static void timeout_resolver(void *notused)
-{
-	timeout_query_list(CURRTIME);
+	resend_query(request);
 }
 
 /*
  * start_resolver - do everything we need to read the resolv.conf file
  * and initialize the resolver file descriptor if needed
  */
-static mowgli_eventloop_timer_t *timeout_resolver_timer = NULL;
-
 static void start_resolver(void)
 {
-	int i;
+	mowgli_node_t *n;
 
 	irc_res_init();
-	for (i = 0; i < irc_nscount; i++)
-		ns_timeout_count[i] = 0;
+	memset(ns_stats, 0, sizeof ns_stats);
+
+	/* server indexes may have changed */
+	MOWGLI_ITER_FOREACH(n, request_list.head)
+		((struct reslist *)n->data)->lastns = -1;
 
 	if (res_fd == NULL)
 	{
@@ -231,7 +309,6 @@ static void start_resolver(void)
 		}
 
 		res_fd = connection_add("UDP resolver socket", fd, 0, res_readreply, NULL);
-		timeout_resolver_timer = mowgli_timer_add(base_eventloop, "timeout_resolver", timeout_resolver, NULL, 1);
 	}
 }
 
@@ -254,9 +331,6 @@ void restart_resolver(void)
 	connection_close(res_fd);
 	res_fd = NULL;
 
-	mowgli_timer_destroy(base_eventloop, timeout_resolver_timer);	/* -ddosen */
-	timeout_resolver_timer = NULL;
-
 	start_resolver();
 }
 
@@ -291,6 +365,9 @@ static void rem_request(struct reslist *request)
 {
 	return_if_fail(request != NULL);
 
+	request_unsend(request);
+	id_hash_del(request);
+	deadline_cancel(&request->deadline);
 	mowgli_node_delete(&request->node, &request_list);
 	free(request->name);
 	free(request);
@@ -305,8 +382,10 @@ static struct reslist *make_request(dns_query_t *query)
 
 	request->sentat = CURRTIME;
 	request->retries = 3;
-	request->timeout = 4;	/* start at 4 and exponential inc. */
+	request->timeout = 0;	/* set from the server's RTT when sent */
+	request->lastns = -1;
 	request->query = query;
+	deadline_init(&request->deadline, "timeout_request", timeout_request, request);
 
 	mowgli_node_add(request, &request->node, &request_list);
 
@@ -357,13 +436,17 @@ static int retryfreq(int timeouts)
 /*
  * send_res_msg - sends msg to a nameserver.
  * This should reflect /etc/resolv.conf.
- * Returns number of nameserver successfully sent to
+ * Of the servers that seem to work, the one with the lowest smoothed RTT
+ * is used, avoiding "exclude" (the server that just timed out) if there
+ * is any choice. Servers without RTT samples yet go first so they get
+ * measured.
+ * Returns the nameserver successfully sent to
  * or -1 if no successful sends.
  */
-static int send_res_msg(const char *rmsg, int len, int rcount)
+static int send_res_msg(const char *rmsg, int len, int exclude)
 {
-	int i;
-	int ns;
+	int i, pass;
+	int ns, best;
 	static int retrycnt;
 
 	retrycnt++;
@@ -371,22 +454,32 @@ static int send_res_msg(const char *rmsg, int len, int rcount)
 	 * Every once in a while, try a possibly broken one to check
 	 * if it is working again.
 	 */
-	for (i = 0; i < irc_nscount; i++)
+	for (pass = 0; pass < 2; pass++)
 	{
-		ns = (i + rcount - 1) % irc_nscount;
-		if (ns_timeout_count[ns] && retrycnt % retryfreq(ns_timeout_count[ns]))
-			continue;
-		if (sendto(res_fd->fd, rmsg, len, 0,
-		     (struct sockaddr *)&(irc_nsaddr_list[ns].saddr),
-				irc_nsaddr_list[ns].saddr_len) == len)
-			return ns;
+		best = -1;
+		for (ns = 0; ns < irc_nscount; ns++)
+		{
+			if (ns == exclude && pass == 0 && irc_nscount > 1)
+				continue;
+			if (ns_stats[ns].timeouts && retrycnt % retryfreq(ns_stats[ns].timeouts))
+				continue;
+			if (best == -1 || ns_stats[ns].srtt < ns_stats[best].srtt ||
+					(ns_stats[ns].srtt == ns_stats[best].srtt &&
+					 ns_stats[ns].outstanding < ns_stats[best].outstanding))
+				best = ns;
+		}
+
+		if (best != -1 && sendto(res_fd->fd, rmsg, len, 0,
+		     (struct sockaddr *)&(irc_nsaddr_list[best].saddr),
+				irc_nsaddr_list[best].saddr_len) == len)
+			return best;
 	}
 
 	/* No known working nameservers, try some broken one. */
 	for (i = 0; i < irc_nscount; i++)
 	{
-		ns = (i + rcount - 1) % irc_nscount;
-		if (!ns_timeout_count[ns])
+		ns = (i + exclude + 1) % irc_nscount;
+		if (!ns_stats[ns].timeouts)
 			continue;
 		if (sendto(res_fd->fd, rmsg, len, 0,
 		     (struct sockaddr *)&(irc_nsaddr_list[ns].saddr),
@@ -402,13 +495,10 @@ static int send_res_msg(const char *rmsg, int len, int rcount)
  */
 static struct reslist *find_id(int id)
 {
-	mowgli_node_t *ptr;
 	struct reslist *request;
 
-	MOWGLI_ITER_FOREACH(ptr, request_list.head)
+	for (request = id_hash[id % RES_IDHASH_SIZE]; request != NULL; request = request->idnext)
 	{
-		request = ptr->data;
-
 		if (request->id == id)
 			return (request);
 	}
@@ -518,10 +608,15 @@ static void query_name(struct reslist *request)
 {
 	char buf[MAXPACKET];
 	int request_len = 0;
-	int ns;
+	int ns, exclude;
 
 	memset(buf, 0, sizeof(buf));
 
+	/* a late answer to the previous send is no longer wanted */
+	exclude = request->lastns;
+	request_unsend(request);
+	id_hash_del(request);
+
 	if ((request_len =
 	     irc_res_mkquery(request->queryname, C_IN, request->type, (unsigned char *)buf, sizeof(buf))) > 0)
 	{
@@ -550,12 +645,25 @@ static void query_name(struct reslist *request)
 		} while (find_id(header->id));
 #endif /* HAVE_LRAND48 */
 		request->id = header->id;
+		id_hash_add(request);
 		++request->sends;
 
-		ns = send_res_msg(buf, request_len, request->sends);
+		ns = send_res_msg(buf, request_len, exclude);
 		if (ns != -1)
+		{
 			request->lastns = ns;
+			ns_stats[ns].outstanding++;
+			ns_stats[ns].sent++;
+		}
 	}
+
+	/* exponential backoff on top of the server's RTO */
+	request->timeout = ns_rto(request->lastns) << (request->sends > 1 ? request->sends - 1 : 0);
+	if (request->timeout > RES_MAX_BACKOFF)
+		request->timeout = RES_MAX_BACKOFF;
+	request->sentat = CURRTIME;
+	request->sentat_ms = res_mstime();
+	deadline_set(&request->deadline, request->sentat + request->timeout);
 }
 
 static void resend_query(struct reslist *request)
@@ -755,6 +863,7 @@ static int res_read_single_reply(connection_t *F)
 	dns_reply_t *reply = NULL;
 	int rc;
 	int answer_count;
+	int ns;
 	socklen_t len = sizeof(sockaddr_any_t);
 	sockaddr_any_t lsin;
 
@@ -787,12 +896,19 @@ static int res_read_single_reply(connection_t *F)
 	/*
 	 * check against possibly fake replies
 	 */
-	if (!res_ourserver(&lsin))
+	if (!(ns = res_ourserver(&lsin)))
 		return 1;
+	ns--;
 
 	if (!check_question(request, header, buf, buf + rc))
 		return 1;
 
+	ns_stats[ns].timeouts = 0;
+	ns_stats[ns].answered++;
+	/* Karn: a resent query gives no usable sample */
+	if (ns == request->lastns && request->sends == 1)
+		ns_sample_rtt(ns, res_mstime() - request->sentat_ms);
+
 	if ((header->rcode != NO_ERRORS) || (header->ancount == 0))
 	{
 		if (NXDOMAIN == header->rcode)
@@ -883,19 +999,29 @@ static dns_reply_t *make_dnsreply(struct reslist *request)
 	return (cp);
 }
 
+/*
+ * report_dns_servers - show the nameservers with their RTT statistics
+ */
 void report_dns_servers(sourceinfo_t *si)
 {
 	int i;
+	char ipaddr[128];
+	const sockaddr_any_t *sa;
+	const void *addr;
 
 	for (i = 0; i < irc_nscount; i++)
 	{
-#if 0
-		char ipaddr[128];
-		if (!rb_inet_ntop_sock((struct sockaddr *)&(irc_nsaddr_list[i]),
-				ipaddr, sizeof ipaddr))
+		sa = &irc_nsaddr_list[i].saddr;
+		if (sa->sa.sa_family == AF_INET6)
+			addr = &((const struct sockaddr_in6 *)sa)->sin6_addr;
+		else
+			addr = &((const struct sockaddr_in *)sa)->sin_addr;
+		if (!inet_ntop(sa->sa.sa_family, addr, ipaddr, sizeof ipaddr))
 			mowgli_strlcpy(ipaddr, "?", sizeof ipaddr);
-		sendto_one_numeric(source_p, RPL_STATSDEBUG,
-				"A %s %d", ipaddr, ns_timeout_count[i]);
-#endif
+
+		command_success_nodata(si, _("Nameserver %s: srtt %u ms, rttvar %u ms, timeout %u s, %u outstanding, %u sent, %u answered, %u timed out"),
+				ipaddr, ns_stats[i].srtt, ns_stats[i].rttvar, (unsigned int)ns_rto(i),
+				ns_stats[i].outstanding, ns_stats[i].sent,
+				ns_stats[i].answered, ns_stats[i].timedout);
 	}
 }
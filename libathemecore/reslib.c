@@ -164,12 +164,18 @@ parse_resvconf(void)
   char *opt;
   char *arg;
   char input[DNS_MAXLINE];
+  const char *path;
   FILE *file;
 
   /* XXX "/etc/resolv.conf" should be from a define in setup.h perhaps
    * for cygwin support etc. this hardcodes it to unix for now -db
+   *
+   * ZOHLAI_RESOLV_CONF points the resolver elsewhere, e.g. at a stub
+   * server for testing.
    */
-  if ((file = fopen("/etc/resolv.conf", "r")) == NULL)
+  if ((path = getenv("ZOHLAI_RESOLV_CONF")) == NULL)
+    path = "/etc/resolv.conf";
+  if ((file = fopen(path, "r")) == NULL)
     return -1;
 
   while (fgets(input, sizeof(input), file) != NULL)
@@ -220,7 +226,8 @@ parse_resvconf(void)
 /* add_nameserver()
  *
  * input        - either an IPV4 address in dotted quad
- *                or an IPV6 address in : format
+ *                or an IPV6 address in : format,
+ *                optionally followed by #port
  * output       - NONE
  * side effects - entry in irc_nsaddr_list is filled in as needed
  */
@@ -228,6 +235,9 @@ static void
 add_nameserver(const char *arg)
 {
   struct addrinfo hints, *res;
+  char host[HOSTIPLEN + 1];
+  const char *port = "domain";
+  char *p;
 
   slog(LG_DEBUG, "add_nameserver(): %s", arg);
 
@@ -243,7 +253,14 @@ add_nameserver(const char *arg)
   hints.ai_socktype = SOCK_DGRAM;
   hints.ai_flags    = AI_PASSIVE | AI_NUMERICHOST;
 
-  if (getaddrinfo(arg, "domain", &hints, &res))
+  mowgli_strlcpy(host, arg, sizeof host);
+  if ((p = strchr(host, '#')) != NULL)
+  {
+    *p++ = '\0';
+    port = p;
+  }
+
+  if (getaddrinfo(host, port, &hints, &res))
     return;
 
   if (res == NULL)
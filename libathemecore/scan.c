@@ -0,0 +1,316 @@
+/*
+ * atheme-services: A collection of minimalist IRC services
+ * scan.c: Time-sliced dictionary scans.
+ *
+ * Copyright (c) 2026 Zohlai Development Group
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING
+ * IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "atheme.h"
+
+/* how long one slice may run, and how many elements are visited between
+ * looking at the clock */
+#define SCAN_SLICE_MS		20
+#define SCAN_CHECK_INTERVAL	64
+
+/* A suspended scan always stands on an element it has already visited;
+ * the patricia iterator keeps a pointer to the leaf after it, which is
+ * the only thing that may not disappear under us. scan_forget() steps
+ * over that leaf before it is deleted. The current leaf itself is never
+ * looked at again, so it may go away freely.
+ */
+static mowgli_list_t scan_list;
+static mowgli_eventloop_timer_t *scan_timer = NULL;
+
+static void scan_run(void *arg);
+
+static unsigned long long scan_mstime(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (unsigned long long)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+static void scan_arm(void)
+{
+	if (scan_timer != NULL || MOWGLI_LIST_LENGTH(&scan_list) == 0)
+		return;
+
+	/* a zero delay runs us on the next loop iteration, after I/O */
+	scan_timer = mowgli_timer_add_once(base_eventloop, "scan_run", scan_run, NULL, 0);
+}
+
+static void scan_finish(scan_t *scan, bool cancelled)
+{
+	mowgli_node_delete(&scan->node, &scan_list);
+
+	if (scan->done != NULL)
+		scan->done(scan, cancelled);
+
+	object_unref(scan->si);
+	free(scan);
+}
+
+/* returns true if the scan ran to its end */
+static bool scan_slice(scan_t *scan, unsigned long long until)
+{
+	void *data;
+	bool finished = false;
+	unsigned int n = 0;
+
+	if (scan->si->force_language != NULL)
+		language_set_active(scan->si->force_language);
+	else if (scan->si->smu != NULL)
+		language_set_active(scan->si->smu->language);
+
+	for (;;)
+	{
+		if (!scan->started)
+		{
+			mowgli_patricia_foreach_start(scan->tree, &scan->state);
+			scan->started = true;
+		}
+		else
+			mowgli_patricia_foreach_next(scan->tree, &scan->state);
+
+		data = mowgli_patricia_foreach_cur(scan->tree, &scan->state);
+		if (data == NULL)
+		{
+			finished = true;
+			break;
+		}
+
+		scan->visited++;
+		if (!scan->func(scan, data))
+		{
+			finished = true;
+			break;
+		}
+
+		if (until != 0 && ++n % SCAN_CHECK_INTERVAL == 0 && scan_mstime() >= until)
+			break;
+	}
+
+	language_set_active(NULL);
+	return finished;
+}
+
+static void scan_run(void *arg)
+{
+	mowgli_node_t *n, *tn;
+	scan_t *scan;
+	unsigned long long until;
+
+	/* one-shot timers are freed by the eventloop after they ran */
+	scan_timer = NULL;
+
+	until = scan_mstime() + SCAN_SLICE_MS;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, scan_list.head)
+	{
+		scan = n->data;
+
+		if (scan_slice(scan, until))
+			scan_finish(scan, false);
+		else
+		{
+			/* out of time: whoever ran last goes to the back */
+			mowgli_node_delete(&scan->node, &scan_list);
+			mowgli_node_add(scan, &scan->node, &scan_list);
+			break;
+		}
+	}
+
+	scan_arm();
+}
+
+/*
+ * scan_start()
+ *
+ * Inputs:
+ *       the requester, the tree to walk, a per-element callback, a
+ *       completion callback and opaque data for both
+ *
+ * Outputs:
+ *       true if the scan was accepted, false if it was refused
+ *
+ * Side Effects:
+ *       - the first slice runs immediately, small trees finish inside it
+ *       - requests from anything but an IRC user (XML-RPC, JSON-RPC,
+ *         fantasy) are answered in one go, as their replies are collected
+ *         when the command returns
+ *       - an IRC user may only have one scan running at a time; a refused
+ *         scan tells them so and leaves privdata to the caller
+ */
+bool scan_start(sourceinfo_t *si, mowgli_patricia_t *tree, scan_func_t func, scan_done_func_t done, void *privdata)
+{
+	mowgli_node_t *n;
+	scan_t *scan;
+	bool sync;
+
+	return_val_if_fail(si != NULL, false);
+	return_val_if_fail(tree != NULL, false);
+	return_val_if_fail(func != NULL, false);
+
+	sync = si->su == NULL || si->v != NULL || si->c != NULL;
+
+	if (!sync)
+	{
+		MOWGLI_ITER_FOREACH(n, scan_list.head)
+		{
+			scan = n->data;
+
+			if (scan->si->su == si->su)
+			{
+				command_fail(si, fault_toomany, _("You already have a search in progress. Please wait for it to finish."));
+				return false;
+			}
+		}
+	}
+
+	scan = smalloc(sizeof(scan_t));
+	memset(scan, 0, sizeof(scan_t));
+
+	scan->tree = tree;
+	scan->si = object_ref(si);
+	scan->func = func;
+	scan->done = done;
+	scan->privdata = privdata;
+
+	mowgli_node_add(scan, &scan->node, &scan_list);
+
+	if (scan_slice(scan, sync ? 0 : scan_mstime() + SCAN_SLICE_MS))
+		scan_finish(scan, false);
+	else
+		scan_arm();
+
+	/* command_exec() resets the language once we return */
+	if (si->force_language != NULL)
+		language_set_active(si->force_language);
+	else if (si->smu != NULL)
+		language_set_active(si->smu->language);
+
+	return true;
+}
+
+/*
+ * scan_forget()
+ *
+ * Inputs:
+ *       a tree and an element that is about to be deleted from it
+ *
+ * Outputs:
+ *       none
+ *
+ * Side Effects:
+ *       - suspended scans of the tree step over the element
+ */
+void scan_forget(mowgli_patricia_t *tree, void *data)
+{
+	mowgli_node_t *n;
+	mowgli_patricia_iteration_state_t peek;
+	scan_t *scan;
+
+	MOWGLI_ITER_FOREACH(n, scan_list.head)
+	{
+		scan = n->data;
+
+		if (scan->tree != tree || !scan->started)
+			continue;
+
+		peek = scan->state;
+		mowgli_patricia_foreach_next(tree, &peek);
+		if (mowgli_patricia_foreach_cur(tree, &peek) == data)
+			scan->state = peek;
+	}
+}
+
+/*
+ * scan_cancel_all()
+ *
+ * Inputs:
+ *       a per-element callback
+ *
+ * Outputs:
+ *       none
+ *
+ * Side Effects:
+ *       - all scans using the callback are cancelled; modules call this
+ *         when they are unloaded
+ */
+void scan_cancel_all(scan_func_t func)
+{
+	mowgli_node_t *n, *tn;
+	scan_t *scan;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, scan_list.head)
+	{
+		scan = n->data;
+
+		if (scan->func == func)
+			scan_finish(scan, true);
+	}
+}
+
+unsigned int scan_count(void)
+{
+	return MOWGLI_LIST_LENGTH(&scan_list);
+}
+
+static void scan_user_delete(user_t *u)
+{
+	mowgli_node_t *n, *tn;
+	scan_t *scan;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, scan_list.head)
+	{
+		scan = n->data;
+
+		if (scan->si->su == u)
+			scan_finish(scan, true);
+	}
+}
+
+static void scan_myuser_delete(myuser_t *mu)
+{
+	mowgli_node_t *n, *tn;
+	scan_t *scan;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, scan_list.head)
+	{
+		scan = n->data;
+
+		if (scan->si->smu == mu)
+			scan_finish(scan, true);
+	}
+}
+
+void scan_init(void)
+{
+	hook_add_event("user_delete");
+	hook_add_user_delete(scan_user_delete);
+	hook_add_event("myuser_delete");
+	hook_add_myuser_delete(scan_myuser_delete);
+}
+
+/* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
+ * vim:ts=8
+ * vim:sw=8
+ * vim:noexpandtab
+ */
@@ -109,6 +109,7 @@ server_t *server_add(const char *name, unsigned int hops, server_t *uplink, cons
 	{
 		s->sid = sstrdup(id);
 		mowgli_patricia_add(sidlist, s->sid, s);
+		p10_server_add(s);
 	}
 
 	/* check to see if it's hidden */
@@ -230,7 +231,10 @@ static void server_delete_serv(server_t *s)
 		mowgli_patricia_delete(servlist, s->name);
 
 	if (s->sid)
+	{
 		mowgli_patricia_delete(sidlist, s->sid);
+		p10_server_delete(s);
+	}
 
 	if (s->uplink)
 	{
@@ -274,6 +278,9 @@ server_t *server_find(const char *name)
 {
 	server_t *s;
 
+	if (ircd != NULL && ircd->uses_p10 && (s = p10_server_find(name)) != NULL)
+		return s;
+
 	s = mowgli_patricia_retrieve(sidlist, name);
 	if (s != NULL)
 		return s;
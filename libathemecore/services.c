@@ -170,20 +170,32 @@ void introduce_enforcer(const char *nick)
 	introduce_nick(u);
 }
 
-/* join a channel, creating it if necessary */
-void join(const char *chan, const char *nick)
+/* channels joined by join_batched() per event loop iteration */
+#define JOIN_BATCH_CHANNELS	128
+
+/* service clients waiting to join one channel */
+typedef struct {
+	mowgli_node_t node;
+	char *name;
+	mowgli_list_t nicks;
+} join_batch_t;
+
+static mowgli_list_t join_queue;
+static mowgli_patricia_t *join_pending = NULL;
+static mowgli_eventloop_timer_t *join_timer = NULL;
+
+/* join a channel with some clients, creating it if necessary;
+ * clients already on the channel are dropped from users */
+static void join_users(const char *chan, user_t **users, unsigned int count)
 {
 	channel_t *c;
-	user_t *u;
 	chanuser_t *cu;
 	bool isnew = false;
 	mychan_t *mc;
 	metadata_t *md;
 	time_t ts;
+	unsigned int i, j;
 
-	u = user_find_named(nick);
-	if (!u)
-		return;
 	c = channel_find(chan);
 	if (c == NULL)
 	{
@@ -208,26 +220,187 @@ void join(const char *chan, const char *nick)
 			check_modes(mc, false);
 		isnew = true;
 	}
-	else if (chanuser_find(c, u))
+	else
 	{
-		slog(LG_DEBUG, "join(): i'm already in `%s'", c->name);
+		for (i = j = 0; i < count; i++)
+		{
+			if (chanuser_find(c, users[i]))
+				slog(LG_DEBUG, "join(): %s is already in `%s'", users[i]->nick, c->name);
+			else
+				users[j++] = users[i];
+		}
+		count = j;
+	}
+
+	if (count == 0)
 		return;
+
+	if (count == 1)
+		join_sts(c, users[0], isnew, channel_modes(c, true));
+	else
+		join_batch_sts(c, users, count, isnew, channel_modes(c, true));
+
+	for (i = 0; i < count; i++)
+	{
+		cu = chanuser_add(c, CLIENT_NAME(users[i]));
+		cu->modes |= CSTATUS_OP;
 	}
-	join_sts(c, u, isnew, channel_modes(c, true));
-	cu = chanuser_add(c, CLIENT_NAME(u));
-	cu->modes |= CSTATUS_OP;
 	if (isnew)
 	{
 		hook_call_channel_add(c);
 	}
 }
 
+/* join a channel, creating it if necessary */
+void join(const char *chan, const char *nick)
+{
+	user_t *u;
+
+	u = user_find_named(nick);
+	if (!u)
+		return;
+	join_users(chan, &u, 1);
+}
+
+static void join_batch_free(join_batch_t *batch)
+{
+	mowgli_node_t *n, *tn;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, batch->nicks.head)
+	{
+		free(n->data);
+		mowgli_node_delete(n, &batch->nicks);
+		mowgli_node_free(n);
+	}
+
+	free(batch->name);
+	free(batch);
+}
+
+static void join_batch_run(void *arg)
+{
+	join_batch_t *batch;
+	mowgli_node_t *n;
+	user_t **users;
+	unsigned int i, count;
+
+	/* one-shot timers are freed by the eventloop after they ran */
+	join_timer = NULL;
+
+	for (i = 0; i < JOIN_BATCH_CHANNELS && join_queue.head != NULL; i++)
+	{
+		batch = join_queue.head->data;
+		mowgli_node_delete(&batch->node, &join_queue);
+		mowgli_patricia_delete(join_pending, batch->name);
+
+		users = smalloc(MOWGLI_LIST_LENGTH(&batch->nicks) * sizeof(user_t *));
+		count = 0;
+
+		/* the clients may have gone away while they were waiting */
+		MOWGLI_ITER_FOREACH(n, batch->nicks.head)
+		{
+			users[count] = user_find_named(n->data);
+			if (users[count] != NULL && is_internal_client(users[count]))
+				count++;
+		}
+
+		if (count != 0)
+			join_users(batch->name, users, count);
+
+		free(users);
+		join_batch_free(batch);
+	}
+
+	if (join_queue.head != NULL)
+		join_timer = mowgli_timer_add_once(base_eventloop, "join_batch_run", join_batch_run, NULL, 0);
+}
+
+/*
+ * join_batched()
+ *
+ * Inputs:
+ *       a channel name and the nick of a service client
+ *
+ * Outputs:
+ *       none
+ *
+ * Side Effects:
+ *       - the client joins the channel as join() would, but starting with
+ *         the next event loop iteration; all clients queued for the same
+ *         channel are sent in one go where the ircd allows it, and large
+ *         numbers of channels are spread over several iterations
+ *       - part() before then takes the client off the queue
+ */
+void join_batched(const char *chan, const char *nick)
+{
+	join_batch_t *batch;
+	mowgli_node_t *n;
+
+	return_if_fail(chan != NULL);
+	return_if_fail(nick != NULL);
+
+	if (join_pending == NULL)
+		join_pending = mowgli_patricia_create(irccasecanon);
+
+	batch = mowgli_patricia_retrieve(join_pending, chan);
+	if (batch == NULL)
+	{
+		batch = smalloc(sizeof(join_batch_t));
+		memset(batch, 0, sizeof(join_batch_t));
+		batch->name = sstrdup(chan);
+		mowgli_patricia_add(join_pending, batch->name, batch);
+		mowgli_node_add(batch, &batch->node, &join_queue);
+	}
+	else
+	{
+		MOWGLI_ITER_FOREACH(n, batch->nicks.head)
+		{
+			if (!irccasecmp(n->data, nick))
+				return;
+		}
+	}
+
+	mowgli_node_add(sstrdup(nick), mowgli_node_create(), &batch->nicks);
+
+	if (join_timer == NULL)
+		join_timer = mowgli_timer_add_once(base_eventloop, "join_batch_run", join_batch_run, NULL, 0);
+}
+
+static void join_batch_cancel(const char *chan, const char *nick)
+{
+	join_batch_t *batch;
+	mowgli_node_t *n;
+
+	if (join_pending == NULL || (batch = mowgli_patricia_retrieve(join_pending, chan)) == NULL)
+		return;
+
+	MOWGLI_ITER_FOREACH(n, batch->nicks.head)
+	{
+		if (!irccasecmp(n->data, nick))
+		{
+			free(n->data);
+			mowgli_node_delete(n, &batch->nicks);
+			mowgli_node_free(n);
+			break;
+		}
+	}
+
+	if (MOWGLI_LIST_LENGTH(&batch->nicks) == 0)
+	{
+		mowgli_node_delete(&batch->node, &join_queue);
+		mowgli_patricia_delete(join_pending, batch->name);
+		join_batch_free(batch);
+	}
+}
+
 /* part a channel */
 void part(const char *chan, const char *nick)
 {
 	channel_t *c = channel_find(chan);
 	user_t *u = user_find_named(nick);
 
+	join_batch_cancel(chan, nick);
+
 	if (!u || !c)
 		return;
 	if (!chanuser_find(c, u))
@@ -267,7 +440,7 @@ void joinall(const char *name)
 		/* service must be online and not a botserv bot */
 		if (svs->me == NULL || svs->botonly)
 			continue;
-		join(name, svs->me->nick);
+		join_batched(name, svs->me->nick);
 	}
 }
 
@@ -399,6 +572,118 @@ void handle_nickchange(user_t *u)
 	hook_call_nick_check(u);
 }
 
+/* bursted logins that need work past the account lookup, handled per
+ * event loop iteration once the user's server has finished its burst */
+#define BURSTLOGIN_BATCH	512
+
+typedef struct {
+	mowgli_node_t node;
+	char *target;		/* UID or nick of the user */
+	time_t ts;		/* the user's TS, to tell nick reuse apart
+				 * where there are no UIDs */
+	char *login;		/* account to log them out of, or whose
+				 * pending login hooks to run */
+	const char *reason;	/* why, or NULL to run the pending login hooks */
+} burstlogin_t;
+
+static mowgli_list_t burstlogin_queue;
+static mowgli_eventloop_timer_t *burstlogin_timer = NULL;
+
+static void burstlogin_defer(user_t *u, const char *login, const char *reason)
+{
+	burstlogin_t *bl;
+
+	bl = smalloc(sizeof(burstlogin_t));
+	bl->target = sstrdup(CLIENT_NAME(u));
+	bl->ts = u->ts;
+	bl->login = sstrdup(login);
+	bl->reason = reason;
+	mowgli_node_add(bl, &bl->node, &burstlogin_queue);
+}
+
+static user_t *burstlogin_user(burstlogin_t *bl)
+{
+	user_t *u = user_find(bl->target);
+
+	if (u == NULL || (!ircd->uses_uid && u->ts != bl->ts))
+		return NULL;
+
+	return u;
+}
+
+static void burstlogin_logout(user_t *u, const char *login, const char *reason)
+{
+	notice(nicksvs.nick ? nicksvs.nick : me.name, u->nick, reason, login);
+	ircd_on_logout(u, login);
+}
+
+static void burstlogin_run(void *arg)
+{
+	mowgli_node_t *n, *tn;
+	burstlogin_t *bl;
+	user_t *u;
+	myuser_t *mu;
+	unsigned int count = 0;
+
+	/* one-shot timers are freed by the eventloop after they ran */
+	burstlogin_timer = NULL;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, burstlogin_queue.head)
+	{
+		bl = n->data;
+		u = burstlogin_user(bl);
+
+		/* wait for the rest of this burst */
+		if (u != NULL && !(u->server->flags & SF_EOB))
+			continue;
+
+		if (count++ == BURSTLOGIN_BATCH)
+		{
+			burstlogin_timer = mowgli_timer_add_once(base_eventloop, "burstlogin_run", burstlogin_run, NULL, 0);
+			return;
+		}
+
+		mowgli_node_delete(&bl->node, &burstlogin_queue);
+
+		if (bl->reason != NULL)
+		{
+			if (u != NULL)
+				burstlogin_logout(u, bl->login, bl->reason);
+		}
+		else if ((mu = myuser_find(bl->login)) != NULL && mu->flags & MU_PENDINGLOGIN)
+		{
+			/* the user may have quit or logged out meanwhile;
+			 * the hooks are for the account, so any session of it
+			 * will do, and with none the flag waits for the next */
+			if (u == NULL || u->myuser != mu)
+				u = mu->logins.head != NULL ? mu->logins.head->data : NULL;
+			if (u != NULL)
+			{
+				mu->flags &= ~MU_PENDINGLOGIN;
+				slog(LG_DEBUG, "handle_burstlogin(): handling pending login hooks for %s", u->nick);
+				hook_call_user_identify(u);
+			}
+		}
+
+		free(bl->target);
+		free(bl->login);
+		free(bl);
+	}
+}
+
+static void burstlogin_eob(server_t *s)
+{
+	/* SF_EOB is only set after the hook ran */
+	if (burstlogin_timer == NULL && MOWGLI_LIST_LENGTH(&burstlogin_queue) != 0)
+		burstlogin_timer = mowgli_timer_add_once(base_eventloop, "burstlogin_run", burstlogin_run, NULL, 0);
+}
+
+void burstlogin_init(void)
+{
+	hook_add_event("server_eob");
+	hook_add_server_eob(burstlogin_eob);
+}
+
 /* User u is bursted as being logged in to login (if not NULL) or as
  * being identified to their current nick (if login is NULL)
  * The timestamp is the time of registration of the account, if the ircd
@@ -412,12 +697,18 @@ void handle_nickchange(user_t *u)
  *    in; for all users, postpone handle_nickchange() until the user's
  *    server confirms EOB
  * -- jilles
+ * The account itself is settled right away, as channel access checks
+ * during the burst need it. While the user's server is still bursting,
+ * forced logouts and the pending login hooks wait until it has finished,
+ * so a healing split does not stall on them.
  */
 void handle_burstlogin(user_t *u, const char *login, time_t ts)
 {
 	mynick_t *mn;
 	myuser_t *mu;
 	mowgli_node_t *n;
+	bool bursting = !(u->server->flags & SF_EOB);
+	const char *reason;
 
 	if (login != NULL)
 		/* don't allow alias nicks here -- jilles */
@@ -437,15 +728,18 @@ void handle_burstlogin(user_t *u, const char *login, time_t ts)
 			slog(LG_DEBUG, "handle_burstlogin(): got nonexistent login %s for user %s", login, u->nick);
 			if (authservice_loaded)
 			{
-				notice(nicksvs.nick ? nicksvs.nick : me.name, u->nick, _("Account %s dropped, forcing logout"), login);
-				ircd_on_logout(u, login);
+				reason = _("Account %s dropped, forcing logout");
+				if (bursting)
+					burstlogin_defer(u, login, reason);
+				else
+					burstlogin_logout(u, login, reason);
 			}
 			return;
 		}
 		/* we're running without a persistent db, create it */
 		mu = myuser_add(login, "*", "noemail", MU_CRYPTPASS);
 		if (ts != 0)
-			mu->registered = ts;
+			myuser_set_registered(mu, ts);
 		metadata_add(mu, "fake", "1");
 	}
 	if (u->myuser != NULL)	/* already logged in, hmm */
@@ -457,8 +751,11 @@ void handle_burstlogin(user_t *u, const char *login, time_t ts)
 		slog(LG_INFO, "handle_burstlogin(): got stale login %s for user %s", login, u->nick);
 		if (authservice_loaded)
 		{
-			notice(nicksvs.nick ? nicksvs.nick : me.name, u->nick, _("Login to account %s is stale, forcing logout"), login);
-			ircd_on_logout(u, login);
+			reason = _("Login to account %s is stale, forcing logout");
+			if (bursting)
+				burstlogin_defer(u, login, reason);
+			else
+				burstlogin_logout(u, login, reason);
 		}
 		return;
 	}
@@ -468,8 +765,11 @@ void handle_burstlogin(user_t *u, const char *login, time_t ts)
 		 * be legit...
 		 * if we have an authentication service, log them out */
 		slog(LG_INFO, "handle_burstlogin(): got illegit login %s for user %s", login, u->nick);
-		notice(nicksvs.nick ? nicksvs.nick : me.name, u->nick, _("Login to account %s seems invalid, forcing logout"), login);
-		ircd_on_logout(u, login);
+		reason = _("Login to account %s seems invalid, forcing logout");
+		if (bursting)
+			burstlogin_defer(u, login, reason);
+		else
+			burstlogin_logout(u, login, reason);
 		return;
 	}
 	u->myuser = mu;
@@ -481,9 +781,17 @@ void handle_burstlogin(user_t *u, const char *login, time_t ts)
 	/* XXX: ugh, this is a lame hack but I can't think of anything better... --nenolod */
 	if (mu->flags & MU_PENDINGLOGIN && authservice_loaded)
 	{
-		slog(LG_DEBUG, "handle_burstlogin(): handling pending login hooks for %s", u->nick);
-		mu->flags &= ~MU_PENDINGLOGIN;
-		hook_call_user_identify(u);
+		/* the flag stays until the hooks have run, so they are not
+		 * lost if this user quits first; entries queued for other
+		 * logins to the account find it cleared by then */
+		if (bursting)
+			burstlogin_defer(u, entity(mu)->name, NULL);
+		else
+		{
+			mu->flags &= ~MU_PENDINGLOGIN;
+			slog(LG_DEBUG, "handle_burstlogin(): handling pending login hooks for %s", u->nick);
+			hook_call_user_identify(u);
+		}
 	}
 }
 
@@ -530,7 +838,7 @@ void handle_setlogin(sourceinfo_t *si, user_t *u, const char *login, time_t ts)
 		/* we're running without a persistent db, create it */
 		mu = myuser_add(login, "*", "noemail", MU_CRYPTPASS);
 		if (ts != 0)
-			mu->registered = ts;
+			myuser_set_registered(mu, ts);
 		metadata_add(mu, "fake", "1");
 	}
 	else if (ts != 0 && ts != mu->registered)
@@ -548,7 +856,7 @@ void handle_setlogin(sourceinfo_t *si, user_t *u, const char *login, time_t ts)
 		slog(LG_DEBUG, "handle_setlogin(): changing registration time for %s from %lu to %lu",
 				entity(mu)->name, (unsigned long)mu->registered,
 				(unsigned long)ts);
-		mu->registered = ts;
+		myuser_set_registered(mu, ts);
 	}
 	u->myuser = mu;
 	u->flags &= ~UF_SOPER_PASS;
@@ -682,7 +990,7 @@ void myuser_login(service_t *svs, user_t *u, myuser_t *mu, bool sendaccount)
 		metadata_delete(mu, "private:loginfail:lastfailaddr");
 	}
 
-	mu->lastlogin = CURRTIME;
+	myuser_set_lastlogin(mu, CURRTIME);
 	mn = mynick_find(u->nick);
 	if (mn != NULL && mn->owner == mu)
 		mn->lastseen = CURRTIME;
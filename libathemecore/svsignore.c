@@ -53,6 +53,7 @@ svsignore_t *svsignore_add(const char *mask, const char *reason)
         mowgli_node_add(svsignore, n, &svs_ignore_list);
 
         svsignore->mask = sstrdup(mask);
+        svsignore->mask_pat = match_pattern_create(mask);
         svsignore->settime = CURRTIME;
         svsignore->reason = sstrdup(reason);
         cnt.svsignore++;
@@ -95,7 +96,7 @@ svsignore_t *svsignore_find(user_t *source)
         {
                 svsignore = (svsignore_t *)n->data;
 
-                if (!match(svsignore->mask, host))
+                if (!match_compiled(svsignore->mask_pat, host))
                         return svsignore;
         }
 
@@ -123,6 +124,7 @@ void svsignore_delete(svsignore_t *svsignore)
 	n = mowgli_node_find(svsignore, &svs_ignore_list);
 	mowgli_node_delete(n, &svs_ignore_list);
 
+	match_pattern_destroy(svsignore->mask_pat);
 	free(svsignore->mask);
 	free(svsignore->reason);
 	free(svsignore);
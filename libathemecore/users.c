@@ -28,6 +28,10 @@ mowgli_heap_t *user_heap;
 mowgli_patricia_t *userlist;
 mowgli_patricia_t *uidlist;
 
+/* the tries are kept in step for anything walking them in order */
+hashdict_t *userlist_hash;
+hashdict_t *uidlist_hash;
+
 /*
  * init_users()
  *
@@ -54,6 +58,8 @@ void init_users(void)
 
 	userlist = mowgli_patricia_create(irccasecanon);
 	uidlist = mowgli_patricia_create(noopcanon);
+	userlist_hash = hashdict_create(hashdict_hash_irccase, irccasecmp);
+	uidlist_hash = hashdict_create(hashdict_hash_exact, strcmp);
 }
 
 /*
@@ -157,6 +163,8 @@ user_t *user_add(const char *nick, const char *user, const char *host,
 	{
 		u->uid = strshare_get(uid);
 		mowgli_patricia_add(uidlist, u->uid, u);
+		hashdict_add(uidlist_hash, u->uid, u);
+		p10_user_add(u);
 	}
 
 	u->nick = strshare_get(nick);
@@ -176,6 +184,7 @@ user_t *user_add(const char *nick, const char *user, const char *host,
 	u->ts = ts ? ts : CURRTIME;
 
 	mowgli_patricia_add(userlist, u->nick, u);
+	hashdict_add(userlist_hash, u->nick, u);
 
 	cnt.user++;
 
@@ -244,10 +253,16 @@ void user_delete(user_t *u, const char *comment)
 		chanuser_delete(cu->chan, u);
 	}
 
+	scan_forget(userlist, u);
+	hashdict_delete(userlist_hash, u->nick);
 	mowgli_patricia_delete(userlist, u->nick);
 
 	if (u->uid != NULL)
+	{
+		hashdict_delete(uidlist_hash, u->uid);
 		mowgli_patricia_delete(uidlist, u->uid);
+		p10_user_delete(u);
+	}
 
 	mowgli_node_delete(&u->snode, &u->server->userlist);
 
@@ -262,7 +277,7 @@ void user_delete(user_t *u, const char *comment)
 				break;
 			}
 		}
-		u->myuser->lastlogin = CURRTIME;
+		myuser_set_lastlogin(u->myuser, CURRTIME);
 		if ((mn = mynick_find(u->nick)) != NULL &&
 				mn->owner == u->myuser)
 			mn->lastseen = CURRTIME;
@@ -307,15 +322,18 @@ user_t *user_find(const char *nick)
 
 	return_val_if_fail(nick != NULL, NULL);
 
+	if (ircd->uses_p10 && (u = p10_user_find(nick)) != NULL)
+		return u;
+
 	if (ircd->uses_uid)
 	{
-		u = mowgli_patricia_retrieve(uidlist, nick);
+		u = hashdict_retrieve(uidlist_hash, nick);
 
 		if (u != NULL)
 			return u;
 	}
 
-	u = mowgli_patricia_retrieve(userlist, nick);
+	u = hashdict_retrieve(userlist_hash, nick);
 
 	if (u != NULL)
 	{
@@ -344,7 +362,7 @@ user_t *user_find(const char *nick)
  */
 user_t *user_find_named(const char *nick)
 {
-	return mowgli_patricia_retrieve(userlist, nick);
+	return hashdict_retrieve(userlist_hash, nick);
 }
 
 /*
@@ -367,13 +385,21 @@ void user_changeuid(user_t *u, const char *uid)
 	return_if_fail(u != NULL);
 
 	if (u->uid != NULL)
+	{
+		hashdict_delete(uidlist_hash, u->uid);
 		mowgli_patricia_delete(uidlist, u->uid);
+		p10_user_delete(u);
+	}
 
 	strshare_unref(u->uid);
 	u->uid = strshare_get(uid);
 
 	if (u->uid != NULL)
+	{
 		mowgli_patricia_add(uidlist, u->uid, u);
+		hashdict_add(uidlist_hash, u->uid, u);
+		p10_user_add(u);
+	}
 }
 
 /*
@@ -489,6 +515,8 @@ bool user_changenick(user_t *u, const char *nick, time_t ts)
 	if (u->myuser != NULL && (mn = mynick_find(u->nick)) != NULL &&
 			mn->owner == u->myuser)
 		mn->lastseen = CURRTIME;
+	scan_forget(userlist, u);
+	hashdict_delete(userlist_hash, u->nick);
 	mowgli_patricia_delete(userlist, u->nick);
 
 	strshare_unref(u->nick);
@@ -497,6 +525,7 @@ bool user_changenick(user_t *u, const char *nick, time_t ts)
 	u->ts = ts;
 
 	mowgli_patricia_add(userlist, u->nick, u);
+	hashdict_add(userlist_hash, u->nick, u);
 
 	if (doenforcer)
 		introduce_enforcer(oldnick);
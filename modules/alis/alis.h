@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2026 Zohlai Development Group
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * ALIS channel index.
+ *
+ */
+
+#ifndef ALIS_H
+#define ALIS_H
+
+#include "atheme.h"
+
+/* length of the channel name prefixes kept in the prefix index */
+#define ALIS_PREFIXLEN		4
+
+/* member counts at or above this share the last user-count bucket */
+#define ALIS_COUNT_BUCKETS	1024
+
+typedef enum {
+	ALIS_PLAN_SCAN,		/* nothing better than walking chanlist */
+	ALIS_PLAN_NONE,		/* the index proves nothing can match */
+	ALIS_PLAN_PREFIX,	/* channels sharing a name prefix */
+	ALIS_PLAN_NAME,		/* channels whose name has a trigram */
+	ALIS_PLAN_TOPIC,	/* channels whose topic has a trigram */
+	ALIS_PLAN_COUNT,	/* channels within a member count range */
+} alis_plan_type_t;
+
+typedef struct {
+	alis_plan_type_t type;
+	unsigned int estimate;
+	void *source;
+	int min, max;
+} alis_plan_t;
+
+E void alis_index_init(void);
+E void alis_index_deinit(void);
+E void alis_index_plan(alis_plan_t *plan, const char *mask, const char *topic, int min, int max);
+E void alis_index_foreach(const alis_plan_t *plan, bool (*cb)(channel_t *c, void *privdata), void *privdata);
+
+#endif
+
+/* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
+ * vim:ts=8
+ * vim:sw=8
+ * vim:noexpandtab
+ */
@@ -0,0 +1,513 @@
+/*
+ * Copyright (c) 2026 Zohlai Development Group
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * An incrementally maintained index over channels for ALIS: trigrams of
+ * names and topics, channels by name prefix and channels by member
+ * count. The index only narrows a query down; every candidate is still
+ * checked with show_channel().
+ *
+ */
+
+#include "atheme.h"
+#include "alis.h"
+
+typedef struct alis_chan_ alis_chan_t;
+typedef struct alis_gram_ alis_gram_t;
+
+enum {
+	FIELD_NAME,
+	FIELD_TOPIC,
+	FIELD_COUNT
+};
+
+/* channels containing one trigram, in no particular order */
+struct alis_gram_ {
+	char key[4];
+
+	alis_chan_t **chans;
+	unsigned int count, size;
+};
+
+typedef struct {
+	alis_gram_t *gram;
+	unsigned int pos;	/* index in gram->chans */
+} alis_posting_t;
+
+struct alis_chan_ {
+	channel_t *chan;
+
+	alis_posting_t *postings[FIELD_COUNT];
+	unsigned int npostings[FIELD_COUNT];
+
+	mowgli_node_t prefix_node;
+	mowgli_list_t *prefix_bucket;
+
+	mowgli_node_t count_node;
+	unsigned int count_bucket;
+};
+
+static mowgli_patricia_t *alis_chans;
+static mowgli_patricia_t *alis_grams[FIELD_COUNT];
+static mowgli_patricia_t *alis_prefixes;
+static mowgli_list_t alis_counts[ALIS_COUNT_BUCKETS];
+
+/*
+ * trigrams
+ */
+
+static int gram_cmp(const void *a, const void *b)
+{
+	return memcmp(a, b, 3);
+}
+
+static void gram_remove_one(alis_chan_t *ac, unsigned int field, alis_posting_t *p)
+{
+	alis_gram_t *g = p->gram;
+	alis_chan_t *last;
+	unsigned int i;
+
+	last = g->chans[--g->count];
+	if (last != ac)
+	{
+		g->chans[p->pos] = last;
+
+		for (i = 0; i < last->npostings[field]; i++)
+			if (last->postings[field][i].gram == g)
+			{
+				last->postings[field][i].pos = p->pos;
+				break;
+			}
+	}
+
+	if (g->count == 0)
+	{
+		mowgli_patricia_delete(alis_grams[field], g->key);
+		free(g->chans);
+		free(g);
+	}
+}
+
+static void grams_remove(alis_chan_t *ac, unsigned int field)
+{
+	unsigned int i;
+
+	for (i = 0; i < ac->npostings[field]; i++)
+		gram_remove_one(ac, field, &ac->postings[field][i]);
+
+	free(ac->postings[field]);
+	ac->postings[field] = NULL;
+	ac->npostings[field] = 0;
+}
+
+static void grams_add(alis_chan_t *ac, unsigned int field, const char *text)
+{
+	size_t len, i, n;
+	char *keys, key[4];
+	alis_gram_t *g;
+	alis_posting_t *p;
+
+	if (text == NULL || (len = strlen(text)) < 3)
+		return;
+
+	/* collect the distinct lowercased trigrams */
+	keys = smalloc((len - 2) * 3);
+	for (i = 0; i + 3 <= len; i++)
+	{
+		keys[i * 3] = ToLower(text[i]);
+		keys[i * 3 + 1] = ToLower(text[i + 1]);
+		keys[i * 3 + 2] = ToLower(text[i + 2]);
+	}
+	qsort(keys, len - 2, 3, gram_cmp);
+
+	ac->postings[field] = smalloc((len - 2) * sizeof(alis_posting_t));
+
+	for (i = 0, n = 0; i < len - 2; i++)
+	{
+		if (i > 0 && !memcmp(keys + i * 3, keys + (i - 1) * 3, 3))
+			continue;
+
+		memcpy(key, keys + i * 3, 3);
+		key[3] = '\0';
+
+		if ((g = mowgli_patricia_retrieve(alis_grams[field], key)) == NULL)
+		{
+			g = smalloc(sizeof(alis_gram_t));
+			memset(g, 0, sizeof(alis_gram_t));
+			memcpy(g->key, key, sizeof key);
+			mowgli_patricia_add(alis_grams[field], g->key, g);
+		}
+
+		if (g->count == g->size)
+		{
+			g->size = g->size ? g->size * 2 : 4;
+			g->chans = srealloc(g->chans, g->size * sizeof(alis_chan_t *));
+		}
+
+		p = &ac->postings[field][n++];
+		p->gram = g;
+		p->pos = g->count;
+		g->chans[g->count++] = ac;
+	}
+
+	ac->npostings[field] = n;
+	free(keys);
+}
+
+/* the rarest trigram of the literal runs in a match() pattern; returns
+ * false if some trigram is in no channel at all, so nothing can match */
+static bool grams_best(unsigned int field, const char *pattern, bool literal_first, alis_gram_t **best)
+{
+	const char *p, *run;
+	char key[4];
+	alis_gram_t *g;
+	size_t len, i;
+
+	*best = NULL;
+
+	for (p = pattern; *p != '\0'; )
+	{
+		/* '?', '&', '#' and '%' match a class of characters; a leading
+		 * '#' or '&' can only be itself in a channel name */
+		run = p;
+		while (*p != '\0' && !strchr("*?\\%", *p) &&
+				!((*p == '#' || *p == '&') && !(literal_first && p == pattern)))
+			p++;
+
+		len = p - run;
+		for (i = 0; i + 3 <= len; i++)
+		{
+			key[0] = ToLower(run[i]);
+			key[1] = ToLower(run[i + 1]);
+			key[2] = ToLower(run[i + 2]);
+			key[3] = '\0';
+
+			if ((g = mowgli_patricia_retrieve(alis_grams[field], key)) == NULL)
+				return false;
+
+			if (*best == NULL || g->count < (*best)->count)
+				*best = g;
+		}
+
+		if (*p == '\\' && p[1] != '\0')
+			p += 2;
+		else if (*p != '\0')
+			p++;
+	}
+
+	return true;
+}
+
+/*
+ * name prefixes
+ */
+
+static void prefix_key(char *buf, const char *name)
+{
+	mowgli_strlcpy(buf, name, ALIS_PREFIXLEN + 1);
+}
+
+static void prefix_add(alis_chan_t *ac)
+{
+	char key[ALIS_PREFIXLEN + 1];
+	mowgli_list_t *bucket;
+
+	prefix_key(key, ac->chan->name);
+
+	if ((bucket = mowgli_patricia_retrieve(alis_prefixes, key)) == NULL)
+	{
+		bucket = mowgli_list_create();
+		mowgli_patricia_add(alis_prefixes, key, bucket);
+	}
+
+	ac->prefix_bucket = bucket;
+	mowgli_node_add(ac, &ac->prefix_node, bucket);
+}
+
+static void prefix_remove(alis_chan_t *ac)
+{
+	char key[ALIS_PREFIXLEN + 1];
+
+	mowgli_node_delete(&ac->prefix_node, ac->prefix_bucket);
+
+	if (MOWGLI_LIST_LENGTH(ac->prefix_bucket) == 0)
+	{
+		prefix_key(key, ac->chan->name);
+		mowgli_patricia_delete(alis_prefixes, key);
+		mowgli_list_free(ac->prefix_bucket);
+	}
+
+	ac->prefix_bucket = NULL;
+}
+
+/*
+ * member counts
+ */
+
+static void count_set(alis_chan_t *ac, unsigned int count)
+{
+	unsigned int bucket = count < ALIS_COUNT_BUCKETS ? count : ALIS_COUNT_BUCKETS - 1;
+
+	if (bucket == ac->count_bucket)
+		return;
+
+	mowgli_node_delete(&ac->count_node, &alis_counts[ac->count_bucket]);
+	ac->count_bucket = bucket;
+	mowgli_node_add(ac, &ac->count_node, &alis_counts[bucket]);
+}
+
+/*
+ * channel tracking
+ */
+
+static alis_chan_t *alis_chan_add(channel_t *c)
+{
+	alis_chan_t *ac;
+
+	if ((ac = mowgli_patricia_retrieve(alis_chans, c->name)) != NULL)
+		return ac;
+
+	ac = smalloc(sizeof(alis_chan_t));
+	memset(ac, 0, sizeof(alis_chan_t));
+	ac->chan = c;
+	mowgli_patricia_add(alis_chans, c->name, ac);
+
+	grams_add(ac, FIELD_NAME, c->name);
+	grams_add(ac, FIELD_TOPIC, c->topic);
+	prefix_add(ac);
+
+	ac->count_bucket = 0;
+	mowgli_node_add(ac, &ac->count_node, &alis_counts[0]);
+	count_set(ac, MOWGLI_LIST_LENGTH(&c->members));
+
+	return ac;
+}
+
+static void alis_chan_free(alis_chan_t *ac)
+{
+	unsigned int i;
+
+	for (i = 0; i < FIELD_COUNT; i++)
+		grams_remove(ac, i);
+	prefix_remove(ac);
+	mowgli_node_delete(&ac->count_node, &alis_counts[ac->count_bucket]);
+
+	free(ac);
+}
+
+static void alis_channel_add(channel_t *c)
+{
+	alis_chan_add(c);
+}
+
+static void alis_channel_delete(channel_t *c)
+{
+	alis_chan_t *ac;
+
+	if ((ac = mowgli_patricia_retrieve(alis_chans, c->name)) != NULL)
+	{
+		mowgli_patricia_delete(alis_chans, c->name);
+		alis_chan_free(ac);
+	}
+}
+
+static void alis_channel_topic(channel_t *c)
+{
+	alis_chan_t *ac;
+
+	if ((ac = mowgli_patricia_retrieve(alis_chans, c->name)) == NULL)
+		return;
+
+	grams_remove(ac, FIELD_TOPIC);
+	grams_add(ac, FIELD_TOPIC, c->topic);
+}
+
+static void alis_channel_join(hook_channel_joinpart_t *hdata)
+{
+	chanuser_t *cu = hdata->cu;
+
+	if (cu == NULL)
+		return;
+
+	/* channels created by services do not call channel_add */
+	count_set(alis_chan_add(cu->chan), MOWGLI_LIST_LENGTH(&cu->chan->members));
+}
+
+static void alis_channel_part(hook_channel_joinpart_t *hdata)
+{
+	chanuser_t *cu = hdata->cu;
+	alis_chan_t *ac;
+
+	if (cu == NULL)
+		return;
+
+	/* called before the member is removed */
+	if ((ac = mowgli_patricia_retrieve(alis_chans, cu->chan->name)) != NULL)
+		count_set(ac, MOWGLI_LIST_LENGTH(&cu->chan->members) - 1);
+}
+
+void alis_index_init(void)
+{
+	mowgli_patricia_iteration_state_t state;
+	channel_t *c;
+	unsigned int i;
+
+	alis_chans = mowgli_patricia_create(irccasecanon);
+	for (i = 0; i < FIELD_COUNT; i++)
+		alis_grams[i] = mowgli_patricia_create(noopcanon);
+	alis_prefixes = mowgli_patricia_create(irccasecanon);
+
+	MOWGLI_PATRICIA_FOREACH(c, &state, chanlist)
+		alis_chan_add(c);
+
+	hook_add_event("channel_add");
+	hook_add_channel_add(alis_channel_add);
+	hook_add_event("channel_delete");
+	hook_add_channel_delete(alis_channel_delete);
+	hook_add_event("channel_topic");
+	hook_add_channel_topic(alis_channel_topic);
+	hook_add_event("channel_join");
+	hook_add_channel_join(alis_channel_join);
+	hook_add_event("channel_part");
+	hook_add_channel_part(alis_channel_part);
+}
+
+static void alis_chan_destroy_cb(const char *key, void *data, void *privdata)
+{
+	alis_chan_free(data);
+}
+
+void alis_index_deinit(void)
+{
+	unsigned int i;
+
+	hook_del_channel_add(alis_channel_add);
+	hook_del_channel_delete(alis_channel_delete);
+	hook_del_channel_topic(alis_channel_topic);
+	hook_del_channel_join(alis_channel_join);
+	hook_del_channel_part(alis_channel_part);
+
+	mowgli_patricia_destroy(alis_chans, alis_chan_destroy_cb, NULL);
+	for (i = 0; i < FIELD_COUNT; i++)
+		mowgli_patricia_destroy(alis_grams[i], NULL, NULL);
+	mowgli_patricia_destroy(alis_prefixes, NULL, NULL);
+}
+
+/*
+ * queries
+ */
+
+static void plan_consider(alis_plan_t *best, alis_plan_type_t type, unsigned int estimate, void *source)
+{
+	if (best->type != ALIS_PLAN_SCAN && best->estimate <= estimate)
+		return;
+
+	best->type = type;
+	best->estimate = estimate;
+	best->source = source;
+}
+
+/*
+ * alis_index_plan()
+ *
+ * Picks the smallest candidate set the index has for a query; plan->type
+ * is ALIS_PLAN_SCAN if the index cannot help.
+ */
+void alis_index_plan(alis_plan_t *plan, const char *mask, const char *topic, int min, int max)
+{
+	alis_gram_t *g;
+	mowgli_list_t *bucket;
+	char key[ALIS_PREFIXLEN + 1];
+	size_t len;
+	unsigned int i, lo, hi, count;
+
+	memset(plan, 0, sizeof *plan);
+	plan->type = ALIS_PLAN_SCAN;
+	plan->min = min;
+	plan->max = max;
+
+	/* a literal prefix, where only the first character may be # or & */
+	len = *mask != '\0' && !strchr("*?\\%", *mask) ? 1 + strcspn(mask + 1, "*?\\%#&") : 0;
+	if (len >= ALIS_PREFIXLEN)
+	{
+		prefix_key(key, mask);
+		bucket = mowgli_patricia_retrieve(alis_prefixes, key);
+
+		if (bucket == NULL)
+			plan_consider(plan, ALIS_PLAN_NONE, 0, NULL);
+		else
+			plan_consider(plan, ALIS_PLAN_PREFIX, MOWGLI_LIST_LENGTH(bucket), bucket);
+	}
+
+	if (!grams_best(FIELD_NAME, mask, true, &g))
+		plan_consider(plan, ALIS_PLAN_NONE, 0, NULL);
+	else if (g != NULL)
+		plan_consider(plan, ALIS_PLAN_NAME, g->count, g);
+
+	if (topic != NULL)
+	{
+		if (!grams_best(FIELD_TOPIC, topic, false, &g))
+			plan_consider(plan, ALIS_PLAN_NONE, 0, NULL);
+		else if (g != NULL)
+			plan_consider(plan, ALIS_PLAN_TOPIC, g->count, g);
+	}
+
+	if (min > 0 || max > 0)
+	{
+		lo = min < ALIS_COUNT_BUCKETS ? min : ALIS_COUNT_BUCKETS - 1;
+		hi = max > 0 && max < ALIS_COUNT_BUCKETS ? max : ALIS_COUNT_BUCKETS - 1;
+
+		for (i = lo, count = 0; i <= hi; i++)
+			count += MOWGLI_LIST_LENGTH(&alis_counts[i]);
+
+		plan_consider(plan, ALIS_PLAN_COUNT, count, NULL);
+	}
+}
+
+/*
+ * alis_index_foreach()
+ *
+ * Calls cb for each candidate of a plan until it returns false. Member
+ * count plans visit the biggest channels first.
+ */
+void alis_index_foreach(const alis_plan_t *plan, bool (*cb)(channel_t *c, void *privdata), void *privdata)
+{
+	mowgli_list_t *bucket;
+	alis_gram_t *g;
+	mowgli_node_t *n;
+	unsigned int i, lo, hi;
+
+	switch (plan->type)
+	{
+	case ALIS_PLAN_PREFIX:
+		bucket = plan->source;
+		MOWGLI_ITER_FOREACH(n, bucket->head)
+			if (!cb(((alis_chan_t *)n->data)->chan, privdata))
+				return;
+		break;
+	case ALIS_PLAN_NAME:
+	case ALIS_PLAN_TOPIC:
+		g = plan->source;
+		for (i = 0; i < g->count; i++)
+			if (!cb(g->chans[i]->chan, privdata))
+				return;
+		break;
+	case ALIS_PLAN_COUNT:
+		lo = plan->min < ALIS_COUNT_BUCKETS ? plan->min : ALIS_COUNT_BUCKETS - 1;
+		hi = plan->max > 0 && plan->max < ALIS_COUNT_BUCKETS ? plan->max : ALIS_COUNT_BUCKETS - 1;
+
+		for (i = hi + 1; i-- > lo; )
+			MOWGLI_ITER_FOREACH(n, alis_counts[i].head)
+				if (!cb(((alis_chan_t *)n->data)->chan, privdata))
+					return;
+		break;
+	default:
+		break;
+	}
+}
+
+/* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
+ * vim:ts=8
+ * vim:sw=8
+ * vim:noexpandtab
+ */
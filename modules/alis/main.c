@@ -34,6 +34,7 @@
  */
 
 #include "atheme.h"
+#include "alis.h"
 #include <limits.h>
 
 DECLARE_MODULE_V1
@@ -46,6 +47,9 @@ DECLARE_MODULE_V1
 #define ALIS_MAX_PARC	10
 #define ALIS_MAX_MATCH	60
 
+/* index candidates above this are left to the time-sliced scan */
+#define ALIS_INDEX_MAX	20000
+
 #define DIR_NONE	-1
 #define DIR_UNSET	0
 #define DIR_SET		1
@@ -55,6 +59,7 @@ service_t *alis;
 
 static void alis_cmd_list(sourceinfo_t *si, int parc, char *parv[]);
 static void alis_cmd_help(sourceinfo_t *si, int parc, char *parv[]);
+static bool alis_scan(scan_t *scan, void *data);
 
 command_t alis_list = { "LIST", "Lists channels matching given parameters.",
 				AC_NONE, ALIS_MAX_PARC, alis_cmd_list, { .path = "alis/list" } };
@@ -65,6 +70,8 @@ struct alis_query
 {
 	char *mask;
 	char *topic;
+	match_pattern_t *mask_pat;
+	match_pattern_t *topic_pat;
 	int min;
 	int max;
 	int show_mode;
@@ -84,10 +91,14 @@ void _modinit(module_t *m)
 	alis = service_add("alis", NULL);
 	service_bind_command(alis, &alis_list);
 	service_bind_command(alis, &alis_help);
+
+	alis_index_init();
 }
 
 void _moddeinit(module_unload_intent_t intent)
 {
+	scan_cancel_all(alis_scan);
+	alis_index_deinit();
 	service_unbind_command(alis, &alis_list);
 	service_unbind_command(alis, &alis_help);
 
@@ -295,6 +306,9 @@ static void free_alis(struct alis_query *query)
 
 	if (query->topic)
 		free(query->topic);
+
+	match_pattern_destroy(query->mask_pat);
+	match_pattern_destroy(query->topic_pat);
 }
 
 static void print_channel(sourceinfo_t *si, channel_t *chptr, struct alis_query *query)
@@ -385,10 +399,10 @@ static int show_channel(channel_t *chptr, struct alis_query *query)
 				return 0;
 	}
 
-	if(match(query->mask, chptr->name))
+	if(match_compiled(query->mask_pat, chptr->name))
 		return 0;
 
-	if(query->topic != NULL && match(query->topic, chptr->topic))
+	if(query->topic != NULL && match_compiled(query->topic_pat, chptr->topic))
 		return 0;
 
 	if(query->skip)
@@ -400,63 +414,116 @@ static int show_channel(channel_t *chptr, struct alis_query *query)
 	return 1;
 }
 
+static bool alis_check(sourceinfo_t *si, channel_t *chptr, struct alis_query *query)
+{
+	/* matches, so show it */
+	if(show_channel(chptr, query))
+	{
+		print_channel(si, chptr, query);
+
+		if(--query->maxmatches == 0)
+		{
+			command_success_nodata(si, "Maximum channel output reached");
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool alis_scan(scan_t *scan, void *data)
+{
+	return alis_check(scan->si, data, scan->privdata);
+}
+
+struct alis_visit
+{
+	sourceinfo_t *si;
+	struct alis_query *query;
+};
+
+static bool alis_visit(channel_t *chptr, void *privdata)
+{
+	struct alis_visit *visit = privdata;
+
+	return alis_check(visit->si, chptr, visit->query);
+}
+
+static void alis_scan_done(scan_t *scan, bool cancelled)
+{
+	struct alis_query *query = scan->privdata;
+
+	if (!cancelled)
+		command_success_nodata(scan->si, "End of output");
+
+	free_alis(query);
+	free(query);
+}
+
 static void alis_cmd_list(sourceinfo_t *si, int parc, char *parv[])
 {
 	channel_t *chptr;
-	struct alis_query query;
-	mowgli_patricia_iteration_state_t state;
-	int maxmatch;
+	struct alis_query *query;
+	struct alis_visit visit;
+	alis_plan_t plan;
 
-	memset(&query, 0, sizeof(struct alis_query));
-	query.maxmatches = ALIS_MAX_MATCH;
+	query = smalloc(sizeof(struct alis_query));
+	memset(query, 0, sizeof(struct alis_query));
+	query->maxmatches = ALIS_MAX_MATCH;
 
-	if (!parse_alis(si, parc, parv, &query))
+	if (!parse_alis(si, parc, parv, query))
 	{
-		free_alis(&query);
+		free_alis(query);
+		free(query);
 		return;
 	}
 
-	logcommand(si, CMDLOG_GET, "LIST: \2%s\2", query.mask);
+	query->mask_pat = match_pattern_create(query->mask);
+	if (query->topic != NULL)
+		query->topic_pat = match_pattern_create(query->topic);
+
+	logcommand(si, CMDLOG_GET, "LIST: \2%s\2", query->mask);
 
-	maxmatch = query.maxmatches;
 	command_success_nodata(si,
 		"Returning maximum of %d channel names matching '\2%s\2'",
-		query.maxmatches, query.mask);
+		query->maxmatches, query->mask);
 
 	/* hunting for one channel.. */
-	if(strchr(query.mask, '*') == NULL && strchr(query.mask, '?') == NULL)
+	if(strchr(query->mask, '*') == NULL && strchr(query->mask, '?') == NULL)
 	{
-		if((chptr = channel_find(query.mask)) != NULL)
+		if((chptr = channel_find(query->mask)) != NULL)
 		{
 			if(!(chptr->modes & CMODE_SEC) ||
 					(si->su != NULL &&
 					 chanuser_find(chptr, si->su)))
-				print_channel(si, chptr, &query);
+				print_channel(si, chptr, query);
 		}
 
 		command_success_nodata(si, "End of output");
-		free_alis(&query);
+		free_alis(query);
+		free(query);
 		return;
 	}
 
-	MOWGLI_PATRICIA_FOREACH(chptr, &state, chanlist)
+	/* small candidate sets from the index are answered right away */
+	alis_index_plan(&plan, query->mask, query->topic, query->min, query->max);
+	if (plan.type != ALIS_PLAN_SCAN && plan.estimate <= ALIS_INDEX_MAX)
 	{
-		/* matches, so show it */
-		if(show_channel(chptr, &query))
-		{
-			print_channel(si, chptr, &query);
+		visit.si = si;
+		visit.query = query;
+		alis_index_foreach(&plan, alis_visit, &visit);
 
-			if(--maxmatch == 0)
-			{
-				command_success_nodata(si, "Maximum channel output reached");
-				break;
-			}
-		}
+		command_success_nodata(si, "End of output");
+		free_alis(query);
+		free(query);
+		return;
 	}
 
-	command_success_nodata(si, "End of output");
-	free_alis(&query);
-	return;
+	if (!scan_start(si, chanlist, alis_scan, alis_scan_done, query))
+	{
+		free_alis(query);
+		free(query);
+	}
 }
 
 static void alis_cmd_help(sourceinfo_t *si, int parc, char *parv[])
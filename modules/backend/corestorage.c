@@ -48,6 +48,7 @@ corestorage_db_save(database_handle_t *db)
 	mowgli_node_t *n, *tn;
 	mowgli_patricia_iteration_state_t state;
 	myentity_iteration_state_t mestate;
+	metadata_iteration_state_t mdstate;
 
 	errno = 0;
 
@@ -97,7 +98,7 @@ corestorage_db_save(database_handle_t *db)
 
 		if (object(mu)->metadata)
 		{
-			MOWGLI_PATRICIA_FOREACH(md, &state, object(mu)->metadata)
+			METADATA_FOREACH(md, &mdstate, mu)
 			{
 				db_start_row(db, "MDU");
 				db_write_word(db, entity(mu)->name);
@@ -166,7 +167,7 @@ corestorage_db_save(database_handle_t *db)
 
 	MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
 	{
-		mowgli_patricia_iteration_state_t state2;
+		metadata_iteration_state_t state2;
 
 		char *flags = gflags_tostr(mc_flags, mc->flags);
 		/* find a founder */
@@ -212,7 +213,7 @@ corestorage_db_save(database_handle_t *db)
 
 			if (object(ca)->metadata)
 			{
-				MOWGLI_PATRICIA_FOREACH(md, &state2, object(ca)->metadata)
+				METADATA_FOREACH(md, &state2, ca)
 				{
 					db_start_row(db, "MDA");
 					db_write_word(db, ca->mychan->name);
@@ -226,7 +227,7 @@ corestorage_db_save(database_handle_t *db)
 
 		if (object(mc)->metadata)
 		{
-			MOWGLI_PATRICIA_FOREACH(md, &state2, object(mc)->metadata)
+			METADATA_FOREACH(md, &state2, mc)
 			{
 				db_start_row(db, "MDC");
 				db_write_word(db, mc->name);
@@ -240,7 +241,7 @@ corestorage_db_save(database_handle_t *db)
 	/* Old names */
 	MOWGLI_PATRICIA_FOREACH(mun, &state, oldnameslist)
 	{
-		mowgli_patricia_iteration_state_t state2;
+		metadata_iteration_state_t state2;
 
 		db_start_row(db, "NAM");
 		db_write_word(db, mun->name);
@@ -248,7 +249,7 @@ corestorage_db_save(database_handle_t *db)
 
 		if (object(mun)->metadata)
 		{
-			MOWGLI_PATRICIA_FOREACH(md, &state2, object(mun)->metadata)
+			METADATA_FOREACH(md, &state2, mun)
 			{
 				db_start_row(db, "MDN");
 				db_write_word(db, mun->name);
@@ -437,8 +438,8 @@ static void corestorage_h_mu(database_handle_t *db, const char *type)
 
 
 	mu = myuser_add_id(uid, name, pass, email, flags);
-	mu->registered = reg;
-	mu->lastlogin = login;
+	myuser_set_registered(mu, reg);
+	myuser_set_lastlogin(mu, login);
 	if (language)
 		mu->language = language_add(language);
 }
@@ -842,8 +843,7 @@ static void corestorage_h_kl(database_handle_t *db, const char *type)
 	strip(buf);
 
 	k = kline_add_with_id(user, host, buf, duration, setby, id ? id : ++me.kline_id);
-	k->settime = settime;
-	k->expires = k->settime + k->duration;
+	kline_set_settime(k, settime);
 }
 
 static void corestorage_h_xid(database_handle_t *db, const char *type)
@@ -873,8 +873,7 @@ static void corestorage_h_xl(database_handle_t *db, const char *type)
 	strip(buf);
 
 	x = xline_add(realname, buf, duration, setby);
-	x->settime = settime;
-	x->expires = x->settime + x->duration;
+	xline_set_settime(x, settime);
 
 	if (id)
 		x->number = id;
@@ -907,8 +906,7 @@ static void corestorage_h_ql(database_handle_t *db, const char *type)
 	strip(buf);
 
 	q = qline_add(mask, buf, duration, setby);
-	q->settime = settime;
-	q->expires = q->settime + q->duration;
+	qline_set_settime(q, settime);
 
 	if (id)
 		q->number = id;
@@ -161,8 +161,8 @@ static void flatfile_db_load(const char *filename)
 
 				mu = myuser_add(muname, mupass, muemail, atol(flagstr));
 
-				mu->registered = registered;
-				mu->lastlogin = lastlogin;
+				myuser_set_registered(mu, registered);
+				myuser_set_lastlogin(mu, lastlogin);
 
 				if (strcmp(failnum, "0"))
 					metadata_add(mu, "private:loginfail:failnum", failnum);
@@ -624,9 +624,7 @@ static void flatfile_db_load(const char *filename)
 			strip(reason);
 
 			k = kline_add(user, host, reason, duration, setby);
-			k->settime = settime;
-			/* XXX this is not nice, oh well -- jilles */
-			k->expires = k->settime + k->duration;
+			kline_set_settime(k, settime);
 
 			kin++;
 		}
@@ -653,10 +651,7 @@ static void flatfile_db_load(const char *filename)
 			strip(reason);
 
 			x = xline_add(realname, reason, duration, setby);
-			x->settime = settime;
-
-			/* XXX this is not nice, oh well -- jilles */
-			x->expires = x->settime + x->duration;
+			xline_set_settime(x, settime);
 
 			xin++;
 		}
@@ -683,10 +678,7 @@ static void flatfile_db_load(const char *filename)
 			strip(reason);
 
 			q = qline_add(mask, reason, duration, setby);
-			q->settime = settime;
-
-			/* XXX this is not nice, oh well -- jilles */
-			q->expires = q->settime + q->duration;
+			qline_set_settime(q, settime);
 
 			qin++;
 		}
@@ -67,6 +67,7 @@ static botserv_bot_t *bs_mychan_find_bot(mychan_t *mc)
 
 		metadata_delete(mc, "private:botserv:bot-assigned");
 		metadata_delete(mc, "private:botserv:bot-handle-fantasy");
+		channel_message_update(mc);
 	}
 	return bot;
 }
@@ -273,25 +274,33 @@ bs_join_registered(bool all)
 		if ((md = metadata_find(mc, "private:botserv:bot-assigned")) == NULL)
 			continue;
 
-		if (all)
-		{
-			join(mc->name, md->value);
-			if (mc->chan && cs && chanuser_find(mc->chan, chansvs.me->me))
-				part(mc->name, chansvs.nick);
+		if (!all && (mc->chan == NULL || mc->chan->members.count == 0))
 			continue;
-		}
-		else if (mc->chan != NULL && mc->chan->members.count != 0)
+
+		/* the bot has to be in before ChanServ may leave, or the
+		 * channel could be destroyed in between */
+		if (mc->chan && cs && chanuser_find(mc->chan, chansvs.me->me))
 		{
 			join(mc->name, md->value);
-			if (mc->chan && cs && chanuser_find(mc->chan, chansvs.me->me))
-				part(mc->name, chansvs.nick);
-			continue;
+			part(mc->name, chansvs.nick);
 		}
+		else
+			join_batched(mc->name, md->value);
 	}
 }
 
 /* ******************************************************************** */
 
+/* fantasy commands, see botserv_channel_handler() */
+static void bs_message_subscribe(mychan_t *mc)
+{
+	if (!chansvs.fantasy || metadata_find(mc, "disable_fantasy") != NULL)
+		return;
+
+	if (metadata_find(mc, "private:botserv:bot-handle-fantasy") != NULL)
+		mc->chan->msgsubs |= CHANMSG_SERVICE;
+}
+
 static void bs_channel_drop(mychan_t *mc)
 {
 	botserv_bot_t *bot;
@@ -675,6 +684,7 @@ static void bs_cmd_change(sourceinfo_t *si, int parc, char *parv[])
 		{
 			metadata_add(mc, "private:botserv:bot-assigned", parv[1]);
 			metadata_add(mc, "private:botserv:bot-handle-fantasy", parv[1]);
+			channel_message_update(mc);
 			if (!config_options.leave_chans || (mc->chan != NULL && MOWGLI_LIST_LENGTH(&mc->chan->members) > 0))
 				join(mc->name, parv[1]);
 		}
@@ -792,6 +802,7 @@ static void bs_cmd_delete(sourceinfo_t *si, int parc, char *parv[])
 
 			metadata_delete(mc, "private:botserv:bot-assigned");
 			metadata_delete(mc, "private:botserv:bot-handle-fantasy");
+			channel_message_update(mc);
 		}
 	}
 
@@ -917,6 +928,7 @@ static void bs_cmd_assign(sourceinfo_t *si, int parc, char *parv[])
 
 	metadata_add(mc, "private:botserv:bot-assigned", parv[1]);
 	metadata_add(mc, "private:botserv:bot-handle-fantasy", parv[1]);
+	channel_message_update(mc);
 
 	logcommand(si, CMDLOG_SET, "BOT:ASSIGN: \2%s\2 to \2%s\2", parv[1], parv[0]);
 	command_success_nodata(si, _("Assigned the bot \2%s\2 to \2%s\2."), parv[1], parv[0]);
@@ -962,6 +974,7 @@ static void bs_cmd_unassign(sourceinfo_t *si, int parc, char *parv[])
 	part(mc->name, md->value);
 	metadata_delete(mc, "private:botserv:bot-assigned");
 	metadata_delete(mc, "private:botserv:bot-handle-fantasy");
+	channel_message_update(mc);
 	logcommand(si, CMDLOG_SET, "BOT:UNASSIGN: \2%s\2", parv[0]);
 	command_success_nodata(si, _("Unassigned the bot from \2%s\2."), parv[0]);
 }
@@ -987,6 +1000,9 @@ void _modinit(module_t *m)
 	hook_add_event("channel_drop");
 	hook_add_channel_drop(bs_channel_drop);
 
+	hook_add_event("channel_message_subscribe");
+	hook_add_channel_message_subscribe(bs_message_subscribe);
+
 	hook_add_event("shutdown");
 	hook_add_shutdown(on_shutdown);
 
@@ -1018,6 +1034,8 @@ void _modinit(module_t *m)
 	msg                   = bs_msg;
 	notice_real           = notice;
 	notice                = bs_notice;
+
+	channel_message_update_all();
 }
 
 void _moddeinit(module_unload_intent_t intent)
@@ -1044,6 +1062,7 @@ void _moddeinit(module_unload_intent_t intent)
 	hook_del_channel_join(bs_join);
 	hook_del_channel_part(bs_part);
 	hook_del_channel_drop(bs_channel_drop);
+	hook_del_channel_message_subscribe(bs_message_subscribe);
 	hook_del_shutdown(on_shutdown);
 	hook_del_config_ready(botserv_config_ready);
 	hook_del_operserv_info(osinfo_hook);
@@ -1061,6 +1080,8 @@ void _moddeinit(module_unload_intent_t intent)
 	topic_sts             = topic_sts_real;
 	msg                   = msg_real;
 	notice                = notice_real;
+
+	channel_message_update_all();
 }
 
 /* ******************************************************************** */
@@ -1150,7 +1171,7 @@ bs_part(hook_channel_joinpart_t *hdata)
 	bot = bs_mychan_find_bot(mc);
 	if (CURRTIME - mc->used >= 3600)
 		if (chanacs_user_flags(mc, cu->user) & CA_USEDUPDATE)
-			mc->used = CURRTIME;
+			mychan_touch(mc);
 	/*
 	* When channel_part is fired, we haven't yet removed the
 	* user from the room. So, the channel will have two members
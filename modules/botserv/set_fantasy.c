@@ -81,6 +81,7 @@ static void bs_cmd_set_fantasy(sourceinfo_t *si, int parc, char *parv[])
 	{
 		if ((md = metadata_find(mc, "private:botserv:bot-assigned")) != NULL)
 			metadata_add(mc, "private:botserv:bot-handle-fantasy", md->value);
+		channel_message_update(mc);
 
 		logcommand(si, CMDLOG_SET, "SET:FANTASY:ON: \2%s\2", mc->name);
 
@@ -89,6 +90,7 @@ static void bs_cmd_set_fantasy(sourceinfo_t *si, int parc, char *parv[])
 	else if(!irccasecmp(option, "OFF"))
 	{
 		metadata_delete(mc, "private:botserv:bot-handle-fantasy");
+		channel_message_update(mc);
 		logcommand(si, CMDLOG_SET, "SET:FANTASY:OFF: \2%s\2", mc->name);
 		command_success_nodata(si, _("Fantasy mode is now \2OFF\2 on channel %s."), mc->name);
 	}
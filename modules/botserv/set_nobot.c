@@ -81,6 +81,7 @@ static void bs_cmd_set_nobot(sourceinfo_t *si, int parc, char *parv[])
 			part(mc->name, md->value);
 			metadata_delete(mc, "private:botserv:bot-assigned");
 			metadata_delete(mc, "private:botserv:bot-handle-fantasy");
+			channel_message_update(mc);
 		}
 		logcommand(si, CMDLOG_SET, "SET:NOBOT:ON: \2%s\2", mc->name);
 		command_success_nodata(si, _("No Bot mode is now \2ON\2 on channel %s."), mc->name);
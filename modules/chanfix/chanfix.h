@@ -15,7 +15,8 @@
 #define CHANFIX_RETENTION_TIME	(86400 * 28)
 #define CHANFIX_FIX_TIME	(60 * 60)
 #define CHANFIX_GATHER_INTERVAL	300
-#define CHANFIX_EXPIRE_INTERVAL 3600
+#define CHANFIX_DECAY_INTERVAL	3600
+#define CHANFIX_EXPIRE_INTERVAL	86400
 
 /* This value has been chosen such that the maximum score is about 8064,
  * which is the number of CHANFIX_GATHER_INTERVALs in CHANFIX_RETENTION_TIME.
@@ -29,8 +30,11 @@ typedef struct chanfix_channel {
 	char *name;
 
 	mowgli_list_t oprecords;
+	mowgli_patricia_t *oprecords_account;	/* by entity id */
+	mowgli_patricia_t *oprecords_mask;	/* by user@host */
 	time_t ts;
 	time_t lastupdate;
+	time_t sampled;		/* ops were last credited up to here */
 
 	channel_t *chan;
 
@@ -50,6 +54,7 @@ typedef struct chanfix_oprecord {
 
 	time_t firstseen;
 	time_t lastevent;
+	time_t decayed;		/* age was last decayed up to here */
 	unsigned int age;
 } chanfix_oprecord_t;
 
@@ -68,14 +73,14 @@ E mowgli_patricia_t *chanfix_channels;
 E void chanfix_gather_init(chanfix_persist_record_t *);
 E void chanfix_gather_deinit(module_unload_intent_t, chanfix_persist_record_t *);
 
-E void chanfix_oprecord_update(chanfix_channel_t *chan, user_t *u);
+E void chanfix_oprecord_update(chanfix_channel_t *chan, user_t *u, unsigned int intervals);
 E void chanfix_oprecord_delete(chanfix_oprecord_t *orec);
 E chanfix_oprecord_t *chanfix_oprecord_create(chanfix_channel_t *chan, user_t *u);
 E chanfix_oprecord_t *chanfix_oprecord_find(chanfix_channel_t *chan, user_t *u);
 E chanfix_channel_t *chanfix_channel_create(const char *name, channel_t *chan);
 E chanfix_channel_t *chanfix_channel_find(const char *name);
 E chanfix_channel_t *chanfix_channel_get(channel_t *chan);
-E void chanfix_gather(void *unused);
+E void chanfix_channel_settle(chanfix_channel_t *chan);
 E void chanfix_expire(void *unused);
 
 E bool chanfix_do_autofix;
@@ -99,6 +99,8 @@ static unsigned int chanfix_get_highscore(chanfix_channel_t *chan)
 	unsigned int highscore = 0;
 	mowgli_node_t *n;
 
+	chanfix_channel_settle(chan);
+
 	MOWGLI_ITER_FOREACH(n, chan->oprecords.head)
 	{
 		unsigned int score;
@@ -442,6 +444,7 @@ static void chanfix_cmd_scores(sourceinfo_t *si, int parc, char *parv[])
 	}
 
 	/* sort records by score. */
+	chanfix_channel_settle(chan);
 	mowgli_list_sort(&chan->oprecords, chanfix_compare_records, NULL);
 
 	if (count > MOWGLI_LIST_LENGTH(&chan->oprecords))
@@ -501,6 +504,7 @@ static void chanfix_cmd_info(sourceinfo_t *si, int parc, char *parv[])
 	}
 
 	/* sort records by score. */
+	chanfix_channel_settle(chan);
 	mowgli_list_sort(&chan->oprecords, chanfix_compare_records, NULL);
 
 	command_success_nodata(si, _("Information on \2%s\2:"), chan->name);
@@ -12,13 +12,72 @@ mowgli_patricia_t *chanfix_channels = NULL;
 mowgli_heap_t *chanfix_channel_heap = NULL;
 mowgli_heap_t *chanfix_oprecord_heap = NULL;
 
-mowgli_eventloop_timer_t *chanfix_gather_timer = NULL;
 mowgli_eventloop_timer_t *chanfix_expire_timer = NULL;
 
 static int loading_cfdbv = 0;
 
 /*************************************************************************************/
 
+/* Op records are found through two dictionaries per channel, by account
+ * and by user@host. Several records may share a key after loading the
+ * database; the dictionaries then point at one of them.
+ */
+static void chanfix_oprecord_mask(char *buf, size_t len, const char *user, const char *host)
+{
+	snprintf(buf, len, "%s@%s", user, host);
+}
+
+static void chanfix_oprecord_index(chanfix_oprecord_t *orec)
+{
+	char mask[USERLEN + HOSTLEN + 2];
+
+	if (orec->entity != NULL && mowgli_patricia_retrieve(orec->chan->oprecords_account, orec->entity->id) == NULL)
+		mowgli_patricia_add(orec->chan->oprecords_account, orec->entity->id, orec);
+
+	chanfix_oprecord_mask(mask, sizeof mask, orec->user, orec->host);
+	if (mowgli_patricia_retrieve(orec->chan->oprecords_mask, mask) == NULL)
+		mowgli_patricia_add(orec->chan->oprecords_mask, mask, orec);
+}
+
+static void chanfix_oprecord_unindex(chanfix_oprecord_t *orec)
+{
+	chanfix_channel_t *chan = orec->chan;
+	char mask[USERLEN + HOSTLEN + 2];
+	mowgli_node_t *n;
+	chanfix_oprecord_t *other;
+
+	if (orec->entity != NULL && mowgli_patricia_retrieve(chan->oprecords_account, orec->entity->id) == orec)
+	{
+		mowgli_patricia_delete(chan->oprecords_account, orec->entity->id);
+
+		MOWGLI_ITER_FOREACH(n, chan->oprecords.head)
+		{
+			other = n->data;
+			if (other != orec && other->entity == orec->entity)
+			{
+				mowgli_patricia_add(chan->oprecords_account, other->entity->id, other);
+				break;
+			}
+		}
+	}
+
+	chanfix_oprecord_mask(mask, sizeof mask, orec->user, orec->host);
+	if (mowgli_patricia_retrieve(chan->oprecords_mask, mask) == orec)
+	{
+		mowgli_patricia_delete(chan->oprecords_mask, mask);
+
+		MOWGLI_ITER_FOREACH(n, chan->oprecords.head)
+		{
+			other = n->data;
+			if (other != orec && !irccasecmp(other->user, orec->user) && !irccasecmp(other->host, orec->host))
+			{
+				mowgli_patricia_add(chan->oprecords_mask, mask, other);
+				break;
+			}
+		}
+	}
+}
+
 chanfix_oprecord_t *chanfix_oprecord_create(chanfix_channel_t *chan, user_t *u)
 {
 	chanfix_oprecord_t *orec;
@@ -36,6 +95,7 @@ chanfix_oprecord_t *chanfix_oprecord_create(chanfix_channel_t *chan, user_t *u)
 
 	orec->firstseen = CURRTIME;
 	orec->lastevent = CURRTIME;
+	orec->decayed = CURRTIME;
 
 	orec->age = 1;
 
@@ -45,6 +105,8 @@ chanfix_oprecord_t *chanfix_oprecord_create(chanfix_channel_t *chan, user_t *u)
 
 		mowgli_strlcpy(orec->user, u->user, sizeof orec->user);
 		mowgli_strlcpy(orec->host, u->vhost, sizeof orec->host);
+
+		chanfix_oprecord_index(orec);
 	}
 
 	mowgli_node_add(orec, &orec->node, &chan->oprecords);
@@ -54,26 +116,34 @@ chanfix_oprecord_t *chanfix_oprecord_create(chanfix_channel_t *chan, user_t *u)
 
 chanfix_oprecord_t *chanfix_oprecord_find(chanfix_channel_t *chan, user_t *u)
 {
-	mowgli_node_t *n;
+	chanfix_oprecord_t *orec;
+	char mask[USERLEN + HOSTLEN + 2];
 
 	return_val_if_fail(chan != NULL, NULL);
 	return_val_if_fail(u != NULL, NULL);
 
-	MOWGLI_ITER_FOREACH(n, chan->oprecords.head)
-	{
-		chanfix_oprecord_t *orec = n->data;
+	if (u->myuser != NULL && (orec = mowgli_patricia_retrieve(chan->oprecords_account, entity(u->myuser)->id)) != NULL)
+		return orec;
 
-		if (orec->entity != NULL && orec->entity == entity(u->myuser))
-			return orec;
+	chanfix_oprecord_mask(mask, sizeof mask, u->user, u->vhost);
+	return mowgli_patricia_retrieve(chan->oprecords_mask, mask);
+}
 
-		if (!irccasecmp(orec->user, u->user) && !irccasecmp(orec->host, u->vhost))
-			return orec;
+/* Simple exponential decay once per CHANFIX_DECAY_INTERVAL, rounding the
+ * decay up so that low scores expire sooner. Applied when a record is
+ * looked at rather than by sweeping all of them.
+ */
+static void chanfix_oprecord_decay(chanfix_oprecord_t *orec)
+{
+	while (orec->age > 0 && CURRTIME - orec->decayed >= CHANFIX_DECAY_INTERVAL)
+	{
+		orec->age -= (orec->age + CHANFIX_EXPIRE_DIVISOR - 1) /
+			CHANFIX_EXPIRE_DIVISOR;
+		orec->decayed += CHANFIX_DECAY_INTERVAL;
 	}
-
-	return NULL;
 }
 
-void chanfix_oprecord_update(chanfix_channel_t *chan, user_t *u)
+void chanfix_oprecord_update(chanfix_channel_t *chan, user_t *u, unsigned int intervals)
 {
 	chanfix_oprecord_t *orec;
 
@@ -83,16 +153,24 @@ void chanfix_oprecord_update(chanfix_channel_t *chan, user_t *u)
 	orec = chanfix_oprecord_find(chan, u);
 	if (orec != NULL)
 	{
-		orec->age++;
+		chanfix_oprecord_decay(orec);
+		if (orec->age == 0)
+			orec->decayed = CURRTIME;
+
+		orec->age += intervals;
 		orec->lastevent = CURRTIME;
 
 		if (orec->entity == NULL && u->myuser != NULL)
+		{
 			orec->entity = entity(u->myuser);
+			chanfix_oprecord_index(orec);
+		}
 
 		return;
 	}
 
-	chanfix_oprecord_create(chan, u);
+	orec = chanfix_oprecord_create(chan, u);
+	orec->age = intervals;
 	chan->lastupdate = CURRTIME;
 }
 
@@ -100,6 +178,8 @@ void chanfix_oprecord_delete(chanfix_oprecord_t *orec)
 {
 	return_if_fail(orec != NULL);
 
+	chanfix_oprecord_unindex(orec);
+
 	mowgli_node_delete(&orec->node, &orec->chan->oprecords);
 	mowgli_heap_free(chanfix_oprecord_heap, orec);
 }
@@ -121,6 +201,11 @@ static void chanfix_channel_delete(chanfix_channel_t *c)
 		chanfix_oprecord_delete(orec);
 	}
 
+	mowgli_patricia_destroy(c->oprecords_account, NULL, NULL);
+	mowgli_patricia_destroy(c->oprecords_mask, NULL, NULL);
+
+	metadata_delete_all(c);
+
 	free(c->name);
 	mowgli_heap_free(chanfix_channel_heap, c);
 }
@@ -137,6 +222,10 @@ chanfix_channel_t *chanfix_channel_create(const char *name, channel_t *chan)
 	c->name = sstrdup(name);
 	c->chan = chan;
 	c->fix_started = 0;
+	c->sampled = CURRTIME;
+
+	c->oprecords_account = mowgli_patricia_create(noopcanon);
+	c->oprecords_mask = mowgli_patricia_create(irccasecanon);
 
 	if (c->chan != NULL)
 		c->ts = c->chan->ts;
@@ -169,6 +258,7 @@ static void chanfix_channel_add_ev(channel_t *ch)
 	if ((chan = chanfix_channel_get(ch)) != NULL)
 	{
 		chan->chan = ch;
+		chan->sampled = CURRTIME;
 		return;
 	}
 
@@ -190,40 +280,97 @@ static void chanfix_channel_delete_ev(channel_t *ch)
 	chanfix_channel_create(ch->name, NULL);
 }
 
-void chanfix_gather(void *unused)
+/*
+ * Ops are credited one point per CHANFIX_GATHER_INTERVAL they hold ops in
+ * an unregistered channel. Instead of visiting every channel on a timer,
+ * a channel is credited for the time since it was last credited whenever
+ * its ops may be about to change (a mode change, a join or a part), and
+ * before its scores are used. Between two such points the set of ops is
+ * taken to have stayed the same.
+ */
+static void chanfix_channel_sample(chanfix_channel_t *chan, chanuser_t *skip)
 {
-	channel_t *ch;
-	mowgli_patricia_iteration_state_t state;
-	int chans = 0, oprecords = 0;
+	unsigned int intervals;
+	mowgli_node_t *n;
+
+	intervals = (CURRTIME - chan->sampled) / CHANFIX_GATHER_INTERVAL;
+	if (intervals == 0)
+		return;
+
+	chan->sampled += intervals * CHANFIX_GATHER_INTERVAL;
+
+	if (chan->chan == NULL || mychan_find(chan->name) != NULL)
+		return;
 
-	MOWGLI_PATRICIA_FOREACH(ch, &state, chanlist)
+	MOWGLI_ITER_FOREACH(n, chan->chan->members.head)
 	{
-		mychan_t *mc;
-		mowgli_node_t *n;
-		chanfix_channel_t *chan;
+		chanuser_t *cu = n->data;
 
-		if ((mc = mychan_find(ch->name)) != NULL)
-			continue;
+		if (cu != skip && cu->modes & CSTATUS_OP)
+			chanfix_oprecord_update(chan, cu->user, intervals);
+	}
+}
 
-		chan = chanfix_channel_get(ch);
-		if (chan == NULL)
-			chan = chanfix_channel_create(ch->name, ch);
+/* brings a channel's scores up to date; records that decayed away or were
+ * not seen for too long are dropped */
+void chanfix_channel_settle(chanfix_channel_t *chan)
+{
+	mowgli_node_t *n, *tn;
 
-		MOWGLI_ITER_FOREACH(n, ch->members.head)
-		{
-			chanuser_t *cu = n->data;
+	return_if_fail(chan != NULL);
 
-			if (cu->modes & CSTATUS_OP)
-			{
-				chanfix_oprecord_update(chan, cu->user);
-				oprecords++;
-			}
-		}
+	chanfix_channel_sample(chan, NULL);
 
-		chans++;
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, chan->oprecords.head)
+	{
+		chanfix_oprecord_t *orec = n->data;
+
+		chanfix_oprecord_decay(orec);
+
+		if (orec->age > 0 && CURRTIME - orec->lastevent < CHANFIX_RETENTION_TIME)
+			continue;
+
+		chanfix_oprecord_delete(orec);
 	}
+}
+
+static chanfix_channel_t *chanfix_channel_lookup(channel_t *ch)
+{
+	chanfix_channel_t *chan;
 
-	slog(LG_DEBUG, "chanfix_gather(): gathered %d channels and %d oprecords.", chans, oprecords);
+	if ((chan = chanfix_channel_get(ch)) == NULL)
+		chan = chanfix_channel_create(ch->name, ch);
+
+	return chan;
+}
+
+static void chanfix_channel_mode_ev(hook_channel_mode_t *hdata)
+{
+	return_if_fail(hdata != NULL);
+
+	chanfix_channel_sample(chanfix_channel_lookup(hdata->c), NULL);
+}
+
+static void chanfix_channel_join_ev(hook_channel_joinpart_t *hdata)
+{
+	chanuser_t *cu = hdata->cu;
+
+	if (cu == NULL)
+		return;
+
+	/* the new member has not held ops before now */
+	chanfix_channel_sample(chanfix_channel_lookup(cu->chan), cu);
+}
+
+static void chanfix_channel_part_ev(hook_channel_joinpart_t *hdata)
+{
+	chanuser_t *cu = hdata->cu;
+
+	if (cu == NULL)
+		return;
+
+	/* called before the member is removed, so their time counts */
+	chanfix_channel_sample(chanfix_channel_lookup(cu->chan), NULL);
 }
 
 void chanfix_expire(void *unused)
@@ -233,23 +380,7 @@ void chanfix_expire(void *unused)
 
 	MOWGLI_PATRICIA_FOREACH(chan, &state, chanfix_channels)
 	{
-		mowgli_node_t *n, *tn;
-
-		MOWGLI_ITER_FOREACH_SAFE(n, tn, chan->oprecords.head)
-		{
-			chanfix_oprecord_t *orec = n->data;
-
-			/* Simple exponential decay, rounding the decay up
-			 * so that low scores expire sooner.
-			 */
-			orec->age -= (orec->age + CHANFIX_EXPIRE_DIVISOR - 1) /
-				CHANFIX_EXPIRE_DIVISOR;
-
-			if (orec->age > 0 && CURRTIME - orec->lastevent < CHANFIX_RETENTION_TIME)
-				continue;
-
-			chanfix_oprecord_delete(orec);
-		}
+		chanfix_channel_settle(chan);
 
 		if (MOWGLI_LIST_LENGTH(&chan->oprecords) > 0 &&
 				CURRTIME - chan->lastupdate < CHANFIX_RETENTION_TIME)
@@ -276,6 +407,8 @@ static void write_chanfixdb(database_handle_t *db)
 	{
 		mowgli_node_t *n;
 
+		chanfix_channel_settle(chan);
+
 		db_start_row(db, "CFCHAN");
 		db_write_word(db, chan->name);
 		db_write_time(db, chan->ts);
@@ -307,10 +440,10 @@ static void write_chanfixdb(database_handle_t *db)
 
 		if (object(chan)->metadata != NULL)
 		{
-			mowgli_patricia_iteration_state_t state2;
+			metadata_iteration_state_t state2;
 			metadata_t *md;
 
-			MOWGLI_PATRICIA_FOREACH(md, &state2, object(chan)->metadata)
+			METADATA_FOREACH(md, &state2, chan)
 			{
 				db_start_row(db, "CFMD");
 				db_write_word(db, chan->name);
@@ -372,6 +505,8 @@ static void db_h_cfop(database_handle_t *db, const char *type)
 	orec->lastevent = lastevent;
 
 	orec->age = age;
+
+	chanfix_oprecord_index(orec);
 }
 
 static void db_h_cfmd(database_handle_t *db, const char *type)
@@ -394,6 +529,12 @@ void chanfix_gather_init(chanfix_persist_record_t *rec)
 	hook_add_db_write(write_chanfixdb);
 	hook_add_channel_add(chanfix_channel_add_ev);
 	hook_add_channel_delete(chanfix_channel_delete_ev);
+	hook_add_event("channel_mode");
+	hook_add_channel_mode(chanfix_channel_mode_ev);
+	hook_add_event("channel_join");
+	hook_add_channel_join(chanfix_channel_join_ev);
+	hook_add_event("channel_part");
+	hook_add_channel_part(chanfix_channel_part_ev);
 
 	db_register_type_handler("CFDBV", db_h_cfdbv);
 	db_register_type_handler("CFCHAN", db_h_cfchan);
@@ -415,7 +556,6 @@ void chanfix_gather_init(chanfix_persist_record_t *rec)
 	chanfix_channels = mowgli_patricia_create(strcasecanon);
 
 	chanfix_expire_timer = mowgli_timer_add(base_eventloop, "chanfix_expire", chanfix_expire, NULL, CHANFIX_EXPIRE_INTERVAL);
-	chanfix_gather_timer = mowgli_timer_add(base_eventloop, "chanfix_gather", chanfix_gather, NULL, CHANFIX_GATHER_INTERVAL);
 }
 
 void chanfix_gather_deinit(module_unload_intent_t intent, chanfix_persist_record_t *rec)
@@ -423,13 +563,15 @@ void chanfix_gather_deinit(module_unload_intent_t intent, chanfix_persist_record
 	hook_del_db_write(write_chanfixdb);
 	hook_del_channel_add(chanfix_channel_add_ev);
 	hook_del_channel_delete(chanfix_channel_delete_ev);
+	hook_del_channel_mode(chanfix_channel_mode_ev);
+	hook_del_channel_join(chanfix_channel_join_ev);
+	hook_del_channel_part(chanfix_channel_part_ev);
 
 	db_unregister_type_handler("CFDBV");
 	db_unregister_type_handler("CFCHAN");
 	db_unregister_type_handler("CFOP");
 
 	mowgli_timer_destroy(base_eventloop, chanfix_expire_timer);
-	mowgli_timer_destroy(base_eventloop, chanfix_gather_timer);
 
 	switch (intent)
 	{
@@ -51,53 +51,17 @@ typedef struct {
 	char *name;
 	size_t max;
 	time_t last_used;
-	mowgli_list_t entries;
-} mqueue_t;
-
-typedef struct {
-	stringref source;
-	char *message;
-	time_t time;
-	mowgli_node_t node;
-} msg_t;
-
-static mowgli_heap_t *msg_heap = NULL;
-
-static void
-msg_destroy(msg_t *msg, mqueue_t *mq)
-{
-	free(msg->message);
-	strshare_unref(msg->source);
-	mowgli_node_delete(&msg->node, &mq->entries);
-
-	mowgli_heap_free(msg_heap, msg);
-}
-
-static msg_t *
-msg_create(mqueue_t *mq, user_t *u, const char *message)
-{
-	msg_t *msg;
-
-	msg = mowgli_heap_alloc(msg_heap);
-	msg->message = sstrdup(message);
-	msg->time = CURRTIME;
-	msg->source = u->uid != NULL ? strshare_ref(u->uid) : strshare_ref(u->nick);
+	ratelimit_window_t window;
 
-	if (MOWGLI_LIST_LENGTH(&mq->entries) > mq->max)
-	{
-		msg_t *head_msg = mq->entries.head->data;
-		msg_destroy(head_msg, mq);
-	}
-
-	mowgli_node_add(msg, &msg->node, &mq->entries);
-	mq->last_used = CURRTIME;
-
-	return msg;
-}
+	deadline_t gc;
+	deadline_t unenforce;
+} mqueue_t;
 
 static mowgli_patricia_t *mqueue_trie = NULL;
 static mowgli_heap_t *mqueue_heap = NULL;
-static mowgli_eventloop_timer_t *mqueue_gc_timer = NULL;
+
+static void mqueue_gc(void *arg);
+static void mqueue_unenforce(void *arg);
 
 static mqueue_t *
 mqueue_create(const char *name)
@@ -109,6 +73,14 @@ mqueue_create(const char *name)
 	mq->last_used = CURRTIME;
 	mq->max = antiflood_msg_count;
 
+	/* one more than the threshold, as the newest message is compared
+	 * against a full window before it */
+	ratelimit_window_init(&mq->window, mq->max + 1);
+
+	deadline_init(&mq->gc, "mqueue_gc", mqueue_gc, mq);
+	deadline_init(&mq->unenforce, "antiflood_unenforce", mqueue_unenforce, mq);
+	deadline_set(&mq->gc, mq->last_used + 3600 + 1);
+
 	mowgli_patricia_add(mqueue_trie, mq->name, mq);
 
 	return mq;
@@ -117,14 +89,14 @@ mqueue_create(const char *name)
 static void
 mqueue_free(mqueue_t *mq)
 {
-	mowgli_node_t *n, *tn;
+	unsigned int i;
 
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, mq->entries.head)
-	{
-		msg_t *msg = n->data;
+	for (i = 0; i < mq->window.count; i++)
+		strshare_unref((stringref)ratelimit_window_nth(&mq->window, i)->source);
+	ratelimit_window_free(&mq->window);
 
-		msg_destroy(msg, mq);
-	}
+	deadline_cancel(&mq->gc);
+	deadline_cancel(&mq->unenforce);
 
 	free(mq->name);
 	mowgli_heap_free(mqueue_heap, mq);
@@ -158,55 +130,56 @@ mqueue_trie_destroy_cb(const char *key, void *data, void *privdata)
 	mqueue_free(mq);
 }
 
+/* last_used moves on every message, so the deadline is only a lower
+ * bound; push it out again instead of touching it per message. A queue
+ * with a pending unenforce is kept until that has run.
+ */
 static void
-mqueue_gc(void *unused)
+mqueue_gc(void *arg)
 {
-	mowgli_patricia_iteration_state_t iter;
-	mqueue_t *mq;
-
-	MOWGLI_PATRICIA_FOREACH(mq, &iter, mqueue_trie)
-	{
-		if ((mq->last_used + 3600) < CURRTIME)
-			mqueue_destroy(mq);
-	}
+	mqueue_t *mq = arg;
+
+	if ((mq->last_used + 3600) >= CURRTIME)
+		deadline_set(&mq->gc, mq->last_used + 3600 + 1);
+	else if (deadline_pending(&mq->unenforce))
+		deadline_set(&mq->gc, mq->unenforce.when + 1);
+	else
+		mqueue_destroy(mq);
 }
 
 static mqueue_enforce_strategy_t
 mqueue_should_enforce(mqueue_t *mq)
 {
-	msg_t *oldest, *newest;
+	const ratelimit_event_t *oldest, *newest;
 	time_t age_delta;
 
-	if (MOWGLI_LIST_LENGTH(&mq->entries) < mq->max)
+	if (mq->window.count < mq->max || mq->window.count < 2)
 		return MQ_ENFORCE_NONE;
 
-	oldest = mq->entries.head->data;
-	newest = mq->entries.tail->data;
-
-	if (oldest == NULL || newest == NULL || oldest == newest)
-		return MQ_ENFORCE_NONE;
+	oldest = ratelimit_window_oldest(&mq->window);
+	newest = ratelimit_window_newest(&mq->window);
 
 	age_delta = newest->time - oldest->time;
 
 	if (age_delta <= antiflood_msg_time)
 	{
-		mowgli_node_t *n;
+		unsigned int i;
 		size_t msg_matches = 0, usr_matches = 0;
 		time_t usr_first_seen = 0;
 
-		MOWGLI_ITER_FOREACH(n, mq->entries.head)
+		for (i = 0; i < mq->window.count; i++)
 		{
-			msg_t *msg = n->data;
+			const ratelimit_event_t *ev = ratelimit_window_nth(&mq->window, i);
 
-			if (!strcasecmp(msg->message, newest->message))
+			if (ev->text == newest->text)
 				msg_matches++;
 
-			if (msg->source == newest->source)
+			if (ev->source == newest->source)
 			{
 				usr_matches++;
 
 				if (!usr_first_seen)
-					usr_first_seen = msg->time;
+					usr_first_seen = ev->time;
 			}
 		}
 
@@ -321,32 +294,29 @@ antiflood_enforce_method_impl_get(mychan_t *mc)
 }
 
 static void
-antiflood_unenforce_timer_cb(void *unused)
+mqueue_unenforce(void *arg)
 {
-	mowgli_patricia_iteration_state_t state;
+	mqueue_t *mq = arg;
 	mychan_t *mc;
+	antiflood_enforce_method_impl_t *enf;
 
-	MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
-	{
-		antiflood_enforce_method_impl_t *enf = antiflood_enforce_method_impl_get(mc);
-
-		if (mc->chan == NULL)
-			continue;
+	mc = mychan_find(mq->name);
+	if (mc == NULL || mc->chan == NULL)
+		return;
 
-		if (enf->unenforce != NULL)
-			enf->unenforce(mc->chan);
-	}
+	enf = antiflood_enforce_method_impl_get(mc);
+	if (enf->unenforce != NULL)
+		enf->unenforce(mc->chan);
 }
 
-static mowgli_eventloop_timer_t *antiflood_unenforce_timer = NULL;
-
 static void
 on_channel_message(hook_cmessage_data_t *data)
 {
 	chanuser_t *cu;
 	mychan_t *mc;
 	mqueue_t *mq;
-	msg_t *msg;
+	stringref source;
+	const void *dropped;
 
 	return_if_fail(data != NULL);
 	return_if_fail(data->msg != NULL);
@@ -364,7 +334,13 @@ on_channel_message(hook_cmessage_data_t *data)
 	mq = mqueue_get(mc);
 	return_if_fail(mq != NULL);
 
-	msg = msg_create(mq, data->u, data->msg);
+	/* the source is compared by its shared string, never by a hash,
+	 * so a collision cannot get someone else punished */
+	source = strshare_ref(data->u->uid != NULL ? data->u->uid : data->u->nick);
+	dropped = ratelimit_window_add(&mq->window, source, ratelimit_fingerprint(data->msg));
+	if (dropped != NULL)
+		strshare_unref((stringref)dropped);
+	mq->last_used = CURRTIME;
 
 	/* never enforce against any user who has special CSTATUS flags. */
 	if (cu->modes)
@@ -382,9 +358,19 @@ on_channel_message(hook_cmessage_data_t *data)
 			return;
 
 		enf->enforce(data->u, data->c);
+
+		if (!deadline_pending(&mq->unenforce))
+			deadline_set(&mq->unenforce, CURRTIME + 3600);
 	}
 }
 
+static void
+on_channel_message_subscribe(mychan_t *mc)
+{
+	if (mc->flags & MC_ANTIFLOOD)
+		mc->chan->msgsubs |= CHANMSG_HOOK;
+}
+
 static void
 on_channel_drop(mychan_t *mc)
 {
@@ -425,6 +411,7 @@ cs_set_cmd_antiflood(sourceinfo_t *si, int parc, char *parv[])
 	{
 		mc->flags &= ~MC_ANTIFLOOD;
 		metadata_delete(mc, METADATA_KEY_ENFORCE_METHOD);
+		channel_message_update(mc);
 
 		logcommand(si, CMDLOG_SET, "ANTIFLOOD:NONE: \2%s\2",  mc->name);
 		verbose(mc, _("\2%s\2 disabled flood protection"), get_source_name(si));
@@ -440,6 +427,7 @@ cs_set_cmd_antiflood(sourceinfo_t *si, int parc, char *parv[])
 		}
 		mc->flags |= MC_ANTIFLOOD;
 		metadata_delete(mc, METADATA_KEY_ENFORCE_METHOD);
+		channel_message_update(mc);
 
 		logcommand(si, CMDLOG_SET, "ANTIFLOOD: %s (%s)",  mc->name, "DEFAULT");
 		verbose(mc, _("\2%s\2 enabled flood protection with default settings"), get_source_name(si));
@@ -450,6 +438,7 @@ cs_set_cmd_antiflood(sourceinfo_t *si, int parc, char *parv[])
 	{
 		mc->flags |= MC_ANTIFLOOD;
 		metadata_add(mc, METADATA_KEY_ENFORCE_METHOD, "QUIET");
+		channel_message_update(mc);
 
 		logcommand(si, CMDLOG_SET, "ANTIFLOOD: %s (%s)",  mc->name, "QUIET");
 		verbose(mc, _("\2%s\2 enabled flood protection with \2%s\2 action"), get_source_name(si), "QUIET");
@@ -460,6 +449,7 @@ cs_set_cmd_antiflood(sourceinfo_t *si, int parc, char *parv[])
 	{
 		mc->flags |= MC_ANTIFLOOD;
 		metadata_add(mc, METADATA_KEY_ENFORCE_METHOD, "KICKBAN");
+		channel_message_update(mc);
 
 		logcommand(si, CMDLOG_SET, "ANTIFLOOD: %s (%s)",  mc->name, "KICKBAN");
 		verbose(mc, _("\2%s\2 enabled flood protection with \2%s\2 action"), get_source_name(si), "KICKBAN");
@@ -472,6 +462,7 @@ cs_set_cmd_antiflood(sourceinfo_t *si, int parc, char *parv[])
 		{
 			mc->flags |= MC_ANTIFLOOD;
 			metadata_add(mc, METADATA_KEY_ENFORCE_METHOD, "AKILL");
+			channel_message_update(mc);
 
 			logcommand(si, CMDLOG_SET, "ANTIFLOOD: %s (%s)",  mc->name, "AKILL");
 			verbose(mc, _("\2%s\2 enabled flood protection with \2%s\2 action"), get_source_name(si), "AKILL");
@@ -529,19 +520,19 @@ _modinit(module_t *m)
 	hook_add_event("channel_message");
 	hook_add_channel_message(on_channel_message);
 
+	hook_add_event("channel_message_subscribe");
+	hook_add_channel_message_subscribe(on_channel_message_subscribe);
+
 	hook_add_event("channel_drop");
 	hook_add_channel_drop(on_channel_drop);
 
-	msg_heap = sharedheap_get(sizeof(msg_t));
-
 	mqueue_heap = sharedheap_get(sizeof(mqueue_t));
 	mqueue_trie = mowgli_patricia_create(irccasecanon);
-	mqueue_gc_timer = mowgli_timer_add(base_eventloop, "mqueue_gc", mqueue_gc, NULL, 300);
-
-	antiflood_unenforce_timer = mowgli_timer_add(base_eventloop, "antiflood_unenforce", antiflood_unenforce_timer_cb, NULL, 3600);
 
 	command_add(&cs_set_antiflood, *cs_set_cmdtree);
 
+	channel_message_update_all();
+
 	add_conf_item("ANTIFLOOD_ENFORCE_METHOD", &chansvs.me->conf_table, c_ci_antiflood_enforce_method);
 }
 
@@ -551,11 +542,12 @@ _moddeinit(module_unload_intent_t intent)
 	command_delete(&cs_set_antiflood, *cs_set_cmdtree);
 
 	hook_del_channel_message(on_channel_message);
+	hook_del_channel_message_subscribe(on_channel_message_subscribe);
 	hook_del_channel_drop(on_channel_drop);
 
+	channel_message_update_all();
+
 	mowgli_patricia_destroy(mqueue_trie, mqueue_trie_destroy_cb, NULL);
-	mowgli_timer_destroy(base_eventloop, mqueue_gc_timer);
-	mowgli_timer_destroy(base_eventloop, antiflood_unenforce_timer);
 
 	del_conf_item("ANTIFLOOD_ENFORCE_METHOD", &chansvs.me->conf_table);
 }
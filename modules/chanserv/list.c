@@ -16,6 +16,7 @@ DECLARE_MODULE_V1
 );
 
 static void cs_cmd_list(sourceinfo_t *si, int parc, char *parv[]);
+static bool list_scan(scan_t *scan, void *data);
 
 command_t cs_list = { "LIST", N_("Lists channels registered matching a given pattern."), PRIV_CHAN_AUSPEX, 10, cs_cmd_list, { .path = "cservice/list" } };
 
@@ -26,6 +27,7 @@ void _modinit(module_t *m)
 
 void _moddeinit(module_unload_intent_t intent)
 {
+	scan_cancel_all(list_scan);
 	service_named_unbind_command("chanserv", &cs_list);
 }
 
@@ -134,122 +136,165 @@ static void build_criteriastr(char *buf, int parc, char *parv[])
 	}
 }
 
-static void cs_cmd_list(sourceinfo_t *si, int parc, char *parv[])
+typedef struct {
+	match_pattern_t *chanpattern, *markpattern, *closedpattern;
+	unsigned int flagset;
+	int aclsize;
+	time_t age, lastused;
+	bool closed, marked;
+	char criteriastr[BUFSIZE];
+	unsigned int matches;
+} list_search_t;
+
+static void list_search_free(list_search_t *search)
+{
+	match_pattern_destroy(search->chanpattern);
+	match_pattern_destroy(search->markpattern);
+	match_pattern_destroy(search->closedpattern);
+	free(search);
+}
+
+static bool list_scan(scan_t *scan, void *data)
 {
-	mychan_t *mc;
+	list_search_t *search = scan->privdata;
+	mychan_t *mc = data;
 	metadata_t *md, *mdclosed;
-	char *chanpattern = NULL, *markpattern = NULL, *closedpattern = NULL;
 	char buf[BUFSIZE];
-	char criteriastr[BUFSIZE];
-	unsigned int matches = 0;
-	unsigned int flagset = 0;
-	int aclsize = 0;
-	time_t age = 0, lastused = 0;
-	bool closed = false, marked = false, markmatch, closedmatch;
-	mowgli_patricia_iteration_state_t state;
-	list_option_t optstable[] = {
-		{"pattern",	OPT_STRING,	{.strval = &chanpattern}, 0},
-		{"mark-reason", OPT_STRING,	{.strval = &markpattern}, 0},
-		{"close-reason", OPT_STRING,    {.strval = &closedpattern}, 0},
-		{"noexpire",	OPT_FLAG,	{.flagval = &flagset}, MC_HOLD},
-		{"held",	OPT_FLAG,	{.flagval = &flagset}, MC_HOLD},
-		{"hold",	OPT_FLAG,	{.flagval = &flagset}, MC_HOLD},
-		{"noop",	OPT_FLAG,	{.flagval = &flagset}, MC_NOOP},
-		{"limitflags",	OPT_FLAG,	{.flagval = &flagset}, MC_LIMITFLAGS},
-		{"secure",	OPT_FLAG,	{.flagval = &flagset}, MC_SECURE},
-		{"nosync",	OPT_FLAG,	{.flagval = &flagset}, MC_NOSYNC},
-		{"verbose",	OPT_FLAG,	{.flagval = &flagset}, MC_VERBOSE},
-		{"restricted",	OPT_FLAG,	{.flagval = &flagset}, MC_RESTRICTED},
-		{"keeptopic",	OPT_FLAG,	{.flagval = &flagset}, MC_KEEPTOPIC},
-		{"verbose-ops",	OPT_FLAG,	{.flagval = &flagset}, MC_VERBOSE_OPS},
-		{"topiclock",	OPT_FLAG,	{.flagval = &flagset}, MC_TOPICLOCK},
-		{"guard",	OPT_FLAG,	{.flagval = &flagset}, MC_GUARD},
-		{"private",	OPT_FLAG,	{.flagval = &flagset}, MC_PRIVATE},
-		{"closed",	OPT_BOOL,	{.boolval = &closed}, 0},
-		{"marked",	OPT_BOOL,	{.boolval = &marked}, 0},
-		{"aclsize",	OPT_INT,	{.intval = &aclsize}, 0},
-		{"registered",	OPT_AGE,	{.ageval = &age}, 0},
-		{"lastused",	OPT_AGE,	{.ageval = &lastused}, 0},
-	};
+	bool markmatch, closedmatch;
 
-	process_parvarray(optstable, ARRAY_SIZE(optstable), parc, parv);
-	build_criteriastr(criteriastr, parc, parv);
+	if (search->chanpattern != NULL && match_compiled(search->chanpattern, mc->name))
+		return true;
+
+	if (search->markpattern)
+	{
+		markmatch = false;
+		md = metadata_find(mc, "private:mark:reason");
+		if (md != NULL && !match_compiled(search->markpattern, md->value))
+			markmatch = true;
 
-	command_success_nodata(si, _("Channels matching \2%s\2:"), criteriastr);
+		if (!markmatch)
+			return true;
+	}
 
-	MOWGLI_PATRICIA_FOREACH(mc, &state, mclist)
+	if (search->closedpattern)
 	{
-		if (chanpattern != NULL && match(chanpattern, mc->name))
-			continue;
+		closedmatch = false;
+		mdclosed = metadata_find(mc, "private:close:reason");
+		if (mdclosed != NULL && !match_compiled(search->closedpattern, mdclosed->value))
+			closedmatch = true;
 
-		if (markpattern)
-		{
-			markmatch = false;
-			md = metadata_find(mc, "private:mark:reason");
-			if (md != NULL && !match(markpattern, md->value))
-				markmatch = true;
+		if (!closedmatch)
+			return true;
+	}
 
-			if (!markmatch)
-				continue;
-		}
+	if (search->marked && !metadata_find(mc, "private:mark:setter"))
+		return true;
 
-		if (closedpattern)
-		{
-			closedmatch = false;
-			mdclosed = metadata_find(mc, "private:close:reason");
-			if (mdclosed != NULL && !match(closedpattern, mdclosed->value))
-				closedmatch = true;
+	if (search->closed && !metadata_find(mc, "private:close:closer"))
+		return true;
 
-			if (!closedmatch)
-				continue;
-		}
+	if (search->flagset && (mc->flags & search->flagset) != search->flagset)
+		return true;
 
-		if (marked && !metadata_find(mc, "private:mark:setter"))
-			continue;
+	if (search->aclsize && MOWGLI_LIST_LENGTH(&mc->chanacs) < (unsigned int)search->aclsize)
+		return true;
 
-		if (closed && !metadata_find(mc, "private:close:closer"))
-			continue;
+	if (search->age && (CURRTIME - mc->registered) < search->age)
+		return true;
 
-		if (flagset && (mc->flags & flagset) != flagset)
-			continue;
+	if (search->lastused && (CURRTIME - mc->used) < search->lastused)
+		return true;
 
-		if (aclsize && MOWGLI_LIST_LENGTH(&mc->chanacs) < (unsigned int)aclsize)
-			continue;
+	/* in the future we could add a LIMIT parameter */
+	*buf = '\0';
 
-		if (age && (CURRTIME - mc->registered) < age)
-			continue;
+	if (metadata_find(mc, "private:mark:setter")) {
+		mowgli_strlcat(buf, "\2[marked]\2", BUFSIZE);
+	}
+	if (metadata_find(mc, "private:close:closer")) {
+		if (*buf)
+			mowgli_strlcat(buf, " ", BUFSIZE);
 
-		if (lastused && (CURRTIME - mc->used) < lastused)
-			continue;
+		mowgli_strlcat(buf, "\2[closed]\2", BUFSIZE);
+	}
+	if (mc->flags & MC_HOLD) {
+		if (*buf)
+			mowgli_strlcat(buf, " ", BUFSIZE);
 
-		/* in the future we could add a LIMIT parameter */
-		*buf = '\0';
+		mowgli_strlcat(buf, "\2[held]\2", BUFSIZE);
+	}
 
-		if (metadata_find(mc, "private:mark:setter")) {
-			mowgli_strlcat(buf, "\2[marked]\2", BUFSIZE);
-		}
-		if (metadata_find(mc, "private:close:closer")) {
-			if (*buf)
-				mowgli_strlcat(buf, " ", BUFSIZE);
+	command_success_nodata(scan->si, "- %s (%s) %s", mc->name, mychan_founder_names(mc), buf);
+	search->matches++;
 
-			mowgli_strlcat(buf, "\2[closed]\2", BUFSIZE);
-		}
-		if (mc->flags & MC_HOLD) {
-			if (*buf)
-				mowgli_strlcat(buf, " ", BUFSIZE);
+	return true;
+}
 
-			mowgli_strlcat(buf, "\2[held]\2", BUFSIZE);
-		}
+static void list_scan_done(scan_t *scan, bool cancelled)
+{
+	list_search_t *search = scan->privdata;
+	sourceinfo_t *si = scan->si;
 
-		command_success_nodata(si, "- %s (%s) %s", mc->name, mychan_founder_names(mc), buf);
-		matches++;
+	if (!cancelled)
+	{
+		logcommand(si, CMDLOG_ADMIN, "LIST: \2%s\2 (\2%d\2 matches)", search->criteriastr, search->matches);
+		if (search->matches == 0)
+			command_success_nodata(si, _("No channel matched criteria \2%s\2"), search->criteriastr);
+		else
+			command_success_nodata(si, ngettext(N_("\2%d\2 match for criteria \2%s\2"), N_("\2%d\2 matches for criteria \2%s\2"), search->matches), search->matches, search->criteriastr);
 	}
 
-	logcommand(si, CMDLOG_ADMIN, "LIST: \2%s\2 (\2%d\2 matches)", criteriastr, matches);
-	if (matches == 0)
-		command_success_nodata(si, _("No channel matched criteria \2%s\2"), criteriastr);
-	else
-		command_success_nodata(si, ngettext(N_("\2%d\2 match for criteria \2%s\2"), N_("\2%d\2 matches for criteria \2%s\2"), matches), matches, criteriastr);
+	list_search_free(search);
+}
+
+static void cs_cmd_list(sourceinfo_t *si, int parc, char *parv[])
+{
+	list_search_t *search;
+	char *chanpattern = NULL, *markpattern = NULL, *closedpattern = NULL;
+
+	search = smalloc(sizeof(list_search_t));
+	memset(search, 0, sizeof(list_search_t));
+
+	list_option_t optstable[] = {
+		{"pattern",	OPT_STRING,	{.strval = &chanpattern}, 0},
+		{"mark-reason", OPT_STRING,	{.strval = &markpattern}, 0},
+		{"close-reason", OPT_STRING,    {.strval = &closedpattern}, 0},
+		{"noexpire",	OPT_FLAG,	{.flagval = &search->flagset}, MC_HOLD},
+		{"held",	OPT_FLAG,	{.flagval = &search->flagset}, MC_HOLD},
+		{"hold",	OPT_FLAG,	{.flagval = &search->flagset}, MC_HOLD},
+		{"noop",	OPT_FLAG,	{.flagval = &search->flagset}, MC_NOOP},
+		{"limitflags",	OPT_FLAG,	{.flagval = &search->flagset}, MC_LIMITFLAGS},
+		{"secure",	OPT_FLAG,	{.flagval = &search->flagset}, MC_SECURE},
+		{"nosync",	OPT_FLAG,	{.flagval = &search->flagset}, MC_NOSYNC},
+		{"verbose",	OPT_FLAG,	{.flagval = &search->flagset}, MC_VERBOSE},
+		{"restricted",	OPT_FLAG,	{.flagval = &search->flagset}, MC_RESTRICTED},
+		{"keeptopic",	OPT_FLAG,	{.flagval = &search->flagset}, MC_KEEPTOPIC},
+		{"verbose-ops",	OPT_FLAG,	{.flagval = &search->flagset}, MC_VERBOSE_OPS},
+		{"topiclock",	OPT_FLAG,	{.flagval = &search->flagset}, MC_TOPICLOCK},
+		{"guard",	OPT_FLAG,	{.flagval = &search->flagset}, MC_GUARD},
+		{"private",	OPT_FLAG,	{.flagval = &search->flagset}, MC_PRIVATE},
+		{"closed",	OPT_BOOL,	{.boolval = &search->closed}, 0},
+		{"marked",	OPT_BOOL,	{.boolval = &search->marked}, 0},
+		{"aclsize",	OPT_INT,	{.intval = &search->aclsize}, 0},
+		{"registered",	OPT_AGE,	{.ageval = &search->age}, 0},
+		{"lastused",	OPT_AGE,	{.ageval = &search->lastused}, 0},
+	};
+
+	process_parvarray(optstable, ARRAY_SIZE(optstable), parc, parv);
+	build_criteriastr(search->criteriastr, parc, parv);
+
+	/* parv goes away when we return, the scan may not */
+	if (chanpattern != NULL)
+		search->chanpattern = match_pattern_create(chanpattern);
+	if (markpattern != NULL)
+		search->markpattern = match_pattern_create(markpattern);
+	if (closedpattern != NULL)
+		search->closedpattern = match_pattern_create(closedpattern);
+
+	command_success_nodata(si, _("Channels matching \2%s\2:"), search->criteriastr);
+
+	if (!scan_start(si, mclist, list_scan, list_scan_done, search))
+		list_search_free(search);
 }
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
@@ -21,6 +21,7 @@ DECLARE_MODULE_V1
 static void cs_join(hook_channel_joinpart_t *hdata);
 static void cs_part(hook_channel_joinpart_t *hdata);
 static void cs_register(hook_channel_req_t *mc);
+static void cs_message_subscribe(mychan_t *mc);
 static void cs_succession(hook_channel_succession_req_t *data);
 static void cs_newchan(channel_t *c);
 static void cs_keeptopic_topicset(channel_t *c);
@@ -46,12 +47,12 @@ static void join_registered(bool all)
 
 		if (all)
 		{
-			join(mc->name, chansvs.nick);
+			join_batched(mc->name, chansvs.nick);
 			continue;
 		}
 		else if (mc->chan != NULL && mc->chan->members.count != 0)
 		{
-			join(mc->name, chansvs.nick);
+			join_batched(mc->name, chansvs.nick);
 			continue;
 		}
 	}
@@ -190,6 +191,9 @@ static void chanserv_config_ready(void *unused)
 
 	service_set_chanmsg(chansvs.me, true);
 
+	/* FANTASY may have changed */
+	channel_message_update_all();
+
 	if (me.connected)
 		join_registered(false); /* !config_options.leave_chans */
 }
@@ -274,6 +278,7 @@ void _modinit(module_t *m)
 	hook_add_event("channel_join");
 	hook_add_event("channel_part");
 	hook_add_event("channel_register");
+	hook_add_event("channel_message_subscribe");
 	hook_add_event("channel_succession");
 	hook_add_event("channel_add");
 	hook_add_event("channel_topic");
@@ -285,6 +290,7 @@ void _modinit(module_t *m)
 	hook_add_channel_join(cs_join);
 	hook_add_channel_part(cs_part);
 	hook_add_channel_register(cs_register);
+	hook_add_channel_message_subscribe(cs_message_subscribe);
 	hook_add_channel_succession(cs_succession);
 	hook_add_channel_add(cs_newchan);
 	hook_add_channel_topic(cs_keeptopic_topicset);
@@ -330,6 +336,7 @@ void _moddeinit(module_unload_intent_t intent)
 	hook_del_channel_join(cs_join);
 	hook_del_channel_part(cs_part);
 	hook_del_channel_register(cs_register);
+	hook_del_channel_message_subscribe(cs_message_subscribe);
 	hook_del_channel_succession(cs_succession);
 	hook_del_channel_add(cs_newchan);
 	hook_del_channel_topic(cs_keeptopic_topicset);
@@ -337,6 +344,8 @@ void _moddeinit(module_unload_intent_t intent)
 	hook_del_channel_tschange(cs_tschange);
 	hook_del_shutdown(on_shutdown);
 
+	channel_message_update_all();
+
 	mowgli_timer_destroy(base_eventloop, cs_leave_empty_timer);
 }
 
@@ -371,9 +380,15 @@ static void cs_join(hook_channel_joinpart_t *hdata)
 	secure = mc->flags & MC_SECURE || (!chansvs.changets &&
 			chan->nummembers == 1 && chan->ts > CURRTIME - 300);
 
+	/* a burst may bring in thousands of these at once */
 	if (chan->nummembers == 1 && mc->flags & MC_GUARD &&
 		metadata_find(mc, "private:botserv:bot-assigned") == NULL)
-		join(chan->name, chansvs.nick);
+	{
+		if (me.bursting)
+			join_batched(chan->name, chansvs.nick);
+		else
+			join(chan->name, chansvs.nick);
+	}
 
 	/*
 	 * CS SET RESTRICTED: if they don't have any access (excluding AKICK)
@@ -587,7 +602,7 @@ static void cs_join(hook_channel_joinpart_t *hdata)
 		numeric_sts(me.me, 328, cu->user, "%s :%s", mc->name, md->value);
 
 	if (flags & CA_USEDUPDATE)
-		mc->used = CURRTIME;
+		mychan_touch(mc);
 }
 
 static void cs_part(hook_channel_joinpart_t *hdata)
@@ -606,7 +621,7 @@ static void cs_part(hook_channel_joinpart_t *hdata)
 
 	if (CURRTIME - mc->used >= 3600)
 		if (chanacs_user_flags(mc, cu->user) & CA_USEDUPDATE)
-			mc->used = CURRTIME;
+			mychan_touch(mc);
 
 	/*
 	 * When channel_part is fired, we haven't yet removed the
@@ -665,6 +680,7 @@ static void cs_register(hook_channel_req_t *hdata)
 	mychan_t *mc;
 
 	mc = hdata->mc;
+	channel_message_update(mc);
 	if (mc->chan)
 	{
 		if (mc->flags & MC_GUARD)
@@ -678,6 +694,13 @@ static void cs_register(hook_channel_req_t *hdata)
 	}
 }
 
+/* fantasy commands, see chanserv() */
+static void cs_message_subscribe(mychan_t *mc)
+{
+	if (chansvs.fantasy && metadata_find(mc, "disable_fantasy") == NULL)
+		mc->chan->msgsubs |= CHANMSG_SERVICE;
+}
+
 static void cs_succession(hook_channel_succession_req_t *data)
 {
 	chanacs_change_simple(data->mc, entity(data->mu), NULL, custom_founder_check(), 0, NULL);
@@ -224,6 +224,7 @@ static void notify_victims(sourceinfo_t *si, channel_t *c, chanban_t *cb, int di
 	 * strip it from those who do so we can reliably match users */
 	memcpy(&tmpban, cb, sizeof(chanban_t));
 	tmpban.mask = strip_extban(cb->mask);
+	tmpban.mask_pat = match_pattern_create(tmpban.mask);
 
 	/* only check the newly added/removed quiet */
 	mowgli_node_add(&tmpban, &ban_n, &ban_l);
@@ -260,6 +261,7 @@ static void notify_victims(sourceinfo_t *si, channel_t *c, chanban_t *cb, int di
 		for (i = 0; i < to_notify_count; i++)
 			notify_one_victim(si, c, to_notify[i], dir);
 
+	match_pattern_destroy(tmpban.mask_pat);
 	free(tmpban.mask);
 }
 
@@ -82,6 +82,7 @@ static void cs_cmd_set_fantasy(sourceinfo_t *si, int parc, char *parv[])
 		}
 
 		metadata_delete(mc, "disable_fantasy");
+		channel_message_update(mc);
 
 		logcommand(si, CMDLOG_SET, "SET:FANTASY:ON: \2%s\2", mc->name);
 		verbose(mc, _("\2%s\2 enabled the FANTASY flag"), get_source_name(si));
@@ -99,6 +100,7 @@ static void cs_cmd_set_fantasy(sourceinfo_t *si, int parc, char *parv[])
 		}
 
 		metadata_add(mc, "disable_fantasy", "on");
+		channel_message_update(mc);
 
 		logcommand(si, CMDLOG_SET, "SET:FANTASY:OFF: \2%s\2", mc->name);
 		verbose(mc, _("\2%s\2 disabled the FANTASY flag"), get_source_name(si));
@@ -40,7 +40,7 @@ static void cs_cmd_set_property(sourceinfo_t *si, int parc, char *parv[])
 	char *property = strtok(parv[1], " ");
 	char *value = strtok(NULL, "");
 	unsigned int count;
-	mowgli_patricia_iteration_state_t state;
+	metadata_iteration_state_t state;
 	metadata_t *md;
 
 	if (!property)
@@ -82,6 +82,8 @@ static void cs_cmd_set_property(sourceinfo_t *si, int parc, char *parv[])
 		}
 
 		metadata_delete(mc, property);
+		/* properties such as disable_fantasy affect who hears the channel */
+		channel_message_update(mc);
 		logcommand(si, CMDLOG_SET, "SET:PROPERTY: \2%s\2 \2%s\2 (deleted)", mc->name, property);
 		verbose(mc, _("\2%s\2 deleted the metadata entry \2%s\2"), get_source_name(si), property);
 		command_success_nodata(si, _("Metadata entry \2%s\2 has been deleted."), property);
@@ -91,7 +93,7 @@ static void cs_cmd_set_property(sourceinfo_t *si, int parc, char *parv[])
 	count = 0;
 	if (object(mc)->metadata)
 	{
-		MOWGLI_PATRICIA_FOREACH(md, &state, object(mc)->metadata)
+		METADATA_FOREACH(md, &state, mc)
 		{
 			if (strncmp(md->name, "private:", 8))
 				count++;
@@ -111,6 +113,7 @@ static void cs_cmd_set_property(sourceinfo_t *si, int parc, char *parv[])
 	}
 
 	metadata_add(mc, property, value);
+	channel_message_update(mc);
 	logcommand(si, CMDLOG_SET, "SET:PROPERTY: \2%s\2 on \2%s\2 to \2%s\2", property, mc->name, value);
 	verbose(mc, _("\2%s\2 added the metadata entry \2%s\2 with value \2%s\2"), get_source_name(si), property, value);
 	command_success_nodata(si, _("Metadata entry \2%s\2 added."), property);
@@ -69,7 +69,7 @@ static void grant_channel_access_hook(user_t *u)
 				}
 
 				if (ca->level & CA_USEDUPDATE)
-					ca->mychan->used = CURRTIME;
+					mychan_touch(ca->mychan);
 
 				if (ca->mychan->flags & MC_NOOP || u->myuser->flags & MU_NOOP)
 					continue;
@@ -36,6 +36,7 @@ static void ms_cmd_forward(sourceinfo_t *si, int parc, char *parv[])
 	user_t *tu;
 	myuser_t *tmu;
 	mymemo_t *memo, *newmemo;
+	hook_memo_sent_t mdata;
 	mowgli_node_t *n, *temp;
 	unsigned int i = 1, memonum = 0;
 
@@ -168,6 +169,9 @@ static void ms_cmd_forward(sourceinfo_t *si, int parc, char *parv[])
 			temp = mowgli_node_create();
 			mowgli_node_add(newmemo, temp, &tmu->memos);
 			tmu->memoct_new++;
+			mdata.mu = tmu;
+			mdata.memo = newmemo;
+			hook_call_user_memo_sent(&mdata);
 
 			/* Should we email this? */
 			if (tmu->flags & MU_EMAILMEMOS)
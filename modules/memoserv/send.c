@@ -40,6 +40,7 @@ static void ms_cmd_send(sourceinfo_t *si, int parc, char *parv[])
 	myuser_t *tmu;
 	mowgli_node_t *n;
 	mymemo_t *memo;
+	hook_memo_sent_t mdata;
 	command_t *cmd;
 	service_t *memoserv;
 
@@ -161,6 +162,9 @@ static void ms_cmd_send(sourceinfo_t *si, int parc, char *parv[])
 		n = mowgli_node_create();
 		mowgli_node_add(memo, n, &tmu->memos);
 		tmu->memoct_new++;
+		mdata.mu = tmu;
+		mdata.memo = memo;
+		hook_call_user_memo_sent(&mdata);
 
 		/* Should we email this? */
 	        if (tmu->flags & MU_EMAILMEMOS)
@@ -37,6 +37,7 @@ static void ms_cmd_sendall(sourceinfo_t *si, int parc, char *parv[])
 	myentity_t *mt;
 	mowgli_node_t *n;
 	mymemo_t *memo;
+	hook_memo_sent_t mdata;
 	int sent = 0, tried = 0;
 	bool ignored;
 	service_t *memoserv;
@@ -144,6 +145,9 @@ static void ms_cmd_sendall(sourceinfo_t *si, int parc, char *parv[])
 		n = mowgli_node_create();
 		mowgli_node_add(memo, n, &tmu->memos);
 		tmu->memoct_new++;
+		mdata.mu = tmu;
+		mdata.memo = memo;
+		hook_call_user_memo_sent(&mdata);
 
 		/* Should we email this? */
 		if (tmu->flags & MU_EMAILMEMOS)
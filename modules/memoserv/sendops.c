@@ -38,6 +38,7 @@ static void ms_cmd_sendops(sourceinfo_t *si, int parc, char *parv[])
 	myuser_t *tmu;
 	mowgli_node_t *n, *tn;
 	mymemo_t *memo;
+	hook_memo_sent_t mdata;
 	mychan_t *mc;
 	int sent = 0, tried = 0;
 	bool ignored, operoverride = false;
@@ -166,6 +167,9 @@ static void ms_cmd_sendops(sourceinfo_t *si, int parc, char *parv[])
 		n = mowgli_node_create();
 		mowgli_node_add(memo, n, &tmu->memos);
 		tmu->memoct_new++;
+		mdata.mu = tmu;
+		mdata.memo = memo;
+		hook_call_user_memo_sent(&mdata);
 
 		/* Should we email this? */
 		if (tmu->flags & MU_EMAILMEMOS)
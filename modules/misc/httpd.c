@@ -11,6 +11,8 @@
 #include "datastream.h"
 
 #define REQUEST_MAX 65536 /* maximum size of one call */
+#define FILE_CACHE_MAX 256 /* maximum number of open files kept */
+#define FILE_RECHECK 5 /* seconds between stat()s of a cached file */
 
 DECLARE_MODULE_V1
 (
@@ -20,7 +22,24 @@ DECLARE_MODULE_V1
 );
 
 connection_t *listener;
-mowgli_list_t httpd_path_handlers;
+mowgli_patricia_t *httpd_path_handlers;
+
+/* a file under www_root, kept open with its response header ready */
+typedef struct {
+	char path[256];
+	int fd;
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	time_t mtime;
+	time_t checked;
+	char etag[64];
+	char last_modified[40];
+	char *header;		/* up to, not including, the Connection header */
+	size_t headerlen;
+} httpd_file_t;
+
+static mowgli_patricia_t *file_cache;
 
 /* conf stuff */
 mowgli_list_t conf_httpd_table;
@@ -50,18 +69,178 @@ static void clear_httpddata(struct httpddata *hd)
 	hd->correct_content_type = false;
 	hd->expect_100_continue = false;
 	hd->sent_reply = false;
+	hd->if_none_match[0] = '\0';
+	hd->if_modified_since[0] = '\0';
 }
 
-static int open_file(const char *filename)
+/*
+ * Finds the handler for a request path. A handler whose path ends in
+ * a slash also gets everything below it; the longest match wins.
+ */
+static path_handler_t *find_path_handler(const char *filename)
+{
+	char path[256];
+	char *p;
+	path_handler_t *ph;
+
+	mowgli_strlcpy(path, filename, sizeof path);
+	if ((p = strchr(path, '?')) != NULL)
+		*p = '\0';
+
+	if ((ph = mowgli_patricia_retrieve(httpd_path_handlers, path)) != NULL)
+		return ph;
+
+	while ((p = strrchr(path, '/')) != NULL)
+	{
+		p[1] = '\0';
+		if ((ph = mowgli_patricia_retrieve(httpd_path_handlers, path)) != NULL)
+			return ph;
+		*p = '\0';
+	}
+
+	return NULL;
+}
+
+static const char *content_type(const char *filename);
+
+static void file_free(httpd_file_t *f)
+{
+	close(f->fd);
+	free(f->header);
+	free(f);
+}
+
+static void file_cache_free_cb(const char *key, void *data, void *privdata)
+{
+	file_free(data);
+}
+
+static void file_cache_clear(void)
+{
+	/* entries are keyed by request path, not by f->path */
+	mowgli_patricia_destroy(file_cache, file_cache_free_cb, NULL);
+	file_cache = mowgli_patricia_create(noopcanon);
+}
+
+static httpd_file_t *file_open(const char *filename)
 {
-	char fname[256];
+	httpd_file_t *f;
+	struct stat sb;
+	struct tm tm;
+	char buf[512];
+	int fd;
 
 	if (strstr(filename, ".."))
-		return -1;
-	if (!strcmp(filename, "/"))
-		filename = "/index.html";
-	snprintf(fname, sizeof fname, "%s/%s", httpd_config.www_root, filename);
-	return open(fname, O_RDONLY);
+		return NULL;
+
+	f = scalloc(sizeof(httpd_file_t), 1);
+	snprintf(f->path, sizeof f->path, "%s/%s", httpd_config.www_root,
+			!strcmp(filename, "/") ? "/index.html" : filename);
+
+	fd = open(f->path, O_RDONLY);
+	if (fd == -1 || fstat(fd, &sb) == -1 || !S_ISREG(sb.st_mode))
+	{
+		if (fd != -1)
+			close(fd);
+		free(f);
+		return NULL;
+	}
+
+	f->fd = fd;
+	f->dev = sb.st_dev;
+	f->ino = sb.st_ino;
+	f->size = sb.st_size;
+	f->mtime = sb.st_mtime;
+	f->checked = CURRTIME;
+
+	snprintf(f->etag, sizeof f->etag, "\"%lx-%lx-%lx\"", (unsigned long)f->ino,
+			(unsigned long)f->size, (unsigned long)f->mtime);
+	gmtime_r(&f->mtime, &tm);
+	strftime(f->last_modified, sizeof f->last_modified, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+
+	snprintf(buf, sizeof buf,
+			"HTTP/1.1 200 OK\r\nServer: Atheme/%s\r\nContent-Type: %s\r\nContent-Length: %lu\r\n"
+			"ETag: %s\r\nLast-Modified: %s\r\n",
+			PACKAGE_VERSION,
+			content_type(filename),
+			(unsigned long)f->size,
+			f->etag, f->last_modified);
+	f->header = sstrdup(buf);
+	f->headerlen = strlen(buf);
+
+	return f;
+}
+
+/*
+ * Returns the cached file for a request path, opening it if needed.
+ * Cached files are checked against the filesystem every FILE_RECHECK
+ * seconds. If the cache is full, the file is returned with *cached
+ * false and must be freed by the caller.
+ */
+static httpd_file_t *file_get(const char *filename, bool *cached)
+{
+	httpd_file_t *f;
+	struct stat sb;
+
+	*cached = true;
+
+	if ((f = mowgli_patricia_retrieve(file_cache, filename)) != NULL)
+	{
+		if (f->checked + FILE_RECHECK > CURRTIME)
+			return f;
+
+		if (stat(f->path, &sb) == 0 && sb.st_dev == f->dev && sb.st_ino == f->ino &&
+				sb.st_size == f->size && sb.st_mtime == f->mtime)
+		{
+			f->checked = CURRTIME;
+			return f;
+		}
+
+		mowgli_patricia_delete(file_cache, filename);
+		file_free(f);
+	}
+
+	if ((f = file_open(filename)) == NULL)
+		return NULL;
+
+	if (mowgli_patricia_size(file_cache) < FILE_CACHE_MAX)
+		mowgli_patricia_add(file_cache, filename, f);
+	else
+		*cached = false;
+
+	return f;
+}
+
+/*
+ * Parses an RFC 1123 date, the form sent in Last-Modified, into a time_t.
+ * The older RFC 850 and asctime() forms are not accepted; a client using
+ * them just gets the full file again.
+ */
+static bool parse_http_date(const char *s, time_t *t)
+{
+	static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+	char mon[4];
+	const char *p;
+	int day, month, year, hour, min, sec;
+	long y, era, yoe, doy, days;
+
+	if (sscanf(s, "%*3s, %2d %3s %4d %2d:%2d:%2d GMT", &day, mon, &year, &hour, &min, &sec) != 6)
+		return false;
+	if (strlen(mon) != 3 || (p = strstr(months, mon)) == NULL || (p - months) % 3 != 0)
+		return false;
+	if (day < 1 || day > 31 || year < 1970 || hour > 23 || min > 59 || sec > 60)
+		return false;
+	month = (p - months) / 3 + 1;
+
+	/* days since the epoch in the proleptic Gregorian calendar */
+	y = year - (month <= 2);
+	era = y / 400;
+	yoe = y - era * 400;
+	doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+	days = era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+
+	*t = (time_t)days * 86400 + hour * 3600 + min * 60 + sec;
+	return true;
 }
 
 static void process_header(connection_t *cptr, char *line)
@@ -87,6 +266,9 @@ static void process_header(connection_t *cptr, char *line)
 				slog(LG_DEBUG, "process_header(): Connection: close requested by fd %d", cptr->fd);
 				hd->connection_close = true;
 			}
+			/* HTTP/1.0 clients may still ask to pipeline requests */
+			else if (!strcasecmp(p, "keep-alive") && !hd->http_1_1)
+				hd->connection_close = false;
 			p = strtok(NULL, ", \t");
 		}
 	}
@@ -103,6 +285,14 @@ static void process_header(connection_t *cptr, char *line)
 	{
 		hd->expect_100_continue = !strcasecmp(p, "100-continue");
 	}
+	else if (!strcasecmp(line, "If-None-Match"))
+	{
+		mowgli_strlcpy(hd->if_none_match, p, sizeof hd->if_none_match);
+	}
+	else if (!strcasecmp(line, "If-Modified-Since"))
+	{
+		mowgli_strlcpy(hd->if_modified_since, p, sizeof hd->if_modified_since);
+	}
 }
 
 static void check_close(connection_t *cptr)
@@ -116,6 +306,7 @@ static void check_close(connection_t *cptr)
 
 static void send_error(connection_t *cptr, int errorcode, const char *text, bool sendentity)
 {
+	struct httpddata *hd = cptr->userdata;
 	char buf1[300];
 	char buf2[700];
 
@@ -123,10 +314,12 @@ static void send_error(connection_t *cptr, int errorcode, const char *text, bool
 		errorcode = 500;
 	snprintf(buf2, sizeof buf2, "HTTP/1.1 %d %s\r\n", errorcode, text);
 	snprintf(buf1, sizeof buf1, "HTTP/1.1 %d %s\r\n"
+			"%s"
 			"Server: Atheme/%s\r\n"
 			"Content-Type: text/plain\r\n"
 			"Content-Length: %lu\r\n\r\n%s",
-			errorcode, text, PACKAGE_VERSION, (unsigned long)strlen(buf2),
+			errorcode, text, httpd_connection_header(hd),
+			PACKAGE_VERSION, (unsigned long)strlen(buf2),
 			sendentity ? buf2 : "");
 	sendq_add(cptr, buf1, strlen(buf1));
 }
@@ -162,23 +355,15 @@ static void httpd_recvqhandler(connection_t *cptr)
 	int count;
 	struct httpddata *hd;
 	char *p;
-	int in;
-	struct stat sb;
-	off_t count1;
-	mowgli_node_t *n;
-	path_handler_t *ph = NULL;
-	bool is_get, is_post, handling_done = false;
+	httpd_file_t *f;
+	path_handler_t *ph;
+	bool is_get, is_post, cached, handling_done;
+	time_t since;
 
 	hd = cptr->userdata;
 
-	MOWGLI_ITER_FOREACH(n, httpd_path_handlers.head)
-	{
-		ph = (path_handler_t *)n->data;
-		handling_done = !strcmp(hd->filename, ph->path);
-
-		if (handling_done)
-			break;
-	}
+	ph = hd->filename[0] != '\0' ? find_path_handler(hd->filename) : NULL;
+	handling_done = ph != NULL;
 
 	if (handling_done)
 	{
@@ -205,6 +390,7 @@ static void httpd_recvqhandler(connection_t *cptr)
 	if (cptr->flags & CF_NONEWLINE)
 	{
 		slog(LG_INFO, "httpd_recvqhandler(): throwing out fd %d (%s) for excessive line length", cptr->fd, cptr->hbuf);
+		hd->connection_close = true;
 		send_error(cptr, 400, "Bad request", true);
 		sendq_add_eof(cptr);
 		return;
@@ -232,6 +418,7 @@ static void httpd_recvqhandler(connection_t *cptr)
 			return;
 		mowgli_strlcpy(hd->filename, p, sizeof hd->filename);
 		p = strtok(NULL, "");
+		hd->http_1_1 = p != NULL && !strcmp(p, "HTTP/1.1");
 		if (p == NULL || !strcmp(p, "HTTP/1.0"))
 			hd->connection_close = true;
 		slog(LG_DEBUG, "httpd_recvqhandler(): request %s for %s", hd->method, hd->filename);
@@ -243,6 +430,7 @@ static void httpd_recvqhandler(connection_t *cptr)
 
 		if (!is_post && !is_get)
 		{
+			hd->connection_close = true;
 			send_error(cptr, 501, "Method Not Implemented", true);
 			sendq_add_eof(cptr);
 			return;
@@ -252,60 +440,56 @@ static void httpd_recvqhandler(connection_t *cptr)
 
 		if (!handling_done)
 		{
-			in = open_file(hd->filename);
-			if (in == -1 || fstat(in, &sb) == -1 || !S_ISREG(sb.st_mode))
+			f = file_get(hd->filename, &cached);
+			if (f == NULL)
 			{
-				if (in != -1)
-					close(in);
 				slog(LG_DEBUG, "httpd_recvqhandler(): 404 for \2%s\2", hd->filename);
 				send_error(cptr, 404, "Not Found", is_get);
 				check_close(cptr);
 				return;
 			}
-			slog(LG_INFO, "httpd_recvqhandler(): 200 for %s", hd->filename);
-			snprintf(outbuf, sizeof outbuf,
-					"HTTP/1.1 200 OK\r\nServer: Atheme/%s\r\nContent-Type: %s\r\nContent-Length: %lu\r\n\r\n",
-					PACKAGE_VERSION,
-					content_type(hd->filename),
-					(unsigned long)sb.st_size);
-			sendq_add(cptr, outbuf, strlen(outbuf));
-			count1 = is_get ? sb.st_size : 0;
-			while (count1 > 0)
+			if (hd->if_none_match[0] != '\0' ?
+					!strcmp(hd->if_none_match, f->etag) :
+					parse_http_date(hd->if_modified_since, &since) && f->mtime <= since)
 			{
-				count = sizeof outbuf;
-				if (count > count1)
-					count = count1;
-				count = read(in, outbuf, count);
-				if (count <= 0)
-					break;
-				sendq_add(cptr, outbuf, count);
-				count1 -= count;
+				slog(LG_DEBUG, "httpd_recvqhandler(): 304 for %s", hd->filename);
+				snprintf(outbuf, sizeof outbuf,
+						"HTTP/1.1 304 Not Modified\r\n%sServer: Atheme/%s\r\nETag: %s\r\n\r\n",
+						httpd_connection_header(hd), PACKAGE_VERSION, f->etag);
+				sendq_add(cptr, outbuf, strlen(outbuf));
 			}
-			close(in);
-			if (count1 > 0)
+			else
 			{
-				slog(LG_INFO, "httpd_recvqhandler(): disconnecting fd %d (%s), read failed on %s", cptr->fd, cptr->hbuf, hd->filename);
-				cptr->flags |= CF_DEAD;
+				slog(LG_INFO, "httpd_recvqhandler(): 200 for %s", hd->filename);
+				sendq_add(cptr, f->header, f->headerlen);
+				snprintf(outbuf, sizeof outbuf, "%s\r\n", httpd_connection_header(hd));
+				sendq_add(cptr, outbuf, strlen(outbuf));
+				if (is_get)
+					sendq_add_file(cptr, f->fd, 0, f->size);
 			}
-			else
-				check_close(cptr);
+			if (!cached)
+				file_free(f);
+			check_close(cptr);
 		}
 		else
 		{
 			if (hd->length <= 0)
 			{
+				hd->connection_close = true;
 				send_error(cptr, 411, "Length Required", true);
 				sendq_add_eof(cptr);
 				return;
 			}
 			if (hd->length > REQUEST_MAX)
 			{
+				hd->connection_close = true;
 				send_error(cptr, 413, "Request Entity Too Large", true);
 				sendq_add_eof(cptr);
 				return;
 			}
 			if (!hd->correct_content_type)
 			{
+				hd->connection_close = true;
 				send_error(cptr, 415, "Unsupported Media Type", true);
 				sendq_add_eof(cptr);
 				return;
@@ -332,12 +516,46 @@ static void httpd_closehandler(connection_t *cptr)
 	hd = cptr->userdata;
 	if (hd != NULL)
 	{
+		deadline_cancel(&hd->idle);
+		if (hd->stream_close != NULL)
+			hd->stream_close(cptr);
 		free(hd->requestbuf);
 		free(hd);
 	}
 	cptr->userdata = NULL;
 }
 
+static void httpd_idle(void *arg)
+{
+	connection_t *cptr = arg;
+	struct httpddata *hd = cptr->userdata;
+
+	/* streams stay open for as long as the client wants them */
+	if (hd->stream_close != NULL)
+	{
+		deadline_set(&hd->idle, CURRTIME + HTTPD_IDLE_TIMEOUT);
+		return;
+	}
+
+	if (cptr->last_recv + HTTPD_IDLE_TIMEOUT >= CURRTIME)
+	{
+		deadline_set(&hd->idle, cptr->last_recv + HTTPD_IDLE_TIMEOUT + 1);
+		return;
+	}
+
+	if (sendq_nonempty(cptr))
+	{
+		cptr->last_recv = CURRTIME;
+		deadline_set(&hd->idle, cptr->last_recv + HTTPD_IDLE_TIMEOUT + 1);
+	}
+	else
+		/* from a timeout function,
+		 * connection_close_soon() may take quite
+		 * a while, and connection_close() is safe
+		 * -- jilles */
+		connection_close(cptr);
+}
+
 static void do_listen(connection_t *cptr)
 {
 	connection_t *newptr;
@@ -349,39 +567,21 @@ static void do_listen(connection_t *cptr)
 	hd->requestbuf = NULL;
 	hd->replybuf = NULL;
 	hd->connection_close = false;
+	hd->stream_close = NULL;
+	hd->stream_data = NULL;
 	clear_httpddata(hd);
+	deadline_init(&hd->idle, "httpd_idle", httpd_idle, newptr);
+	deadline_set(&hd->idle, newptr->last_recv + HTTPD_IDLE_TIMEOUT + 1);
 	newptr->userdata = hd;
 	newptr->recvq_handler = httpd_recvqhandler;
 	newptr->close_handler = httpd_closehandler;
 }
 
-static void httpd_checkidle(void *arg)
-{
-	mowgli_node_t *n, *tn;
-	connection_t *cptr;
-
-	(void)arg;
-	if (listener == NULL)
-		return;
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, connection_list.head)
-	{
-		cptr = n->data;
-		if (cptr->listener == listener && cptr->last_recv + 300 < CURRTIME)
-		{
-			if (sendq_nonempty(cptr))
-				cptr->last_recv = CURRTIME;
-			else
-				/* from a timeout function,
-				 * connection_close_soon() may take quite
-				 * a while, and connection_close() is safe
-				 * -- jilles */
-				connection_close(cptr);
-		}
-	}
-}
-
 static void httpd_config_ready(void *vptr)
 {
+	/* www_root may have changed */
+	file_cache_clear();
+
 	if (httpd_config.host != NULL && httpd_config.port != 0)
 	{
 		/* Some code depends on connection_t.listener == listener. */
@@ -396,14 +596,13 @@ static void httpd_config_ready(void *vptr)
 		slog(LG_ERROR, "httpd_config_ready(): httpd {} block missing or invalid");
 }
 
-static mowgli_eventloop_timer_t *httpd_checkidle_timer = NULL;
-
 void _modinit(module_t *m)
 {
-	httpd_checkidle_timer = mowgli_timer_add(base_eventloop, "httpd_checkidle", httpd_checkidle, NULL, 60);
-
 	/* This module needs a rehash to initialize fully if loaded
 	 * at run time */
+	httpd_path_handlers = mowgli_patricia_create(noopcanon);
+	file_cache = mowgli_patricia_create(noopcanon);
+
 	hook_add_event("config_ready");
 	hook_add_config_ready(httpd_config_ready);
 
@@ -415,10 +614,24 @@ void _modinit(module_t *m)
 
 void _moddeinit(module_unload_intent_t intent)
 {
-	mowgli_timer_destroy(base_eventloop, httpd_checkidle_timer);
+	mowgli_node_t *n;
+	connection_t *cptr;
+	struct httpddata *hd;
+
+	/* the idle callbacks live in this module */
+	MOWGLI_ITER_FOREACH(n, connection_list.head)
+	{
+		cptr = n->data;
+		hd = cptr->userdata;
+		if (listener != NULL && cptr->listener == listener && hd != NULL)
+			deadline_cancel(&hd->idle);
+	}
 
 	hook_del_config_ready(httpd_config_ready);
 	connection_close_soon_children(listener);
+	file_cache_clear();
+	mowgli_patricia_destroy(file_cache, NULL, NULL);
+	mowgli_patricia_destroy(httpd_path_handlers, NULL, NULL);
 	del_conf_item("HOST", &conf_httpd_table);
 	del_conf_item("WWW_ROOT", &conf_httpd_table);
 	del_conf_item("PORT", &conf_httpd_table);
@@ -26,12 +26,12 @@ typedef struct {
 	char nick[NICKLEN];
 	char host[HOSTLEN];
 	time_t timelimit;
+	deadline_t deadline;
 	mowgli_node_t node;
 } enforce_timeout_t;
 
 mowgli_list_t enforce_list;
 mowgli_heap_t *enforce_timeout_heap;
-time_t enforce_next;
 
 static void guest_nickname(user_t *u);
 
@@ -39,7 +39,7 @@ static void ns_cmd_set_enforce(sourceinfo_t *si, int parc, char *parv[]);
 static void ns_cmd_release(sourceinfo_t *si, int parc, char *parv[]);
 static void ns_cmd_regain(sourceinfo_t *si, int parc, char *parv[]);
 
-static void enforce_timeout_check(void *arg);
+static void enforce_timeout_expire(void *arg);
 static void show_enforce(hook_user_req_t *hdata);
 static void check_registration(hook_user_register_check_t *hdata);
 static void check_enforce(hook_nick_enforce_t *hdata);
@@ -50,7 +50,6 @@ command_t ns_regain = { "REGAIN", N_("Regain usage of a nickname."), AC_NONE, 2,
 
 mowgli_patricia_t **ns_set_cmdtree;
 
-static mowgli_eventloop_timer_t *enforce_timeout_check_timer = NULL;
 static mowgli_eventloop_timer_t *enforce_remove_enforcers_timer = NULL;
 
 /* logs a released nickname out */
@@ -64,7 +63,7 @@ static bool log_enforce_victim_out(user_t *u, myuser_t *mu)
 	if (u->myuser == NULL || u->myuser != mu)
 		return false;
 
-	u->myuser->lastlogin = CURRTIME;
+	myuser_set_lastlogin(u->myuser, CURRTIME);
 
 	if ((mn = mynick_find(u->nick)) != NULL)
 		mn->lastseen = CURRTIME;
@@ -88,6 +87,13 @@ static bool log_enforce_victim_out(user_t *u, myuser_t *mu)
 	return true;
 }
 
+static void enforce_timeout_destroy(enforce_timeout_t *timeout)
+{
+	deadline_cancel(&timeout->deadline);
+	mowgli_node_delete(&timeout->node, &enforce_list);
+	mowgli_heap_free(enforce_timeout_heap, timeout);
+}
+
 /* sends an FNC for the given user */
 static void guest_nickname(user_t *u)
 {
@@ -231,8 +237,7 @@ static void ns_cmd_release(sourceinfo_t *si, int parc, char *parv[])
 				timeout = n->data;
 				if (!irccasecmp(mn->nick, timeout->nick) && (!strcmp(si->su->host, timeout->host) || !strcmp(si->su->vhost, timeout->host)))
 				{
-					mowgli_node_delete(&timeout->node, &enforce_list);
-					mowgli_heap_free(enforce_timeout_heap, timeout);
+					enforce_timeout_destroy(timeout);
 				}
 			}
 		}
@@ -358,8 +363,7 @@ static void ns_cmd_regain(sourceinfo_t *si, int parc, char *parv[])
 				timeout = n->data;
 				if (!irccasecmp(mn->nick, timeout->nick) && (!strcmp(si->su->host, timeout->host) || !strcmp(si->su->vhost, timeout->host)))
 				{
-					mowgli_node_delete(&timeout->node, &enforce_list);
-					mowgli_heap_free(enforce_timeout_heap, timeout);
+					enforce_timeout_destroy(timeout);
 				}
 			}
 		}
@@ -419,7 +423,7 @@ static void ns_cmd_regain(sourceinfo_t *si, int parc, char *parv[])
 				if (ircd_on_logout(si->su, entity(si->smu)->name))
 					/* logout killed the user... */
 					return;
-				si->smu->lastlogin = CURRTIME;
+				myuser_set_lastlogin(si->smu, CURRTIME);
 				MOWGLI_ITER_FOREACH_SAFE(n, tn, si->smu->logins.head)
 				{
 					if (n->data == si->su)
@@ -467,48 +471,35 @@ static void enforce_remove_enforcers(void *arg)
 	}
 }
 
-void enforce_timeout_check(void *arg)
+static void enforce_timeout_expire(void *arg)
 {
-	mowgli_node_t *n, *tn;
-	enforce_timeout_t *timeout;
+	enforce_timeout_t *timeout = arg;
 	user_t *u;
 	mynick_t *mn;
 	bool valid;
 
-	enforce_next = 0;
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, enforce_list.head)
-	{
-		timeout = n->data;
-		if (timeout->timelimit > CURRTIME)
-		{
-			enforce_next = timeout->timelimit;
-			enforce_timeout_check_timer = mowgli_timer_add_once(base_eventloop, "enforce_timeout_check", enforce_timeout_check, NULL, enforce_next - CURRTIME);
-			break; /* assume sorted list */
-		}
-		u = user_find_named(timeout->nick);
-		mn = mynick_find(timeout->nick);
-		valid = u != NULL && mn != NULL && (!strcmp(u->host, timeout->host) || !strcmp(u->vhost, timeout->host));
-		mowgli_node_delete(&timeout->node, &enforce_list);
-		mowgli_heap_free(enforce_timeout_heap, timeout);
-		if (!valid)
-			continue;
-		if (is_internal_client(u))
-			continue;
-		if (u->myuser == mn->owner)
-			continue;
-		if (myuser_access_verify(u, mn->owner))
-			continue;
-		if (!metadata_find(mn->owner, "private:doenforce"))
-			continue;
-
-		notice(nicksvs.nick, u->nick, "You failed to identify in time for the nickname %s", mn->nick);
-		guest_nickname(u);
-		if (ircd->flags & IRCD_HOLDNICK)
-			holdnick_sts(nicksvs.me->me, u->flags & UF_WASENFORCED ? 3600 : 30, u->nick, mn->owner);
-		else
-			u->flags |= UF_DOENFORCE;
-		u->flags |= UF_WASENFORCED;
-	}
+	u = user_find_named(timeout->nick);
+	mn = mynick_find(timeout->nick);
+	valid = u != NULL && mn != NULL && (!strcmp(u->host, timeout->host) || !strcmp(u->vhost, timeout->host));
+	enforce_timeout_destroy(timeout);
+	if (!valid)
+		return;
+	if (is_internal_client(u))
+		return;
+	if (u->myuser == mn->owner)
+		return;
+	if (myuser_access_verify(u, mn->owner))
+		return;
+	if (!metadata_find(mn->owner, "private:doenforce"))
+		return;
+
+	notice(nicksvs.nick, u->nick, "You failed to identify in time for the nickname %s", mn->nick);
+	guest_nickname(u);
+	if (ircd->flags & IRCD_HOLDNICK)
+		holdnick_sts(nicksvs.me->me, u->flags & UF_WASENFORCED ? 3600 : 30, u->nick, mn->owner);
+	else
+		u->flags |= UF_DOENFORCE;
+	u->flags |= UF_WASENFORCED;
 }
 
 static void show_enforce(hook_user_req_t *hdata)
@@ -537,8 +528,11 @@ static void check_registration(hook_user_register_check_t *hdata)
 
 static void check_enforce(hook_nick_enforce_t *hdata)
 {
-	enforce_timeout_t *timeout, *timeout2;
+	enforce_timeout_t *timeout;
+#ifdef SHOW_CORRECT_TIMEOUT_BUT_BE_SLOW
+	enforce_timeout_t *timeout2;
 	mowgli_node_t *n;
+#endif
 	metadata_t *md;
 
 	/* nick is a service, ignore it */
@@ -584,27 +578,9 @@ static void check_enforce(hook_nick_enforce_t *hdata)
 			timeout->timelimit = CURRTIME + enforcetime;
 		}
 
-		/* insert in sorted order */
-		MOWGLI_ITER_FOREACH_PREV(n, enforce_list.tail)
-		{
-			timeout2 = n->data;
-			if (timeout2->timelimit <= timeout->timelimit)
-				break;
-		}
-		if (n == NULL)
-			mowgli_node_add_head(timeout, &timeout->node, &enforce_list);
-		else if (n->next == NULL)
-			mowgli_node_add(timeout, &timeout->node, &enforce_list);
-		else
-			mowgli_node_add_before(timeout, &timeout->node, &enforce_list, n->next);
-
-		if (enforce_next == 0 || enforce_next > timeout->timelimit)
-		{
-			if (enforce_next != 0)
-				mowgli_timer_destroy(base_eventloop, enforce_timeout_check_timer);
-			enforce_next = timeout->timelimit;
-			enforce_timeout_check_timer = mowgli_timer_add_once(base_eventloop, "enforce_timeout_check", enforce_timeout_check, NULL, enforce_next - CURRTIME);
-		}
+		mowgli_node_add(timeout, &timeout->node, &enforce_list);
+		deadline_init(&timeout->deadline, "enforce_timeout", enforce_timeout_expire, timeout);
+		deadline_set(&timeout->deadline, timeout->timelimit);
 	}
 
 	notice(nicksvs.nick, hdata->u->nick, "You have %d seconds to identify to your nickname before it is changed.", (int)(timeout->timelimit - CURRTIME));
@@ -662,12 +638,14 @@ void _modinit(module_t *m)
 
 void _moddeinit(module_unload_intent_t intent)
 {
+	mowgli_node_t *n, *tn;
+
 	enforce_remove_enforcers(NULL);
 
 	mowgli_timer_destroy(base_eventloop, enforce_remove_enforcers_timer);
 
-	if (enforce_next)
-		mowgli_timer_destroy(base_eventloop, enforce_timeout_check_timer);
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, enforce_list.head)
+		enforce_timeout_destroy(n->data);
 
 	service_named_unbind_command("nickserv", &ns_release);
 	service_named_unbind_command("nickserv", &ns_regain);
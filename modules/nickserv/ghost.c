@@ -103,9 +103,9 @@ void ns_cmd_ghost(sourceinfo_t *si, int parc, char *parv[])
 		 * Perhaps the ghosted nick belonged to someone else, but we were identified to it?
 		 * Try this first. */
 		if (target_u->myuser && target_u->myuser == si->smu)
-			target_u->myuser->lastlogin = CURRTIME;
+			myuser_set_lastlogin(target_u->myuser, CURRTIME);
 		else
-			mu->lastlogin = CURRTIME;
+			myuser_set_lastlogin(mu, CURRTIME);
 
 		return;
 	}
@@ -155,7 +155,7 @@ static void ns_cmd_login(sourceinfo_t *si, int parc, char *parv[])
 			if (ircd_on_logout(u, entity(u->myuser)->name))
 				/* logout killed the user... */
 				return;
-		        u->myuser->lastlogin = CURRTIME;
+		        myuser_set_lastlogin(u->myuser, CURRTIME);
 		        MOWGLI_ITER_FOREACH_SAFE(n, tn, u->myuser->logins.head)
 		        {
 			        if (n->data == u)
@@ -18,6 +18,7 @@ DECLARE_MODULE_V1
 );
 
 static void ns_cmd_list(sourceinfo_t *si, int parc, char *parv[]);
+static bool list_scan(scan_t *scan, void *data);
 static mowgli_patricia_t *list_params;
 
 command_t ns_list = { "LIST", N_("Lists nicknames registered matching a given pattern."), PRIV_USER_AUSPEX, 10, ns_cmd_list, { .path = "nickserv/list" } };
@@ -41,36 +42,45 @@ static bool lastlogin_match(const mynick_t *mn, const void *arg)
 	return (CURRTIME - mu->lastlogin) > lastlogin;
 }
 
+static void split_pattern(const char *pattern, char *pat, size_t patlen, char **nickpattern, char **hostpattern)
+{
+	char *p;
+
+	*nickpattern = *hostpattern = NULL;
+
+	if (pattern == NULL)
+		return;
+
+	mowgli_strlcpy(pat, pattern, patlen);
+	p = strrchr(pat, ' ');
+	if (p == NULL)
+		p = strrchr(pat, '!');
+	if (p != NULL)
+	{
+		*p++ = '\0';
+		*nickpattern = pat;
+		*hostpattern = p;
+	}
+	else if (strchr(pat, '@'))
+		*hostpattern = pat;
+	else
+		*nickpattern = pat;
+	if (*nickpattern && !strcmp(*nickpattern, "*"))
+		*nickpattern = NULL;
+}
+
 static bool pattern_match(const mynick_t *mn, const void *arg)
 {
 	const char *pattern = (const char*)arg;
 
-	char pat[512], *nickpattern = NULL, *hostpattern = NULL, *p;
+	char pat[512], *nickpattern, *hostpattern;
 	metadata_t *md;
 
 	bool hostmatch;
 
 	myuser_t *mu = mn->owner;
 
-	if (pattern != NULL)
-	{
-		mowgli_strlcpy(pat, pattern, sizeof pat);
-		p = strrchr(pat, ' ');
-		if (p == NULL)
-			p = strrchr(pat, '!');
-		if (p != NULL)
-		{
-			*p++ = '\0';
-			nickpattern = pat;
-			hostpattern = p;
-		}
-		else if (strchr(pat, '@'))
-			hostpattern = pat;
-		else
-			nickpattern = pat;
-		if (nickpattern && !strcmp(nickpattern, "*"))
-			nickpattern = NULL;
-	}
+	split_pattern(pattern, pat, sizeof pat, &nickpattern, &hostpattern);
 
 	if (nickpattern && match(nickpattern, mn->nick))
 		return false;
@@ -105,25 +115,25 @@ static bool has_waitauth(const mynick_t *mn, const void *arg) {
 	return ( mu->flags & MU_WAITAUTH ) == MU_WAITAUTH;
 }
 
+/* the planner knows how to look these up in the account indexes */
+static list_param_t email, lastlogin, pattern, registered;
+
 void _modinit(module_t *m)
 {
 	list_params = mowgli_patricia_create(strcasecanon);
+	account_index_enable();
 	service_named_bind_command("nickserv", &ns_list);
 
 	/* list email */
-	static list_param_t email;
 	email.opttype = OPT_STRING;
 	email.is_match = email_match;
 
-	static list_param_t lastlogin;
 	lastlogin.opttype = OPT_AGE;
 	lastlogin.is_match = lastlogin_match;
 
-	static list_param_t pattern;
 	pattern.opttype = OPT_STRING;
 	pattern.is_match = pattern_match;
 
-	static list_param_t registered;
 	registered.opttype = OPT_AGE;
 	registered.is_match = registered_match;
 
@@ -153,6 +163,8 @@ void _moddeinit(module_unload_intent_t intent)
 	list_unregister("registered");
 
 	list_unregister("waitauth");
+
+	account_index_disable();
 }
 
 void list_register(const char *param_name, list_param_t *param) {
@@ -160,6 +172,8 @@ void list_register(const char *param_name, list_param_t *param) {
 }
 
 void list_unregister(const char *param_name) {
+	/* running searches may hold on to the parameter */
+	scan_cancel_all(list_scan);
 	mowgli_patricia_delete(list_params, param_name);
 }
 
@@ -239,100 +253,290 @@ static void list_one(sourceinfo_t *si, myuser_t *mu, mynick_t *mn)
 		command_success_nodata(si, "- %s (%s) (%s) %s", mn->nick, mu->email, entity(mu)->name, buf);
 }
 
-static void ns_cmd_list(sourceinfo_t *si, int parc, char *parv[])
-{
+typedef struct {
+	list_param_t *param;
+	union {
+		bool boolval;
+		int intval;
+		char *strval;
+		time_t ageval;
+	} arg;
+} list_criterion_t;
+
+typedef struct {
+	list_criterion_t criteria[10];
+	size_t count;
 	char criteriastr[BUFSIZE];
+	unsigned int matches;
+} list_search_t;
+
+static void list_search_free(list_search_t *search)
+{
+	size_t i;
+
+	for (i = 0; i < search->count; i++)
+		if (search->criteria[i].param->opttype == OPT_STRING)
+			free(search->criteria[i].arg.strval);
+
+	free(search);
+}
+
+static bool list_criterion_match(const list_criterion_t *crit, const mynick_t *mn)
+{
+	switch (crit->param->opttype)
+	{
+	case OPT_BOOL:
+		return crit->param->is_match(mn, &crit->arg.boolval);
+	case OPT_INT:
+		return crit->param->is_match(mn, &crit->arg.intval);
+	case OPT_STRING:
+		return crit->param->is_match(mn, crit->arg.strval);
+	case OPT_AGE:
+		return crit->param->is_match(mn, &crit->arg.ageval);
+	default:
+		return true;
+	}
+}
+
+static bool list_scan(scan_t *scan, void *data)
+{
+	list_search_t *search = scan->privdata;
+	mynick_t *mn = data;
+	size_t i;
 
-	mowgli_patricia_iteration_state_t state;
-	myentity_iteration_state_t mestate;
-	mynick_t *mn;
+	for (i = 0; i < search->count; i++)
+		if (!list_criterion_match(&search->criteria[i], mn))
+			return true;
 
-	int matches = 0;
+	list_one(scan->si, NULL, mn);
+	search->matches++;
+
+	return true;
+}
+
+static void list_report(sourceinfo_t *si, list_search_t *search)
+{
+	logcommand(si, CMDLOG_ADMIN, "LIST: \2%s\2 (\2%d\2 matches)", search->criteriastr, search->matches);
+	if (search->matches == 0)
+		command_success_nodata(si, _("No nicknames matched criteria \2%s\2"), search->criteriastr);
+	else
+		command_success_nodata(si, ngettext(N_("\2%d\2 match for criteria \2%s\2"), N_("\2%d\2 matches for criteria \2%s\2"), search->matches), search->matches, search->criteriastr);
+}
+
+static void list_scan_done(scan_t *scan, bool cancelled)
+{
+	list_search_t *search = scan->privdata;
 
+	if (!cancelled)
+		list_report(scan->si, search);
+
+	list_search_free(search);
+}
+
+/*
+ * Query planning: each criterion that one of the account indexes can
+ * answer yields a candidate set, and the smallest one is filtered with
+ * all criteria instead of walking nicklist. Sets larger than
+ * LIST_INDEX_MAX are left to a time-sliced scan of nicklist.
+ */
+#define LIST_INDEX_MAX 20000
+
+typedef enum {
+	PLAN_SCAN,
+	PLAN_ACCOUNTS,		/* a list of accounts */
+	PLAN_NICKS,		/* a list of nicks */
+	PLAN_TIME,		/* accounts from a time index */
+} list_plan_type_t;
+
+typedef struct {
+	list_plan_type_t type;
+	unsigned int estimate;
+	mowgli_list_t *list;
+	account_index_time_t which;
+	time_t before;
+} list_plan_t;
+
+typedef struct {
+	sourceinfo_t *si;
+	list_search_t *search;
+} list_visit_t;
+
+static void list_plan_consider(list_plan_t *best, const list_plan_t *plan)
+{
+	if (best->type == PLAN_SCAN || plan->estimate < best->estimate)
+		*best = *plan;
+}
+
+static void list_plan_criterion(list_plan_t *best, const list_criterion_t *crit)
+{
+	list_plan_t plan;
+	char pat[512], *nickpattern, *hostpattern;
+	stringref canon;
+	size_t len;
+
+	memset(&plan, 0, sizeof plan);
+
+	if (crit->param == &email && !match_has_wildcards(crit->arg.strval))
+	{
+		canon = canonicalize_email(crit->arg.strval);
+		plan.type = PLAN_ACCOUNTS;
+		plan.list = account_index_email(canon);
+		plan.estimate = plan.list != NULL ? MOWGLI_LIST_LENGTH(plan.list) : 0;
+		strshare_unref(canon);
+		list_plan_consider(best, &plan);
+	}
+	else if (crit->param == &pattern)
+	{
+		split_pattern(crit->arg.strval, pat, sizeof pat, &nickpattern, &hostpattern);
+		if (nickpattern == NULL)
+			return;
+
+		len = strcspn(nickpattern, "*?\\");
+		if (len < ACCOUNT_INDEX_PREFIXLEN && nickpattern[len] != '\0')
+			return;
+
+		plan.type = PLAN_NICKS;
+		plan.list = account_index_nick_prefix(nickpattern);
+		plan.estimate = plan.list != NULL ? MOWGLI_LIST_LENGTH(plan.list) : 0;
+		list_plan_consider(best, &plan);
+	}
+	else if (crit->param == &lastlogin || crit->param == &registered)
+	{
+		plan.type = PLAN_TIME;
+		plan.which = crit->param == &registered ? ACCOUNT_INDEX_REGISTERED : ACCOUNT_INDEX_LASTLOGIN;
+		plan.before = CURRTIME - crit->arg.ageval;
+		plan.estimate = account_index_count_before(plan.which, plan.before);
+		list_plan_consider(best, &plan);
+	}
+}
+
+static void list_visit_nick(list_visit_t *visit, mynick_t *mn)
+{
+	list_search_t *search = visit->search;
+	size_t i;
+
+	for (i = 0; i < search->count; i++)
+		if (!list_criterion_match(&search->criteria[i], mn))
+			return;
+
+	list_one(visit->si, NULL, mn);
+	search->matches++;
+}
+
+static void list_visit_account(myuser_t *mu, void *privdata)
+{
+	mowgli_node_t *n;
+
+	MOWGLI_ITER_FOREACH(n, mu->nicks.head)
+		list_visit_nick(privdata, n->data);
+}
+
+static bool list_plan_run(sourceinfo_t *si, list_search_t *search)
+{
+	list_plan_t best;
+	list_visit_t visit;
+	mowgli_node_t *n;
+	size_t i;
+
+	memset(&best, 0, sizeof best);
+	best.type = PLAN_SCAN;
+
+	for (i = 0; i < search->count; i++)
+		list_plan_criterion(&best, &search->criteria[i]);
+
+	if (best.type == PLAN_SCAN || best.estimate > LIST_INDEX_MAX)
+		return false;
+
+	visit.si = si;
+	visit.search = search;
+
+	switch (best.type)
+	{
+	case PLAN_ACCOUNTS:
+		if (best.list != NULL)
+			MOWGLI_ITER_FOREACH(n, best.list->head)
+				list_visit_account(n->data, &visit);
+		break;
+	case PLAN_NICKS:
+		if (best.list != NULL)
+			MOWGLI_ITER_FOREACH(n, best.list->head)
+				list_visit_nick(&visit, n->data);
+		break;
+	case PLAN_TIME:
+		account_index_foreach_before(best.which, best.before, list_visit_account, &visit);
+		break;
+	default:
+		break;
+	}
+
+	list_report(si, search);
+	return true;
+}
+
+static void ns_cmd_list(sourceinfo_t *si, int parc, char *parv[])
+{
+	list_search_t *search;
+	list_criterion_t *crit;
+	list_param_t *param;
 	int i;
-	bool error = false;
-	bool found;
 
-	MOWGLI_PATRICIA_FOREACH(mn, &state, nicklist)
+	search = smalloc(sizeof(list_search_t));
+	memset(search, 0, sizeof(list_search_t));
+
+	/* the criteria are checked once here instead of for every nick */
+	for (i = 0; i < parc && search->count < ARRAY_SIZE(search->criteria); i++)
 	{
-		found = true;
+		param = mowgli_patricia_retrieve(list_params, parv[i]);
 
-		for (i = 0; i < parc; i++)
+		if (param == NULL)
 		{
-			list_param_t *param = mowgli_patricia_retrieve(list_params, parv[i]);
-
-			if (param == NULL) {
-				command_fail(si, fault_badparams, _("\2%s\2 is not a recognized LIST criterion"), parv[i]);
-				error = true;
-				break;
-			}
-
-			if (param->opttype == OPT_BOOL) {
-				bool arg = true;
-
-				if (!param->is_match(mn, &arg)) {
-					found = false;
-					break;
-				}
-			} else if (param->opttype == OPT_INT) {
-				if (i + 1 < parc) {
-					int arg = atoi(parv[++i]);
-
-					if (!param->is_match (mn, &arg)) {
-						found = false;
-						break;
-					}
-				} else {
-					command_fail(si, fault_needmoreparams, STR_INSUFFICIENT_PARAMS, parv[i]);
-					error = true;
-					break;
-				}
-			} else if (param->opttype == OPT_STRING) {
-				if (i + 1 < parc) {
-					if (!param->is_match (mn, parv[++i])) {
-						found = false;
-						break;
-					}
-				} else {
-					command_fail(si, fault_needmoreparams, STR_INSUFFICIENT_PARAMS, parv[i]);
-					error = true;
-					break;
-				}
-			}
-			else if (param->opttype == OPT_AGE) {
-				if (i + 1 < parc)
-				{
-					time_t age = parse_age(parv[++i]);
-
-					if (!param->is_match (mn, &age)) {
-						found = false;
-						break;
-					}
-				} else {
-					command_fail(si, fault_needmoreparams, STR_INSUFFICIENT_PARAMS, parv[i]);
-					error = true;
-					break;
-				}
-			}
-		} //for (i = 0; i < parc; i++)
-
-		if (error) {
-			break;
+			command_fail(si, fault_badparams, _("\2%s\2 is not a recognized LIST criterion"), parv[i]);
+			list_search_free(search);
+			return;
 		}
 
-		if (found) {
-			list_one(si, NULL, mn);
-			matches++;
+		if (param->opttype == OPT_FLAG)
+			continue;
+
+		if (param->opttype != OPT_BOOL && i + 1 >= parc)
+		{
+			command_fail(si, fault_needmoreparams, STR_INSUFFICIENT_PARAMS, parv[i]);
+			list_search_free(search);
+			return;
 		}
-	} //MOWGLI_PATRICIA_FOREACH(mn, &state, nicklist)
 
-	build_criteriastr(criteriastr, parc, parv);
+		crit = &search->criteria[search->count++];
+		crit->param = param;
 
-	logcommand(si, CMDLOG_ADMIN, "LIST: \2%s\2 (\2%d\2 matches)", criteriastr, matches);
-	if (matches == 0)
-		command_success_nodata(si, _("No nicknames matched criteria \2%s\2"), criteriastr);
-	else
-		command_success_nodata(si, ngettext(N_("\2%d\2 match for criteria \2%s\2"), N_("\2%d\2 matches for criteria \2%s\2"), matches), matches, criteriastr);
+		switch (param->opttype)
+		{
+		case OPT_BOOL:
+			crit->arg.boolval = true;
+			break;
+		case OPT_INT:
+			crit->arg.intval = atoi(parv[++i]);
+			break;
+		case OPT_STRING:
+			crit->arg.strval = sstrdup(parv[++i]);
+			break;
+		case OPT_AGE:
+			crit->arg.ageval = parse_age(parv[++i]);
+			break;
+		default:
+			break;
+		}
+	}
+
+	build_criteriastr(search->criteriastr, parc, parv);
+
+	if (list_plan_run(si, search))
+	{
+		list_search_free(search);
+		return;
+	}
+
+	if (!scan_start(si, nicklist, list_scan, list_scan_done, search))
+		list_search_free(search);
 }
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
@@ -22,11 +22,13 @@ command_t ns_listmail = { "LISTMAIL", N_("Lists accounts registered to an e-mail
 void _modinit(module_t *m)
 {
 	service_named_bind_command("nickserv", &ns_listmail);
+	account_index_enable();
 }
 
 void _moddeinit(module_unload_intent_t intent)
 {
 	service_named_unbind_command("nickserv", &ns_listmail);
+	account_index_disable();
 }
 
 struct listmail_state
@@ -71,7 +73,20 @@ static void ns_cmd_listmail(sourceinfo_t *si, int parc, char *parv[])
 	state.pattern = email;
 	state.email_canonical = canonicalize_email(email);
 	state.origin = si;
-	myentity_foreach_t(ENT_USER, listmail_foreach_cb, &state);
+
+	/* without wildcards, only accounts sharing the canonical address can match */
+	if (!match_has_wildcards(email))
+	{
+		mowgli_list_t *l = account_index_email(state.email_canonical);
+		mowgli_node_t *n;
+
+		if (l != NULL)
+			MOWGLI_ITER_FOREACH(n, l->head)
+				listmail_foreach_cb(entity(n->data), &state);
+	}
+	else
+		myentity_foreach_t(ENT_USER, listmail_foreach_cb, &state);
+
 	strshare_unref(state.email_canonical);
 
 	logcommand(si, CMDLOG_ADMIN, "LISTMAIL: \2%s\2 (\2%d\2 matches)", email, state.matches);
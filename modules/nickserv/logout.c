@@ -103,7 +103,7 @@ static void ns_cmd_logout(sourceinfo_t *si, int parc, char *parv[])
 		command_success_nodata(si, _("You have been logged out."));
 	}
 
-	u->myuser->lastlogin = CURRTIME;
+	myuser_set_lastlogin(u->myuser, CURRTIME);
 	mn = mynick_find(u->nick);
 	if (mn != NULL && mn->owner == u->myuser)
 		mn->lastseen = CURRTIME;
@@ -159,8 +159,8 @@ static void ns_cmd_register(sourceinfo_t *si, int parc, char *parv[])
 	}
 
 	mu = myuser_add(account, auth_module_loaded ? "*" : pass, email, config_options.defuflags | MU_NOBURSTLOGIN | (auth_module_loaded ? MU_CRYPTPASS : 0));
-	mu->registered = CURRTIME;
-	mu->lastlogin = CURRTIME;
+	myuser_set_registered(mu, CURRTIME);
+	myuser_set_lastlogin(mu, CURRTIME);
 	if (!nicksvs.no_nick_ownership)
 	{
 		mn = mynick_add(mu, entity(mu)->name);
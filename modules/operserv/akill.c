@@ -519,9 +519,9 @@ static void os_cmd_akill_list(sourceinfo_t *si, int parc, char *parv[])
 
 		if (num != 0 && k->number != num)
 			continue;
-		if (user != NULL && match(k->user, user))
+		if (user != NULL && match_compiled(k->user_pat, user))
 			continue;
-		if (host != NULL && match(k->host, host) && match_ips(k->host, host))
+		if (host != NULL && match_compiled(k->host_pat, host) && match_ips(k->host, host))
 			continue;
 
 		if (k->duration && full)
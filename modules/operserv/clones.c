@@ -25,6 +25,7 @@ static void clones_configready(void *unused);
 static void os_cmd_clones(sourceinfo_t *si, int parc, char *parv[]);
 static void os_cmd_clones_kline(sourceinfo_t *si, int parc, char *parv[]);
 static void os_cmd_clones_list(sourceinfo_t *si, int parc, char *parv[]);
+static bool clones_list_scan(scan_t *scan, void *data);
 static void os_cmd_clones_addexempt(sourceinfo_t *si, int parc, char *parv[]);
 static void os_cmd_clones_delexempt(sourceinfo_t *si, int parc, char *parv[]);
 static void os_cmd_clones_setexempt(sourceinfo_t *si, int parc, char *parv[]);
@@ -168,6 +169,7 @@ void _moddeinit(module_unload_intent_t intent)
 {
 	mowgli_node_t *n, *tn;
 
+	scan_cancel_all(clones_list_scan);
 	mowgli_patricia_destroy(hostlist, free_hostentry, NULL);
 	mowgli_heap_destroy(hostentry_heap);
 
@@ -408,27 +410,37 @@ static void os_cmd_clones_kline(sourceinfo_t *si, int parc, char *parv[])
 	}
 }
 
-static void os_cmd_clones_list(sourceinfo_t *si, int parc, char *parv[])
+static bool clones_list_scan(scan_t *scan, void *data)
 {
-	hostentry_t *he;
-	int k = 0;
-	mowgli_patricia_iteration_state_t state;
+	hostentry_t *he = data;
+	int k;
 
-	MOWGLI_PATRICIA_FOREACH(he, &state, hostlist)
-	{
-		k = MOWGLI_LIST_LENGTH(&he->clients);
+	k = MOWGLI_LIST_LENGTH(&he->clients);
 
-		if (k > 3)
-		{
-			cexcept_t *c = find_exempt(he->ip);
-			if (c)
-				command_success_nodata(si, _("%d from %s (\2EXEMPT\2; allowed %d)"), k, he->ip, c->allowed);
-			else
-				command_success_nodata(si, _("%d from %s"), k, he->ip);
-		}
+	if (k > 3)
+	{
+		cexcept_t *c = find_exempt(he->ip);
+		if (c)
+			command_success_nodata(scan->si, _("%d from %s (\2EXEMPT\2; allowed %d)"), k, he->ip, c->allowed);
+		else
+			command_success_nodata(scan->si, _("%d from %s"), k, he->ip);
 	}
-	command_success_nodata(si, _("End of CLONES LIST"));
-	logcommand(si, CMDLOG_ADMIN, "CLONES:LIST");
+
+	return true;
+}
+
+static void clones_list_scan_done(scan_t *scan, bool cancelled)
+{
+	if (cancelled)
+		return;
+
+	command_success_nodata(scan->si, _("End of CLONES LIST"));
+	logcommand(scan->si, CMDLOG_ADMIN, "CLONES:LIST");
+}
+
+static void os_cmd_clones_list(sourceinfo_t *si, int parc, char *parv[])
+{
+	scan_start(si, hostlist, clones_list_scan, clones_list_scan_done, NULL);
 }
 
 static void os_cmd_clones_addexempt(sourceinfo_t *si, int parc, char *parv[])
@@ -965,6 +977,7 @@ static void clones_userquit(user_t *u)
 		if (MOWGLI_LIST_LENGTH(&he->clients) == 0)
 		{
 			/* TODO: free later if he->firstkill > time(NULL) - CLONES_GRACE_TIMEPERIOD. */
+			scan_forget(hostlist, he);
 			mowgli_patricia_delete(hostlist, he->ip);
 			mowgli_heap_free(hostentry_heap, he);
 		}
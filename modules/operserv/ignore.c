@@ -181,6 +181,7 @@ static void os_cmd_ignore_clear(sourceinfo_t *si, int parc, char *parv[])
 		command_success_nodata(si, _("\2%s\2 has been removed from the services ignore list."), svsignore->mask);
 		mowgli_node_delete(n,&svs_ignore_list);
 		mowgli_node_free(n);
+		match_pattern_destroy(svsignore->mask_pat);
 		free(svsignore->mask);
 		free(svsignore->setby);
 		free(svsignore->reason);
@@ -7,6 +7,7 @@
  */
 
 #include "atheme.h"
+#include "res.h"
 
 DECLARE_MODULE_V1
 (
@@ -86,6 +87,9 @@ static void os_cmd_info(sourceinfo_t *si, int parc, char *parv[])
 		command_success_nodata(si, _("user@host mask(s) that are autokline exempt: %s"), (char *)n2->data);
 	}
 
+	report_dns_servers(si);
+	command_success_nodata(si, _("Emails waiting for delivery: %u"), email_queue_length());
+
 	hook_call_operserv_info(si);
 }
 
@@ -21,6 +21,7 @@ DECLARE_MODULE_V1
 );
 
 static void os_cmd_rmatch(sourceinfo_t *si, int parc, char *parv[]);
+static bool rmatch_scan(scan_t *scan, void *data);
 
 command_t os_rmatch = { "RMATCH", N_("Scans the network for users based on a specific regex pattern."), PRIV_USER_AUSPEX, 1, os_cmd_rmatch, { .path = "oservice/rmatch" } };
 
@@ -31,18 +32,66 @@ void _modinit(module_t *m)
 
 void _moddeinit(module_unload_intent_t intent)
 {
+	scan_cancel_all(rmatch_scan);
 	service_named_unbind_command("operserv", &os_rmatch);
 }
 
 #define MAXMATCHES_DEF 1000
 
+typedef struct {
+	atheme_regex_t *regex;
+	char *pattern;
+	unsigned int matches, maxmatches;
+} rmatch_search_t;
+
+static void rmatch_search_free(rmatch_search_t *search)
+{
+	regex_destroy(search->regex);
+	free(search->pattern);
+	free(search);
+}
+
+static bool rmatch_scan(scan_t *scan, void *data)
+{
+	rmatch_search_t *search = scan->privdata;
+	user_t *u = data;
+	char usermask[512];
+
+	snprintf(usermask, sizeof usermask, "%s!%s@%s %s", u->nick, u->user, u->host, u->gecos);
+
+	if (regex_match(search->regex, usermask))
+	{
+		search->matches++;
+		if (search->matches <= search->maxmatches)
+			command_success_nodata(scan->si, _("\2Match:\2  %s!%s@%s %s"), u->nick, u->user, u->host, u->gecos);
+		else if (search->matches == search->maxmatches + 1)
+		{
+			command_success_nodata(scan->si, _("Too many matches, not displaying any more"));
+			command_success_nodata(scan->si, _("Add the FORCE keyword to see them all"));
+		}
+	}
+
+	return true;
+}
+
+static void rmatch_scan_done(scan_t *scan, bool cancelled)
+{
+	rmatch_search_t *search = scan->privdata;
+
+	if (!cancelled)
+	{
+		command_success_nodata(scan->si, _("\2%d\2 matches for %s"), search->matches, search->pattern);
+		logcommand(scan->si, CMDLOG_ADMIN, "RMATCH: \2%s\2 (\2%d\2 matches)", search->pattern, search->matches);
+	}
+
+	rmatch_search_free(search);
+}
+
 static void os_cmd_rmatch(sourceinfo_t *si, int parc, char *parv[])
 {
+	rmatch_search_t *search;
 	atheme_regex_t *regex;
-	char usermask[512];
-	unsigned int matches = 0, maxmatches;
-	mowgli_patricia_iteration_state_t state;
-	user_t *u;
+	unsigned int maxmatches;
 	char *args = parv[0];
 	char *pattern;
 	int flags = 0;
@@ -84,26 +133,14 @@ static void os_cmd_rmatch(sourceinfo_t *si, int parc, char *parv[])
 		return;
 	}
 
-	MOWGLI_PATRICIA_FOREACH(u, &state, userlist)
-	{
-		sprintf(usermask, "%s!%s@%s %s", u->nick, u->user, u->host, u->gecos);
-
-		if (regex_match(regex, usermask))
-		{
-			matches++;
-			if (matches <= maxmatches)
-				command_success_nodata(si, _("\2Match:\2  %s!%s@%s %s"), u->nick, u->user, u->host, u->gecos);
-			else if (matches == maxmatches + 1)
-			{
-				command_success_nodata(si, _("Too many matches, not displaying any more"));
-				command_success_nodata(si, _("Add the FORCE keyword to see them all"));
-			}
-		}
-	}
+	search = smalloc(sizeof(rmatch_search_t));
+	search->regex = regex;
+	search->pattern = sstrdup(pattern);
+	search->matches = 0;
+	search->maxmatches = maxmatches;
 
-	regex_destroy(regex);
-	command_success_nodata(si, _("\2%d\2 matches for %s"), matches, pattern);
-	logcommand(si, CMDLOG_ADMIN, "RMATCH: \2%s\2 (\2%d\2 matches)", pattern, matches);
+	if (!scan_start(si, userlist, rmatch_scan, rmatch_scan_done, search))
+		rmatch_search_free(search);
 }
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
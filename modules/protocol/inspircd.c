@@ -137,7 +137,7 @@ static mowgli_node_t *inspircd_next_matching_ban(channel_t *c, user_t *u, int ty
 		if (cb->type != type)
 			continue;
 
-		if ((!match(cb->mask, hostbuf) || !match(cb->mask, realbuf) || !match(cb->mask, ipbuf)) || !match_cidr(cb->mask, ipbuf))
+		if ((!match_compiled(cb->mask_pat, hostbuf) || !match_compiled(cb->mask_pat, realbuf) || !match_compiled(cb->mask_pat, ipbuf)) || !match_cidr(cb->mask, ipbuf))
 			return n;
 
 		if (cb->mask[1] == ':' && strchr("MRUjrm", cb->mask[0]))
@@ -394,6 +394,37 @@ static void inspircd_join_sts(channel_t *c, user_t *u, bool isnew, char *modes)
 	inspircd_send_fjoin(c, u, modes);
 }
 
+/* join a channel with several clients, as few FJOINs as possible */
+static void inspircd_join_batch_sts(channel_t *c, user_t **users, unsigned int count, bool isnew, char *modes)
+{
+	char buf[512];
+	size_t len, prefixlen;
+	unsigned int i;
+
+	if (!isnew || !modes[0])
+		modes = "+";
+
+	prefixlen = len = snprintf(buf, sizeof buf, ":%s FJOIN %s %lu %s :", me.numeric,
+			c->name, (unsigned long)c->ts, modes);
+
+	for (i = 0; i < count; i++)
+	{
+		/* leave room for "o,", " " and \r\n */
+		if (len > prefixlen && len + strlen(users[i]->uid) + 5 > 512)
+		{
+			buf[len - 1] = '\0';
+			sts("%s", buf);
+			prefixlen = len = snprintf(buf, sizeof buf, ":%s FJOIN %s %lu + :", me.numeric,
+					c->name, (unsigned long)c->ts);
+		}
+
+		len += snprintf(buf + len, sizeof buf - len, "o,%s ", users[i]->uid);
+	}
+
+	buf[len - 1] = '\0';
+	sts("%s", buf);
+}
+
 static void inspircd_chan_lowerts(channel_t *c, user_t *u)
 {
 	slog(LG_DEBUG, "inspircd_chan_lowerts(): lowering TS for %s to %lu",
@@ -1653,6 +1684,7 @@ void _modinit(module_t * m)
 	quit_sts = &inspircd_quit_sts;
 	wallops_sts = &inspircd_wallops_sts;
 	join_sts = &inspircd_join_sts;
+	join_batch_sts = &inspircd_join_batch_sts;
 	chan_lowerts = &inspircd_chan_lowerts;
 	kick = &inspircd_kick;
 	msg = &inspircd_msg;
@@ -696,6 +696,8 @@ void _modinit(module_t * m)
 
 	/* Symbol relocation voodoo. */
 	join_sts = &nefarious_join_sts;
+	/* p10-generic packs batches into BURST; ours go through C/J */
+	join_batch_sts = &generic_join_batch_sts;
 	kick = &nefarious_kick;
 	notice_channel_sts = &nefarious_notice_channel_sts;
 	topic_sts = &nefarious_topic_sts;
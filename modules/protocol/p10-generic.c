@@ -80,6 +80,40 @@ static void p10_join_sts(channel_t *c, user_t *u, bool isnew, char *modes)
 	}
 }
 
+/* join a channel with several clients, as few BURSTs as possible;
+ * the status given to the first numeric carries over to the rest */
+static void p10_join_batch_sts(channel_t *c, user_t **users, unsigned int count, bool isnew, char *modes)
+{
+	char buf[512];
+	size_t len, prefixlen;
+	unsigned int i;
+
+	if (isnew && modes[0] && modes[1])
+		prefixlen = len = snprintf(buf, sizeof buf, "%s B %s %lu %s ", me.numeric,
+				c->name, (unsigned long)c->ts, modes);
+	else
+		prefixlen = len = snprintf(buf, sizeof buf, "%s B %s %lu ", me.numeric,
+				c->name, (unsigned long)c->ts);
+
+	for (i = 0; i < count; i++)
+	{
+		/* leave room for ":o", "," and \r\n */
+		if (len > prefixlen && len + strlen(users[i]->uid) + 5 > 512)
+		{
+			buf[len - 1] = '\0';
+			sts("%s", buf);
+			prefixlen = len = snprintf(buf, sizeof buf, "%s B %s %lu ", me.numeric,
+					c->name, (unsigned long)c->ts);
+		}
+
+		len += snprintf(buf + len, sizeof buf - len, "%s%s,", users[i]->uid,
+				len == prefixlen ? ":o" : "");
+	}
+
+	buf[len - 1] = '\0';
+	sts("%s", buf);
+}
+
 static void p10_chan_lowerts(channel_t *c, user_t *u)
 {
 	slog(LG_DEBUG, "p10_chan_lowerts(): lowering TS for %s to %lu",
@@ -987,6 +1021,7 @@ void _modinit(module_t * m)
 	quit_sts = &p10_quit_sts;
 	wallops_sts = &p10_wallops_sts;
 	join_sts = &p10_join_sts;
+	join_batch_sts = &p10_join_batch_sts;
 	chan_lowerts = &p10_chan_lowerts;
 	kick = &p10_kick;
 	msg = &p10_msg;
@@ -135,6 +135,37 @@ static void ts6_join_sts(channel_t *c, user_t *u, bool isnew, char *modes)
 				c->name, CLIENT_NAME(u));
 }
 
+/* join a channel with several clients, as few SJOINs as possible */
+static void ts6_join_batch_sts(channel_t *c, user_t **users, unsigned int count, bool isnew, char *modes)
+{
+	char buf[512];
+	size_t len, prefixlen;
+	unsigned int i;
+	const char *id;
+
+	prefixlen = len = snprintf(buf, sizeof buf, ":%s SJOIN %lu %s %s :", ME,
+			(unsigned long)c->ts, c->name, isnew ? modes : "+");
+
+	for (i = 0; i < count; i++)
+	{
+		id = CLIENT_NAME(users[i]);
+
+		/* leave room for "@", " " and \r\n */
+		if (len > prefixlen && len + strlen(id) + 4 > 512)
+		{
+			buf[len - 1] = '\0';
+			sts("%s", buf);
+			prefixlen = len = snprintf(buf, sizeof buf, ":%s SJOIN %lu %s + :", ME,
+					(unsigned long)c->ts, c->name);
+		}
+
+		len += snprintf(buf + len, sizeof buf - len, "@%s ", id);
+	}
+
+	buf[len - 1] = '\0';
+	sts("%s", buf);
+}
+
 static void ts6_chan_lowerts(channel_t *c, user_t *u)
 {
 	slog(LG_DEBUG, "ts6_chan_lowerts(): lowering TS for %s to %lu",
@@ -1462,6 +1493,7 @@ void _modinit(module_t * m)
 	quit_sts = &ts6_quit_sts;
 	wallops_sts = &ts6_wallops_sts;
 	join_sts = &ts6_join_sts;
+	join_batch_sts = &ts6_join_batch_sts;
 	chan_lowerts = &ts6_chan_lowerts;
 	kick = &ts6_kick;
 	msg = &ts6_msg;
@@ -270,7 +270,7 @@ static mowgli_node_t *unreal_next_matching_ban(channel_t *c, user_t *u, int type
 		if (cb->type != type)
 			continue;
 
-		if ((!match(cb->mask, hostbuf) || !match(cb->mask, realbuf) || !match(cb->mask, ipbuf)))
+		if ((!match_compiled(cb->mask_pat, hostbuf) || !match_compiled(cb->mask_pat, realbuf) || !match_compiled(cb->mask_pat, ipbuf)))
 			return n;
 		if (cb->mask[0] == '~')
 		{
@@ -58,6 +58,15 @@
  *	"dnsbl.dronebl.org";
  *	"rbl.efnetrbl.org";
  * };
+ *
+ * A blacklist that is mirrored locally can be given an rbldnsd-style
+ * ip4set/ip6trie zone file instead; it is loaded into memory on every
+ * rehash and checked without any DNS queries:
+ *
+ *	"dnsbl.dronebl.org" "/var/lib/rbldnsd/dronebl.zone";
+ *
+ * Answers from DNS are cached per IP for dnsbl_cache_ttl (listed) or
+ * dnsbl_negative_ttl (not listed), both in the proxyscan{} block.
  */
 
 #include "atheme.h"
@@ -74,6 +83,23 @@ mowgli_list_t blacklist_list = { NULL, NULL, 0 };
 mowgli_patricia_t **os_set_cmdtree;
 static char *action = NULL;
 
+/* A node of a local zone: a binary trie over IPv6 addresses, with IPv4
+ * addresses stored as ::ffff:a.b.c.d. A prefix from the zone file ends
+ * at the node for its last bit; the most specific prefix wins.
+ */
+typedef struct dnsbl_zone_node_ dnsbl_zone_node_t;
+
+struct dnsbl_zone_node_ {
+	dnsbl_zone_node_t *child[2];
+	unsigned char state;
+};
+
+#define ZONE_NONE	0
+#define ZONE_LISTED	1
+#define ZONE_EXCLUDED	2
+
+static mowgli_heap_t *zone_node_heap;
+
 /* A configured DNSBL */
 struct Blacklist {
 	unsigned int status;	/* If CONF_ILLEGAL, delete when no clients */
@@ -82,17 +108,51 @@ struct Blacklist {
 	unsigned int hits;
 	time_t lastwarning;
 
+	char *zonefile;		/* if set, answered from zone, not DNS */
+	dnsbl_zone_node_t *zone;
+	unsigned int zone_entries;
+
+	mowgli_patricia_t *cache;	/* IP -> struct BlacklistEntry */
+
 	mowgli_node_t node;
 };
 
-/* A lookup in progress for a particular DNSBL for a particular client */
-struct BlacklistClient {
+#define DNSBL_PENDING	0
+#define DNSBL_LISTED	1
+#define DNSBL_CLEAN	2
+
+/* The lookup of one IP in one DNSBL. While the query is in flight every
+ * client from that IP waits on the same entry; once answered, the entry
+ * stays around as a cached result until its expiry deadline.
+ */
+struct BlacklistEntry {
 	struct Blacklist *blacklist;
-	user_t *u;
+	char *ip;
+	unsigned int state;
 	dns_query_t dns_query;
-	mowgli_node_t node;
+	mowgli_list_t clients;
+	deadline_t expiry;
 };
 
+/* A client waiting for a lookup */
+struct BlacklistClient {
+	struct BlacklistEntry *entry;
+	user_t *u;
+	mowgli_node_t node;	/* in entry->clients */
+	mowgli_node_t unode;	/* in dnsbl_queries(u) */
+};
+
+static struct {
+	unsigned int hits;	/* answered from the cache */
+	unsigned int joined;	/* attached to a query already in flight */
+	unsigned int queries;	/* DNS queries sent */
+	unsigned int outstanding;
+	unsigned int cached;
+} dnsbl_stats;
+
+static unsigned int dnsbl_cache_ttl;
+static unsigned int dnsbl_negative_ttl;
+
 struct dnsbl_exempt_ {
 	char *ip;
 	time_t exempt_ts;
@@ -310,20 +370,57 @@ static struct Blacklist *find_blacklist(char *name)
 	return NULL;
 }
 
-static void blacklist_dns_callback(void *vptr, dns_reply_t *reply)
+static void blacklist_client_free(struct BlacklistClient *blcptr)
 {
-	struct BlacklistClient *blcptr = (struct BlacklistClient *) vptr;
-	int listed = 0;
-	mowgli_list_t *l;
+	mowgli_node_delete(&blcptr->node, &blcptr->entry->clients);
+	mowgli_node_delete(&blcptr->unode, dnsbl_queries(blcptr->u));
+	free(blcptr);
+}
 
-	if (blcptr == NULL)
-		return;
+/* frees an entry, which must already be out of its blacklist's cache */
+static void blacklist_entry_free(struct BlacklistEntry *e)
+{
+	mowgli_node_t *n, *tn;
 
-	if (blcptr->u == NULL)
+	if (e->state == DNSBL_PENDING)
 	{
-		free(blcptr);
-		return;
+		delete_resolver_queries(&e->dns_query);
+		dnsbl_stats.outstanding--;
 	}
+	else
+		dnsbl_stats.cached--;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, e->clients.head)
+		blacklist_client_free(n->data);
+
+	deadline_cancel(&e->expiry);
+	free(e->ip);
+	free(e);
+}
+
+static void blacklist_entry_expire(void *vptr)
+{
+	struct BlacklistEntry *e = vptr;
+
+	mowgli_patricia_delete(e->blacklist->cache, e->ip);
+	blacklist_entry_free(e);
+}
+
+static void blacklist_cache_destroy_cb(const char *key, void *data, void *privdata)
+{
+	blacklist_entry_free(data);
+}
+
+static void blacklist_dns_callback(void *vptr, dns_reply_t *reply)
+{
+	struct BlacklistEntry *e = vptr;
+	struct BlacklistClient *blcptr;
+	user_t *u;
+	int listed = 0;
+	unsigned int ttl;
+
+	if (e == NULL)
+		return;
 
 	if (reply != NULL)
 	{
@@ -331,53 +428,274 @@ static void blacklist_dns_callback(void *vptr, dns_reply_t *reply)
 		if (reply->addr.saddr.sa.sa_family == AF_INET &&
 				!memcmp(&((struct sockaddr_in *)&reply->addr)->sin_addr, "\177", 1))
 			listed++;
-		else if (blcptr->blacklist->lastwarning + 3600 < CURRTIME)
+		else if (e->blacklist->lastwarning + 3600 < CURRTIME)
 		{
 			slog(LG_DEBUG,
 					"Garbage reply from blacklist %s",
-					blcptr->blacklist->host);
-			blcptr->blacklist->lastwarning = CURRTIME;
+					e->blacklist->host);
+			e->blacklist->lastwarning = CURRTIME;
 		}
 	}
 
-	/* they have a blacklist entry for this client */
-	if (listed)
+	e->state = listed ? DNSBL_LISTED : DNSBL_CLEAN;
+	dnsbl_stats.outstanding--;
+	dnsbl_stats.cached++;
+
+	/* dnsbl_hit() may change the user, so detach everyone first */
+	while (e->clients.head != NULL)
 	{
-		dnsbl_hit(blcptr->u, blcptr->blacklist);
-		return;
+		blcptr = e->clients.head->data;
+		u = blcptr->u;
+		blacklist_client_free(blcptr);
+
+		/* they have a blacklist entry for this client */
+		if (listed)
+			dnsbl_hit(u, e->blacklist);
 	}
 
-	l = dnsbl_queries(blcptr->u);
-	mowgli_node_delete(&blcptr->node, l);
+	ttl = listed ? dnsbl_cache_ttl : dnsbl_negative_ttl;
+	if (ttl == 0)
+	{
+		blacklist_entry_expire(e);
+		return;
+	}
 
-	free(blcptr);
+	deadline_set(&e->expiry, CURRTIME + ttl);
 }
 
 /* XXX: no IPv6 implementation, not to concerned right now though. */
 static void initiate_blacklist_dnsquery(struct Blacklist *blptr, user_t *u)
 {
-	struct BlacklistClient *blcptr = malloc(sizeof(struct BlacklistClient));
+	struct BlacklistEntry *e;
+	struct BlacklistClient *blcptr;
 	char buf[IRCD_RES_HOSTLEN + 1];
 	int ip[4];
-	mowgli_list_t *l;
 
-	blcptr->blacklist = blptr;
+	if (u->ip == NULL || strchr(u->ip, ':') != NULL)
+		return;
+
+	e = mowgli_patricia_retrieve(blptr->cache, u->ip);
+	if (e != NULL && e->state != DNSBL_PENDING)
+	{
+		dnsbl_stats.hits++;
+		if (e->state == DNSBL_LISTED)
+			dnsbl_hit(u, blptr);
+		return;
+	}
+
+	if (e != NULL)
+		dnsbl_stats.joined++;
+	else
+	{
+		e = scalloc(sizeof(struct BlacklistEntry), 1);
+		e->blacklist = blptr;
+		e->ip = sstrdup(u->ip);
+		e->state = DNSBL_PENDING;
+		deadline_init(&e->expiry, "dnsbl_cache_expire", blacklist_entry_expire, e);
+		mowgli_patricia_add(blptr->cache, e->ip, e);
+
+		e->dns_query.ptr = e;
+		e->dns_query.callback = blacklist_dns_callback;
+
+		/* A sscanf worked fine for chary for many years, it'll be fine here */
+		sscanf(u->ip, "%d.%d.%d.%d", &ip[3], &ip[2], &ip[1], &ip[0]);
+
+		/* becomes 2.0.0.127.torbl.ahbl.org or whatever */
+		snprintf(buf, sizeof buf, "%d.%d.%d.%d.%s", ip[0], ip[1], ip[2], ip[3], blptr->host);
+
+		dnsbl_stats.queries++;
+		dnsbl_stats.outstanding++;
+		gethost_byname_type(buf, &e->dns_query, T_A);
+	}
+
+	blcptr = smalloc(sizeof(struct BlacklistClient));
+	blcptr->entry = e;
 	blcptr->u = u;
+	mowgli_node_add(blcptr, &blcptr->node, &e->clients);
+	mowgli_node_add(blcptr, &blcptr->unode, dnsbl_queries(u));
+}
 
-	blcptr->dns_query.ptr = blcptr;
-	blcptr->dns_query.callback = blacklist_dns_callback;
+/*
+ * L O C A L   Z O N E S
+ */
 
-	/* A sscanf worked fine for chary for many years, it'll be fine here */
-	sscanf(u->ip, "%d.%d.%d.%d", &ip[3], &ip[2], &ip[1], &ip[0]);
+static void zone_free(dnsbl_zone_node_t *zn)
+{
+	if (zn == NULL)
+		return;
 
-	/* becomes 2.0.0.127.torbl.ahbl.org or whatever */
-	snprintf(buf, sizeof buf, "%d.%d.%d.%d.%s", ip[0], ip[1], ip[2], ip[3], blptr->host);
+	zone_free(zn->child[0]);
+	zone_free(zn->child[1]);
+	mowgli_heap_free(zone_node_heap, zn);
+}
+
+static void zone_insert(struct Blacklist *blptr, const unsigned char *addr, unsigned int plen, unsigned char state)
+{
+	dnsbl_zone_node_t **znp = &blptr->zone;
+	unsigned int i;
+
+	for (i = 0; ; i++)
+	{
+		if (*znp == NULL)
+			*znp = mowgli_heap_alloc(zone_node_heap);
+		if (i == plen)
+			break;
+		znp = &(*znp)->child[(addr[i >> 3] >> (7 - (i & 7))) & 1];
+	}
+
+	if ((*znp)->state == ZONE_NONE)
+		blptr->zone_entries++;
+	(*znp)->state = state;
+}
+
+static bool zone_match(const dnsbl_zone_node_t *zn, const unsigned char *addr)
+{
+	unsigned char state = ZONE_NONE;
+	unsigned int i;
+
+	for (i = 0; zn != NULL; i++)
+	{
+		if (zn->state != ZONE_NONE)
+			state = zn->state;
+		if (i == 128)
+			break;
+		zn = zn->child[(addr[i >> 3] >> (7 - (i & 7))) & 1];
+	}
+
+	return state == ZONE_LISTED;
+}
+
+/* converts an address to the 16 byte form used in the zone trie */
+static bool zone_addr(const char *ip, unsigned char *addr)
+{
+	struct in_addr in4;
+
+	if (strchr(ip, ':') != NULL)
+		return inet_pton(AF_INET6, ip, addr) == 1;
+
+	if (inet_pton(AF_INET, ip, &in4) != 1)
+		return false;
+
+	memset(addr, 0, 10);
+	addr[10] = addr[11] = 0xff;
+	memcpy(addr + 12, &in4, 4);
+
+	return true;
+}
+
+/* parses an ip4set/ip6trie entry: a.b.c.d, a.b.c (a /24), a.b.c.d/nn or
+ * an IPv6 prefix */
+static bool zone_parse_prefix(char *s, unsigned char *addr, unsigned int *plen)
+{
+	char *p, *end;
+	unsigned long len = 0, octet;
+	bool has_len = false;
+	int n;
+
+	if ((p = strchr(s, '/')) != NULL)
+	{
+		*p++ = '\0';
+		len = strtoul(p, &end, 10);
+		if (*p == '\0' || *end != '\0')
+			return false;
+		has_len = true;
+	}
+
+	if (strchr(s, ':') != NULL)
+	{
+		if (inet_pton(AF_INET6, s, addr) != 1)
+			return false;
+		if (!has_len)
+			len = 128;
+		if (len > 128)
+			return false;
+		*plen = len;
+		return true;
+	}
+
+	memset(addr, 0, 16);
+	addr[10] = addr[11] = 0xff;
+
+	for (n = 0, p = s; n < 4; n++)
+	{
+		octet = strtoul(p, &end, 10);
+		if (end == p || octet > 255)
+			return false;
+		addr[12 + n] = octet;
+		if (*end == '\0')
+			break;
+		if (*end != '.')
+			return false;
+		p = end + 1;
+	}
+	if (n == 4)
+		return false;
+
+	if (!has_len)
+		len = 8 * (n + 1);
+	if (len > 32)
+		return false;
+	*plen = 96 + len;
+
+	return true;
+}
+
+static void zone_load(struct Blacklist *blptr)
+{
+	FILE *f;
+	char line[BUFSIZE];
+	char *p, *q;
+	unsigned char addr[16];
+	unsigned int plen, lineno = 0, skipped = 0;
+	unsigned char state;
+
+	zone_free(blptr->zone);
+	blptr->zone = NULL;
+	blptr->zone_entries = 0;
+
+	if ((f = fopen(blptr->zonefile, "r")) == NULL)
+	{
+		slog(LG_ERROR, "dnsbl: cannot open zone file %s for %s: %s", blptr->zonefile, blptr->host, strerror(errno));
+		return;
+	}
+
+	while (fgets(line, sizeof line, f) != NULL)
+	{
+		lineno++;
+
+		p = line;
+		while (isspace((unsigned char)*p))
+			p++;
+
+		/* comments, default values and $SOA/$NS/$TTL directives */
+		if (*p == '\0' || *p == '#' || *p == ';' || *p == ':' || *p == '$')
+			continue;
 
-	gethost_byname_type(buf, &blcptr->dns_query, T_A);
+		state = ZONE_LISTED;
+		if (*p == '!')
+		{
+			state = ZONE_EXCLUDED;
+			p++;
+		}
 
-	l = dnsbl_queries(u);
-	mowgli_node_add(blcptr, &blcptr->node, l);
-	blptr->refcount++;
+		/* anything after the address is the per-entry value */
+		for (q = p; *q != '\0' && !isspace((unsigned char)*q); q++)
+			;
+		*q = '\0';
+
+		if (strchr(p, '-') != NULL || !zone_parse_prefix(p, addr, &plen))
+		{
+			if (skipped++ == 0)
+				slog(LG_DEBUG, "dnsbl: %s:%u: unsupported entry %s", blptr->zonefile, lineno, p);
+			continue;
+		}
+
+		zone_insert(blptr, addr, plen, state);
+	}
+
+	fclose(f);
+
+	slog(LG_DEBUG, "dnsbl: loaded %u entries for %s from %s (%u skipped)", blptr->zone_entries, blptr->host, blptr->zonefile, skipped);
 }
 
 /* public interfaces */
@@ -392,7 +710,8 @@ static struct Blacklist *new_blacklist(char *name)
 
 	if (blptr == NULL)
 	{
-		blptr = malloc(sizeof(struct Blacklist));
+		blptr = scalloc(sizeof(struct Blacklist), 1);
+		blptr->cache = mowgli_patricia_create(noopcanon);
 		mowgli_node_add(blptr, &blptr->node, &blacklist_list);
 	}
 
@@ -405,6 +724,10 @@ static struct Blacklist *new_blacklist(char *name)
 static void lookup_blacklists(user_t *u)
 {
 	mowgli_node_t *n;
+	unsigned char addr[16];
+	bool have_addr;
+
+	have_addr = u != NULL && u->ip != NULL && zone_addr(u->ip, addr);
 
 	MOWGLI_ITER_FOREACH(n, blacklist_list.head)
 	{
@@ -414,6 +737,13 @@ static void lookup_blacklists(user_t *u)
 		if (u == NULL)
 			return;
 
+		if (blptr->zonefile != NULL)
+		{
+			if (have_addr && zone_match(blptr->zone, addr))
+				dnsbl_hit(u, blptr);
+			continue;
+		}
+
 		initiate_blacklist_dnsquery(blptr, u);
 	}
 }
@@ -430,7 +760,10 @@ static void destroy_blacklists(void)
 
 		mowgli_node_delete(n, &blacklist_list);
 
-		free(n->data);
+		mowgli_patricia_destroy(blptr->cache, blacklist_cache_destroy_cb, NULL);
+		zone_free(blptr->zone);
+		free(blptr->zonefile);
+		free(blptr);
 	}
 }
 
@@ -441,7 +774,15 @@ static int dnsbl_config_handler(mowgli_config_file_entry_t *ce)
 	MOWGLI_ITER_FOREACH(cce, ce->entries)
 	{
 		char *line = sstrdup(cce->varname);
-		new_blacklist(line);
+		struct Blacklist *blptr = new_blacklist(line);
+
+		free(blptr->zonefile);
+		blptr->zonefile = NULL;
+		if (cce->vardata != NULL)
+		{
+			blptr->zonefile = sstrdup(cce->vardata);
+			zone_load(blptr);
+		}
 		free(line);
 	}
 
@@ -478,6 +819,20 @@ static void check_dnsbls(hook_user_nick_t *data)
 	lookup_blacklists(u);
 }
 
+static void dnsbl_user_delete(user_t *u)
+{
+	mowgli_list_t *l;
+
+	l = privatedata_get(u, "dnsbl:queries");
+	if (l == NULL)
+		return;
+
+	while (l->head != NULL)
+		blacklist_client_free(l->head->data);
+
+	mowgli_list_free(l);
+}
+
 static void dnsbl_hit(user_t *u, struct Blacklist *blptr)
 {
 	service_t *svs;
@@ -513,6 +868,7 @@ static void dnsbl_hit(user_t *u, struct Blacklist *blptr)
 static void osinfo_hook(sourceinfo_t *si)
 {
 	mowgli_node_t *n;
+	unsigned int lookups;
 
 	if (action)
 		command_success_nodata(si, "Action taken when a user is an a DNSBL: %s", action);
@@ -523,8 +879,17 @@ static void osinfo_hook(sourceinfo_t *si)
 	{
 		struct Blacklist *blptr = (struct Blacklist *) n->data;
 
-		command_success_nodata(si, "Blacklist(s): %s", blptr->host);
+		if (blptr->zonefile != NULL)
+			command_success_nodata(si, "Blacklist(s): %s (local zone, %u entries)", blptr->host, blptr->zone_entries);
+		else
+			command_success_nodata(si, "Blacklist(s): %s", blptr->host);
 	}
+
+	lookups = dnsbl_stats.hits + dnsbl_stats.joined + dnsbl_stats.queries;
+	command_success_nodata(si, "DNSBL cache: %u hits, %u joined in-flight, %u queries sent (%u%% answered without a query)",
+			dnsbl_stats.hits, dnsbl_stats.joined, dnsbl_stats.queries,
+			lookups ? (unsigned int)(100ULL * (lookups - dnsbl_stats.queries) / lookups) : 0);
+	command_success_nodata(si, "DNSBL cache: %u queries outstanding, %u results cached", dnsbl_stats.outstanding, dnsbl_stats.cached);
 }
 
 static void write_dnsbl_exempt_db(database_handle_t *db)
@@ -577,6 +942,8 @@ _modinit(module_t *m)
 
 	proxyscan = service_find("proxyscan");
 
+	zone_node_heap = mowgli_heap_create(sizeof(dnsbl_zone_node_t), 1024, BH_NOW);
+
 	hook_add_db_write(write_dnsbl_exempt_db);
 
 	db_register_type_handler("BLE", db_h_ble);
@@ -590,10 +957,15 @@ _modinit(module_t *m)
 	hook_add_event("user_add");
 	hook_add_user_add(check_dnsbls);
 
+	hook_add_event("user_delete");
+	hook_add_user_delete(dnsbl_user_delete);
+
 	hook_add_event("operserv_info");
 	hook_add_operserv_info(osinfo_hook);
 
 	add_dupstr_conf_item("dnsbl_action", &proxyscan->conf_table, 0, &action, NULL);
+	add_duration_conf_item("dnsbl_cache_ttl", &proxyscan->conf_table, 0, &dnsbl_cache_ttl, "m", 3600);
+	add_duration_conf_item("dnsbl_negative_ttl", &proxyscan->conf_table, 0, &dnsbl_negative_ttl, "m", 300);
 	add_conf_item("BLACKLISTS", &proxyscan->conf_table, dnsbl_config_handler);
 
 	command_add(&os_set_dnsblaction, *os_set_cmdtree);
@@ -606,6 +978,7 @@ _moddeinit(module_unload_intent_t intent)
 
 	hook_del_db_write(write_dnsbl_exempt_db);
 	hook_del_user_add(check_dnsbls);
+	hook_del_user_delete(dnsbl_user_delete);
 	hook_del_config_purge(dnsbl_config_purge);
 	hook_del_operserv_info(osinfo_hook);
 
@@ -614,12 +987,17 @@ _moddeinit(module_unload_intent_t intent)
 	proxyscan = service_find("proxyscan");
 
 	del_conf_item("dnsbl_action", &proxyscan->conf_table);
+	del_conf_item("dnsbl_cache_ttl", &proxyscan->conf_table);
+	del_conf_item("dnsbl_negative_ttl", &proxyscan->conf_table);
 	del_conf_item("BLACKLISTS", &proxyscan->conf_table);
 
 	command_delete(&os_set_dnsblaction, *os_set_cmdtree);
 
 	service_unbind_command(proxyscan, &ps_dnsblexempt);
 	service_unbind_command(proxyscan, &ps_dnsblscan);
+
+	destroy_blacklists();
+	mowgli_heap_destroy(zone_node_heap);
 }
 
 /* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
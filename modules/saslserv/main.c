@@ -33,7 +33,7 @@ static bool may_impersonate(myuser_t *source_mu, myuser_t *target_mu);
 static myuser_t *login_user(sasl_session_t *p);
 static void sasl_newuser(hook_user_nick_t *data);
 static void sasl_server_eob(server_t *s);
-static void delete_stale(void *vptr);
+static void session_timeout(void *vptr);
 static void sasl_mech_register(sasl_mechanism_t *mech);
 static void sasl_mech_unregister(sasl_mechanism_t *mech);
 static void mechlist_build_string(char *ptr, size_t buflen);
@@ -77,7 +77,6 @@ static void saslserv(sourceinfo_t *si, int parc, char *parv[])
 }
 
 service_t *saslsvs = NULL;
-mowgli_eventloop_timer_t *delete_stale_timer = NULL;
 
 static void sasl_mech_register(sasl_mechanism_t *mech)
 {
@@ -132,8 +131,6 @@ void _modinit(module_t *m)
 	hook_add_event("sasl_may_impersonate");
 	hook_add_event("user_can_login");
 
-	delete_stale_timer = mowgli_timer_add(base_eventloop, "sasl_delete_stale", delete_stale, NULL, 30);
-
 	saslsvs = service_add("saslserv", saslserv);
 	add_bool_conf_item("ANNOUNCE_AUTH_FAILURE", &saslsvs->conf_table, 0, &announce_auth_failure, true);
 	add_bool_conf_item("HIDE_SERVER_NAMES", &saslsvs->conf_table, 0, &hide_server_names, false);
@@ -148,8 +145,6 @@ void _moddeinit(module_unload_intent_t intent)
 	hook_del_user_add(sasl_newuser);
 	hook_del_server_eob(sasl_server_eob);
 
-	mowgli_timer_destroy(base_eventloop, delete_stale_timer);
-
 	del_conf_item("ANNOUNCE_AUTH_FAILURE", &saslsvs->conf_table);
 	del_conf_item("HIDE_SERVER_NAMES", &saslsvs->conf_table);
 
@@ -206,6 +201,9 @@ sasl_session_t *make_session(const char *uid, server_t *server)
 	n = mowgli_node_create();
 	mowgli_node_add(p, n, &sessions);
 
+	deadline_init(&p->deadline, "sasl_session_timeout", session_timeout, p);
+	deadline_set(&p->deadline, CURRTIME + SASL_SESSION_TIMEOUT);
+
 	return p;
 }
 
@@ -222,6 +220,8 @@ void destroy_session(sasl_session_t *p)
 			sasl_logcommand(p, mu, CMDLOG_LOGIN, "LOGIN (session timed out)");
 	}
 
+	deadline_cancel(&p->deadline);
+
 	MOWGLI_ITER_FOREACH_SAFE(n, tn, sessions.head)
 	{
 		if(n->data == p)
@@ -456,7 +456,7 @@ static void sasl_packet(sasl_session_t *p, char *buf, int len)
 	}
 
 	/* Some progress has been made, reset timeout. */
-	p->flags &= ~ASASL_MARKED_FOR_DELETION;
+	deadline_set(&p->deadline, CURRTIME + SASL_SESSION_TIMEOUT);
 
 	if(rc == ASASL_DONE)
 	{
@@ -729,27 +729,12 @@ static void sasl_newuser(hook_user_nick_t *data)
 	logcommand_user(saslsvs, u, CMDLOG_LOGIN, "LOGIN (%s)", mptr->name);
 }
 
-/* This function is run approximately once every 30 seconds.
- * It looks for flagged sessions, and deletes them, while
- * flagging all the others. This way stale sessions are deleted
- * after no more than 60 seconds.
+/* Runs when a session has made no progress for SASL_SESSION_TIMEOUT
+ * seconds; destroy_session() takes it off the session list.
  */
-static void delete_stale(void *vptr)
+static void session_timeout(void *vptr)
 {
-	sasl_session_t *p;
-	mowgli_node_t *n, *tn;
-
-	MOWGLI_ITER_FOREACH_SAFE(n, tn, sessions.head)
-	{
-		p = n->data;
-		if(p->flags & ASASL_MARKED_FOR_DELETION)
-		{
-			mowgli_node_delete(n, &sessions);
-			destroy_session(p);
-			mowgli_node_free(n);
-		} else
-			p->flags |= ASASL_MARKED_FOR_DELETION;
-	}
+	destroy_session(vptr);
 }
 
 static const char *sasl_get_source_name(sourceinfo_t *si)
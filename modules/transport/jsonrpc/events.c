@@ -0,0 +1,493 @@
+/*
+ * Copyright (c) 2026 Zohlai Development Group
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * JSONRPC event subscriptions: instead of polling, a client subscribes
+ * once and the connection is kept open to stream selected events to it
+ * as newline-delimited JSON.
+ *
+ */
+
+#include "atheme.h"
+#include "httpd.h"
+#include "jsonrpclib.h"
+#include "datastream.h"
+#include "authcookie.h"
+
+/* stop queueing events for a subscriber that is this far behind */
+#define EVENTS_SENDQ_MAX	65536
+
+#define EV_USER_IDENTIFY	0x01
+#define EV_USER_REGISTER	0x02
+#define EV_CHANNEL_REGISTER	0x04
+#define EV_CHANACS_CHANGE	0x08
+#define EV_MEMO			0x10
+#define EV_ALL			0x1F
+
+static const struct {
+	const char *name;
+	unsigned int flag;
+} event_names[] = {
+	{ "user_identify",	EV_USER_IDENTIFY },
+	{ "user_register",	EV_USER_REGISTER },
+	{ "channel_register",	EV_CHANNEL_REGISTER },
+	{ "chanacs_change",	EV_CHANACS_CHANGE },
+	{ "memo",		EV_MEMO },
+	{ NULL, 0 }
+};
+
+typedef struct {
+	connection_t *cptr;
+	myuser_t *mu;
+	char *ticket;			/* authcookie, checked before every event */
+	unsigned int events;
+	mowgli_patricia_t *targets;	/* accounts and channels, NULL for all */
+	bool chunked;
+	unsigned int dropped;		/* events lost to backpressure */
+	mowgli_node_t node;
+} jsonrpc_subscriber_t;
+
+static mowgli_list_t subscribers;
+static unsigned int subscribed_events;
+
+static void subscriber_update_events(void)
+{
+	mowgli_node_t *n;
+	jsonrpc_subscriber_t *sub;
+
+	subscribed_events = 0;
+	MOWGLI_ITER_FOREACH(n, subscribers.head)
+	{
+		sub = n->data;
+		subscribed_events |= sub->events;
+	}
+}
+
+static void subscriber_free(jsonrpc_subscriber_t *sub)
+{
+	mowgli_node_delete(&sub->node, &subscribers);
+	if (sub->targets != NULL)
+		mowgli_patricia_destroy(sub->targets, NULL, NULL);
+	free(sub->ticket);
+	free(sub);
+
+	subscriber_update_events();
+}
+
+/* called by httpd when a subscriber's connection goes away */
+static void subscriber_close(connection_t *cptr)
+{
+	struct httpddata *hd = cptr->userdata;
+	jsonrpc_subscriber_t *sub = hd->stream_data;
+
+	hd->stream_close = NULL;
+	hd->stream_data = NULL;
+	subscriber_free(sub);
+}
+
+/* ends the stream cleanly; httpd closes the connection once the rest
+ * of its sendq has been written */
+static void subscriber_end(jsonrpc_subscriber_t *sub)
+{
+	struct httpddata *hd = sub->cptr->userdata;
+
+	if (!CF_IS_DEAD(sub->cptr))
+	{
+		if (sub->chunked)
+			sendq_add(sub->cptr, "0\r\n\r\n", 5);
+		sendq_add_eof(sub->cptr);
+	}
+
+	hd->stream_close = NULL;
+	hd->stream_data = NULL;
+	subscriber_free(sub);
+}
+
+/* the cookie may have expired or been destroyed, and the privilege
+ * revoked, since the subscription was accepted */
+static bool subscriber_valid(jsonrpc_subscriber_t *sub)
+{
+	return authcookie_validate(sub->ticket, sub->mu) && has_priv_myuser(sub->mu, PRIV_USER_AUSPEX);
+}
+
+static void subscriber_write(jsonrpc_subscriber_t *sub, mowgli_string_t *line)
+{
+	char buf[32];
+
+	if (sub->chunked)
+	{
+		snprintf(buf, sizeof buf, "%lx\r\n", (unsigned long)line->pos);
+		sendq_add(sub->cptr, buf, strlen(buf));
+	}
+	sendq_add(sub->cptr, line->str, line->pos);
+	if (sub->chunked)
+		sendq_add(sub->cptr, "\r\n", 2);
+}
+
+static mowgli_string_t *event_serialize(mowgli_json_t *obj)
+{
+	mowgli_string_t *line = mowgli_string_create();
+
+	mowgli_json_serialize_to_string(obj, line, 0);
+	mowgli_string_append_char(line, '\n');
+	mowgli_json_decref(obj);
+
+	return line;
+}
+
+static mowgli_json_t *event_create(const char *name)
+{
+	mowgli_json_t *obj = mowgli_json_create_object();
+
+	mowgli_patricia_add(MOWGLI_JSON_OBJECT(obj), "event", mowgli_json_create_string(name));
+	mowgli_patricia_add(MOWGLI_JSON_OBJECT(obj), "ts", mowgli_json_create_integer(CURRTIME));
+
+	return obj;
+}
+
+static void event_add_string(mowgli_json_t *obj, const char *key, const char *value)
+{
+	if (value != NULL)
+		mowgli_patricia_add(MOWGLI_JSON_OBJECT(obj), key, mowgli_json_create_string(value));
+}
+
+static bool subscriber_wants(jsonrpc_subscriber_t *sub, unsigned int flag, const char *account, const char *channel)
+{
+	if (!(sub->events & flag))
+		return false;
+	if (sub->targets == NULL)
+		return true;
+	if (account != NULL && mowgli_patricia_retrieve(sub->targets, account) != NULL)
+		return true;
+	if (channel != NULL && mowgli_patricia_retrieve(sub->targets, channel) != NULL)
+		return true;
+	return false;
+}
+
+/*
+ * Queues an event for every subscriber whose filter matches. A subscriber
+ * that does not read fast enough loses events rather than making the
+ * sendq grow without bound; it is told how many once it catches up.
+ */
+static void event_publish(unsigned int flag, const char *account, const char *channel, mowgli_json_t *obj)
+{
+	mowgli_node_t *n, *tn;
+	jsonrpc_subscriber_t *sub;
+	mowgli_string_t *line, *overflow;
+	mowgli_json_t *oobj;
+
+	line = event_serialize(obj);
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, subscribers.head)
+	{
+		sub = n->data;
+
+		if (!subscriber_wants(sub, flag, account, channel))
+			continue;
+		if (CF_IS_DEAD(sub->cptr))
+			continue;
+		if (!subscriber_valid(sub))
+		{
+			subscriber_end(sub);
+			continue;
+		}
+
+		if (sendq_length(sub->cptr) + line->pos > EVENTS_SENDQ_MAX)
+		{
+			sub->dropped++;
+			continue;
+		}
+
+		if (sub->dropped != 0)
+		{
+			oobj = event_create("overflow");
+			mowgli_patricia_add(MOWGLI_JSON_OBJECT(oobj), "dropped", mowgli_json_create_integer(sub->dropped));
+			overflow = event_serialize(oobj);
+			subscriber_write(sub, overflow);
+			mowgli_string_destroy(overflow);
+			sub->dropped = 0;
+		}
+
+		subscriber_write(sub, line);
+	}
+
+	mowgli_string_destroy(line);
+}
+
+static void events_user_identify(user_t *u)
+{
+	mowgli_json_t *obj;
+
+	if (!(subscribed_events & EV_USER_IDENTIFY) || u->myuser == NULL)
+		return;
+
+	obj = event_create("user_identify");
+	event_add_string(obj, "account", entity(u->myuser)->name);
+	event_add_string(obj, "nick", u->nick);
+	event_publish(EV_USER_IDENTIFY, entity(u->myuser)->name, NULL, obj);
+}
+
+static void events_user_register(myuser_t *mu)
+{
+	mowgli_json_t *obj;
+
+	if (!(subscribed_events & EV_USER_REGISTER))
+		return;
+
+	obj = event_create("user_register");
+	event_add_string(obj, "account", entity(mu)->name);
+	event_publish(EV_USER_REGISTER, entity(mu)->name, NULL, obj);
+}
+
+static void events_channel_register(hook_channel_req_t *hdata)
+{
+	mowgli_json_t *obj;
+	const char *founder;
+
+	if (!(subscribed_events & EV_CHANNEL_REGISTER))
+		return;
+
+	founder = hdata->si != NULL && hdata->si->smu != NULL ? entity(hdata->si->smu)->name : NULL;
+
+	obj = event_create("channel_register");
+	event_add_string(obj, "channel", hdata->mc->name);
+	event_add_string(obj, "account", founder);
+	event_publish(EV_CHANNEL_REGISTER, founder, hdata->mc->name, obj);
+}
+
+static void events_channel_acl_change(hook_channel_acl_req_t *hdata)
+{
+	mowgli_json_t *obj;
+	chanacs_t *ca = hdata->ca;
+	const char *target;
+
+	if (!(subscribed_events & EV_CHANACS_CHANGE) || hdata->approved != 0)
+		return;
+
+	target = ca->entity != NULL ? entity(ca->entity)->name : ca->host;
+
+	obj = event_create("chanacs_change");
+	event_add_string(obj, "channel", ca->mychan->name);
+	event_add_string(obj, "target", target);
+	event_add_string(obj, "flags", bitmask_to_flags(ca->level));
+	if (hdata->si != NULL && hdata->si->smu != NULL)
+		event_add_string(obj, "setter", entity(hdata->si->smu)->name);
+	event_publish(EV_CHANACS_CHANGE, ca->entity != NULL ? target : NULL, ca->mychan->name, obj);
+}
+
+static void events_memo_sent(hook_memo_sent_t *hdata)
+{
+	mowgli_json_t *obj;
+
+	if (!(subscribed_events & EV_MEMO))
+		return;
+
+	/* the text stays private to the recipient */
+	obj = event_create("memo");
+	event_add_string(obj, "account", entity(hdata->mu)->name);
+	event_add_string(obj, "sender", hdata->memo->sender);
+	event_publish(EV_MEMO, entity(hdata->mu)->name, NULL, obj);
+}
+
+static void events_myuser_delete(myuser_t *mu)
+{
+	mowgli_node_t *n, *tn;
+	jsonrpc_subscriber_t *sub;
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, subscribers.head)
+	{
+		sub = n->data;
+
+		if (sub->mu == mu)
+			subscriber_end(sub);
+	}
+}
+
+static unsigned int parse_events(const char *list)
+{
+	char *copy, *p, *save;
+	unsigned int events = 0;
+	int i;
+
+	copy = sstrdup(list);
+	for (p = strtok_r(copy, ", ", &save); p != NULL; p = strtok_r(NULL, ", ", &save))
+	{
+		if (!strcmp(p, "*"))
+		{
+			events |= EV_ALL;
+			continue;
+		}
+
+		for (i = 0; event_names[i].name != NULL; i++)
+			if (!strcasecmp(p, event_names[i].name))
+				break;
+
+		if (event_names[i].name == NULL)
+		{
+			events = 0;
+			break;
+		}
+		events |= event_names[i].flag;
+	}
+	free(copy);
+
+	return events;
+}
+
+/*
+ * atheme.subscribe
+ *
+ * Parameters:
+ *       authcookie, account name, event list, targets (optional, any number)
+ *
+ * The event list is a comma separated list of user_identify,
+ * user_register, channel_register, chanacs_change and memo, or "*".
+ * If targets (account names or channels) are given, only events
+ * concerning one of them are sent.
+ *
+ * Outputs:
+ *       fault 1 - insufficient parameters
+ *       fault 2 - unknown event name, or used inside a batch
+ *       fault 3 - unknown user
+ *       fault 6 - insufficient privileges
+ *       fault 15 - invalid authcookie
+ *       default - success, followed by a stream of events
+ *
+ * Side Effects:
+ *       the connection is kept open and no further requests are read
+ *       from it; events are sent as newline-delimited JSON objects,
+ *       in a chunked response for HTTP/1.1 clients. The stream is
+ *       ended once the authcookie is no longer valid, the account is
+ *       dropped or it loses the user:auspex privilege.
+ */
+static bool jsonrpcmethod_subscribe(void *conn, mowgli_list_t *params, char *id)
+{
+	connection_t *cptr = conn;
+	struct httpddata *hd = cptr->userdata;
+	jsonrpc_subscriber_t *sub;
+	myuser_t *mu;
+	mowgli_node_t *n;
+	mowgli_json_t *obj;
+	mowgli_string_t *line;
+	unsigned int events;
+	char buf[300];
+	int i;
+
+	if (MOWGLI_LIST_LENGTH(params) < 3)
+	{
+		jsonrpc_failure_string(conn, fault_needmoreparams, "Insufficient parameters.", id);
+		return false;
+	}
+
+	if (jsonrpc_in_batch(conn) || hd->stream_close != NULL)
+	{
+		jsonrpc_failure_string(conn, fault_badparams, "atheme.subscribe must be the only request on a connection.", id);
+		return false;
+	}
+
+	if ((mu = myuser_find(mowgli_node_nth_data(params, 1))) == NULL)
+	{
+		jsonrpc_failure_string(conn, fault_nosuch_source, "Unknown user.", id);
+		return false;
+	}
+
+	if (!authcookie_validate(mowgli_node_nth_data(params, 0), mu))
+	{
+		jsonrpc_failure_string(conn, fault_badauthcookie, "Invalid authcookie for this account.", id);
+		return false;
+	}
+
+	if (!has_priv_myuser(mu, PRIV_USER_AUSPEX))
+	{
+		jsonrpc_failure_string(conn, fault_noprivs, "You do not have sufficient privileges.", id);
+		return false;
+	}
+
+	if ((events = parse_events(mowgli_node_nth_data(params, 2))) == 0)
+	{
+		jsonrpc_failure_string(conn, fault_badparams, "Unknown event name.", id);
+		return false;
+	}
+
+	sub = scalloc(sizeof(jsonrpc_subscriber_t), 1);
+	sub->cptr = cptr;
+	sub->mu = mu;
+	sub->ticket = sstrdup(mowgli_node_nth_data(params, 0));
+	sub->events = events;
+	sub->chunked = hd->http_1_1;
+
+	i = 0;
+	MOWGLI_ITER_FOREACH(n, params->head)
+	{
+		if (i++ < 3)
+			continue;
+		if (sub->targets == NULL)
+			sub->targets = mowgli_patricia_create(irccasecanon);
+		mowgli_patricia_add(sub->targets, n->data, sub);
+	}
+
+	mowgli_node_add(sub, &sub->node, &subscribers);
+	subscribed_events |= events;
+
+	/* no more requests on this connection; the reply never ends */
+	hd->connection_close = true;
+	hd->stream_close = subscriber_close;
+	hd->stream_data = sub;
+
+	snprintf(buf, sizeof buf, "HTTP/1.1 200 OK\r\n"
+			"Connection: close\r\n"
+			"Server: Atheme/%s\r\n"
+			"Content-Type: application/x-ndjson\r\n"
+			"%s\r\n",
+			PACKAGE_VERSION,
+			sub->chunked ? "Transfer-Encoding: chunked\r\n" : "");
+	sendq_add(cptr, buf, strlen(buf));
+
+	/* the first line is the usual response to the request */
+	obj = mowgli_json_create_object();
+	mowgli_patricia_add(MOWGLI_JSON_OBJECT(obj), "result", mowgli_json_create_string("Subscribed."));
+	mowgli_patricia_add(MOWGLI_JSON_OBJECT(obj), "id", mowgli_json_create_string(id));
+	mowgli_patricia_add(MOWGLI_JSON_OBJECT(obj), "error", mowgli_json_null);
+	line = event_serialize(obj);
+	subscriber_write(sub, line);
+	mowgli_string_destroy(line);
+
+	logcommand_external(nicksvs.me, "jsonrpc", cptr, NULL, mu, CMDLOG_ADMIN, "SUBSCRIBE: \2%s\2", (char *)mowgli_node_nth_data(params, 2));
+
+	return true;
+}
+
+void jsonrpc_events_init(void)
+{
+	jsonrpc_register_method("atheme.subscribe", jsonrpcmethod_subscribe);
+
+	hook_add_event("user_identify");
+	hook_add_user_identify(events_user_identify);
+	hook_add_event("user_register");
+	hook_add_user_register(events_user_register);
+	hook_add_event("channel_register");
+	hook_add_channel_register(events_channel_register);
+	hook_add_event("channel_acl_change");
+	hook_add_channel_acl_change(events_channel_acl_change);
+	hook_add_event("user_memo_sent");
+	hook_add_user_memo_sent(events_memo_sent);
+	hook_add_event("myuser_delete");
+	hook_add_myuser_delete(events_myuser_delete);
+}
+
+void jsonrpc_events_deinit(void)
+{
+	mowgli_node_t *n, *tn;
+
+	jsonrpc_unregister_method("atheme.subscribe");
+
+	hook_del_user_identify(events_user_identify);
+	hook_del_user_register(events_user_register);
+	hook_del_channel_register(events_channel_register);
+	hook_del_channel_acl_change(events_channel_acl_change);
+	hook_del_user_memo_sent(events_memo_sent);
+	hook_del_myuser_delete(events_myuser_delete);
+
+	MOWGLI_ITER_FOREACH_SAFE(n, tn, subscribers.head)
+		subscriber_end(n->data);
+}
@@ -9,19 +9,8 @@
 #include "atheme.h"
 #include "jsonrpclib.h"
 
-void jsonrpc_process(char *buffer, void *userdata)
+static void jsonrpc_process_object(mowgli_json_t *parsed, void *userdata)
 {
-	if (!buffer)
-	{
-		return;
-	}
-
-	mowgli_json_t *parsed = mowgli_json_parse_string(buffer);
-
-	if (parsed == NULL) {
-		return;
-	}
-
 	mowgli_json_tag_t tag = MOWGLI_JSON_TAG(parsed);
 
 	//JSON RPC works with JSON objects only, anything else can't be correct.
@@ -95,6 +84,46 @@ void jsonrpc_process(char *buffer, void *userdata)
 
 }
 
+void jsonrpc_process(char *buffer, void *userdata)
+{
+	mowgli_json_t *parsed;
+	mowgli_node_t *n;
+
+	if (!buffer)
+	{
+		return;
+	}
+
+	parsed = mowgli_json_parse_string(buffer);
+
+	if (parsed == NULL) {
+		return;
+	}
+
+	/* A batch: every call is run in order, and the transport streams
+	 * each response into a single array as soon as it is produced. */
+	if (MOWGLI_JSON_TAG(parsed) == MOWGLI_JSON_TAG_ARRAY)
+	{
+		if (MOWGLI_LIST_LENGTH(MOWGLI_JSON_ARRAY(parsed)) == 0)
+		{
+			jsonrpc_failure_string(userdata, JSONRPC_INVALID_REQUEST, "Invalid Request", NULL);
+			return;
+		}
+
+		jsonrpc_batch_begin(userdata);
+
+		MOWGLI_LIST_FOREACH(n, MOWGLI_JSON_ARRAY(parsed)->head)
+		{
+			jsonrpc_process_object(n->data, userdata);
+		}
+
+		jsonrpc_batch_end(userdata);
+		return;
+	}
+
+	jsonrpc_process_object(parsed, userdata);
+}
+
 void jsonrpc_success_string(void *conn, const char *result, const char *id)
 {
 	mowgli_json_t *obj = mowgli_json_create_object();
@@ -127,7 +156,8 @@ void jsonrpc_failure_string(void *conn, int code, const char *error, const char
 
 	patricia = MOWGLI_JSON_OBJECT(obj);
 
-	mowgli_json_t *idobj = mowgli_json_create_string(id);
+	/* id is NULL when the request was too broken to read one from */
+	mowgli_json_t *idobj = id != NULL ? mowgli_json_create_string(id) : mowgli_json_null;
 
 	mowgli_patricia_add(patricia, "result", mowgli_json_null);
 	mowgli_patricia_add(patricia, "id", idobj);
@@ -10,6 +10,9 @@
 
 #include "atheme.h"
 
+/* JSON-RPC 2.0 error for a request that is not a valid call at all */
+#define JSONRPC_INVALID_REQUEST -32600
+
 typedef bool (*jsonrpc_method_t)(void *conn, mowgli_list_t *params, char *id);
 
 typedef struct {
@@ -25,6 +28,11 @@ E void jsonrpc_process(char *buffer, void *userdata);
 E void jsonrpc_register_method(const char *method_name, bool (*method)(void *conn, mowgli_list_t *params, char *id));
 E void jsonrpc_unregister_method(const char *method_name);
 E void jsonrpc_send_data(void *conn, char *str);
+E void jsonrpc_batch_begin(void *conn);
+E void jsonrpc_batch_end(void *conn);
+E bool jsonrpc_in_batch(void *conn);
+E void jsonrpc_events_init(void);
+E void jsonrpc_events_deinit(void);
 E void jsonrpc_success_string(void *conn, const char *str, const char *id);
 E void jsonrpc_failure_string(void *conn, int code, const char *str, const char *id);
 
@@ -21,7 +21,7 @@ DECLARE_MODULE_V1
 
 static void handle_request(connection_t *cptr, void *requestbuf);
 
-mowgli_list_t *httpd_path_handlers;
+mowgli_patricia_t **httpd_path_handlers;
 static mowgli_patricia_t *json_methods;
 
 static bool jsonrpcmethod_login(void *conn, mowgli_list_t *params, char *id);
@@ -60,7 +60,7 @@ void _modinit(module_t *m)
 	MODULE_TRY_REQUEST_SYMBOL(m, httpd_path_handlers, "misc/httpd", "httpd_path_handlers");
 
 	handle_jsonrpc.path = "/jsonrpc";
-	mowgli_node_add(&handle_jsonrpc, mowgli_node_create(), httpd_path_handlers);
+	mowgli_patricia_add(*httpd_path_handlers, handle_jsonrpc.path, &handle_jsonrpc);
 
 	json_methods = mowgli_patricia_create(strcasecanon);
 
@@ -74,12 +74,12 @@ void _modinit(module_t *m)
 
 	jsonrpc_register_method("atheme.register", jsonrpcmethod_register);
 	jsonrpc_register_method("atheme.verify", jsonrpcmethod_verify);
+
+	jsonrpc_events_init();
 }
 
 void _moddeinit(module_unload_intent_t intent)
 {
-	mowgli_node_t *n;
-
 	jsonrpc_unregister_method("atheme.login");
 	jsonrpc_unregister_method("atheme.logout");
 	jsonrpc_unregister_method("atheme.command");
@@ -91,11 +91,9 @@ void _moddeinit(module_unload_intent_t intent)
 	jsonrpc_unregister_method("atheme.register");
 	jsonrpc_unregister_method("atheme.verify");
 
-	if ((n = mowgli_node_find(&handle_jsonrpc, httpd_path_handlers)) != NULL)
-	{
-		mowgli_node_delete(n, httpd_path_handlers);
-		mowgli_node_free(n);
-	}
+	jsonrpc_events_deinit();
+
+	mowgli_patricia_delete(*httpd_path_handlers, handle_jsonrpc.path);
 }
 
 void jsonrpc_register_method(const char *method_name, jsonrpc_method_t method) {
@@ -187,7 +185,7 @@ static bool jsonrpcmethod_login(void *conn, mowgli_list_t *params, char *id)
 		return false;
 	}
 
-	mu->lastlogin = CURRTIME;
+	myuser_set_lastlogin(mu, CURRTIME);
 
 	ac = authcookie_create(mu);
 
@@ -748,8 +746,8 @@ static bool jsonrpcmethod_register(void *conn, mowgli_list_t *params, char *id)
 	mu = myuser_add(mowgli_node_nth_data(params, 0), auth_module_loaded ? "*" : mowgli_node_nth_data(params, 1),
 			mowgli_node_nth_data(params, 2), config_options.defuflags | MU_NOBURSTLOGIN |
 			(auth_module_loaded ? MU_CRYPTPASS : 0));
-	mu->registered = CURRTIME;
-	mu->lastlogin = CURRTIME;
+	myuser_set_registered(mu, CURRTIME);
+	myuser_set_lastlogin(mu, CURRTIME);
 
 	if (!nicksvs.no_nick_ownership)
 	{
@@ -837,25 +835,119 @@ static bool jsonrpcmethod_verify(void *conn, mowgli_list_t *params, char *id)
 	return 0;
 }
 
-void jsonrpc_send_data(void *conn, char *str) {
-	struct httpddata *hd = ((connection_t *) conn)->userdata;
+/* The batch whose responses are being streamed. Requests are handled
+ * synchronously, so there is at most one. HTTP/1.1 clients get a chunked
+ * response with one chunk per array element; older clients get the
+ * array buffered up and sent with a Content-Length.
+ */
+static struct {
+	connection_t *conn;
+	unsigned int count;
+	mowgli_string_t *buf;
+} jsonrpc_batch;
 
-	char buf[300];
+static void jsonrpc_send_response(connection_t *cptr, char *str, size_t len) {
+	struct httpddata *hd = cptr->userdata;
 
-	size_t len = strlen(str);
+	char buf[300];
 
 	snprintf(buf, sizeof buf, "HTTP/1.1 200 OK\r\n"
 			"%s"
 			"Server: Atheme/%s\r\n"
 			"Content-Type: application/json\r\n"
 			"Content-Length: %lu\r\n\r\n",
-			hd->connection_close ? "Connection: close\r\n" : "",
+			httpd_connection_header(hd),
 			PACKAGE_VERSION, (unsigned long)len);
 
-	sendq_add((connection_t *)conn, buf, strlen(buf));
-	sendq_add((connection_t *)conn, str, len);
+	sendq_add(cptr, buf, strlen(buf));
+	sendq_add(cptr, str, len);
 
 	if (hd->connection_close) {
-		sendq_add_eof((connection_t *) conn);
+		sendq_add_eof(cptr);
 	}
 }
+
+static void jsonrpc_send_chunk(connection_t *cptr, char prefix, char *str, size_t len) {
+	char buf[32];
+
+	snprintf(buf, sizeof buf, "%lx\r\n%c", (unsigned long)len + 1, prefix);
+	sendq_add(cptr, buf, strlen(buf));
+	sendq_add(cptr, str, len);
+	sendq_add(cptr, "\r\n", 2);
+}
+
+void jsonrpc_batch_begin(void *conn) {
+	jsonrpc_batch.conn = conn;
+	jsonrpc_batch.count = 0;
+	jsonrpc_batch.buf = NULL;
+}
+
+bool jsonrpc_in_batch(void *conn) {
+	return jsonrpc_batch.conn == conn;
+}
+
+void jsonrpc_batch_end(void *conn) {
+	connection_t *cptr = conn;
+	struct httpddata *hd = cptr->userdata;
+
+	return_if_fail(jsonrpc_batch.conn == conn);
+	jsonrpc_batch.conn = NULL;
+
+	/* a batch of notifications only gets no body at all */
+	if (jsonrpc_batch.count == 0)
+	{
+		jsonrpc_send_response(cptr, "", 0);
+		return;
+	}
+
+	if (jsonrpc_batch.buf == NULL)
+	{
+		jsonrpc_send_chunk(cptr, ']', "", 0);
+		sendq_add(cptr, "0\r\n\r\n", 5);
+
+		if (hd->connection_close) {
+			sendq_add_eof(cptr);
+		}
+		return;
+	}
+
+	mowgli_string_append_char(jsonrpc_batch.buf, ']');
+	jsonrpc_send_response(cptr, jsonrpc_batch.buf->str, jsonrpc_batch.buf->pos);
+	mowgli_string_destroy(jsonrpc_batch.buf);
+	jsonrpc_batch.buf = NULL;
+}
+
+void jsonrpc_send_data(void *conn, char *str) {
+	connection_t *cptr = conn;
+	struct httpddata *hd = cptr->userdata;
+
+	size_t len = strlen(str);
+
+	if (cptr != jsonrpc_batch.conn) {
+		jsonrpc_send_response(cptr, str, len);
+		return;
+	}
+
+	if (!hd->http_1_1) {
+		if (jsonrpc_batch.buf == NULL)
+			jsonrpc_batch.buf = mowgli_string_create();
+		mowgli_string_append_char(jsonrpc_batch.buf, jsonrpc_batch.count++ ? ',' : '[');
+		mowgli_string_append(jsonrpc_batch.buf, str, len);
+		return;
+	}
+
+	if (jsonrpc_batch.count == 0) {
+		char buf[300];
+
+		snprintf(buf, sizeof buf, "HTTP/1.1 200 OK\r\n"
+				"%s"
+				"Server: Atheme/%s\r\n"
+				"Content-Type: application/json\r\n"
+				"Transfer-Encoding: chunked\r\n\r\n",
+				hd->connection_close ? "Connection: close\r\n" : "",
+				PACKAGE_VERSION);
+		sendq_add(cptr, buf, strlen(buf));
+	}
+
+	jsonrpc_send_chunk(cptr, jsonrpc_batch.count++ ? ',' : '[', str, len);
+}
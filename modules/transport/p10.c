@@ -88,7 +88,9 @@ static void p10_parse(char *line)
                                 	si->s = server_find(origin);
                                 	si->su = user_find_named(origin);
 				}
-				else
+				else if ((si->su = p10_user_find(origin)) != NULL)
+					si->s = NULL;
+				else if ((si->s = p10_server_find(origin)) == NULL)
 				{
                                 	si->s = server_find(origin);
                                 	si->su = user_find(origin);
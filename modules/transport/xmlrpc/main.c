@@ -30,7 +30,8 @@ struct
 
 connection_t *current_cptr; /* XXX: Hack: src/xmlrpc.c requires us to do this */
 
-mowgli_list_t *httpd_path_handlers;
+mowgli_patricia_t **httpd_path_handlers;
+static char *xmlrpc_registered_path; /* key of handle_xmlrpc in httpd_path_handlers */
 
 static void xmlrpc_command_fail(sourceinfo_t *si, cmd_faultcode_t code, const char *message);
 static void xmlrpc_command_success_nodata(sourceinfo_t *si, const char *message);
@@ -66,7 +67,7 @@ static char *dump_buffer(char *buf, int length)
 			"Server: Atheme/%s\r\n"
 			"Content-Type: text/xml\r\n"
 			"Content-Length: %d\r\n\r\n",
-			hd->connection_close ? "Connection: close\r\n" : "",
+			httpd_connection_header(hd),
 			PACKAGE_VERSION, length);
 	sendq_add(current_cptr, buf1, strlen(buf1));
 	sendq_add(current_cptr, buf, length);
@@ -93,10 +94,17 @@ static void xmlrpc_config_ready(void *vptr)
 
 	if (handle_xmlrpc.handler != NULL)
 	{
-		if (mowgli_node_find(&handle_xmlrpc, httpd_path_handlers))
-			return;
+		if (xmlrpc_registered_path != NULL)
+		{
+			if (!strcmp(xmlrpc_registered_path, handle_xmlrpc.path))
+				return;
+
+			mowgli_patricia_delete(*httpd_path_handlers, xmlrpc_registered_path);
+			free(xmlrpc_registered_path);
+		}
 
-		mowgli_node_add(&handle_xmlrpc, mowgli_node_create(), httpd_path_handlers);
+		mowgli_patricia_add(*httpd_path_handlers, handle_xmlrpc.path, &handle_xmlrpc);
+		xmlrpc_registered_path = sstrdup(handle_xmlrpc.path);
 	}
 	else
 		slog(LG_ERROR, "xmlrpc_config_ready(): xmlrpc {} block missing or invalid");
@@ -128,8 +136,6 @@ void _modinit(module_t *m)
 
 void _moddeinit(module_unload_intent_t intent)
 {
-	mowgli_node_t *n;
-
 	xmlrpc_unregister_method("atheme.login");
 	xmlrpc_unregister_method("atheme.logout");
 	xmlrpc_unregister_method("atheme.command");
@@ -139,10 +145,11 @@ void _moddeinit(module_unload_intent_t intent)
 	xmlrpc_unregister_method("atheme.register");
 	xmlrpc_unregister_method("atheme.verify");
 
-	if ((n = mowgli_node_find(&handle_xmlrpc, httpd_path_handlers)) != NULL)
+	if (xmlrpc_registered_path != NULL)
 	{
-		mowgli_node_delete(n, httpd_path_handlers);
-		mowgli_node_free(n);
+		mowgli_patricia_delete(*httpd_path_handlers, xmlrpc_registered_path);
+		free(xmlrpc_registered_path);
+		xmlrpc_registered_path = NULL;
 	}
 
 	del_conf_item("PATH", &conf_xmlrpc_table);
@@ -279,7 +286,7 @@ static int xmlrpcmethod_login(void *conn, int parc, char *parv[])
 		return 0;
 	}
 
-	mu->lastlogin = CURRTIME;
+	myuser_set_lastlogin(mu, CURRTIME);
 
 	ac = authcookie_create(mu);
 
@@ -678,8 +685,8 @@ static int xmlrpcmethod_register(void *conn, int parc, char *parv[])
 	mu = myuser_add(parv[0], auth_module_loaded ? "*" : parv[1], parv[2],
 			config_options.defuflags | MU_NOBURSTLOGIN |
 			(auth_module_loaded ? MU_CRYPTPASS : 0));
-	mu->registered = CURRTIME;
-	mu->lastlogin = CURRTIME;
+	myuser_set_registered(mu, CURRTIME);
+	myuser_set_lastlogin(mu, CURRTIME);
 	if (!nicksvs.no_nick_ownership)
 	{
 		mn = mynick_add(mu, entity(mu)->name);
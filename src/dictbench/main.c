@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2026 Zohlai Development Group
+ * Rights to this code are as documented in doc/LICENSE.
+ *
+ * Compares patricia trees and hash dictionaries on the kind of keys
+ * the user, channel and account lists hold.
+ */
+
+#include "atheme.h"
+#include "serno.h"
+
+#define LOOKUPS		1000000
+
+typedef struct {
+	const char *name;
+	void (*canon)(char *);
+	hashdict_hash_fn_t hash;
+	hashdict_compare_fn_t compare;
+	unsigned int count;
+	char **keys;	/* as inserted */
+	char **probes;	/* the same keys as clients would send them */
+	char **misses;
+} keyset_t;
+
+static const char *words[] = {
+	"alpha", "Bravo", "charlie", "Delta", "echo", "foxtrot", "Golf",
+	"hotel", "india", "Juliet", "kilo", "lima", "Mike", "november",
+	"oscar", "papa", "Quebec", "romeo", "Sierra", "tango", "uniform",
+	"victor", "Whiskey", "xray", "yankee", "Zulu", "linux", "gentoo",
+	"debian", "python", "rust", "help", "dev", "ops", "chat", "irc",
+};
+
+static unsigned long long bench_nstime(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (unsigned long long)tv.tv_sec * 1000000000ULL + tv.tv_usec * 1000ULL;
+}
+
+static const char *random_word(void)
+{
+	return words[arc4random_uniform(ARRAY_SIZE(words))];
+}
+
+static void make_nick(char *buf, size_t len)
+{
+	switch (arc4random_uniform(4))
+	{
+	case 0:
+		snprintf(buf, len, "Guest%u", arc4random_uniform(100000));
+		break;
+	case 1:
+		snprintf(buf, len, "%s%s", random_word(), random_word());
+		break;
+	case 2:
+		snprintf(buf, len, "%s%u", random_word(), arc4random_uniform(10000));
+		break;
+	default:
+		snprintf(buf, len, "[%s]%s|%u", random_word(), random_word(), arc4random_uniform(100));
+		break;
+	}
+}
+
+static void make_channel(char *buf, size_t len)
+{
+	if (arc4random_uniform(2))
+		snprintf(buf, len, "#%s-%s%u", random_word(), random_word(), arc4random_uniform(1000));
+	else
+		snprintf(buf, len, "#%s%u", random_word(), arc4random_uniform(100000));
+}
+
+static void make_uid(char *buf, size_t len)
+{
+	static const char alnum[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+	unsigned int i;
+
+	snprintf(buf, len, "%u%c%cAAA", arc4random_uniform(10), alnum[arc4random_uniform(36)], alnum[arc4random_uniform(36)]);
+	for (i = 6; i < 9 && i < len - 1; i++)
+		buf[i] = alnum[arc4random_uniform(36)];
+	buf[i] = '\0';
+}
+
+/* clients rarely use the case a nick or channel was registered with */
+static char *flip_case(const char *s, bool flip)
+{
+	char *p, *r = sstrdup(s);
+
+	if (flip)
+		for (p = r; *p != '\0'; p++)
+			if (arc4random_uniform(3) == 0)
+				*p = isupper((unsigned char)*p) ? tolower((unsigned char)*p) : toupper((unsigned char)*p);
+
+	return r;
+}
+
+static void keyset_fill(keyset_t *ks, void (*make)(char *, size_t), bool flip)
+{
+	mowgli_patricia_t *seen = mowgli_patricia_create(ks->canon);
+	char buf[BUFSIZE];
+	unsigned int i;
+
+	ks->keys = smalloc(ks->count * sizeof(char *));
+	ks->probes = smalloc(ks->count * sizeof(char *));
+	ks->misses = smalloc(ks->count * sizeof(char *));
+
+	for (i = 0; i < ks->count; )
+	{
+		make(buf, sizeof buf);
+		if (mowgli_patricia_retrieve(seen, buf) != NULL)
+			continue;
+
+		ks->keys[i] = sstrdup(buf);
+		ks->probes[i] = flip_case(buf, flip);
+		mowgli_patricia_add(seen, ks->keys[i], ks->keys[i]);
+		i++;
+	}
+
+	for (i = 0; i < ks->count; )
+	{
+		make(buf, sizeof buf);
+		if (mowgli_patricia_retrieve(seen, buf) != NULL)
+			continue;
+
+		ks->misses[i++] = sstrdup(buf);
+	}
+
+	mowgli_patricia_destroy(seen, NULL, NULL);
+}
+
+static void report(const char *what, const char *how, unsigned long long ns, unsigned int ops)
+{
+	printf("  %-8s %-10s %8.1f ns/op\n", what, how, (double)ns / ops);
+}
+
+static void bench_patricia(keyset_t *ks)
+{
+	mowgli_patricia_t *tree = mowgli_patricia_create(ks->canon);
+	unsigned long long start;
+	unsigned int i, found = 0;
+
+	start = bench_nstime();
+	for (i = 0; i < ks->count; i++)
+		mowgli_patricia_add(tree, ks->keys[i], ks->keys[i]);
+	report("patricia", "add", bench_nstime() - start, ks->count);
+
+	start = bench_nstime();
+	for (i = 0; i < LOOKUPS; i++)
+		found += mowgli_patricia_retrieve(tree, ks->probes[i % ks->count]) != NULL;
+	report("patricia", "hit", bench_nstime() - start, LOOKUPS);
+
+	start = bench_nstime();
+	for (i = 0; i < LOOKUPS; i++)
+		found += mowgli_patricia_retrieve(tree, ks->misses[i % ks->count]) != NULL;
+	report("patricia", "miss", bench_nstime() - start, LOOKUPS);
+
+	start = bench_nstime();
+	for (i = 0; i < ks->count; i++)
+		mowgli_patricia_delete(tree, ks->keys[i]);
+	report("patricia", "delete", bench_nstime() - start, ks->count);
+
+	if (found != LOOKUPS)
+		printf("  patricia found %u of %u\n", found, LOOKUPS);
+
+	mowgli_patricia_destroy(tree, NULL, NULL);
+}
+
+static void bench_hashdict(keyset_t *ks)
+{
+	hashdict_t *hd = hashdict_create(ks->hash, ks->compare);
+	unsigned long long start;
+	unsigned int i, found = 0;
+
+	start = bench_nstime();
+	for (i = 0; i < ks->count; i++)
+		hashdict_add(hd, ks->keys[i], ks->keys[i]);
+	report("hashdict", "add", bench_nstime() - start, ks->count);
+
+	start = bench_nstime();
+	for (i = 0; i < LOOKUPS; i++)
+		found += hashdict_retrieve(hd, ks->probes[i % ks->count]) != NULL;
+	report("hashdict", "hit", bench_nstime() - start, LOOKUPS);
+
+	start = bench_nstime();
+	for (i = 0; i < LOOKUPS; i++)
+		found += hashdict_retrieve(hd, ks->misses[i % ks->count]) != NULL;
+	report("hashdict", "miss", bench_nstime() - start, LOOKUPS);
+
+	start = bench_nstime();
+	for (i = 0; i < ks->count; i++)
+		hashdict_delete(hd, ks->keys[i]);
+	report("hashdict", "delete", bench_nstime() - start, ks->count);
+
+	if (found != LOOKUPS)
+		printf("  hashdict found %u of %u\n", found, LOOKUPS);
+
+	hashdict_destroy(hd);
+}
+
+int main(int argc, char *argv[])
+{
+	keyset_t sets[] = {
+		{ "nicknames", irccasecanon, hashdict_hash_irccase, irccasecmp, 50000 },
+		{ "channels", irccasecanon, hashdict_hash_irccase, irccasecmp, 20000 },
+		{ "UIDs", noopcanon, hashdict_hash_exact, strcmp, 50000 },
+	};
+	void (*makers[])(char *, size_t) = { make_nick, make_channel, make_uid };
+	unsigned int i;
+
+	printf("dictbench for atheme %s (%s)\n", PACKAGE_VERSION, SERNO);
+
+	for (i = 0; i < ARRAY_SIZE(sets); i++)
+	{
+		keyset_fill(&sets[i], makers[i], sets[i].canon != noopcanon);
+
+		printf("\n%u %s, %u lookups\n", sets[i].count, sets[i].name, LOOKUPS);
+		bench_patricia(&sets[i]);
+		bench_hashdict(&sets[i]);
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/* vim:cinoptions=>s,e0,n0,f0,{0,}0,^0,=s,ps,t0,c3,+s,(2s,us,)20,*30,gs,hs
+ * vim:ts=8
+ * vim:sw=8
+ * vim:noexpandtab
+ */